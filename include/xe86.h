@@ -0,0 +1,121 @@
+#ifndef XE86_H
+#define XE86_H
+
+/*
+LIBXE86
+	the emulator as a library, behind a C interface that stays the same from one release to the
+	next: XE86_API_VERSION only goes up when something is added. each machine is the pc the xe86
+	executable runs, with its own memory and clock, and any number of them can live in one
+	process. a machine is only ever used from one thread at a time, different machines from
+	different threads at once are fine.
+
+	functions returning int give 0 on success and -1 on failure, with the reason on stderr.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32) && defined(XE86_SHARED)
+	#ifdef XE86_BUILDING_LIBRARY
+		#define XE86_API __declspec(dllexport)
+	#else
+		#define XE86_API __declspec(dllimport)
+	#endif
+#elif defined(__GNUC__)
+	#define XE86_API __attribute__((visibility("default")))
+#else
+	#define XE86_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define XE86_API_VERSION 2
+
+typedef struct xe86_machine xe86_machine;
+typedef struct xe86_snapshot xe86_snapshot;
+
+typedef struct xe86_registers {
+	uint16_t ax, bx, cx, dx;
+	uint16_t sp, bp, si, di;
+	uint16_t cs, ds, ss, es;
+	uint16_t ip, flags;
+} xe86_registers;
+
+// why xe86_run returned
+typedef enum xe86_stop {
+	XE86_STOP_BUDGET = 0,		// the cycle budget ran out
+	XE86_STOP_STALLED = 1,		// halted or idle with nothing scheduled, only the host can wake it
+	XE86_STOP_INVALID_OPCODE = 2,	// the cpu hit an opcode it doesn't implement and halted there
+	XE86_STOP_EXITED = 3,		// the program loaded with xe86_load_program exited
+	XE86_STOP_TEXT = 4,		// the text xe86_wait_for_text waits for is on the screen, since version 2
+} xe86_stop;
+
+// a port the host answers. either may be null: reads then return 0xff and writes are dropped
+typedef uint8_t (*xe86_port_read)(void* user, uint16_t port);
+typedef void (*xe86_port_write)(void* user, uint16_t port, uint8_t value);
+
+// what a program loaded with xe86_load_program writes to a handle, 1 for stdout and 2 for stderr
+typedef void (*xe86_output)(void* user, uint16_t handle, const uint8_t* data, size_t length);
+
+// the XE86_API_VERSION the library was built with
+XE86_API uint32_t xe86_api_version(void);
+
+// a machine with the bios rom from a file or a buffer, 8 KB either way, reset and ready to run.
+// null on failure, including a null path or buffer
+XE86_API xe86_machine* xe86_create(const char* rom_path);
+XE86_API xe86_machine* xe86_create_from_memory(const uint8_t* rom, size_t size);
+XE86_API void xe86_destroy(xe86_machine* machine);
+
+// back to the reset vector, without a loaded program
+XE86_API void xe86_reset(xe86_machine* machine);
+
+// resets the machine and starts a .COM or .EXE straight away instead of the bios, with DOS
+// services answered on the host side. arguments may be null. -1 if it couldn't be loaded, in
+// which case the machine is left reset with no program
+XE86_API int xe86_load_program(xe86_machine* machine, const char* path, const char* arguments);
+XE86_API int xe86_get_exit_code(const xe86_machine* machine);
+XE86_API void xe86_set_output(xe86_machine* machine, xe86_output output, void* user);
+
+// runs for at least cycles of guest time at 4.77 MHz, or until something stops it first
+XE86_API xe86_stop xe86_run(xe86_machine* machine, uint64_t cycles);
+
+// what the text mode screen says as utf-8, a line per row without the spaces at its end, and
+// nothing in a graphics mode. writes at most size bytes including the terminating null and
+// returns the length of all of it, as snprintf does. since version 2
+XE86_API size_t xe86_get_text(xe86_machine* machine, char* buffer, size_t size);
+
+// xe86_run until pattern appears anywhere in the text, XE86_STOP_TEXT straight away if it's
+// already there. the screen is only looked at again after the guest writes to it. since version 2
+XE86_API xe86_stop xe86_wait_for_text(xe86_machine* machine, const char* pattern, uint64_t cycles);
+
+XE86_API uint64_t xe86_get_cycles(const xe86_machine* machine);
+XE86_API uint64_t xe86_get_instructions(const xe86_machine* machine);
+
+XE86_API void xe86_get_registers(xe86_machine* machine, xe86_registers* registers);
+XE86_API void xe86_set_registers(xe86_machine* machine, const xe86_registers* registers);
+
+// reads have no side effects and give 0xff where nothing is mapped. writes go through the bus as
+// the cpu's would, so the rom can't be written. addresses wrap at 1 MB
+XE86_API void xe86_read_memory(xe86_machine* machine, uint32_t address, void* buffer, size_t length);
+XE86_API void xe86_write_memory(xe86_machine* machine, uint32_t address, const void* data, size_t length);
+
+// fails if a device or an earlier call already has the port
+XE86_API int xe86_attach_port(xe86_machine* machine, uint16_t port, xe86_port_read read, xe86_port_write write, void* user);
+
+// the cpu, devices, clock and all of ram. a snapshot only loads into a machine of the same
+// library build, and the host-side DOS's own bookkeeping isn't part of it
+XE86_API xe86_snapshot* xe86_save_snapshot(xe86_machine* machine);
+XE86_API const uint8_t* xe86_snapshot_data(const xe86_snapshot* snapshot);
+XE86_API size_t xe86_snapshot_size(const xe86_snapshot* snapshot);
+XE86_API void xe86_free_snapshot(xe86_snapshot* snapshot);
+
+// from xe86_snapshot_data, or the same bytes stored elsewhere. nothing changes if they don't fit
+XE86_API int xe86_load_snapshot(xe86_machine* machine, const uint8_t* data, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
\ No newline at end of file
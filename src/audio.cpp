@@ -0,0 +1,153 @@
+#include "audio.hpp"
+#include <print>
+#include <string>
+#include <algorithm>
+#include <limits>
+
+using namespace xe86;
+
+AudioSink::AudioSink(std::string_view output, unsigned rate)
+	: m_Batches(QueueDepth + 2), m_Output(std::string(output), std::ios::binary | std::ios::trunc),
+	  m_Rate(rate ? rate : 44100) {
+	if (!m_Output) {
+		std::println(stderr, "audio: failed to create '{}'", output);
+	}
+
+	m_Step = static_cast<double>(CyclesPerSecond) / AudioBatch::SampleCycles / m_Rate;
+
+	// sizes are unknown until the end, the header is rewritten then
+	WriteHeader(0);
+
+	for (size_t i = 0; i < m_Batches.size(); i++) {
+		m_Free.push_back(static_cast<uint8_t>(i));
+	}
+
+	m_Thread = std::thread([this]() { SinkThread(); });
+}
+
+AudioSink::~AudioSink() {
+	uint8_t evicted;
+	m_Queue.PushEvictOldest(Quit, evicted);
+	m_Thread.join();
+}
+
+AudioBatch& AudioSink::BeginBatch() {
+	if (m_Filling == Quit) {
+		// the pool is sized so there is always one either free or on its way back
+		uint8_t index;
+		while (m_Returned.TryPop(index)) {
+			m_Free.push_back(index);
+		}
+
+		m_Filling = m_Free.back();
+		m_Free.pop_back();
+	}
+
+	return m_Batches[m_Filling];
+}
+
+void AudioSink::PublishBatch() {
+	uint8_t evicted;
+	if (m_Queue.PushEvictOldest(m_Filling, evicted)) {
+		m_Free.push_back(evicted);
+		m_Dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	m_Filling = Quit;
+}
+
+void AudioSink::SinkThread() {
+	while (true) {
+		uint64_t head = m_Queue.GetHead();
+
+		uint8_t index;
+		if (!m_Queue.TryPop(index)) {
+			m_Queue.WaitForPush(head);
+			continue;
+		}
+
+		if (index == Quit) {
+			break;
+		}
+
+		Resample(m_Batches[index]);
+		m_Returned.TryPush(index);
+
+		if (m_Pending.size() >= 4096) {
+			m_Output.write(reinterpret_cast<const char*>(m_Pending.data()), m_Pending.size() * sizeof(int16_t));
+			m_Pending.clear();
+		}
+	}
+
+	m_Output.write(reinterpret_cast<const char*>(m_Pending.data()), m_Pending.size() * sizeof(int16_t));
+	m_Output.seekp(0);
+	WriteHeader(static_cast<uint32_t>(std::min<uint64_t>(GetWrittenSamples(), std::numeric_limits<uint32_t>::max() / 2 - 36)));
+	m_Output.flush();
+}
+
+void AudioSink::Resample(const AudioBatch& batch) {
+	if (batch.count == 0) {
+		return;
+	}
+
+	if (!m_Started) {
+		m_Started = true;
+		m_Previous = batch.samples[0] / 32768.0f;
+	} else if (batch.time > m_Time && batch.time - m_Time <= MaxGap) {
+		// batches were dropped in between, keep the output in step with the guest
+		for (Cycles gap = (batch.time - m_Time) / AudioBatch::SampleCycles; gap > 0; gap--) {
+			Feed(0.0f);
+		}
+	} else if (batch.time != m_Time) {
+		// guest time jumped, carry on from here
+		m_Position = 0;
+		m_Previous = batch.samples[0] / 32768.0f;
+	}
+
+	for (uint32_t i = 0; i < batch.count; i++) {
+		Feed(batch.samples[i] / 32768.0f);
+	}
+
+	m_Time = batch.time + batch.count * AudioBatch::SampleCycles;
+}
+
+void AudioSink::Feed(float sample) {
+	// linear interpolation between the previous guest sample (position 0) and this one (position 1)
+	while (m_Position <= 1.0) {
+		Emit(m_Previous + (sample - m_Previous) * static_cast<float>(m_Position));
+		m_Position += m_Step;
+	}
+
+	m_Position -= 1.0;
+	m_Previous = sample;
+}
+
+void AudioSink::Emit(float sample) {
+	// one-pole high-pass, removes the dc offset without touching anything audible
+	float out = sample - m_DcIn + 0.995f * m_DcOut;
+	m_DcIn = sample;
+	m_DcOut = out;
+
+	m_Pending.push_back(static_cast<int16_t>(std::clamp(out, -1.0f, 1.0f) * 32767.0f));
+	m_Written.fetch_add(1, std::memory_order_relaxed);
+}
+
+void AudioSink::WriteHeader(uint32_t samples) {
+	auto write32 = [this](uint32_t value) { m_Output.write(reinterpret_cast<const char*>(&value), 4); };
+	auto write16 = [this](uint16_t value) { m_Output.write(reinterpret_cast<const char*>(&value), 2); };
+
+	uint32_t data = samples * sizeof(int16_t);
+
+	m_Output.write("RIFF", 4);
+	write32(36 + data);
+	m_Output.write("WAVEfmt ", 8);
+	write32(16);
+	write16(1);				// pcm
+	write16(1);				// mono
+	write32(m_Rate);
+	write32(m_Rate * sizeof(int16_t));
+	write16(sizeof(int16_t));
+	write16(16);
+	m_Output.write("data", 4);
+	write32(data);
+}
\ No newline at end of file
@@ -0,0 +1,92 @@
+#ifndef AUDIO_HPP
+#define AUDIO_HPP
+
+#include "scheduler.hpp"
+#include "spsc_queue.hpp"
+
+#include <array>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <fstream>
+#include <thread>
+#include <atomic>
+
+namespace xe86 {
+	// a run of consecutive samples, the first one taken at guest cycle `time`
+	struct AudioBatch {
+		// one sample every 108 cycles, about 44192 Hz
+		static constexpr Cycles SampleCycles = 108;
+		static constexpr size_t Capacity = 1024;
+
+		Cycles time;
+		uint32_t count;
+		std::array<int16_t, Capacity> samples;
+	};
+
+	/*
+	AUDIO SINK
+		takes batches of samples from the emulation thread and writes them out on its own thread, so
+		the emulation never waits for audio. batches travel through a lock-free queue the same way
+		video frames do, and if the sink falls behind the oldest batch is dropped.
+
+		batches are stamped with guest time. the sink resamples from the guest rate to its output
+		rate, fills gaps left by dropped batches with silence so the output stays in step with the
+		guest, and strips the dc offset a speaker that is only ever on or off leaves behind.
+
+		output is a 16-bit mono wav file, whose sizes are filled in when the sink is destroyed.
+	*/
+	class AudioSink {
+	public:
+		AudioSink(std::string_view output, unsigned rate = 44100);
+		~AudioSink();
+
+		// emulation thread. BeginBatch hands out a buffer to fill, PublishBatch queues it
+		AudioBatch& BeginBatch();
+		void PublishBatch();
+
+		uint64_t GetDroppedBatches() const { return m_Dropped.load(std::memory_order_relaxed); }
+		uint64_t GetWrittenSamples() const { return m_Written.load(std::memory_order_relaxed); }
+
+	private:
+		static constexpr size_t QueueDepth = 16;
+		static constexpr uint8_t Quit = 0xff;
+
+		// a gap longer than this is a jump in guest time (a rewind or a loaded state), not lost batches
+		static constexpr Cycles MaxGap = CyclesPerSecond;
+
+		void SinkThread();
+		void Resample(const AudioBatch& batch);
+		void Feed(float sample);
+		void Emit(float sample);
+		void WriteHeader(uint32_t samples);
+
+	private:
+		std::vector<AudioBatch> m_Batches;
+		SpscQueue<uint8_t, QueueDepth> m_Queue;
+		SpscQueue<uint8_t, QueueDepth * 2> m_Returned;
+
+		// emulation thread only
+		std::vector<uint8_t> m_Free;
+		uint8_t m_Filling = Quit;
+
+		// sink thread only
+		std::ofstream m_Output;
+		unsigned m_Rate;
+		double m_Step;			// guest samples per output sample
+		double m_Position = 0;	// of the next output sample, in guest samples past m_Previous
+		float m_Previous = 0;	// last guest sample fed
+		Cycles m_Time = 0;		// guest time just past the last sample fed
+		bool m_Started = false;
+		float m_DcIn = 0;
+		float m_DcOut = 0;
+		std::vector<int16_t> m_Pending;
+
+		std::atomic<uint64_t> m_Dropped = 0;
+		std::atomic<uint64_t> m_Written = 0;
+
+		std::thread m_Thread;
+	};
+}
+
+#endif
\ No newline at end of file
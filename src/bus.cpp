@@ -1,9 +1,176 @@
 #include "bus.hpp"
+#include "hash.hpp"
 #include <print>
 #include <fstream>
+#include <mutex>
+#include <new>
+#include <vector>
+#include <algorithm>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
 
 using namespace xe86;
 
+namespace {
+	/*
+	pages come straight from the os in slabs, and go back to it once more than a few are free.
+	the deduplicator frees pages in the middle of everything all the time, which a general
+	purpose heap would keep for itself rather than return, so the memory it saves would never
+	show up. freed pages go on a list and are handed out again first, and when the list grows
+	past twice what's worth keeping the rest are decommitted, a run of neighbouring pages per
+	call. a slab's address space is never released, only its memory.
+	*/
+	class PageAllocator {
+	public:
+		static constexpr size_t SlabPages = 64;
+		static constexpr size_t SlabSize = SlabPages * MemoryArea::PageSize;
+
+		// freed pages kept committed for reuse, 1 MB
+		static constexpr size_t KeptPages = 256;
+
+		static PageAllocator& Get() {
+			static PageAllocator allocator;
+			return allocator;
+		}
+
+		MemoryArea::Page* Allocate() {
+			std::lock_guard lock(m_Mutex);
+
+			if (m_Committed.empty()) {
+				if (m_Decommitted.empty() && !Reserve()) {
+					throw std::bad_alloc();
+				}
+
+				uint8_t* page = m_Decommitted.back();
+				if (!Commit(page)) {
+					std::println(stderr, "bus: failed to commit a page of memory");
+					throw std::bad_alloc();
+				}
+
+				m_Decommitted.pop_back();
+				m_Committed.push_back(page);
+			}
+
+			uint8_t* page = m_Committed.back();
+			m_Committed.pop_back();
+			return reinterpret_cast<MemoryArea::Page*>(page);
+		}
+
+		void Free(MemoryArea::Page* page) {
+			std::lock_guard lock(m_Mutex);
+
+			m_Committed.push_back(reinterpret_cast<uint8_t*>(page));
+			if (m_Committed.size() > KeptPages * 2) {
+				Trim();
+			}
+		}
+
+	private:
+		// a new slab, all of it decommitted, lowest page handed out first
+		bool Reserve() {
+			uint8_t* slab = ReserveSlab();
+			if (!slab) {
+				std::println(stderr, "bus: failed to reserve {} KB of memory", SlabSize / 1024);
+				return false;
+			}
+
+			for (size_t i = SlabPages; i-- > 0;) {
+				m_Decommitted.push_back(slab + i * MemoryArea::PageSize);
+			}
+
+			return true;
+		}
+
+		// down to KeptPages, the ones at the lowest addresses go
+		void Trim() {
+			std::sort(m_Committed.begin(), m_Committed.end());
+			size_t excess = m_Committed.size() - KeptPages;
+
+			for (size_t i = 0; i < excess;) {
+				size_t run = 1;
+				while (i + run < excess && m_Committed[i + run] == m_Committed[i] + run * MemoryArea::PageSize) {
+					run++;
+				}
+
+				Decommit(m_Committed[i], run * MemoryArea::PageSize);
+				i += run;
+			}
+
+			m_Decommitted.insert(m_Decommitted.end(), m_Committed.begin(), m_Committed.begin() + excess);
+			m_Committed.erase(m_Committed.begin(), m_Committed.begin() + excess);
+		}
+
+#ifdef _WIN32
+		static uint8_t* ReserveSlab() { return static_cast<uint8_t*>(VirtualAlloc(nullptr, SlabSize, MEM_RESERVE, PAGE_NOACCESS)); }
+		static bool Commit(uint8_t* page) { return VirtualAlloc(page, MemoryArea::PageSize, MEM_COMMIT, PAGE_READWRITE) != nullptr; }
+		static void Decommit(uint8_t* start, size_t length) { VirtualFree(start, length, MEM_DECOMMIT); }
+#else
+		static uint8_t* ReserveSlab() {
+			void* slab = mmap(nullptr, SlabSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			return slab == MAP_FAILED ? nullptr : static_cast<uint8_t*>(slab);
+		}
+
+		static bool Commit(uint8_t*) { return true; }
+		static void Decommit(uint8_t* start, size_t length) { madvise(start, length, MADV_DONTNEED); }
+#endif
+
+	private:
+		std::mutex m_Mutex;
+
+		// free pages, ready to use and given back to the os
+		std::vector<uint8_t*> m_Committed;
+		std::vector<uint8_t*> m_Decommitted;
+	};
+}
+
+MemoryArea::MemoryArea(Address20 start, Address20 end, bool readable, bool writable)
+	: m_Start(start), m_End(end), m_Length(end - start + 1), m_Readable(readable), m_Writable(writable),
+	  m_PageVersions((m_Length + PageSize - 1) >> PageShift, 0), m_Merges(std::make_shared<MergeQueue>()) {
+	// nothing is allocated until it is written to
+	m_Pages.assign(m_PageVersions.size(), GetZeroPage());
+	m_Read.assign(m_PageVersions.size(), GetZeroPage()->data());
+	m_Write.assign(m_PageVersions.size(), nullptr);
+}
+
+const std::shared_ptr<const MemoryArea::Page>& MemoryArea::GetZeroPage() {
+	static const std::shared_ptr<const Page> zero = std::make_shared<const Page>();
+	return zero;
+}
+
+uint8_t* MemoryArea::Unshare(size_t page) {
+	std::shared_ptr<Page> data(PageAllocator::Get().Allocate(), [](Page* page) { PageAllocator::Get().Free(page); });
+	*data = *m_Pages[page];
+	m_CopyCount++;
+
+	m_Read[page] = data->data();
+	m_Write[page] = data->data();
+	m_Pages[page] = std::move(data);
+	return m_Write[page];
+}
+
+void MemoryArea::CopyOut(Address20 offset, std::span<uint8_t> out) {
+	size_t done = 0;
+	while (done < out.size()) {
+		std::span<const uint8_t> run = GetSpan(offset + done, out.size() - done);
+		std::memcpy(out.data() + done, run.data(), run.size());
+		done += run.size();
+	}
+}
+
+void MemoryArea::CopyIn(Address20 offset, std::span<const uint8_t> data) {
+	size_t done = 0;
+	while (done < data.size()) {
+		std::span<uint8_t> run = GetWritableSpan(offset + done, data.size() - done);
+		std::memcpy(run.data(), data.data() + done, run.size());
+		done += run.size();
+	}
+}
+
 void MemoryArea::LoadFromFile(std::string_view filename) {
 	std::ifstream file(filename.data(), std::ios::binary | std::ios::ate);
 	if (!file) {
@@ -17,14 +184,47 @@ void MemoryArea::LoadFromFile(std::string_view filename) {
 		exit(1);
 	}
 
+	std::vector<uint8_t> data(size);
 	file.seekg(0, std::ios::beg);
-	file.read(reinterpret_cast<char*>(m_Area.data()), size);
+	file.read(reinterpret_cast<char*>(data.data()), size);
+	CopyIn(0, data);
+}
+
+uint64_t MemoryArea::ComputeHash() {
+	uint64_t hash = Fnv1a64(nullptr, 0);
+	for (size_t page = 0; page < m_Pages.size(); page++) {
+		std::span<const uint8_t> data = GetPage(page);
+		hash = Fnv1a64(data.data(), data.size(), hash);
+	}
+
+	return hash;
 }
 
-std::shared_ptr<MemoryArea> Bus::FindArea(Address20 address) {
-	for (auto area : m_Memory) {
+MemoryStats MemoryArea::GetStats() const {
+	MemoryStats stats;
+	stats.pages = m_Pages.size();
+	stats.merges = m_MergeCount;
+	stats.copies = m_CopyCount;
+
+	for (size_t page = 0; page < m_Pages.size(); page++) {
+		if (m_Write[page]) {
+			stats.private_pages++;
+			stats.resident_bytes += PageSize;
+		} else {
+			// the deduplicator's own reference while it looks at a page counts as a user too, so this
+			// is on the low side for a moment after each Share
+			stats.shared_pages++;
+			stats.resident_bytes += PageSize / std::max<long>(1, m_Pages[page].use_count());
+		}
+	}
+
+	return stats;
+}
+
+MemoryArea* Bus::FindArea(Address20 address) {
+	for (auto& area : m_Memory) {
 		if (address >= area->GetStartAddress() && address <= area->GetEndAddress()) {
-			return area;
+			return area.get();
 		}
 	}
 
@@ -34,23 +234,197 @@ std::shared_ptr<MemoryArea> Bus::FindArea(Address20 address) {
 uint8_t Bus::ReadByte(Address20 address) {
 	auto area = FindArea(address);
 	if (!area) {
-		std::println(stderr, "attempted to read from unknown memory area @ {:05x}", static_cast<uint32_t>(address));
+		m_Diagnostics->Report(Fault::UnmappedRead, address);
 		return 0;
 	}
 
-	return area->ReadByte(address - area->GetStartAddress());
+	uint8_t value = area->ReadByte(address - area->GetStartAddress());
+	if (m_Debugger.IsWatched(address, Debugger::Read)) [[unlikely]] {
+		m_Debugger.CheckWatch(address, value, Debugger::Read);
+	}
+
+	return value;
 }
 
 void Bus::WriteByte(Address20 address, uint8_t byte) {
+	if (m_Debugger.IsWatched(address, Debugger::Write)) [[unlikely]] {
+		m_Debugger.CheckWatch(address, byte, Debugger::Write);
+	}
+
 	auto area = FindArea(address);
 	if (!area) {
-		std::println(stderr, "attempted to write {:02x} to unknown memory area @ {:05x}",
-			static_cast<uint8_t>(byte),
-			static_cast<uint32_t>(address)
-		);
-
+		m_Diagnostics->Report(Fault::UnmappedWrite, address, byte);
 		return;
 	}
 
+	m_Activity++;
 	area->WriteByte(address - area->GetStartAddress(), byte);
+}
+
+uint8_t Bus::PeekByte(Address20 address) {
+	auto area = FindArea(address);
+	if (!area || !area->IsReadable()) {
+		return 0xff;
+	}
+
+	return area->PeekByte(address - area->GetStartAddress());
+}
+
+size_t Bus::ClipToWatches(uint32_t start, size_t length, Debugger::Access access) {
+	if (!m_Debugger.HasWatches()) {
+		return length;
+	}
+
+	// a direct run must not cover a watched page, those have to go byte by byte
+	for (uint32_t page = start & ~0xfffu; page < start + length; page += 0x1000) {
+		if (m_Debugger.IsWatched(page, access)) {
+			return page > start ? page - start : 0;
+		}
+	}
+
+	return length;
+}
+
+std::span<const uint8_t> Bus::GetReadableSpan(Address20 address, size_t length) {
+	auto area = FindArea(address);
+	if (!area || !area->IsReadable()) {
+		return {};
+	}
+
+	uint32_t start = address;
+	size_t available = std::min<size_t>(area->GetEndAddress() - start + 1, 0x100000 - start);
+	length = ClipToWatches(start, std::min(length, available), Debugger::Read);
+	return area->GetSpan(start - area->GetStartAddress(), length);
+}
+
+std::span<uint8_t> Bus::GetWritableSpan(Address20 address, size_t length) {
+	auto area = FindArea(address);
+	if (!area || !area->IsWritable()) {
+		return {};
+	}
+
+	uint32_t start = address;
+	size_t available = std::min<size_t>(area->GetEndAddress() - start + 1, 0x100000 - start);
+	length = ClipToWatches(start, std::min(length, available), Debugger::Write);
+	if (length == 0) {
+		return {};
+	}
+
+	m_Activity++;
+	return area->GetWritableSpan(start - area->GetStartAddress(), length);
+}
+
+void Bus::ReadBlock(Address20 address, std::span<uint8_t> out) {
+	uint32_t current = address;
+	size_t done = 0;
+
+	while (done < out.size()) {
+		std::span<const uint8_t> run = GetReadableSpan(current, out.size() - done);
+		if (run.empty()) {
+			// a gap: one byte at a time so it is reported like any other bad access
+			out[done++] = ReadByte(current);
+			current = (current + 1) & 0xfffff;
+			continue;
+		}
+
+		std::memcpy(out.data() + done, run.data(), run.size());
+		done += run.size();
+		current = (current + run.size()) & 0xfffff;
+	}
+}
+
+void Bus::WriteBlock(Address20 address, std::span<const uint8_t> data) {
+	uint32_t current = address;
+	size_t done = 0;
+
+	while (done < data.size()) {
+		std::span<uint8_t> run = GetWritableSpan(current, data.size() - done);
+		if (run.empty()) {
+			WriteByte(current, data[done++]);
+			current = (current + 1) & 0xfffff;
+			continue;
+		}
+
+		std::memcpy(run.data(), data.data() + done, run.size());
+		done += run.size();
+		current = (current + run.size()) & 0xfffff;
+	}
+}
+
+uint8_t Bus::JournalPortRead(PortAddress16 port) {
+	uint64_t instruction = m_Scheduler.GetInstructionCount();
+
+	if (m_Replaying) {
+		// the journal stands in for a device that changes over time
+		m_Activity++;
+		return m_Journal->ReplayPortRead(instruction, port);
+	}
+
+	uint8_t value = ReadByteFromDevice(port);
+	m_Journal->RecordPortRead(instruction, port, value);
+	return value;
+}
+
+uint8_t Bus::AcknowledgeInterrupt() {
+	if (m_Replaying) {
+		return m_Journal->ReplayInterrupt();
+	}
+
+	uint8_t vector = m_InterruptAcknowledge ? m_InterruptAcknowledge() : 0;
+	if (m_Journal) {
+		m_Journal->RecordInterrupt(m_Scheduler.GetInstructionCount(), vector);
+	}
+
+	return vector;
+}
+
+void Bus::InjectHostInput(uint8_t channel, std::span<const uint8_t> data) {
+	if (m_Replaying) {
+		return;
+	}
+
+	if (m_Journal) {
+		m_Journal->RecordHostInput(m_Scheduler.GetInstructionCount(), channel, data);
+	}
+
+	for (auto& input : m_HostInputs) {
+		if (input.channel == channel) {
+			input.sink(data);
+		}
+	}
+}
+
+uint64_t Bus::GetRomHash() {
+	uint64_t hash = Fnv1a64(nullptr, 0);
+	for (auto& area : m_Memory) {
+		if (!area->IsWritable()) {
+			// where it's mapped too, the same bytes somewhere else are a different machine
+			uint32_t start = area->GetStartAddress();
+			uint64_t area_hash = area->ComputeHash();
+			hash = Fnv1a64(reinterpret_cast<const uint8_t*>(&start), sizeof(start), hash);
+			hash = Fnv1a64(reinterpret_cast<const uint8_t*>(&area_hash), sizeof(area_hash), hash);
+		}
+	}
+
+	return hash;
+}
+
+void Bus::SaveState(StateWriter& state) const {
+	m_Scheduler.SaveState(state);
+	state.Write(m_INTR);
+	state.Write(m_Activity);
+
+	if (m_Journal) {
+		m_Journal->SaveState(state);
+	}
+}
+
+void Bus::LoadState(StateReader& state) {
+	m_Scheduler.LoadState(state);
+	state.Read(m_INTR);
+	state.Read(m_Activity);
+
+	if (m_Journal) {
+		m_Journal->LoadState(state);
+	}
 }
\ No newline at end of file
@@ -2,74 +2,207 @@
 #define BUS_HPP
 
 #include "types.hpp"
+#include "scheduler.hpp"
+#include "journal.hpp"
+#include "diagnostics.hpp"
+#include "debugger.hpp"
 #include <vector>
 #include <string>
 #include <print>
 #include <memory>
 #include <functional>
+#include <span>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <mutex>
 
 namespace xe86 {
+	class PageDeduplicator;
+
+	// how much of an area, or of a whole bus, is backed by memory of its own
+	struct MemoryStats {
+		size_t pages = 0;
+		size_t private_pages = 0;	// writable, owned by this instance alone
+		size_t shared_pages = 0;	// immutable, possibly mapped by other instances too
+
+		// private pages, plus each shared page divided among everything mapping it
+		size_t resident_bytes = 0;
+
+		uint64_t merges = 0;		// pages replaced by an identical one from elsewhere
+		uint64_t copies = 0;		// shared pages copied back to private on a write
+
+		MemoryStats& operator+=(const MemoryStats& other) {
+			pages += other.pages;
+			private_pages += other.private_pages;
+			shared_pages += other.shared_pages;
+			resident_bytes += other.resident_bytes;
+			merges += other.merges;
+			copies += other.copies;
+			return *this;
+		}
+	};
+
 	class MemoryArea {
 	public:
-		MemoryArea(Address20 start, Address20 end, bool readable, bool writable)
-			: m_Start(start), m_End(end), m_Length(end - start + 1), m_Area(m_Length, 0), 
-			  m_Readable(readable), m_Writable(writable) {}
+		static constexpr size_t PageShift = 12;
+		static constexpr size_t PageSize = 1 << PageShift;
+		static constexpr size_t PageMask = PageSize - 1;
+
+		using Page = std::array<uint8_t, PageSize>;
+
+		MemoryArea(Address20 start, Address20 end, bool readable, bool writable);
+
+		// bumped on every write to a page. anything that wants to know what changed since it last
+		// looked keeps its own copy and compares, so any number of observers can share these.
+		const std::vector<uint32_t>& GetPageVersions() { return m_PageVersions; }
+		size_t GetPageCount() { return m_PageVersions.size(); }
+
+		std::span<const uint8_t> GetPage(size_t page) {
+			return std::span<const uint8_t>(m_Read[page], std::min(PageSize, m_Length - (page << PageShift)));
+		}
 
-		std::vector<uint8_t>& GetArea() { return m_Area; }
+		// direct access to [offset, offset + length), cut short at the end of the page. the caller
+		// has checked the range is inside the area. a writable span counts as written to
+		std::span<const uint8_t> GetSpan(Address20 offset, size_t length) {
+			return std::span<const uint8_t>(m_Read[offset >> PageShift] + (offset & PageMask), std::min(length, PageSize - (offset & PageMask)));
+		}
+
+		std::span<uint8_t> GetWritableSpan(Address20 offset, size_t length) {
+			length = std::min(length, PageSize - (offset & PageMask));
+			MarkWritten(offset, length);
+			return std::span<uint8_t>(GetWritablePage(offset >> PageShift) + (offset & PageMask), length);
+		}
+
+		// host side copies in and out, ignoring protection. for whoever builds or restores the machine
+		void CopyOut(Address20 offset, std::span<uint8_t> out);
+		void CopyIn(Address20 offset, std::span<const uint8_t> data);
+
+		// for anything that wrote to the area without going through WriteByte
+		void MarkWritten(Address20 offset, size_t length) {
+			if (length == 0) {
+				return;
+			}
+
+			for (size_t page = offset >> PageShift; page <= (offset + length - 1) >> PageShift; page++) {
+				m_PageVersions[page]++;
+			}
+		}
+
+		void WritePage(size_t page, std::span<const uint8_t> data) {
+			std::memcpy(GetWritablePage(page), data.data(), std::min(GetPage(page).size(), data.size()));
+			m_PageVersions[page]++;
+		}
 
 		Address20 GetStartAddress() { return m_Start; }
 		Address20 GetEndAddress() { return m_End; }
 		size_t GetLength() { return m_Length; }
 
+		void SetDiagnostics(Diagnostics* diagnostics) { m_Diagnostics = diagnostics; }
+
 		bool IsReadable() { return m_Readable; }
 		bool IsWritable() { return m_Writable; }
 
 		void LoadFromFile(std::string_view filename);
+		uint64_t ComputeHash();
+
+		// every page starts out as this one, shared by every area in the process
+		static const std::shared_ptr<const Page>& GetZeroPage();
+
+		// on the thread that runs this area: takes up any merges the deduplicator has found since
+		// last time, and hands it every page that hasn't been written to since the last call
+		void Share(PageDeduplicator& deduplicator);
+
+		MemoryStats GetStats() const;
 
 		uint8_t ReadByte(Address20 offset) {
-			if (!m_Readable) {
-				std::println(stderr, "attempted to read from unreadable memory area [{:05x} -> {:05x}] @ off. {:05x}",
-					static_cast<uint32_t>(GetStartAddress()),
-					static_cast<uint32_t>(GetEndAddress()),
-					static_cast<uint32_t>(offset)
-				);
+			if (!m_Readable) [[unlikely]] {
+				if (m_Diagnostics) {
+					m_Diagnostics->Report(Fault::ProtectedRead, m_Start + offset);
+				}
 
 				return 0;
 			}
 
-			return m_Area[offset];
+			return m_Read[offset >> PageShift][offset & PageMask];
+		}
+
+		// no side effects, for debuggers and the like
+		uint8_t PeekByte(Address20 offset) {
+			return m_Read[offset >> PageShift][offset & PageMask];
 		}
 
 		void WriteByte(Address20 offset, uint8_t byte) {
-			if (!m_Writable) {
-				std::println(stderr, "attempted to write {:02x} to unwritable memory area [{:05x} -> {:05x}] @ off. {:05x}",
-					static_cast<uint8_t>(byte),
-					static_cast<uint32_t>(GetStartAddress()),
-					static_cast<uint32_t>(GetEndAddress()),
-					static_cast<uint32_t>(offset)
-				);
+			if (!m_Writable) [[unlikely]] {
+				if (m_Diagnostics) {
+					m_Diagnostics->Report(Fault::ProtectedWrite, m_Start + offset, byte);
+				}
 
 				return;
 			}
-			
-			m_Area[offset] = byte;
+
+			GetWritablePage(offset >> PageShift)[offset & PageMask] = byte;
+			m_PageVersions[offset >> PageShift]++;
+		}
+
+		// merges found by the deduplicator's thread, waiting for this area's own thread to pick them up
+		struct Merge {
+			size_t page;
+			std::shared_ptr<const Page> from;
+			std::shared_ptr<const Page> to;
+		};
+
+		struct MergeQueue {
+			std::mutex mutex;
+			std::vector<Merge> merges;
+		};
+
+	private:
+		uint8_t* GetWritablePage(size_t page) {
+			uint8_t* data = m_Write[page];
+			if (!data) [[unlikely]] {
+				data = Unshare(page);
+			}
+
+			return data;
 		}
 
+		uint8_t* Unshare(size_t page);
+
 	private:
 		Address20 m_Start;
 		Address20 m_End;
 		size_t m_Length;
 
-		std::vector<uint8_t> m_Area;
+		// every page is its own allocation, so one can be swapped for a shared copy. m_Read is where
+		// each page is, m_Write the same for private pages and null for shared ones, which are
+		// copied on the first write
+		std::vector<std::shared_ptr<const Page>> m_Pages;
+		std::vector<const uint8_t*> m_Read;
+		std::vector<uint8_t*> m_Write;
 
 		bool m_Readable;
 		bool m_Writable;
+
+		std::vector<uint32_t> m_PageVersions;
+
+		// page versions as of the last Share, a page that still matches has been left alone since
+		std::vector<uint32_t> m_SharedVersions;
+		std::shared_ptr<MergeQueue> m_Merges;
+		uint64_t m_MergeCount = 0;
+		uint64_t m_CopyCount = 0;
+
+		Diagnostics* m_Diagnostics = nullptr;
 	};
 
 	struct PortRegistration {
 		std::function<void(uint8_t)> write;
 		std::function<uint8_t()> read;
 		PortAddress16 port;
+
+		// set for ports whose value changes with guest time alone (counters, refresh toggles),
+		// so a loop polling them is never mistaken for an idle loop
+		bool time_dependent = false;
 	};
 
 	/*
@@ -84,15 +217,25 @@ namespace xe86 {
 	*/
 	class Bus {
 	public:
-		Bus(std::string_view bios_rom) {
+		// the rom area is left blank, for whoever builds the machine to fill in directly
+		Bus() : m_Diagnostics(std::make_unique<Diagnostics>()) {
+			m_Debugger.SetMemoryReader([this](uint32_t address) { return PeekByte(address); });
+
 			AttachMemoryArea(std::make_shared<MemoryArea>(0xfe000, 0xfffff, true, false));	// GLaBIOS ROM
 			AttachMemoryArea(std::make_shared<MemoryArea>(0x00000, 0x9ffff, true, true));	// RAM
+		}
+
+		Bus(std::string_view bios_rom) : Bus() {
 			m_Memory[0]->LoadFromFile(bios_rom);
 		}
 
 		uint8_t ReadByte(Address20 address);
 		void WriteByte(Address20 address, uint8_t byte);
 
+		// no side effects at all: no faults, watchpoints or activity. 0xff where nothing readable is mapped
+		uint8_t PeekByte(Address20 address);
+
+		// the cpu's hottest path, so two plain byte accesses rather than a block
 		uint16_t ReadWord(Address20 address) {
 			return (ReadByte(address + 1) << 8) | ReadByte(address);
 		}
@@ -102,25 +245,58 @@ namespace xe86 {
 			WriteByte(address + 1, (word >> 8) & 0xff);
 		}
 
+		// copy a block in or out with one area lookup and one memcpy per contiguous run. addresses
+		// wrap at 1 MB like byte accesses do, and gaps behave exactly as ReadByte/WriteByte would.
+		void ReadBlock(Address20 address, std::span<uint8_t> out);
+		void WriteBlock(Address20 address, std::span<const uint8_t> data);
+
+		// the longest directly addressable run starting at address, at most length bytes: it stops at
+		// the end of the page and at the top of the address space. empty if nothing readable or
+		// writable is mapped there. a writable span counts as written to as soon as it is handed out.
+		std::span<const uint8_t> GetReadableSpan(Address20 address, size_t length);
+		std::span<uint8_t> GetWritableSpan(Address20 address, size_t length);
+
 		uint8_t ReadByteFromPort(PortAddress16 port) {
+			if (m_Journal) [[unlikely]] {
+				return JournalPortRead(port);
+			}
+
+			return ReadByteFromDevice(port);
+		}
+
+		uint8_t ReadByteFromDevice(PortAddress16 port) {
 			for (auto& p : m_Ports) {
 				if (p.port == port) {
+					if (p.time_dependent) {
+						m_Activity++;
+					}
+
 					return p.read();
 				}
 			}
 
-			std::println(stderr, "emulator: reading from unknown port {:02x}", port);
+			if (m_UnclaimedPorts.read) [[unlikely]] {
+				m_Activity++;
+				return m_UnclaimedPorts.read(port);
+			}
+
+			m_Diagnostics->Report(Fault::UnknownPortRead, port);
 			return 0;
 		}
 
 		void WriteByteToPort(PortAddress16 port, uint8_t byte) {
+			m_Activity++;
 			for (auto& p : m_Ports) {
 				if (p.port == port) {
 					return p.write(byte);
 				}
 			}
 
-			std::println(stderr, "emulator: writing to unknown port {:02x} -> {:02x}", byte, port);
+			if (m_UnclaimedPorts.write) [[unlikely]] {
+				return m_UnclaimedPorts.write(port, byte);
+			}
+
+			m_Diagnostics->Report(Fault::UnknownPortWrite, port, byte);
 		}
 
 		uint16_t ReadWordFromPort(PortAddress16 port) {
@@ -132,25 +308,126 @@ namespace xe86 {
 			WriteByteToPort(port + 1, (word >> 8) & 0xff);
 		}
 
-		void AttachPort(PortRegistration&& port) {
+		// false if the port is already taken
+		bool AttachPort(PortRegistration&& port) {
 			for (auto& p : m_Ports) {
 				if (p.port == port.port) {
 					std::println(stderr, "emulator: trying to reregister port {:02x}", port.port);
-					return;
+					return false;
 				}
 			}
 
 			m_Ports.push_back(std::move(port));
+			return true;
+		}
+
+		// takes every port no device claims, instead of reporting them as faults. for a test or
+		// fuzzer that wants to answer port reads itself
+		void SetUnclaimedPortHandler(std::function<uint8_t(PortAddress16)> read, std::function<void(PortAddress16, uint8_t)> write) {
+			m_UnclaimedPorts = { std::move(read), std::move(write) };
 		}
 
 		void AttachMemoryArea(std::shared_ptr<MemoryArea> area) {
+			area->SetDiagnostics(m_Diagnostics.get());
 			m_Memory.push_back(area);
 		}
 
+		const std::vector<std::shared_ptr<MemoryArea>>& GetMemoryAreas() { return m_Memory; }
+
+		MemoryStats GetMemoryStats() const {
+			MemoryStats stats;
+			for (auto& area : m_Memory) {
+				stats += area->GetStats();
+			}
+
+			return stats;
+		}
+
+		Scheduler& GetScheduler() { return m_Scheduler; }
+
+		// unmapped, protected and unknown port accesses are counted and logged here
+		Diagnostics& GetDiagnostics() { return *m_Diagnostics; }
+
+		Debugger& GetDebugger() { return m_Debugger; }
+
+		// INTR line. an interrupt controller asserts it and hands out the vector when the cpu acknowledges
+		void SetInterruptController(std::function<uint8_t()> acknowledge) {
+			m_InterruptAcknowledge = std::move(acknowledge);
+		}
+
+		void SetINTR(bool asserted) { m_INTR = asserted; }
+
+		// ahead looks at the line as it will be that many instructions on, which only differs when replaying
+		bool IsINTRAsserted(uint64_t ahead = 0) const {
+			if (m_Replaying) [[unlikely]] {
+				return m_Journal->IsInterruptDue(m_Scheduler.GetInstructionCount() + ahead);
+			}
+
+			return m_INTR;
+		}
+
+		uint8_t AcknowledgeInterrupt();
+
+		// record mode logs every port read, interrupt and host input into the journal. replay mode
+		// serves them back from it instead of asking devices. the devices stay attached, they
+		// still take the guest's writes and drive video and audio, but what they answer is unused
+		void SetJournal(std::shared_ptr<InputJournal> journal) {
+			m_Journal = journal;
+			m_Replaying = journal && journal->IsReplaying();
+		}
+
+		std::shared_ptr<InputJournal> GetJournal() { return m_Journal; }
+
+		// input from the host side (keystrokes, serial bytes, ...) goes through here so it can be journaled
+		void AttachHostInput(uint8_t channel, std::function<void(std::span<const uint8_t>)> sink) {
+			m_HostInputs.push_back({ channel, std::move(sink) });
+		}
+
+		void InjectHostInput(uint8_t channel, std::span<const uint8_t> data);
+
+		// hash of every read-only area and where it's mapped, i.e. the roms this machine was built with
+		uint64_t GetRomHash();
+
+		// clock, interrupt line and journal position. memory is snapshotted separately, page by page
+		void SaveState(StateWriter& state) const;
+		void LoadState(StateReader& state);
+
+		// bumped on anything the cpu does that a device or memory could observe. if it hasn't
+		// moved across a loop iteration, that iteration had no side effects.
+		uint64_t GetActivity() const { return m_Activity; }
+
 	private:
 		std::vector<std::shared_ptr<MemoryArea>> m_Memory;
 		std::vector<PortRegistration> m_Ports;
-		std::shared_ptr<MemoryArea> FindArea(Address20 address);
+
+		struct UnclaimedPorts {
+			std::function<uint8_t(PortAddress16)> read;
+			std::function<void(PortAddress16, uint8_t)> write;
+		};
+
+		UnclaimedPorts m_UnclaimedPorts;
+		MemoryArea* FindArea(Address20 address);
+		size_t ClipToWatches(uint32_t start, size_t length, Debugger::Access access);
+
+		Scheduler m_Scheduler;
+		std::unique_ptr<Diagnostics> m_Diagnostics;
+		Debugger m_Debugger;
+
+		std::function<uint8_t()> m_InterruptAcknowledge;
+		bool m_INTR = false;
+
+		std::shared_ptr<InputJournal> m_Journal;
+		bool m_Replaying = false;
+		uint8_t JournalPortRead(PortAddress16 port);
+
+		struct HostInput {
+			uint8_t channel;
+			std::function<void(std::span<const uint8_t>)> sink;
+		};
+
+		std::vector<HostInput> m_HostInputs;
+
+		uint64_t m_Activity = 0;
 	};
 }
 
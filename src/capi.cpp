@@ -0,0 +1,321 @@
+#include "xe86.h"
+#include "pc.hpp"
+#include "dos.hpp"
+#include "textscreen.hpp"
+#include <print>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include <new>
+#include <algorithm>
+
+struct xe86_machine {
+	std::shared_ptr<xe86::Bus> bus;
+	xe86::PC pc;
+
+	std::unique_ptr<xe86::DOS> dos;
+	xe86::TextScreen screen;
+	xe86_output output = nullptr;
+	void* output_user = nullptr;
+
+	bool invalid_opcode = false;
+
+	xe86_machine(std::shared_ptr<xe86::Bus> bus) : bus(bus), pc(bus), screen(pc.Get<xe86::CGA>()) {}
+
+	xe86::CPU& GetCpu() { return pc.Get<xe86::CPU>(); }
+
+	void Reset() {
+		// a DOS left hooked would answer INT 21h for whatever runs next
+		if (dos) {
+			GetCpu().SetInterruptHook(0x20, nullptr);
+			GetCpu().SetInterruptHook(0x21, nullptr);
+			dos.reset();
+		}
+
+		invalid_opcode = false;
+		pc.Reset();
+	}
+};
+
+struct xe86_snapshot {
+	std::vector<uint8_t> data;
+};
+
+namespace {
+	// snapshots start with this, so bytes that were never one are turned away
+	constexpr uint32_t SnapshotMagic = 0x36385845;	// "XE86"
+
+	// xe86_run, and whatever else stops it after each step
+	template<typename Stop>
+	xe86_stop Run(xe86_machine* machine, uint64_t cycles, Stop stop) {
+		xe86::Scheduler& scheduler = machine->bus->GetScheduler();
+		xe86::Cycles end = scheduler.GetNow() + cycles;
+
+		while (scheduler.GetNow() < end) {
+			machine->pc.Step();
+
+			if (machine->invalid_opcode) {
+				machine->invalid_opcode = false;
+				return XE86_STOP_INVALID_OPCODE;
+			}
+
+			if (machine->dos && machine->dos->HasExited()) {
+				return XE86_STOP_EXITED;
+			}
+
+			if (stop()) {
+				return XE86_STOP_TEXT;
+			}
+
+			if (machine->pc.IsStalled()) {
+				return XE86_STOP_STALLED;
+			}
+		}
+
+		return XE86_STOP_BUDGET;
+	}
+}
+
+uint32_t xe86_api_version(void) {
+	return XE86_API_VERSION;
+}
+
+xe86_machine* xe86_create(const char* rom_path) {
+	if (!rom_path) {
+		return nullptr;
+	}
+
+	std::ifstream file{ rom_path, std::ios::binary };
+	if (!file) {
+		std::println(stderr, "xe86: failed to open '{}'", rom_path);
+		return nullptr;
+	}
+
+	std::vector<uint8_t> rom{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+	return xe86_create_from_memory(rom.data(), rom.size());
+}
+
+xe86_machine* xe86_create_from_memory(const uint8_t* rom, size_t size) {
+	if (!rom) {
+		return nullptr;
+	}
+
+	auto bus = std::make_shared<xe86::Bus>();
+
+	// the blank rom area the bus starts out with
+	xe86::MemoryArea& area = *bus->GetMemoryAreas()[0];
+	if (size != area.GetLength()) {
+		std::println(stderr, "xe86: the rom has to be {} bytes, not {}", area.GetLength(), size);
+		return nullptr;
+	}
+
+	area.CopyIn(0, std::span<const uint8_t>(rom, size));
+
+	xe86_machine* machine = new (std::nothrow) xe86_machine(bus);
+	if (!machine) {
+		return nullptr;
+	}
+
+	xe86::ConnectPC(machine->pc);
+
+	// an opcode the cpu doesn't know stops the run instead of the whole process
+	machine->GetCpu().SetInvalidOpcodeHandler([machine]() { machine->invalid_opcode = true; });
+
+	machine->Reset();
+	return machine;
+}
+
+void xe86_destroy(xe86_machine* machine) {
+	delete machine;
+}
+
+void xe86_reset(xe86_machine* machine) {
+	machine->Reset();
+}
+
+int xe86_load_program(xe86_machine* machine, const char* path, const char* arguments) {
+	machine->Reset();
+
+	machine->dos = std::make_unique<xe86::DOS>(machine->bus, machine->GetCpu());
+	if (machine->output) {
+		machine->dos->SetOutput([machine](uint16_t handle, std::span<const uint8_t> data) {
+			machine->output(machine->output_user, handle, data.data(), data.size());
+		});
+	}
+
+	if (!path || !machine->dos->Load(path, arguments ? arguments : "")) {
+		// nothing half loaded may answer INT 21h for the next run
+		machine->Reset();
+		return -1;
+	}
+
+	return 0;
+}
+
+int xe86_get_exit_code(const xe86_machine* machine) {
+	return machine->dos ? machine->dos->GetExitCode() : 0;
+}
+
+void xe86_set_output(xe86_machine* machine, xe86_output output, void* user) {
+	machine->output = output;
+	machine->output_user = user;
+
+	// takes effect for a program that is already loaded too
+	if (machine->dos && output) {
+		machine->dos->SetOutput([machine](uint16_t handle, std::span<const uint8_t> data) {
+			machine->output(machine->output_user, handle, data.data(), data.size());
+		});
+	}
+}
+
+xe86_stop xe86_run(xe86_machine* machine, uint64_t cycles) {
+	return Run(machine, cycles, []() { return false; });
+}
+
+size_t xe86_get_text(xe86_machine* machine, char* buffer, size_t size) {
+	machine->screen.Update();
+
+	const std::string& text = machine->screen.GetText();
+	if (size) {
+		size_t length = std::min(text.size(), size - 1);
+		std::copy_n(text.data(), length, buffer);
+		buffer[length] = '\0';
+	}
+
+	return text.size();
+}
+
+xe86_stop xe86_wait_for_text(xe86_machine* machine, const char* pattern, uint64_t cycles) {
+	xe86::TextScreen& screen = machine->screen;
+	screen.Update();
+	if (screen.Contains(pattern)) {
+		return XE86_STOP_TEXT;
+	}
+
+	return Run(machine, cycles, [&screen, pattern]() { return screen.Update() && screen.Contains(pattern); });
+}
+
+uint64_t xe86_get_cycles(const xe86_machine* machine) {
+	return machine->bus->GetScheduler().GetNow();
+}
+
+uint64_t xe86_get_instructions(const xe86_machine* machine) {
+	return machine->bus->GetScheduler().GetInstructionCount();
+}
+
+void xe86_get_registers(xe86_machine* machine, xe86_registers* registers) {
+	const xe86::Registers& r = machine->GetCpu().GetRegisters();
+
+	*registers = {
+		r.ax, r.bx, r.cx, r.dx,
+		r.sp, r.bp, r.si, r.di,
+		r.cs, r.ds, r.ss, r.es,
+		r.ip, static_cast<uint16_t>(r.flags),
+	};
+}
+
+void xe86_set_registers(xe86_machine* machine, const xe86_registers* registers) {
+	xe86::CPU& cpu = machine->GetCpu();
+	xe86::Registers& r = cpu.GetRegisters();
+
+	r.ax = registers->ax;
+	r.bx = registers->bx;
+	r.cx = registers->cx;
+	r.dx = registers->dx;
+	r.sp = registers->sp;
+	r.bp = registers->bp;
+	r.si = registers->si;
+	r.di = registers->di;
+	r.ip = registers->ip;
+	r.flags = static_cast<xe86::Flags>(registers->flags);
+
+	cpu.SetSegment(xe86::CS, registers->cs);
+	cpu.SetSegment(xe86::DS, registers->ds);
+	cpu.SetSegment(xe86::SS, registers->ss);
+	cpu.SetSegment(xe86::ES, registers->es);
+}
+
+void xe86_read_memory(xe86_machine* machine, uint32_t address, void* buffer, size_t length) {
+	uint8_t* out = static_cast<uint8_t*>(buffer);
+	for (size_t i = 0; i < length; i++) {
+		out[i] = machine->bus->PeekByte(static_cast<uint32_t>(address + i));
+	}
+}
+
+void xe86_write_memory(xe86_machine* machine, uint32_t address, const void* data, size_t length) {
+	machine->bus->WriteBlock(address, std::span<const uint8_t>(static_cast<const uint8_t*>(data), length));
+}
+
+int xe86_attach_port(xe86_machine* machine, uint16_t port, xe86_port_read read, xe86_port_write write, void* user) {
+	bool attached = machine->bus->AttachPort({
+		[write, user, port](uint8_t value) {
+			if (write) {
+				write(user, port, value);
+			}
+		},
+		[read, user, port]() -> uint8_t { return read ? read(user, port) : 0xff; },
+		port
+	});
+
+	return attached ? 0 : -1;
+}
+
+xe86_snapshot* xe86_save_snapshot(xe86_machine* machine) {
+	xe86::StateWriter state;
+	state.Write(SnapshotMagic);
+	state.WriteBytes(machine->pc.SaveMachineState());
+
+	std::vector<uint8_t> contents;
+	for (auto& area : machine->bus->GetMemoryAreas()) {
+		if (area->IsWritable()) {
+			contents.resize(area->GetLength());
+			area->CopyOut(0, contents);
+			state.WriteBytes(contents);
+		}
+	}
+
+	return new (std::nothrow) xe86_snapshot{ std::move(state.GetData()) };
+}
+
+const uint8_t* xe86_snapshot_data(const xe86_snapshot* snapshot) {
+	return snapshot->data.data();
+}
+
+size_t xe86_snapshot_size(const xe86_snapshot* snapshot) {
+	return snapshot->data.size();
+}
+
+void xe86_free_snapshot(xe86_snapshot* snapshot) {
+	delete snapshot;
+}
+
+int xe86_load_snapshot(xe86_machine* machine, const uint8_t* data, size_t size) {
+	xe86::StateReader state(std::span<const uint8_t>(data, size));
+	if (state.Read<uint32_t>() != SnapshotMagic) {
+		std::println(stderr, "xe86: not a snapshot");
+		return -1;
+	}
+
+	// everything is checked before anything is loaded
+	std::span<const uint8_t> machine_state = state.ReadBytes();
+
+	std::vector<std::pair<xe86::MemoryArea*, std::span<const uint8_t>>> contents;
+	for (auto& area : machine->bus->GetMemoryAreas()) {
+		if (area->IsWritable()) {
+			std::span<const uint8_t> bytes = state.ReadBytes();
+			if (bytes.size() != area->GetLength()) {
+				std::println(stderr, "xe86: the snapshot is from a different machine");
+				return -1;
+			}
+
+			contents.emplace_back(area.get(), bytes);
+		}
+	}
+
+	for (auto& [area, bytes] : contents) {
+		area->CopyIn(0, bytes);
+	}
+
+	machine->pc.LoadMachineState(machine_state);
+	return 0;
+}
\ No newline at end of file
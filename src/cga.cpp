@@ -0,0 +1,133 @@
+#include "cga.hpp"
+#include <algorithm>
+
+using namespace xe86;
+
+CGA::CGA(std::shared_ptr<Bus> bus) : Component(bus, "CGA") {
+	m_Vram = std::make_shared<MemoryArea>(0xb8000, 0xb8000 + VideoFrame::VramSize - 1, true, true);
+	m_Bus->AttachMemoryArea(m_Vram);
+
+	m_Bus->AttachPort({
+		[this](uint8_t byte) { m_CrtcIndex = byte; },
+		[]() -> uint8_t { return 0xff; },
+		0x3d4
+	});
+
+	m_Bus->AttachPort({
+		[this](uint8_t byte) {
+			if (m_CrtcIndex < m_Crtc.size()) {
+				m_Crtc[m_CrtcIndex] = byte;
+			}
+		},
+		[this]() -> uint8_t { return m_CrtcIndex < m_Crtc.size() ? m_Crtc[m_CrtcIndex] : 0xff; },
+		0x3d5
+	});
+
+	m_Bus->AttachPort({
+		[this](uint8_t byte) { m_Mode = byte; },
+		[]() -> uint8_t { return 0xff; },
+		0x3d8
+	});
+
+	m_Bus->AttachPort({
+		[this](uint8_t byte) { m_Color = byte; },
+		[]() -> uint8_t { return 0xff; },
+		0x3d9
+	});
+
+	// retrace bits move with the beam, so polling them is never idle
+	m_Bus->AttachPort({
+		[](uint8_t) {},
+		[this]() -> uint8_t { return ReadStatus(); },
+		0x3da,
+		true
+	});
+}
+
+void CGA::Reset() {
+	m_Crtc.fill(0);
+	m_CrtcIndex = 0;
+	m_Mode = 0;
+	m_Color = 0;
+	m_FrameNumber = 0;
+
+	m_FrameStart = m_Bus->GetScheduler().GetNow();
+	ScheduleRetrace(NextRetrace());
+}
+
+uint8_t CGA::ReadStatus() {
+	Cycles position = (m_Bus->GetScheduler().GetNow() - m_FrameStart) % FrameCycles;
+	bool vertical = position >= ActiveLines * LineCycles;
+	bool horizontal = position % LineCycles >= ActiveLineCycles;
+
+	// bit 0: safe to touch vram (not drawing), bit 3: vertical retrace
+	return 0b11110000 | ((vertical || horizontal) ? 0b0001 : 0) | (vertical ? 0b1000 : 0);
+}
+
+void CGA::ScheduleRetrace(Cycles when) {
+	Scheduler& scheduler = m_Bus->GetScheduler();
+	if (m_RetraceScheduled) {
+		scheduler.Cancel(m_RetraceEvent);
+	}
+
+	m_RetraceEvent = scheduler.Schedule(when, [this]() { VerticalRetrace(); });
+	m_RetraceScheduled = true;
+}
+
+void CGA::VerticalRetrace() {
+	m_RetraceScheduled = false;
+	Cycles now = m_Bus->GetScheduler().GetNow();
+
+	if (m_Presenter) {
+		VideoFrame& frame = m_Presenter->BeginFrame();
+		frame.number = m_FrameNumber;
+		frame.time = now;
+		frame.mode = m_Mode;
+		frame.color = m_Color;
+		frame.start = GetStartAddress();
+		frame.cursor = GetCursorAddress();
+		frame.cursor_start = m_Crtc[10];
+
+		auto& versions = m_Vram->GetPageVersions();
+		std::copy_n(versions.begin(), VideoFrame::VramPages, frame.versions.begin());
+
+		m_Vram->CopyOut(0, frame.vram);
+		m_Presenter->PublishFrame();
+	}
+
+	m_FrameNumber++;
+	ScheduleRetrace(NextRetrace());
+}
+
+Cycles CGA::NextRetrace() {
+	Cycles now = m_Bus->GetScheduler().GetNow();
+
+	// keep m_FrameStart on the frame the beam is in, whatever the clock has jumped over
+	while (m_FrameStart + FrameCycles <= now) {
+		m_FrameStart += FrameCycles;
+	}
+
+	Cycles retrace = m_FrameStart + ActiveLines * LineCycles;
+	return retrace > now ? retrace : retrace + FrameCycles;
+}
+
+void CGA::SaveState(StateWriter& state) const {
+	state.Write(m_Crtc);
+	state.Write(m_CrtcIndex);
+	state.Write(m_Mode);
+	state.Write(m_Color);
+	state.Write(m_FrameStart);
+	state.Write(m_FrameNumber);
+}
+
+void CGA::LoadState(StateReader& state) {
+	state.Read(m_Crtc);
+	state.Read(m_CrtcIndex);
+	state.Read(m_Mode);
+	state.Read(m_Color);
+	state.Read(m_FrameStart);
+	state.Read(m_FrameNumber);
+
+	// the pending retrace belonged to the timeline we left
+	ScheduleRetrace(NextRetrace());
+}
\ No newline at end of file
@@ -0,0 +1,74 @@
+#ifndef CGA_HPP
+#define CGA_HPP
+
+#include "component.hpp"
+#include "video.hpp"
+
+#include <array>
+#include <memory>
+
+namespace xe86 {
+	/*
+	IBM COLOR GRAPHICS ADAPTER
+		16 KB of video ram at B8000, the 6845 crtc at 3D4/3D5, mode control at 3D8, color select
+		at 3D9 and status at 3DA. the card does nothing per instruction: retrace status is worked
+		out from the clock when it is read, and a scheduled event at each vertical retrace hands
+		the frame to the presenter, if there is one.
+	*/
+	class CGA final : public Component {
+	public:
+		// 14.31818 MHz dot clock, 912 dots by 262 lines per frame, and the cpu runs at a third of it
+		static constexpr Cycles LineCycles = 912 / 3;
+		static constexpr Cycles FrameCycles = 912 * 262 / 3;
+		static constexpr Cycles ActiveLineCycles = 640 / 3;
+		static constexpr unsigned ActiveLines = 200;
+
+		CGA(const CGA&) = delete;
+		CGA& operator=(const CGA&) = delete;
+
+		CGA(std::shared_ptr<Bus> bus);
+
+		void Reset() override;
+		void Step() override {}
+
+		// only does anything at retrace, which is scheduled
+		bool IsIdle() const override { return true; }
+
+		void SaveState(StateWriter& state) const override;
+		void LoadState(StateReader& state) override;
+
+		void AttachPresenter(std::shared_ptr<VideoPresenter> presenter) {
+			m_Presenter = presenter;
+		}
+
+		std::shared_ptr<MemoryArea> GetVideoMemory() { return m_Vram; }
+
+		uint8_t GetMode() const { return m_Mode; }
+		uint16_t GetStartAddress() const { return (m_Crtc[12] << 8) | m_Crtc[13]; }
+		uint16_t GetCursorAddress() const { return (m_Crtc[14] << 8) | m_Crtc[15]; }
+
+	private:
+		uint8_t ReadStatus();
+		void VerticalRetrace();
+		void ScheduleRetrace(Cycles when);
+		Cycles NextRetrace();
+
+	private:
+		std::shared_ptr<MemoryArea> m_Vram;
+		std::shared_ptr<VideoPresenter> m_Presenter;
+
+		std::array<uint8_t, 18> m_Crtc{};
+		uint8_t m_CrtcIndex = 0;
+		uint8_t m_Mode = 0;
+		uint8_t m_Color = 0;
+
+		// cycle at which the frame the beam is in started
+		Cycles m_FrameStart = 0;
+		uint64_t m_FrameNumber = 0;
+
+		Scheduler::EventId m_RetraceEvent = 0;
+		bool m_RetraceScheduled = false;
+	};
+}
+
+#endif
\ No newline at end of file
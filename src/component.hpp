@@ -2,6 +2,7 @@
 #define COMPONENT_HPP
 
 #include "bus.hpp"
+#include "state.hpp"
 #include <memory>
 #include <string>
 
@@ -16,6 +17,14 @@ namespace xe86 {
 		virtual void Reset() = 0;
 		virtual void Step() = 0;
 
+		// true when the component has nothing to do until the next scheduled event
+		virtual bool IsIdle() const { return false; }
+
+		// snapshot support. scheduled events aren't part of the saved state, a component that
+		// schedules events has to cancel and re-post them when its state is loaded.
+		virtual void SaveState(StateWriter&) const {}
+		virtual void LoadState(StateReader&) {}
+
 	public:
 		std::string_view GetHumanName() const {
 			return m_HumanName;
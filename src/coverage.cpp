@@ -0,0 +1,261 @@
+#include "coverage.hpp"
+#include <print>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cctype>
+
+using namespace xe86;
+
+// five hex digits, a linear address
+static std::string Hex(uint32_t address) {
+	std::ostringstream text;
+	text << std::hex << std::setw(5) << std::setfill('0') << address;
+	return text.str();
+}
+
+Coverage::Coverage(CPU& cpu) : m_Cpu(cpu), m_Map(std::make_unique<uint8_t[]>(1 << 20)) {
+	m_Cpu.SetCoverageMap(m_Map.get());
+}
+
+Coverage::~Coverage() {
+	m_Cpu.SetCoverageMap(nullptr);
+}
+
+void Coverage::AddRegion(std::string_view name, uint32_t start, uint32_t end) {
+	m_Regions.push_back({ std::string(name), start & 0xfffff, std::max(start, end) & 0xfffff });
+}
+
+bool Coverage::LoadListing(std::string_view filename, uint32_t base) {
+	std::ifstream file{ std::string(filename) };
+	if (!file) {
+		std::println(stderr, "coverage: failed to open '{}'", filename);
+		return false;
+	}
+
+	auto is_hex = [](std::string_view text) {
+		return !text.empty() && text.find_first_not_of("0123456789abcdefABCDEF") == std::string_view::npos;
+	};
+
+	auto is_decimal = [](std::string_view text) {
+		return !text.empty() && text.find_first_not_of("0123456789") == std::string_view::npos;
+	};
+
+	// what assembles to data rather than code, as the first or second word of the source
+	auto is_data = [](std::string_view source) {
+		static constexpr std::string_view directives[] = {
+			"db", "dw", "dd", "dq", "dt", "times", "resb", "resw", "resd", "resq", "incbin", "equ", "byte", "word", "dword"
+		};
+
+		std::istringstream words{ std::string(source) };
+		std::string word;
+		for (int i = 0; i < 2 && words >> word; i++) {
+			std::transform(word.begin(), word.end(), word.begin(), [](unsigned char c) { return std::tolower(c); });
+			if (std::find(std::begin(directives), std::end(directives), word) != std::end(directives)) {
+				return true;
+			}
+		}
+
+		return false;
+	};
+
+	Listing listing{ std::string(filename), {} };
+	size_t code = 0;
+
+	std::string text;
+	while (std::getline(file, text)) {
+		if (!text.empty() && text.back() == '\r') {
+			text.pop_back();
+		}
+
+		Line line{ text };
+
+		// the words before the source, one at a time. at is where the next one is looked for
+		size_t at = 0;
+		auto next_word = [&]() -> std::string_view {
+			size_t start = text.find_first_not_of(" \t", at);
+			if (start == std::string::npos) {
+				at = text.size();
+				return {};
+			}
+
+			size_t end = std::min(text.find_first_of(" \t", start), text.size());
+			at = end;
+			return std::string_view(text).substr(start, end - start);
+		};
+
+		std::string_view first = next_word();
+		size_t after_first = at;
+		std::string_view second = next_word();
+
+		uint32_t offset = 0;
+		uint32_t bytes = 0;
+		std::string_view source;
+
+		// NASM lines start with a line number, MASM ones with a four digit offset, which can look like one
+		bool nasm = is_decimal(first) && (second.empty() || second.starts_with('<') || (second.size() == 8 && is_hex(second)));
+		if (nasm) {
+			// line, [<macro level>], offset, bytes with [relocations] and (segments), a - if they go on
+			size_t before = after_first;
+			std::string_view word = second;
+			if (word.starts_with('<')) {
+				before = at;
+				word = next_word();
+			}
+
+			if (word.size() == 8 && is_hex(word)) {
+				offset = std::stoul(std::string(word), nullptr, 16);
+				before = at;
+				word = next_word();
+
+				std::string digits;
+				for (char c : word) {
+					if (std::isxdigit(static_cast<unsigned char>(c))) {
+						digits += c;
+					} else if (c != '[' && c != ']' && c != '(' && c != ')' && c != '-') {
+						digits.clear();
+						break;
+					}
+				}
+
+				if (!digits.empty() && digits.size() % 2 == 0) {
+					bytes = static_cast<uint32_t>(digits.size() / 2);
+					before = at;
+				}
+			}
+
+			source = std::string_view(text).substr(std::min(before, text.size()));
+		} else if (first.size() == 4 && is_hex(first)) {
+			// offset, then bytes in pairs and relocated words as four digits and a letter
+			size_t before = after_first;
+			for (std::string_view word = second; !word.empty(); word = next_word()) {
+				bool upper = std::none_of(word.begin(), word.end(), [](unsigned char c) { return std::islower(c); });
+				if ((word.size() == 2 || word.size() == 4) && is_hex(word) && upper) {
+					bytes += static_cast<uint32_t>(word.size() / 2);
+				} else if (word.size() != 1 || !std::isupper(static_cast<unsigned char>(word[0]))) {
+					break;
+				}
+
+				before = at;
+			}
+
+			offset = std::stoul(std::string(first), nullptr, 16);
+			source = std::string_view(text).substr(std::min(before, text.size()));
+		}
+
+		if (bytes != 0 && !is_data(source)) {
+			line.address = (base + offset) & 0xfffff;
+			line.length = static_cast<uint16_t>(std::min<uint32_t>(bytes, 0xffff));
+			code++;
+		}
+
+		listing.lines.push_back(std::move(line));
+	}
+
+	if (code == 0) {
+		std::println(stderr, "coverage: no code in listing '{}'", filename);
+		return false;
+	}
+
+	m_Listings.push_back(std::move(listing));
+	return true;
+}
+
+bool Coverage::IsExecuted(const Line& line) const {
+	for (uint32_t i = 0; i < line.length; i++) {
+		if (IsExecuted(line.address + i)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+size_t Coverage::GetCodeLines() const {
+	size_t count = 0;
+	for (const Listing& listing : m_Listings) {
+		count += std::count_if(listing.lines.begin(), listing.lines.end(), [](const Line& line) { return line.length != 0; });
+	}
+
+	return count;
+}
+
+size_t Coverage::GetExecutedLines() const {
+	size_t count = 0;
+	for (const Listing& listing : m_Listings) {
+		count += std::count_if(listing.lines.begin(), listing.lines.end(), [this](const Line& line) { return line.length != 0 && IsExecuted(line); });
+	}
+
+	return count;
+}
+
+bool Coverage::WriteLcov(std::string_view filename) const {
+	std::ofstream file{ std::string(filename), std::ios::trunc };
+	if (!file) {
+		std::println(stderr, "coverage: failed to create '{}'", filename);
+		return false;
+	}
+
+	if (m_Listings.empty()) {
+		std::println(stderr, "coverage: no listings to report lines against, '{}' has no records", filename);
+	}
+
+	for (const Listing& listing : m_Listings) {
+		size_t found = 0, hit = 0;
+
+		file << "TN:xe86\nSF:" << listing.filename << '\n';
+		for (size_t i = 0; i < listing.lines.size(); i++) {
+			const Line& line = listing.lines[i];
+			if (line.length == 0) {
+				continue;
+			}
+
+			bool executed = IsExecuted(line);
+			file << "DA:" << i + 1 << ',' << (executed ? 1 : 0) << '\n';
+			found++;
+			hit += executed;
+		}
+
+		file << "LF:" << found << "\nLH:" << hit << "\nend_of_record\n";
+	}
+
+	return true;
+}
+
+bool Coverage::WriteText(std::string_view filename) const {
+	std::ofstream file{ std::string(filename), std::ios::trunc };
+	if (!file) {
+		std::println(stderr, "coverage: failed to create '{}'", filename);
+		return false;
+	}
+
+	for (const Region& region : m_Regions) {
+		std::vector<uint32_t> executed;
+		for (uint32_t address = region.start; address <= region.end; address++) {
+			if (IsExecuted(address)) {
+				executed.push_back(address);
+			}
+		}
+
+		file << "region " << region.name << ' ' << Hex(region.start) << '-' << Hex(region.end) << ": instructions executed at " << executed.size() << " addresses\n";
+		for (size_t i = 0; i < executed.size(); i++) {
+			file << (i % 16 == 0 ? "\t" : " ") << Hex(executed[i]) << (i % 16 == 15 || i + 1 == executed.size() ? "\n" : "");
+		}
+	}
+
+	for (const Listing& listing : m_Listings) {
+		size_t found = 0, hit = 0;
+		for (const Line& line : listing.lines) {
+			found += line.length != 0;
+			hit += line.length != 0 && IsExecuted(line);
+		}
+
+		file << "listing " << listing.filename << ": " << hit << " of " << found << " code lines executed\n";
+		for (const Line& line : listing.lines) {
+			file << (line.length == 0 ? ' ' : IsExecuted(line) ? '+' : '-') << ' ' << line.text << '\n';
+		}
+	}
+
+	return true;
+}
\ No newline at end of file
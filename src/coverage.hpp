@@ -0,0 +1,81 @@
+#ifndef COVERAGE_HPP
+#define COVERAGE_HPP
+
+#include "cpu.hpp"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace xe86 {
+	/*
+	CODE COVERAGE
+		a byte for every linear address, 1 MB in all, that the cpu sets to 1 where an instruction
+		starts executing: one store per instruction, interpreted, translated or fused, and nothing
+		else. everything else happens when the coverage is written out.
+
+		regions name the address ranges worth reporting on, the rom and the program that was
+		loaded. without a listing all there is to say about a region is which addresses ran. with
+		an assembler listing each line that assembled to code is executed if an instruction started
+		in its bytes, and data lines (db, dw, times...) aren't counted. NASM listings
+		("line offset bytes source") and MASM ones ("offset bytes source") are both understood, the
+		offsets being from the base the listing is loaded at.
+
+		written out as lcov tracefiles, one record per listing with its lines numbered as in the
+		listing, so genhtml shows the listing itself. or as text: each region's executed addresses,
+		then each listing with its lines marked + executed, - not executed.
+	*/
+	class Coverage {
+	public:
+		Coverage(CPU& cpu);
+		~Coverage();
+
+		Coverage(const Coverage&) = delete;
+		Coverage& operator=(const Coverage&) = delete;
+
+		// end is inclusive
+		void AddRegion(std::string_view name, uint32_t start, uint32_t end);
+
+		// base is the linear address of the listing's offset 0
+		bool LoadListing(std::string_view filename, uint32_t base);
+
+		bool WriteLcov(std::string_view filename) const;
+		bool WriteText(std::string_view filename) const;
+
+		bool IsExecuted(uint32_t address) const { return m_Map[address & 0xfffff] != 0; }
+
+		// of the lines in every listing that assembled to code, and how many of them ran
+		size_t GetCodeLines() const;
+		size_t GetExecutedLines() const;
+
+	private:
+		struct Line {
+			std::string text;
+			uint32_t address = 0;
+			uint16_t length = 0;	// 0 for anything but code
+		};
+
+		struct Listing {
+			std::string filename;
+			std::vector<Line> lines;
+		};
+
+		struct Region {
+			std::string name;
+			uint32_t start;
+			uint32_t end;
+		};
+
+		bool IsExecuted(const Line& line) const;
+
+	private:
+		CPU& m_Cpu;
+		std::unique_ptr<uint8_t[]> m_Map;
+
+		std::vector<Region> m_Regions;
+		std::vector<Listing> m_Listings;
+	};
+}
+
+#endif
\ No newline at end of file
@@ -1,9 +1,16 @@
 #include "cpu.hpp"
+#include "translation.hpp"
 #include <print>
 
 using namespace xe86;
 
 void CPU::InvalidOpcode() {
+	if (m_InvalidOpcodeHandler) {
+		m_Halted = true;
+		m_InvalidOpcodeHandler();
+		return;
+	}
+
 	std::println(stderr, "invalid opcode @ {:04x}:{:04x} ({:05x})",
 		static_cast<uint16_t>(m_Registers.cs),
 		static_cast<uint16_t>(m_Registers.ip - 1),
@@ -23,7 +30,7 @@ void CPU::SetOpcodes() {
 		uint16_t new_cs = Fetch16();
 
 		m_Registers.ip = new_ip;
-		m_Registers.cs = new_cs;
+		LoadSegment(CS, new_cs);
 	};
 
 	// CLI
@@ -31,6 +38,11 @@ void CPU::SetOpcodes() {
 		ClearFlag(Flags::IF); // interrupt flag
 	};
 
+	// HLT
+	m_Functions[0xf4] = [this]() {
+		m_Halted = true;
+	};
+
 	// CLD
 	m_Functions[0xfc] = [this]() {
 		ClearFlag(Flags::DF); // direction flag
@@ -39,64 +51,64 @@ void CPU::SetOpcodes() {
 	// MOV Eb, Gb
 	m_Functions[0x88] = [this]() {
 		ModRM modrm = FetchModRM(RegEncoding::Register8);
-		modrm.modrm.Write8(m_Bus, m_Registers.ds, modrm.reg.Read8());
+		modrm.modrm.Write8(*m_Bus, modrm.reg.Read8());
 	};
 
 	// MOV Ev, Gv
 	m_Functions[0x89] = [this]() {
 		ModRM modrm = FetchModRM(RegEncoding::Register16);
-		modrm.modrm.Write16(m_Bus, m_Registers.ds, modrm.reg.Read16());
+		modrm.modrm.Write16(*m_Bus, modrm.reg.Read16());
 	};
 
 	// MOV Gb, Eb
 	m_Functions[0x8a] = [this]() {
 		ModRM modrm = FetchModRM(RegEncoding::Register8);
-		modrm.reg.Write8(modrm.modrm.Read8(m_Bus, m_Registers.ds));
+		modrm.reg.Write8(modrm.modrm.Read8(*m_Bus));
 	};
 
 	// MOV Gv, Ev
 	m_Functions[0x8b] = [this]() {
 		ModRM modrm = FetchModRM(RegEncoding::Register16);
-		modrm.reg.Write16(modrm.modrm.Read16(m_Bus, m_Registers.ds)); // TODO: the segment can be changed using a segment prefix
+		modrm.reg.Write16(modrm.modrm.Read16(*m_Bus)); // TODO: the segment can be changed using a segment prefix
 	};
 
 	// MOV Ew, Sw
 	m_Functions[0x8c] = [this]() {
 		ModRM modrm = FetchModRM(RegEncoding::Segment);
-		modrm.modrm.Write16(m_Bus, m_Registers.ds, modrm.reg.Read16());
+		modrm.modrm.Write16(*m_Bus, modrm.reg.Read16());
 	};
 
 	// MOV Sw, Ew
 	m_Functions[0x8e] = [this]() {
 		ModRM modrm = FetchModRM(RegEncoding::Segment);
-		modrm.reg.Write16(modrm.modrm.Read16(m_Bus, m_Registers.ds));
+		LoadSegment(modrm.reg.index & 0b11, modrm.modrm.Read16(*m_Bus));
 	};
 
 	// MOV AL, Ob
 	m_Functions[0xa0] = [this]() {
-		m_Registers.al = m_Bus->ReadByte((m_Registers.ds * 0x10) + Fetch16());
+		m_Registers.al = m_Bus->ReadByte(m_Registers.base[DS] + Fetch16());
 	};
 
 	// MOV AX, Ov
 	m_Functions[0xa1] = [this]() {
-		m_Registers.ax = m_Bus->ReadWord((m_Registers.ds * 0x10) + Fetch16());
+		m_Registers.ax = m_Bus->ReadWord(m_Registers.base[DS] + Fetch16());
 	};
 
 	// MOV Ob, AL
 	m_Functions[0xa2] = [this]() {
-		uint16_t addr = (m_Registers.ds * 0x10) + Fetch16();
+		uint32_t addr = m_Registers.base[DS] + Fetch16();
 		m_Bus->WriteByte(addr, m_Registers.al);
 	};
 
 	// MOV Ov, AX
 	m_Functions[0xa3] = [this]() {
-		uint16_t addr = (m_Registers.ds * 0x10) + Fetch16();
+		uint32_t addr = m_Registers.base[DS] + Fetch16();
 		m_Bus->WriteWord(addr, m_Registers.ax);
 	};
 
 	// MOVSB
 	m_Functions[0xa4] = [this]() {
-		m_Bus->WriteByte((m_Registers.es * 0x10) + m_Registers.di, m_Bus->ReadByte((m_Registers.ds * 0x10) + m_Registers.si));
+		m_Bus->WriteByte(m_Registers.base[ES] + m_Registers.di, m_Bus->ReadByte(m_Registers.base[DS] + m_Registers.si));
 
 		if (GetFlag(Flags::DF)) {
 			m_Registers.si--;
@@ -109,7 +121,7 @@ void CPU::SetOpcodes() {
 
 	// MOVSW
 	m_Functions[0xa5] = [this]() {
-		m_Bus->WriteWord((m_Registers.es * 0x10) + m_Registers.di, m_Bus->ReadWord((m_Registers.ds * 0x10) + m_Registers.si));
+		m_Bus->WriteWord(m_Registers.base[ES] + m_Registers.di, m_Bus->ReadWord(m_Registers.base[DS] + m_Registers.si));
 
 		if (GetFlag(Flags::DF)) {
 			m_Registers.si -= 2;
@@ -203,13 +215,50 @@ void CPU::SetOpcodes() {
 	// MOV Eb, Ib
 	m_Functions[0xc6] = [this]() {
 		ModRM modrm = FetchModRM(RegEncoding::Register8);
-		modrm.modrm.Write8(m_Bus, m_Registers.ds, Fetch8());
+		modrm.modrm.Write8(*m_Bus, Fetch8());
 	};
 
 	// MOV Ev, Iv
 	m_Functions[0xc7] = [this]() {
 		ModRM modrm = FetchModRM(RegEncoding::Register16);
-		modrm.modrm.Write16(m_Bus, m_Registers.ds, Fetch16());
+		modrm.modrm.Write16(*m_Bus, Fetch16());
+	};
+
+	// ESC: the 8087's instructions. the cpu works out the operand's address, the 8087 does the
+	// rest and carries on by itself while the cpu goes on to the next instruction
+	for (uint8_t op = 0xd8; op <= 0xdf; op++) {
+		m_Functions[op] = [this, op]() {
+			uint32_t instruction = (m_Registers.base[CS] + m_InstructionStart) & 0xfffff;
+			uint8_t byte = m_Bus->PeekByte((m_Registers.base[CS] + m_Registers.ip) & 0xfffff);
+
+			ModRM modrm = FetchModRM(RegEncoding::Group);
+			bool memory = modrm.modrm.type == ModRMType::Address;
+			if (memory) {
+				m_Cycles += 6;
+			}
+
+			if (!m_FpuPresent) {
+				return;
+			}
+
+			// one issued while the 8087 is still busy queues up behind what it's doing
+			Cycles now = m_Bus->GetScheduler().GetNow() + m_Cycles;
+			Cycles start = std::max(now, m_FpuBusyUntil);
+			m_FpuBusyUntil = start + m_Fpu.Execute(op, byte, memory ? modrm.modrm.addr : 0, instruction);
+
+			// FSTSW AX, from the 80287
+			if (op == 0xdf && byte == 0xe0) {
+				m_Registers.ax = m_Fpu.GetStatusWord();
+			}
+		};
+	}
+
+	// WAIT, for the 8087 to finish
+	m_Functions[0x9b] = [this]() {
+		Cycles now = m_Bus->GetScheduler().GetNow() + m_Cycles;
+		if (m_FpuBusyUntil > now) {
+			m_Cycles += m_FpuBusyUntil - now;
+		}
 	};
 
 	// GRP3b Ev
@@ -219,7 +268,7 @@ void CPU::SetOpcodes() {
 		switch (modrm.reg.group) {
 			// TEST Ev Iv
 			case 0: {
-				uint16_t result = modrm.modrm.Read16(m_Bus, m_Registers.ds) & Fetch16();
+				uint16_t result = modrm.modrm.Read16(*m_Bus) & Fetch16();
 				SetFlagByValue(Flags::SF, result & 0x8000);
 				SetFlagByValue(Flags::ZF, result == 0);
 				SetFlagByValue(Flags::PF, parity[result & 0xff]);
@@ -237,7 +286,7 @@ void CPU::SetOpcodes() {
 	// XOR Gv, Ev
 	m_Functions[0x33] = [this]() {
 		ModRM modrm = FetchModRM(RegEncoding::Register16);
-		uint16_t result = modrm.reg.Read16() ^ modrm.modrm.Read16(m_Bus, m_Registers.ds);
+		uint16_t result = modrm.reg.Read16() ^ modrm.modrm.Read16(*m_Bus);
 		modrm.reg.Write16(result);
 
 		SetFlagByValue(Flags::SF, result & 0x8000);
@@ -250,7 +299,10 @@ void CPU::SetOpcodes() {
 	// TEST Gv Ev
 	m_Functions[0x85] = [this]() {
 		ModRM modrm = FetchModRM(RegEncoding::Register16);
-		uint16_t result = modrm.modrm.Read16(m_Bus, m_Registers.ds) & modrm.reg.Read16();
+		uint16_t result = modrm.modrm.Read16(*m_Bus) & modrm.reg.Read16();
+		if (TryFuse(Fusion::TestJcc, { LazyOp::Logic16, 0, 0, result })) {
+			return;
+		}
 
 		SetFlagByValue(Flags::SF, result & 0x8000);
 		SetFlagByValue(Flags::ZF, result == 0);
@@ -379,7 +431,10 @@ void CPU::SetOpcodes() {
 	m_Functions[0x48] = [this]() {
 		uint16_t original = m_Registers.ax;
 		m_Registers.ax--;
-		
+		if (TryFuse(Fusion::DecJcc, { LazyOp::Dec16, original, 1, m_Registers.ax })) {
+			return;
+		}
+
 		SetFlagByValue(Flags::OF, original == 0x8000);
 		SetFlagByValue(Flags::SF, m_Registers.ax & 0x8000);
 		SetFlagByValue(Flags::ZF, m_Registers.ax == 0);
@@ -391,7 +446,10 @@ void CPU::SetOpcodes() {
 	m_Functions[0x49] = [this]() {
 		uint16_t original = m_Registers.cx;
 		m_Registers.cx--;
-		
+		if (TryFuse(Fusion::DecJcc, { LazyOp::Dec16, original, 1, m_Registers.cx })) {
+			return;
+		}
+
 		SetFlagByValue(Flags::OF, original == 0x8000);
 		SetFlagByValue(Flags::SF, m_Registers.cx & 0x8000);
 		SetFlagByValue(Flags::ZF, m_Registers.cx == 0);
@@ -403,7 +461,10 @@ void CPU::SetOpcodes() {
 	m_Functions[0x4a] = [this]() {
 		uint16_t original = m_Registers.dx;
 		m_Registers.dx--;
-		
+		if (TryFuse(Fusion::DecJcc, { LazyOp::Dec16, original, 1, m_Registers.dx })) {
+			return;
+		}
+
 		SetFlagByValue(Flags::OF, original == 0x8000);
 		SetFlagByValue(Flags::SF, m_Registers.dx & 0x8000);
 		SetFlagByValue(Flags::ZF, m_Registers.dx == 0);
@@ -415,7 +476,10 @@ void CPU::SetOpcodes() {
 	m_Functions[0x4b] = [this]() {
 		uint16_t original = m_Registers.bx;
 		m_Registers.bx--;
-		
+		if (TryFuse(Fusion::DecJcc, { LazyOp::Dec16, original, 1, m_Registers.bx })) {
+			return;
+		}
+
 		SetFlagByValue(Flags::OF, original == 0x8000);
 		SetFlagByValue(Flags::SF, m_Registers.bx & 0x8000);
 		SetFlagByValue(Flags::ZF, m_Registers.bx == 0);
@@ -427,7 +491,10 @@ void CPU::SetOpcodes() {
 	m_Functions[0x4c] = [this]() {
 		uint16_t original = m_Registers.sp;
 		m_Registers.sp--;
-		
+		if (TryFuse(Fusion::DecJcc, { LazyOp::Dec16, original, 1, m_Registers.sp })) {
+			return;
+		}
+
 		SetFlagByValue(Flags::OF, original == 0x8000);
 		SetFlagByValue(Flags::SF, m_Registers.sp & 0x8000);
 		SetFlagByValue(Flags::ZF, m_Registers.sp == 0);
@@ -439,7 +506,10 @@ void CPU::SetOpcodes() {
 	m_Functions[0x4d] = [this]() {
 		uint16_t original = m_Registers.bp;
 		m_Registers.bp--;
-		
+		if (TryFuse(Fusion::DecJcc, { LazyOp::Dec16, original, 1, m_Registers.bp })) {
+			return;
+		}
+
 		SetFlagByValue(Flags::OF, original == 0x8000);
 		SetFlagByValue(Flags::SF, m_Registers.bp & 0x8000);
 		SetFlagByValue(Flags::ZF, m_Registers.bp == 0);
@@ -451,7 +521,10 @@ void CPU::SetOpcodes() {
 	m_Functions[0x4e] = [this]() {
 		uint16_t original = m_Registers.si;
 		m_Registers.si--;
-		
+		if (TryFuse(Fusion::DecJcc, { LazyOp::Dec16, original, 1, m_Registers.si })) {
+			return;
+		}
+
 		SetFlagByValue(Flags::OF, original == 0x8000);
 		SetFlagByValue(Flags::SF, m_Registers.si & 0x8000);
 		SetFlagByValue(Flags::ZF, m_Registers.si == 0);
@@ -463,7 +536,10 @@ void CPU::SetOpcodes() {
 	m_Functions[0x4f] = [this]() {
 		uint16_t original = m_Registers.di;
 		m_Registers.di--;
-		
+		if (TryFuse(Fusion::DecJcc, { LazyOp::Dec16, original, 1, m_Registers.di })) {
+			return;
+		}
+
 		SetFlagByValue(Flags::OF, original == 0x8000);
 		SetFlagByValue(Flags::SF, m_Registers.di & 0x8000);
 		SetFlagByValue(Flags::ZF, m_Registers.di == 0);
@@ -477,9 +553,12 @@ void CPU::SetOpcodes() {
 		switch (modrm.reg.group) {
 			// CMP Ev, Iv
 			case 7: {
-				uint16_t ev = modrm.modrm.Read16(m_Bus, m_Registers.ds);
+				uint16_t ev = modrm.modrm.Read16(*m_Bus);
 				uint16_t iv = Fetch16();
 				uint16_t result = ev - iv;
+				if (TryFuse(Fusion::CmpJcc, { LazyOp::Sub16, ev, iv, result })) {
+					break;
+				}
 
 				SetFlagByValue(Flags::SF, result & 0x8000);
 				SetFlagByValue(Flags::ZF, result == 0);
@@ -520,8 +599,8 @@ void CPU::SetOpcodes() {
 	// AND Eb, Gb
 	m_Functions[0x20] = [this]() {
 		ModRM modrm = FetchModRM(RegEncoding::Register8);
-		uint8_t result = modrm.modrm.Read8(m_Bus, m_Registers.ds) & modrm.reg.Read8();
-		modrm.modrm.Write8(m_Bus, m_Registers.ds, result);
+		uint8_t result = modrm.modrm.Read8(*m_Bus) & modrm.reg.Read8();
+		modrm.modrm.Write8(*m_Bus, result);
 
 		SetFlagByValue(Flags::SF, result & 0x80);
 		SetFlagByValue(Flags::ZF, result == 0);
@@ -534,8 +613,8 @@ void CPU::SetOpcodes() {
 	// AND Ev, Gv
 	m_Functions[0x21] = [this]() {
 		ModRM modrm = FetchModRM(RegEncoding::Register16);
-		uint16_t result = modrm.modrm.Read16(m_Bus, m_Registers.ds) & modrm.reg.Read16();
-		modrm.modrm.Write16(m_Bus, m_Registers.ds, result);
+		uint16_t result = modrm.modrm.Read16(*m_Bus) & modrm.reg.Read16();
+		modrm.modrm.Write16(*m_Bus, result);
 		
 		SetFlagByValue(Flags::SF, result & 0x8000);
 		SetFlagByValue(Flags::ZF, result == 0);
@@ -548,7 +627,7 @@ void CPU::SetOpcodes() {
 	// AND Gb, Eb
 	m_Functions[0x22] = [this]() {
 		ModRM modrm = FetchModRM(RegEncoding::Register8);
-		uint8_t result = modrm.reg.Read8() & modrm.modrm.Read8(m_Bus, m_Registers.ds);
+		uint8_t result = modrm.reg.Read8() & modrm.modrm.Read8(*m_Bus);
 		modrm.reg.Write8(result);
 
 		SetFlagByValue(Flags::SF, result & 0x80);
@@ -562,7 +641,7 @@ void CPU::SetOpcodes() {
 	// AND Gv, Ev
 	m_Functions[0x23] = [this]() {
 		ModRM modrm = FetchModRM(RegEncoding::Register16);
-		uint16_t result = modrm.reg.Read16() & modrm.modrm.Read16(m_Bus, m_Registers.ds);
+		uint16_t result = modrm.reg.Read16() & modrm.modrm.Read16(*m_Bus);
 		modrm.reg.Write16(result);
 
 		SetFlagByValue(Flags::SF, result & 0x8000);
@@ -593,7 +672,7 @@ void CPU::SetOpcodes() {
 
 		SetFlagByValue(Flags::SF, result & 0x8000);
 		SetFlagByValue(Flags::ZF, result == 0);
-		SetFlagByValue(Flags::PF, parity[result]);
+		SetFlagByValue(Flags::PF, parity[result & 0xff]);
 
 		ClearFlag(Flags::OF);
 		ClearFlag(Flags::CF);
@@ -602,8 +681,8 @@ void CPU::SetOpcodes() {
 	// OR Eb, Gb
 	m_Functions[0x08] = [this]() {
 		ModRM modrm = FetchModRM(RegEncoding::Register8);
-		uint8_t result = modrm.modrm.Read8(m_Bus, m_Registers.ds) | modrm.reg.Read8();
-		modrm.modrm.Write8(m_Bus, m_Registers.ds, result);
+		uint8_t result = modrm.modrm.Read8(*m_Bus) | modrm.reg.Read8();
+		modrm.modrm.Write8(*m_Bus, result);
 
 		SetFlagByValue(Flags::SF, result & 0x80);
 		SetFlagByValue(Flags::ZF, result == 0);
@@ -616,8 +695,8 @@ void CPU::SetOpcodes() {
 	// OR Ev, Gv
 	m_Functions[0x09] = [this]() {
 		ModRM modrm = FetchModRM(RegEncoding::Register16);
-		uint16_t result = modrm.modrm.Read16(m_Bus, m_Registers.ds) | modrm.reg.Read16();
-		modrm.modrm.Write16(m_Bus, m_Registers.ds, result);
+		uint16_t result = modrm.modrm.Read16(*m_Bus) | modrm.reg.Read16();
+		modrm.modrm.Write16(*m_Bus, result);
 		
 		SetFlagByValue(Flags::SF, result & 0x8000);
 		SetFlagByValue(Flags::ZF, result == 0);
@@ -630,7 +709,7 @@ void CPU::SetOpcodes() {
 	// OR Gb, Eb
 	m_Functions[0x0a] = [this]() {
 		ModRM modrm = FetchModRM(RegEncoding::Register8);
-		uint8_t result = modrm.reg.Read8() | modrm.modrm.Read8(m_Bus, m_Registers.ds);
+		uint8_t result = modrm.reg.Read8() | modrm.modrm.Read8(*m_Bus);
 		modrm.reg.Write8(result);
 
 		SetFlagByValue(Flags::SF, result & 0x80);
@@ -644,7 +723,7 @@ void CPU::SetOpcodes() {
 	// OR Gv, Ev
 	m_Functions[0x0b] = [this]() {
 		ModRM modrm = FetchModRM(RegEncoding::Register16);
-		uint16_t result = modrm.reg.Read16() | modrm.modrm.Read16(m_Bus, m_Registers.ds);
+		uint16_t result = modrm.reg.Read16() | modrm.modrm.Read16(*m_Bus);
 		modrm.reg.Write16(result);
 
 		SetFlagByValue(Flags::SF, result & 0x8000);
@@ -675,7 +754,7 @@ void CPU::SetOpcodes() {
 
 		SetFlagByValue(Flags::SF, result & 0x8000);
 		SetFlagByValue(Flags::ZF, result == 0);
-		SetFlagByValue(Flags::PF, parity[result]);
+		SetFlagByValue(Flags::PF, parity[result & 0xff]);
 
 		ClearFlag(Flags::OF);
 		ClearFlag(Flags::CF);
@@ -763,7 +842,7 @@ void CPU::SetOpcodes() {
 
 	// LODSB
 	m_Functions[0xac] = [this]() {
-		m_Registers.al = m_Bus->ReadByte((m_Registers.ds * 0x10) + m_Registers.si);
+		m_Registers.al = m_Bus->ReadByte(m_Registers.base[DS] + m_Registers.si);
 
 		if (!GetFlag(Flags::DF)) {
 			m_Registers.si++;
@@ -774,7 +853,7 @@ void CPU::SetOpcodes() {
 
 	// LODSW
 	m_Functions[0xad] = [this]() {
-		m_Registers.ax = m_Bus->ReadWord((m_Registers.ds * 0x10) + m_Registers.si);
+		m_Registers.ax = m_Bus->ReadWord(m_Registers.base[DS] + m_Registers.si);
 		
 		if (!GetFlag(Flags::DF)) {
 			m_Registers.si += 2;
@@ -786,11 +865,11 @@ void CPU::SetOpcodes() {
 	// ADD Eb, Gb
 	m_Functions[0x00] = [this]() {
 		ModRM modrm = FetchModRM(RegEncoding::Register8);
-		uint8_t src1 = modrm.modrm.Read8(m_Bus, m_Registers.ds);
+		uint8_t src1 = modrm.modrm.Read8(*m_Bus);
 		uint8_t src2 = modrm.reg.Read8();
 		uint8_t result = src1 + src2;
 
-		modrm.modrm.Write8(m_Bus, m_Registers.ds, result);
+		modrm.modrm.Write8(*m_Bus, result);
 
 		SetFlagByValue(Flags::CF, result < src1);
 		SetFlagByValue(Flags::OF, ((src1 ^ src2) & 0x80) == 0 && ((src1 ^ result) & 0x80) != 0);
@@ -803,11 +882,11 @@ void CPU::SetOpcodes() {
 	// ADD Ev, Gv
 	m_Functions[0x01] = [this]() {
 		ModRM modrm = FetchModRM(RegEncoding::Register16);
-		uint16_t src1 = modrm.modrm.Read16(m_Bus, m_Registers.ds);
+		uint16_t src1 = modrm.modrm.Read16(*m_Bus);
 		uint16_t src2 = modrm.reg.Read16();
 		uint16_t result = src1 + src2;
 
-		modrm.modrm.Write16(m_Bus, m_Registers.ds, result);
+		modrm.modrm.Write16(*m_Bus, result);
 
 		SetFlagByValue(Flags::CF, result < src1);
 		SetFlagByValue(Flags::OF, ((src1 ^ src2) & 0x8000) == 0 && ((src1 ^ result) & 0x8000) != 0);
@@ -821,7 +900,7 @@ void CPU::SetOpcodes() {
 	m_Functions[0x02] = [this]() {
 		ModRM modrm = FetchModRM(RegEncoding::Register8);
 		uint8_t src1 = modrm.reg.Read8();
-		uint8_t src2 = modrm.modrm.Read8(m_Bus, m_Registers.ds);
+		uint8_t src2 = modrm.modrm.Read8(*m_Bus);
 		uint8_t result = src1 + src2;
 
 		modrm.reg.Write8(result);
@@ -838,7 +917,7 @@ void CPU::SetOpcodes() {
 	m_Functions[0x03] = [this]() {
 		ModRM modrm = FetchModRM(RegEncoding::Register16);
 		uint16_t src1 = modrm.reg.Read16();
-		uint16_t src2 = modrm.modrm.Read16(m_Bus, m_Registers.ds);
+		uint16_t src2 = modrm.modrm.Read16(*m_Bus);
 		uint16_t result = src1 + src2;
 
 		modrm.reg.Write16(result);
@@ -898,6 +977,78 @@ void CPU::SetOpcodes() {
 	m_Functions[0xe9] = [this]() {
 		JumpRelative16(true, static_cast<int16_t>(Fetch16()));
 	};
+
+	// CALL Jv
+	m_Functions[0xe8] = [this]() {
+		int16_t rel = static_cast<int16_t>(Fetch16());
+		Push16(m_Registers.ip);
+
+		m_Registers.ip += rel;
+		EnterCall();
+	};
+
+	// CALL Ap
+	m_Functions[0x9a] = [this]() {
+		uint16_t new_ip = Fetch16();
+		uint16_t new_cs = Fetch16();
+
+		Push16(m_Registers.cs);
+		Push16(m_Registers.ip);
+
+		m_Registers.ip = new_ip;
+		LoadSegment(CS, new_cs);
+		EnterCall();
+	};
+
+	// RET Iw
+	m_Functions[0xc2] = [this]() {
+		uint16_t bytes = Fetch16();
+		m_Registers.ip = Pop16();
+		m_Registers.sp += bytes;
+		LeaveCall();
+	};
+
+	// RET
+	m_Functions[0xc3] = [this]() {
+		m_Registers.ip = Pop16();
+		LeaveCall();
+	};
+
+	// RETF Iw
+	m_Functions[0xca] = [this]() {
+		uint16_t bytes = Fetch16();
+		m_Registers.ip = Pop16();
+		LoadSegment(CS, Pop16());
+		m_Registers.sp += bytes;
+		LeaveCall();
+	};
+
+	// RETF
+	m_Functions[0xcb] = [this]() {
+		m_Registers.ip = Pop16();
+		LoadSegment(CS, Pop16());
+		LeaveCall();
+	};
+
+	// INT 3
+	m_Functions[0xcc] = [this]() {
+		SoftwareInterrupt(3);
+	};
+
+	// INT Ib
+	m_Functions[0xcd] = [this]() {
+		SoftwareInterrupt(Fetch8());
+	};
+
+	// IRET
+	m_Functions[0xcf] = [this]() {
+		m_Registers.ip = Pop16();
+		LoadSegment(CS, Pop16());
+
+		m_Pending = {};
+		m_Registers.flags = static_cast<Flags>(Pop16());
+		LeaveCall();
+	};
 }
 
 ModRM CPU::FetchModRM(bool w, RegEncoding encoding) {
@@ -907,141 +1058,343 @@ ModRM CPU::FetchModRM(bool w, RegEncoding encoding) {
 	uint8_t mod	= (byte & 0b11000000) >> 6;
 	uint8_t reg	= (byte & 0b00111000) >> 3;
 	uint8_t rm	= (byte & 0b00000111) >> 0;
-	
-	// REG (16-bit)
-	if (encoding == RegEncoding::Register16) {
-		result.reg.type = RegType::Register16;
-		switch (reg) {
-			case 0b000: result.reg.reg16 = &m_Registers.ax; break;
-			case 0b001: result.reg.reg16 = &m_Registers.cx; break;
-			case 0b010: result.reg.reg16 = &m_Registers.dx; break;
-			case 0b011: result.reg.reg16 = &m_Registers.bx; break;
-			case 0b100: result.reg.reg16 = &m_Registers.sp; break;
-			case 0b101: result.reg.reg16 = &m_Registers.bp; break;
-			case 0b110: result.reg.reg16 = &m_Registers.si; break;
-			case 0b111: result.reg.reg16 = &m_Registers.di; break;
+
+	result.reg.index = reg;
+	switch (encoding) {
+		// REG (16-bit)
+		case RegEncoding::Register16: {
+			result.reg.type = RegType::Register16;
+			result.reg.reg16 = &m_Registers.r16[reg];
+			break;
 		}
-	}
 
-	// REG (8-bit)
-	else if (encoding == RegEncoding::Register8) {
-		result.reg.type = RegType::Register8;
-		switch (reg) {
-			case 0b000: result.reg.reg8 = &m_Registers.al; break;
-			case 0b001: result.reg.reg8 = &m_Registers.cl; break;
-			case 0b010: result.reg.reg8 = &m_Registers.dl; break;
-			case 0b011: result.reg.reg8 = &m_Registers.bl; break;
-			case 0b100: result.reg.reg8 = &m_Registers.ah; break;
-			case 0b101: result.reg.reg8 = &m_Registers.ch; break;
-			case 0b110: result.reg.reg8 = &m_Registers.dh; break;
-			case 0b111: result.reg.reg8 = &m_Registers.bh; break;
+		// REG (8-bit)
+		case RegEncoding::Register8: {
+			result.reg.type = RegType::Register8;
+			result.reg.reg8 = &m_Registers.r8(reg);
+			break;
 		}
-	}
 
-	// REG (segment)
-	else if (encoding == RegEncoding::Segment) {
-		result.reg.type = RegType::Register16;
-		switch (reg) {
-			case 0b000: result.reg.reg16 = &m_Registers.es; break;
-			case 0b001: result.reg.reg16 = &m_Registers.cs; break;
-			case 0b010: result.reg.reg16 = &m_Registers.ss; break;
-			case 0b011: result.reg.reg16 = &m_Registers.ds; break;
+		// REG (segment), the 8086 only decodes the low two bits
+		case RegEncoding::Segment: {
+			result.reg.type = RegType::Register16;
+			result.reg.reg16 = &m_Registers.sreg[reg & 0b11];
+			break;
 		}
-	}
 
-	// REG (group)
-	else if (encoding == RegEncoding::Group) {
-		result.reg.type = RegType::Raw;
-		result.reg.group = reg;
+		// REG (group)
+		case RegEncoding::Group: {
+			result.reg.type = RegType::Raw;
+			result.reg.group = reg;
+			break;
+		}
 	}
 
-	// MOD = 00
-	if (mod == 0b00) {
-		result.modrm.type = ModRMType::Address;
-		switch (rm) {
-			case 0b000: result.modrm.addr = m_Registers.bx + m_Registers.si; break;
-			case 0b001: result.modrm.addr = m_Registers.bx + m_Registers.di; break;
-			case 0b010: result.modrm.addr = m_Registers.bp + m_Registers.si; break;
-			case 0b011: result.modrm.addr = m_Registers.bp + m_Registers.di; break;
-			case 0b100: result.modrm.addr = m_Registers.si; break;
-			case 0b101: result.modrm.addr = m_Registers.di; break;
-			case 0b110: result.modrm.addr = Fetch16(); break;
-			case 0b111: result.modrm.addr = m_Registers.bx; break;
+	// MOD = 11
+	if (mod == 0b11) {
+		if (w) {
+			result.modrm.type = ModRMType::Register16;
+			result.modrm.reg16 = &m_Registers.r16[rm];
+		} else {
+			result.modrm.type = ModRMType::Register8;
+			result.modrm.reg8 = &m_Registers.r8(rm);
 		}
 
 		return result;
 	}
 
-	// MOD = 01
-	else if (mod == 0b01) {
-		result.modrm.type = ModRMType::Address;
-		int8_t disp = static_cast<int8_t>(Fetch8());
-		switch (rm) {
-			case 0b000: result.modrm.addr = m_Registers.bx + m_Registers.si + disp; break;
-			case 0b001: result.modrm.addr = m_Registers.bx + m_Registers.di + disp; break;
-			case 0b010: result.modrm.addr = m_Registers.bp + m_Registers.si + disp; break;
-			case 0b011: result.modrm.addr = m_Registers.bp + m_Registers.di + disp; break;
-			case 0b100: result.modrm.addr = m_Registers.si + disp; break;
-			case 0b101: result.modrm.addr = m_Registers.di + disp; break;
-			case 0b110: result.modrm.addr = m_Registers.bp + disp; break;
-			case 0b111: result.modrm.addr = m_Registers.bx + disp; break;
-		}
+	// MOD = 00, 01, 10
+	// base + index + displacement. a mask of 0 drops a term, so [SI] is SI + (BX & 0) and the
+	// direct address form is just the displacement.
+	struct EffectiveAddress {
+		uint8_t base;
+		uint16_t base_mask;
+		uint8_t index;
+		uint16_t index_mask;
+		uint8_t segment;	// BP based addressing defaults to SS
+		uint8_t clocks;
+	};
+
+	static constexpr std::array<std::array<EffectiveAddress, 8>, 3> ea_table = {{
+		{{
+			{ BX, 0xffff, SI, 0xffff, DS, 7 },	// [BX + SI]
+			{ BX, 0xffff, DI, 0xffff, DS, 8 },	// [BX + DI]
+			{ BP, 0xffff, SI, 0xffff, SS, 8 },	// [BP + SI]
+			{ BP, 0xffff, DI, 0xffff, SS, 7 },	// [BP + DI]
+			{ SI, 0xffff, BX, 0x0000, DS, 5 },	// [SI]
+			{ DI, 0xffff, BX, 0x0000, DS, 5 },	// [DI]
+			{ BP, 0x0000, BX, 0x0000, DS, 6 },	// [disp16]
+			{ BX, 0xffff, BX, 0x0000, DS, 5 },	// [BX]
+		}},
+		{{
+			{ BX, 0xffff, SI, 0xffff, DS, 11 },	// [BX + SI + disp8]
+			{ BX, 0xffff, DI, 0xffff, DS, 12 },	// [BX + DI + disp8]
+			{ BP, 0xffff, SI, 0xffff, SS, 12 },	// [BP + SI + disp8]
+			{ BP, 0xffff, DI, 0xffff, SS, 11 },	// [BP + DI + disp8]
+			{ SI, 0xffff, BX, 0x0000, DS, 9 },	// [SI + disp8]
+			{ DI, 0xffff, BX, 0x0000, DS, 9 },	// [DI + disp8]
+			{ BP, 0xffff, BX, 0x0000, SS, 9 },	// [BP + disp8]
+			{ BX, 0xffff, BX, 0x0000, DS, 9 },	// [BX + disp8]
+		}},
+		{{
+			{ BX, 0xffff, SI, 0xffff, DS, 11 },	// [BX + SI + disp16]
+			{ BX, 0xffff, DI, 0xffff, DS, 12 },	// [BX + DI + disp16]
+			{ BP, 0xffff, SI, 0xffff, SS, 12 },	// [BP + SI + disp16]
+			{ BP, 0xffff, DI, 0xffff, SS, 11 },	// [BP + DI + disp16]
+			{ SI, 0xffff, BX, 0x0000, DS, 9 },	// [SI + disp16]
+			{ DI, 0xffff, BX, 0x0000, DS, 9 },	// [DI + disp16]
+			{ BP, 0xffff, BX, 0x0000, SS, 9 },	// [BP + disp16]
+			{ BX, 0xffff, BX, 0x0000, DS, 9 },	// [BX + disp16]
+		}},
+	}};
+
+	const EffectiveAddress& ea = ea_table[mod][rm];
+
+	uint16_t disp = 0;
+	if (mod == 0b01) {
+		disp = static_cast<uint16_t>(static_cast<int8_t>(Fetch8()));
+	} else if (mod == 0b10 || rm == 0b110) {
+		disp = Fetch16();
+	}
 
-		return result;
+	uint16_t offset = (m_Registers.r16[ea.base] & ea.base_mask) + (m_Registers.r16[ea.index] & ea.index_mask) + disp;
+
+	result.modrm.type = ModRMType::Address;
+	result.modrm.addr = (m_Registers.base[ea.segment] + offset) & 0xfffff;
+	m_Cycles += ea.clocks;
+
+	return result;
+}
+
+void CPU::ServiceInterrupt(uint8_t vector) {
+	MaterializeFlags();
+	Push16(static_cast<uint16_t>(m_Registers.flags));
+	Push16(m_Registers.cs);
+	Push16(m_Registers.ip);
+
+	ClearFlag(Flags::IF);
+	ClearFlag(Flags::TF);
+
+	m_Registers.ip = m_Bus->ReadWord(vector * 4 + 0);
+	LoadSegment(CS, m_Bus->ReadWord(vector * 4 + 2));
+	EnterCall();
+
+	m_Halted = false;
+}
+
+void CPU::SoftwareInterrupt(uint8_t vector) {
+	if (m_InterruptHooks[vector] && m_InterruptHooks[vector]()) {
+		return;
 	}
 
-	// MOD = 10
-	else if (mod == 0b10) {
-		result.modrm.type = ModRMType::Address;
-		switch (rm) {
-			case 0b000: result.modrm.addr = m_Registers.bx + m_Registers.si + Fetch16(); break;
-			case 0b001: result.modrm.addr = m_Registers.bx + m_Registers.di + Fetch16(); break;
-			case 0b010: result.modrm.addr = m_Registers.bp + m_Registers.si + Fetch16(); break;
-			case 0b011: result.modrm.addr = m_Registers.bp + m_Registers.di + Fetch16(); break;
-			case 0b100: result.modrm.addr = m_Registers.si + Fetch16(); break;
-			case 0b101: result.modrm.addr = m_Registers.di + Fetch16(); break;
-			case 0b110: result.modrm.addr = m_Registers.bp + Fetch16(); break;
-			case 0b111: result.modrm.addr = m_Registers.bx + Fetch16(); break;
-		}
+	ServiceInterrupt(vector);
+}
 
-		return result;
+void CPU::CheckIdleLoop() {
+	// landing back on the exact same state with nothing written since the last time round means
+	// every iteration from here on is identical, until a device event changes what the loop reads
+	uint64_t activity = m_Bus->GetActivity();
+	uint64_t retired = m_Bus->GetScheduler().GetInstructionCount();
+
+	// compared with any pending flags worked out, without landing them
+	Registers registers = m_Registers;
+	registers.flags = GetFlags();
+
+	if (activity == m_LoopActivity && retired - m_LoopRetired <= MaxIdleLoopLength &&
+		std::memcmp(&registers, &m_LoopRegisters, sizeof(Registers)) == 0) {
+		m_SpinIdle = true;
+	}
+
+	m_LoopRegisters = registers;
+	m_LoopActivity = activity;
+	m_LoopRetired = retired;
+}
+
+void CPU::Step() {
+	m_Cycles = 0;
+	m_SpinIdle = false;
+
+	if (m_Bus->IsINTRAsserted() && GetFlag(Flags::IF)) {
+		ServiceInterrupt(m_Bus->AcknowledgeInterrupt());
+		m_Cycles += 61;
+	}
+
+	// time still passes while halted, or a device that isn't idle would never get to its next event
+	if (m_Halted) {
+		m_Bus->GetScheduler().Idle(HaltedCycles);
+		return;
 	}
 
-	// MOD = 11 (16-bit)
-	if (w) {
-		result.modrm.type = ModRMType::Register16;
-		switch (rm) {
-			case 0b000: result.modrm.reg16 = &m_Registers.ax; break;
-			case 0b001: result.modrm.reg16 = &m_Registers.cx; break;
-			case 0b010: result.modrm.reg16 = &m_Registers.dx; break;
-			case 0b011: result.modrm.reg16 = &m_Registers.bx; break;
-			case 0b100: result.modrm.reg16 = &m_Registers.sp; break;
-			case 0b101: result.modrm.reg16 = &m_Registers.bp; break;
-			case 0b110: result.modrm.reg16 = &m_Registers.si; break;
-			case 0b111: result.modrm.reg16 = &m_Registers.di; break;
+	// one flag byte per page decides whether the breakpoint list needs a look
+	m_InstructionStart = m_Registers.ip;
+	uint32_t linear = m_Registers.base[CS] + m_Registers.ip;
+	Debugger& debugger = m_Bus->GetDebugger();
+	if (debugger.HasBreakpoint(linear)) [[unlikely]] {
+		if (debugger.CheckBreakpoint(linear, m_Registers.cs, m_Registers.ip)) {
+			return;
 		}
 	}
 
-	// MOD = 11 (8-bit)
-	else {
-		result.modrm.type = ModRMType::Register8;
-		switch (rm) {
-			case 0b000: result.modrm.reg8 = &m_Registers.al; break;
-			case 0b001: result.modrm.reg8 = &m_Registers.cl; break;
-			case 0b010: result.modrm.reg8 = &m_Registers.dl; break;
-			case 0b011: result.modrm.reg8 = &m_Registers.bl; break;
-			case 0b100: result.modrm.reg8 = &m_Registers.ah; break;
-			case 0b101: result.modrm.reg8 = &m_Registers.ch; break;
-			case 0b110: result.modrm.reg8 = &m_Registers.dh; break;
-			case 0b111: result.modrm.reg8 = &m_Registers.bh; break;
+	// rom code translated ahead of time runs as far as it can before anything else has to
+	// happen. its instruction fetches aren't real reads, so not while anything is watched
+	if (!m_Translated.empty() && !debugger.HasWatches()) {
+		uint32_t offset = linear - m_TranslatedBase;
+		if (offset < m_Translated.size() && m_Translated[offset]) {
+			TranslationContext context(*this);
+			m_Translated[offset](context);
+			return;
 		}
 	}
 
-	return result;
+	MarkCovered(linear);
+	Execute();
 }
 
-void CPU::Step() {
+void CPU::Execute() {
 	uint8_t opcode = Fetch8();
 	//std::println("{:02x}", opcode);
+	m_Cycles += timings[opcode];
 	m_Functions[opcode]();
+
+	m_Bus->GetScheduler().Retire(m_Cycles);
+}
+
+void CPU::AttachTranslation() {
+	m_Translated = {};
+	if (!m_TranslationEnabled) {
+		return;
+	}
+
+	const TranslationTable* table = GetTranslationTable(m_Bus->GetRomHash());
+	if (!table) {
+		return;
+	}
+
+	m_TranslatedBase = table->base;
+	m_Translated = table->blocks;
+}
+
+bool CPU::TryFuse(Fusion pair, const PendingFlags& pending) {
+	Scheduler& scheduler = m_Bus->GetScheduler();
+	if (!m_FusionEnabled || GetFlag(Flags::TF) || !scheduler.CanRetire(2)) {
+		return false;
+	}
+
+	// unfused, events due once the first instruction retires run before the jump
+	if (scheduler.GetNow() + m_Cycles >= scheduler.GetNextEventTime()) {
+		return false;
+	}
+
+	// and a watchpoint the first instruction hit stops the run before it
+	uint32_t linear = m_Registers.base[CS] + m_Registers.ip;
+	Debugger& debugger = m_Bus->GetDebugger();
+	if (debugger.HasHit() || debugger.HasBreakpoint(linear)) {
+		return false;
+	}
+
+	uint8_t opcode = m_Bus->PeekByte(linear);
+	if ((opcode & 0xf0) != 0x70) {
+		return false;
+	}
+
+	// unfused, an interrupt due once the first instruction retires would be taken before the jump
+	if (GetFlag(Flags::IF) && m_Bus->IsINTRAsserted(1)) {
+		return false;
+	}
+
+	// a pair left pending by the last fusion has to land first, DEC keeps its CF
+	MaterializeFlags();
+	m_Pending = pending;
+
+	scheduler.Retire(m_Cycles);
+	m_Cycles = timings[opcode];
+	m_InstructionStart = m_Registers.ip;
+	MarkCovered(linear);
+
+	// fetched for real, so watchpoints and faults on the jump's bytes still fire
+	Fetch8();
+	JumpRelative(TestPendingCondition(opcode & 0x0f), static_cast<int8_t>(Fetch8()));
+
+	m_FusionCounts[static_cast<size_t>(pair)][opcode & 0x0f]++;
+	return true;
+}
+
+bool CPU::TestPendingCondition(uint8_t condition) const {
+	const PendingFlags& p = m_Pending;
+
+	auto zf = [&]() { return p.result == 0; };
+	auto sf = [&]() { return (p.result & 0x8000) != 0; };
+	auto pf = [&]() { return parity[p.result & 0xff]; };
+
+	auto cf = [&]() {
+		switch (p.op) {
+			case LazyOp::Sub16: return p.a < p.b;
+			case LazyOp::Dec16: return (static_cast<uint16_t>(m_Registers.flags) & static_cast<uint16_t>(Flags::CF)) != 0;
+			default: return false;
+		}
+	};
+
+	auto of = [&]() {
+		switch (p.op) {
+			case LazyOp::Sub16: return ((p.a ^ p.b) & (p.a ^ p.result) & 0x8000) != 0;
+			case LazyOp::Dec16: return p.a == 0x8000;
+			default: return false;
+		}
+	};
+
+	bool result = false;
+	switch (condition >> 1) {
+		case 0: result = of(); break;
+		case 1: result = cf(); break;
+		case 2: result = zf(); break;
+		case 3: result = cf() || zf(); break;
+		case 4: result = sf(); break;
+		case 5: result = pf(); break;
+		case 6: result = sf() != of(); break;
+		case 7: result = zf() || sf() != of(); break;
+	}
+
+	// odd conditions are the negations of the even ones
+	return result != static_cast<bool>(condition & 1);
+}
+
+Flags CPU::ComputePendingFlags() const {
+	const PendingFlags& p = m_Pending;
+	uint16_t flags = static_cast<uint16_t>(m_Registers.flags);
+
+	auto set = [&](Flags flag, bool condition) {
+		if (condition) flags |= static_cast<uint16_t>(flag);
+		else flags &= ~static_cast<uint16_t>(flag);
+	};
+
+	set(Flags::SF, p.result & 0x8000);
+	set(Flags::ZF, p.result == 0);
+	set(Flags::PF, parity[p.result & 0xff]);
+
+	switch (p.op) {
+		case LazyOp::Sub16: {
+			set(Flags::CF, p.a < p.b);
+			set(Flags::OF, ((p.a ^ p.b) & 0x8000) != 0 && ((p.a ^ p.result) & 0x8000) != 0);
+			set(Flags::AF, (p.a & 0x0f) < (p.b & 0x0f));
+			break;
+		}
+
+		case LazyOp::Logic16: {
+			set(Flags::CF, false);
+			set(Flags::OF, false);
+			break;
+		}
+
+		case LazyOp::Dec16: {
+			set(Flags::OF, p.a == 0x8000);
+			set(Flags::AF, (p.a & 0x0f) == 0);
+			break;
+		}
+
+		case LazyOp::None: {
+			break;
+		}
+	}
+
+	return static_cast<Flags>(flags);
 }
\ No newline at end of file
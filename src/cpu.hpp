@@ -2,13 +2,18 @@
 #define CPU_HPP
 
 #include "component.hpp"
+#include "fpu.hpp"
 #include "types.hpp"
 
 #include <functional>
 #include <memory>
 #include <array>
+#include <cstring>
+#include <span>
 
 namespace xe86 {
+	class TranslationContext;
+
 	enum class Flags : uint16_t {
 		OF = 0b0000100000000000,
 		DF = 0b0000010000000000,
@@ -21,28 +26,51 @@ namespace xe86 {
 		CF = 0b0000000000000001,
 	};
 
+	// register numbers as the instruction encoding uses them
+	enum RegisterIndex : uint8_t { AX = 0, CX, DX, BX, SP, BP, SI, DI };
+	enum SegmentIndex : uint8_t { ES = 0, CS, SS, DS };
+
 	struct Registers {
-		// data group
-		union { Register16 ax; struct { Register8 al; Register8 ah; }; }; // AX - accumulator
-		union { Register16 bx; struct { Register8 bl; Register8 bh; }; }; // BX - base
-		union { Register16 cx; struct { Register8 cl; Register8 ch; }; }; // CX - count
-		union { Register16 dx; struct { Register8 dl; Register8 dh; }; }; // DX - data
-
-		// pointer and index group
-		Register16 sp; // SP - stack pointer
-		Register16 bp; // BP - base pointer
-		Register16 si; // SI - source index
-		Register16 di; // DI - destination index
-
-		// segment registers
-		SegmentRegister cs; // CS - code segment
-		SegmentRegister ds; // DS - data segment
-		SegmentRegister ss; // SS - stack segment
-		SegmentRegister es; // ES - extra segment
+		// general registers, indexable by the reg/rm field through r16
+		union {
+			std::array<Register16, 8> r16;
+			struct {
+				// data group
+				union { Register16 ax; struct { Register8 al; Register8 ah; }; }; // AX - accumulator
+				union { Register16 cx; struct { Register8 cl; Register8 ch; }; }; // CX - count
+				union { Register16 dx; struct { Register8 dl; Register8 dh; }; }; // DX - data
+				union { Register16 bx; struct { Register8 bl; Register8 bh; }; }; // BX - base
+
+				// pointer and index group
+				Register16 sp; // SP - stack pointer
+				Register16 bp; // BP - base pointer
+				Register16 si; // SI - source index
+				Register16 di; // DI - destination index
+			};
+		};
+
+		// segment registers, indexable through sreg. only ever written through CPU::LoadSegment
+		union {
+			std::array<SegmentRegister, 4> sreg;
+			struct {
+				SegmentRegister es; // ES - extra segment
+				SegmentRegister cs; // CS - code segment
+				SegmentRegister ss; // SS - stack segment
+				SegmentRegister ds; // DS - data segment
+			};
+		};
 
 		// other
 		Register16 ip; // IP - instruction pointer
 		Flags flags; // FLAGS - flags
+
+		// segment * 0x10 for each segment register, updated only when the segment is loaded
+		std::array<uint32_t, 4> base;
+
+		// AL, CL, DL, BL, AH, CH, DH, BH: low bytes of the first four registers, then their high bytes
+		Register8& r8(uint8_t index) {
+			return reinterpret_cast<Register8*>(r16.data())[((index & 0b011) << 1) | (index >> 2)];
+		}
 	};
 
 	enum class ModRMType {
@@ -71,12 +99,12 @@ namespace xe86 {
 		union {
 			uint16_t* reg16;	// use Read16() instead of accessing this directly
 			uint8_t* reg8;		// use Read8() instead of accessing this directly
-			uint16_t addr;		// use Read16() instead of accessing this directly
+			uint32_t addr;		// physical address, segment already applied. use Read16() instead of accessing this directly
 		};
 		
-		uint16_t Read16(std::shared_ptr<Bus> bus, uint16_t segment) {
+		uint16_t Read16(Bus& bus) {
 			switch (type) {
-				case ModRMType::Address: return bus->ReadWord((segment * 0x10) + addr);
+				case ModRMType::Address: return bus.ReadWord(addr);
 				case ModRMType::Register16: return *reg16;
 				case ModRMType::Register8: {
 					std::println(stderr, "reading 8-bit register as 16-bit!!");
@@ -85,9 +113,9 @@ namespace xe86 {
 			}
 		}
 
-		uint8_t Read8(std::shared_ptr<Bus> bus, uint16_t segment) {
+		uint8_t Read8(Bus& bus) {
 			switch (type) {
-				case ModRMType::Address: return bus->ReadByte((segment * 0x10) + addr);
+				case ModRMType::Address: return bus.ReadByte(addr);
 				case ModRMType::Register8: return *reg8;
 				case ModRMType::Register16: {
 					std::println(stderr, "reading 16-bit register as 8-bit!!");
@@ -96,9 +124,9 @@ namespace xe86 {
 			}
 		}
 
-		void Write16(std::shared_ptr<Bus> bus, uint16_t segment, uint16_t word) {
+		void Write16(Bus& bus, uint16_t word) {
 			switch (type) {
-				case ModRMType::Address: bus->WriteWord((segment * 0x10) + addr, word); break;
+				case ModRMType::Address: bus.WriteWord(addr, word); break;
 				case ModRMType::Register16: *reg16 = word; break;
 				case ModRMType::Register8: {
 					std::println(stderr, "writing 16-bit value to 8-bit register!!");
@@ -108,9 +136,9 @@ namespace xe86 {
 			}
 		}
 
-		void Write8(std::shared_ptr<Bus> bus, uint16_t segment, uint8_t byte) {
+		void Write8(Bus& bus, uint8_t byte) {
 			switch (type) {
-				case ModRMType::Address: bus->WriteByte((segment * 0x10) + addr, byte); break;
+				case ModRMType::Address: bus.WriteByte(addr, byte); break;
 				case ModRMType::Register8: *reg8 = byte; break;
 				case ModRMType::Register16: {
 					std::println(stderr, "writing 8-bit value to 16-bit register!!");
@@ -123,6 +151,7 @@ namespace xe86 {
 
 	struct RegPart {
 		RegType type;
+		uint8_t index;	// the raw reg field
 
 		// only one of these will be used at a time
 		union {
@@ -201,42 +230,344 @@ namespace xe86 {
 		false, true, true, false, true, false, false, true, true, false, false, true, false, true, true, false
 	};
 
-	class CPU : public Component {
+	// base 8086 clock counts, register operand forms. effective address calculation is added on top
+	// by FetchModRM and taken branches add their own penalty, so this is close enough to pace devices.
+	static constexpr std::array<uint8_t, 256> timings = [] {
+		std::array<uint8_t, 256> t{};
+		t.fill(4);
+
+		for (int op : { 0x00, 0x01, 0x02, 0x03, 0x08, 0x09, 0x0a, 0x0b, 0x20, 0x21, 0x22, 0x23, 0x33, 0x85 }) t[op] = 3;
+		for (int op = 0x40; op <= 0x4f; op++) t[op] = 2;	// INC/DEC r16
+		for (int op = 0x70; op <= 0x7f; op++) t[op] = 4;	// Jcc, not taken
+		for (int op = 0x88; op <= 0x8e; op++) t[op] = 2;	// MOV r/m
+		for (int op = 0xa0; op <= 0xa3; op++) t[op] = 10;	// MOV acc, moffs
+		for (int op = 0xb8; op <= 0xbf; op++) t[op] = 4;	// MOV r16, imm
+
+		for (int op = 0xd8; op <= 0xdf; op++) t[op] = 2;	// ESC, register forms
+
+		t[0x9a] = 28;					// CALL far
+		t[0x9b] = 3;					// WAIT, if the 8087 isn't busy
+		t[0xa4] = 18; t[0xa5] = 18;		// MOVS
+		t[0xac] = 12; t[0xad] = 12;		// LODS
+		t[0xc2] = 20; t[0xc3] = 16;		// RET
+		t[0xc6] = 10; t[0xc7] = 10;		// MOV r/m, imm
+		t[0xca] = 25; t[0xcb] = 26;		// RETF
+		t[0xcc] = 52; t[0xcd] = 51;		// INT
+		t[0xcf] = 24;					// IRET
+		t[0xe2] = 5;					// LOOP, not taken
+		t[0xe4] = 10; t[0xe5] = 10;		// IN imm
+		t[0xe6] = 10; t[0xe7] = 10;		// OUT imm
+		t[0xe8] = 19;					// CALL
+		t[0xe9] = 3; t[0xeb] = 3;		// JMP, plus the taken branch penalty
+		t[0xea] = 15;					// JMP far
+		t[0xec] = 8; t[0xed] = 8;		// IN DX
+		t[0xee] = 8; t[0xef] = 8;		// OUT DX
+		t[0xf4] = 2;					// HLT
+		t[0xf7] = 5;					// GRP3
+		t[0xfa] = 2; t[0xfc] = 2;		// CLI, CLD
+
+		return t;
+	}();
+
+	class CPU final : public Component {
+		friend class TranslationContext;
+
 	public:
-		CPU(std::shared_ptr<Bus> bus) : Component(bus, "CPU") {
+		CPU(const CPU&) = delete;
+		CPU& operator=(const CPU&) = delete;
+
+		CPU(std::shared_ptr<Bus> bus) : Component(bus, "CPU"), m_Fpu(*bus) {
 			// fill m_Functions with invalid opcodes
 			m_Functions.resize(256);
 			std::fill(m_Functions.begin(), m_Functions.end(), [this]() { InvalidOpcode(); });
 
 			// now set the proper opcodes
 			SetOpcodes();
+
+			m_Bus->GetDebugger().SetRegisterReader([this](uint8_t index) -> uint16_t {
+				if (index < 8) return m_Registers.r16[index];
+				if (index < 12) return m_Registers.sreg[index - 8];
+				if (index == Debugger::IP) return m_InstructionStart;
+				return static_cast<uint16_t>(GetFlags());
+			});
 		}
 
 		void Reset() override {
-			// CS:IP = FFFF:0000 on 8086
-			m_Registers.cs = 0xffff;
+			// CS:IP = FFFF:0000 on 8086, everything else cleared
+			LoadSegment(CS, 0xffff);
+			LoadSegment(DS, 0x0000);
+			LoadSegment(SS, 0x0000);
+			LoadSegment(ES, 0x0000);
+
 			m_Registers.ip = 0x0000;
+			m_Registers.flags = static_cast<Flags>(0);
+			m_Pending = {};
+
+			m_Halted = false;
+			m_SpinIdle = false;
+			m_CallDepth = 0;
+
+			m_Fpu.Reset();
+			m_FpuBusyUntil = 0;
+
+			AttachTranslation();
 		}
 
 		void Step() override;
 
+		void SaveState(StateWriter& state) const override {
+			// flags a fused pair left pending are saved as they would have been set
+			Registers registers = m_Registers;
+			registers.flags = GetFlags();
+
+			state.Write(registers);
+			state.Write(m_Halted);
+			state.Write(m_SpinIdle);
+			state.Write(m_LoopRegisters);
+			state.Write(m_LoopActivity);
+			state.Write(m_LoopRetired);
+
+			m_Fpu.SaveState(state);
+			state.Write(m_FpuBusyUntil);
+		}
+
+		void LoadState(StateReader& state) override {
+			state.Read(m_Registers);
+			state.Read(m_Halted);
+			state.Read(m_SpinIdle);
+			state.Read(m_LoopRegisters);
+			state.Read(m_LoopActivity);
+			state.Read(m_LoopRetired);
+			m_Pending = {};
+
+			m_Fpu.LoadState(state);
+			state.Read(m_FpuBusyUntil);
+
+			// the call stack isn't machine state, and the one we had belongs to the timeline we left
+			m_CallDepth = 0;
+		}
+
+		// calls and interrupts entered and not yet returned from, outermost first. it is only a
+		// record for profilers and debuggers, kept in step with the stack pointer: a return
+		// drops every frame at or below the stack it returns to, so code that unwinds the stack
+		// by hand doesn't leave stale frames behind for long.
+		struct CallFrame {
+			uint32_t target;	// linear address called
+			uint16_t sp;		// stack pointer just after the return address was pushed
+		};
+
+		static constexpr size_t MaxCallDepth = 64;
+
+		std::span<const CallFrame> GetCallStack() const { return { m_CallStack.data(), m_CallDepth }; }
+
+		uint32_t GetLinearIP() const { return (m_Registers.base[CS] + m_Registers.ip) & 0xfffff; }
+
+		/*
+		MACRO-OP FUSION
+			a compare, test or decrement followed by a conditional jump runs as one fused step: the
+			first instruction peeks at the next opcode, and if it's a Jcc the jump is taken or not
+			straight from the operands, without going back through dispatch. the flags are left
+			pending and only worked out when something reads or changes them, which for most loops
+			is the next compare.
+
+			each instruction still retires on its own, so instruction counts, journals and replays
+			are the same as unfused. the pair isn't fused when something could happen between the
+			two: single stepping, a breakpoint on the page, or an interrupt due after the first.
+		*/
+		enum class Fusion : uint8_t {
+			CmpJcc,		// CMP Ev, Iv then Jcc
+			TestJcc,	// TEST Ev, Gv then Jcc
+			DecJcc,		// DEC r16 then Jcc
+			Count,
+		};
+
+		void SetFusion(bool enabled) { m_FusionEnabled = enabled; }
+
+		// how often a pair fused, by the condition (0-15, as in opcodes 70h-7Fh) of its jump
+		uint64_t GetFusionCount(Fusion pair, uint8_t condition) const {
+			return m_FusionCounts[static_cast<size_t>(pair)][condition & 0x0f];
+		}
+
+		static const char* GetFusionName(Fusion pair) {
+			constexpr const char* names[] = { "cmp", "test", "dec" };
+			return names[static_cast<size_t>(pair)];
+		}
+
+		static const char* GetConditionName(uint8_t condition) {
+			constexpr const char* names[] = {
+				"jo", "jno", "jb", "jnb", "jz", "jnz", "jbe", "ja",
+				"js", "jns", "jp", "jnp", "jl", "jge", "jle", "jg",
+			};
+
+			return names[condition & 0x0f];
+		}
+
+		// whether there's an 8087 in the socket. without one ESC instructions still fetch their
+		// operand's address and then do nothing, which is how software finds out
+		void SetFpu(bool present) { m_FpuPresent = present; }
+
+		// hand the 8087's basic arithmetic to the host where that gives the same result
+		void SetFastMath(bool enabled) { m_Fpu.SetFastMath(enabled); }
+
+		const FPU& GetFpu() const { return m_Fpu; }
+
+		// use code translated from the rom ahead of time, when there is some for the rom on the bus
+		void SetTranslation(bool enabled) {
+			m_TranslationEnabled = enabled;
+			AttachTranslation();
+		}
+
+		uint64_t GetTranslatedInstructions() const { return m_TranslatedInstructions; }
+
+		// a byte per linear address, 1 MB of them, set to 1 where an instruction starts executing.
+		// null turns it off
+		void SetCoverageMap(uint8_t* map) { m_CoverageMap = map; }
+
+		// an opcode the cpu doesn't implement dumps the registers and exits, unless there is a
+		// handler. then the cpu halts where it is and the handler is called instead
+		void SetInvalidOpcodeHandler(std::function<void()> handler) { m_InvalidOpcodeHandler = std::move(handler); }
+
+		// services written on the host side (a high-level DOS, BIOS calls) hook INT n instructions.
+		// a hook returning true has handled the call and execution carries on after the INT, false
+		// lets it go through the vector table as usual. hardware interrupts are never hooked
+		void SetInterruptHook(uint8_t vector, std::function<bool()> hook) { m_InterruptHooks[vector] = std::move(hook); }
+
+		// for loaders and hooks standing in for guest code. flags are up to date while the
+		// reference is held, segments must be changed through SetSegment
+		Registers& GetRegisters() {
+			MaterializeFlags();
+			return m_Registers;
+		}
+
+		void SetSegment(uint8_t segment, SegmentRegister value) { LoadSegment(segment, value); }
+
+		// halted with no interrupt able to wake us, or spinning in a loop that can't change anything
+		bool IsIdle() const override {
+			return (m_Halted && !(m_Bus->IsINTRAsserted() && GetFlag(Flags::IF))) || m_SpinIdle;
+		}
+
 	private:
 		void InvalidOpcode();
 		void SetOpcodes();
 
+		void ServiceInterrupt(uint8_t vector);
+		void SoftwareInterrupt(uint8_t vector);
+		void CheckIdleLoop();
+
+		// fetch, dispatch and retire one instruction
+		void Execute();
+
+		// one store per instruction while coverage is on
+		void MarkCovered(uint32_t linear) {
+			if (m_CoverageMap) [[unlikely]] {
+				m_CoverageMap[linear & 0xfffff] = 1;
+			}
+		}
+
+		void AttachTranslation();
+
+		// flags as the first half of a fused pair would have set them
+		enum class LazyOp : uint8_t {
+			None,
+			Sub16,		// OSZAPC from a - b
+			Logic16,	// SZP from result, OF and CF cleared
+			Dec16,		// OSZAP from a - 1, CF kept
+		};
+
+		struct PendingFlags {
+			LazyOp op = LazyOp::None;
+			uint16_t a = 0;
+			uint16_t b = 0;
+			uint16_t result = 0;
+
+		};
+
+		// called by the first instruction of a pair once it has its result. returns true if the
+		// jump after it ran too, in which case the first instruction must not set its own flags
+		bool TryFuse(Fusion pair, const PendingFlags& pending);
+
+		// a Jcc condition, looking only at the flags it needs
+		bool TestPendingCondition(uint8_t condition) const;
+
+		Flags GetFlags() const {
+			if (m_Pending.op == LazyOp::None) [[likely]] {
+				return m_Registers.flags;
+			}
+
+			return ComputePendingFlags();
+		}
+
+		Flags ComputePendingFlags() const;
+
+		void MaterializeFlags() {
+			if (m_Pending.op != LazyOp::None) [[unlikely]] {
+				m_Registers.flags = ComputePendingFlags();
+				m_Pending.op = LazyOp::None;
+			}
+		}
+
 	private:
+		// a taken branch flushes the prefetch queue
+		static constexpr Cycles BranchPenalty = 12;
+
+		// loops longer than this are real work, not polling
+		static constexpr uint64_t MaxIdleLoopLength = 16;
+
+		// how long a halted cpu waits per step when a busy device keeps the machine from fast-forwarding
+		static constexpr Cycles HaltedCycles = 4;
+
 		void JumpRelative(bool condition, int8_t rel) {
 			if (condition) {
 				m_Registers.ip += rel;
+				m_Cycles += BranchPenalty;
+
+				if (rel < 0) {
+					CheckIdleLoop();
+				}
 			}
 		}
 
 		void JumpRelative16(bool condition, int16_t rel) {
 			if (condition) {
 				m_Registers.ip += rel;
+				m_Cycles += BranchPenalty;
+
+				if (rel < 0) {
+					CheckIdleLoop();
+				}
 			}
 		}
 
+		void Push16(uint16_t word) {
+			m_Registers.sp -= 2;
+			m_Bus->WriteWord(m_Registers.base[SS] + m_Registers.sp, word);
+		}
+
+		uint16_t Pop16() {
+			uint16_t word = m_Bus->ReadWord(m_Registers.base[SS] + m_Registers.sp);
+			m_Registers.sp += 2;
+			return word;
+		}
+
+		// after a call or interrupt has pushed its return address and loaded CS:IP
+		void EnterCall() {
+			if (m_CallDepth < MaxCallDepth) {
+				m_CallStack[m_CallDepth++] = { GetLinearIP(), m_Registers.sp };
+			}
+		}
+
+		// after a return has popped its return address
+		void LeaveCall() {
+			while (m_CallDepth > 0 && m_CallStack[m_CallDepth - 1].sp < m_Registers.sp) {
+				m_CallDepth--;
+			}
+		}
+
+		void LoadSegment(uint8_t segment, SegmentRegister value) {
+			m_Registers.sreg[segment] = value;
+			m_Registers.base[segment] = static_cast<uint32_t>(value) << 4;
+		}
+
 	private:
 		ModRM FetchModRM(bool w, RegEncoding encoding);
 		
@@ -249,7 +580,7 @@ namespace xe86 {
 		}
 
 		uint8_t Fetch8() {
-			return m_Bus->ReadByte(Address20(m_Registers.cs, m_Registers.ip++));
+			return m_Bus->ReadByte(m_Registers.base[CS] + m_Registers.ip++);
 		}
 
 		uint16_t Fetch16() {
@@ -259,11 +590,14 @@ namespace xe86 {
 		}
 
 		void ClearFlag(Flags flag) {
+			MaterializeFlags();
+
 			// maybe i shouldnt use enum class
 			m_Registers.flags = static_cast<Flags>(static_cast<uint16_t>(m_Registers.flags) & ~static_cast<uint16_t>(flag));
 		}
 
 		void SetFlag(Flags flag) {
+			MaterializeFlags();
 			m_Registers.flags = static_cast<Flags>(static_cast<uint16_t>(m_Registers.flags) | static_cast<uint16_t>(flag));
 		}
 
@@ -272,11 +606,12 @@ namespace xe86 {
 			else ClearFlag(flag);
 		}
 
-		bool GetFlag(Flags flag) {
-			return (static_cast<uint16_t>(m_Registers.flags) & static_cast<uint16_t>(flag)) != 0;
+		bool GetFlag(Flags flag) const {
+			return (static_cast<uint16_t>(GetFlags()) & static_cast<uint16_t>(flag)) != 0;
 		}
 
 		void Dump() {
+			MaterializeFlags();
 			std::println(
 				"ax = {:04x} bx = {:04x} cx = {:04x} dx = {:04x}\n"
 				"sp = {:04x} bp = {:04x} si = {:04x} di = {:04x}\n"
@@ -297,8 +632,43 @@ namespace xe86 {
 		}
 		
 	private:
-		Registers m_Registers;
+		Registers m_Registers{};
 		std::vector<std::function<void()>> m_Functions;
+		std::function<void()> m_InvalidOpcodeHandler;
+		std::array<std::function<bool()>, 256> m_InterruptHooks;
+
+		// cycles spent by the instruction currently executing, and where it started
+		Cycles m_Cycles = 0;
+		uint16_t m_InstructionStart = 0;
+
+		bool m_Halted = false;
+		bool m_SpinIdle = false;
+
+		PendingFlags m_Pending;
+		bool m_FusionEnabled = true;
+		std::array<std::array<uint64_t, 16>, static_cast<size_t>(Fusion::Count)> m_FusionCounts{};
+
+		// translated blocks by offset from m_TranslatedBase, empty without a translation. the table
+		// belongs to the process, every cpu running the same rom looks into the same one
+		std::span<void (* const)(TranslationContext&)> m_Translated;
+		uint32_t m_TranslatedBase = 0;
+		bool m_TranslationEnabled = true;
+		uint64_t m_TranslatedInstructions = 0;
+
+		uint8_t* m_CoverageMap = nullptr;
+
+		// the 8087 works alongside, only WAIT has to catch up with it
+		FPU m_Fpu;
+		bool m_FpuPresent = true;
+		Cycles m_FpuBusyUntil = 0;
+
+		std::array<CallFrame, MaxCallDepth> m_CallStack{};
+		size_t m_CallDepth = 0;
+
+		// state at the last backward branch, to spot loops that repeat without side effects
+		Registers m_LoopRegisters{};
+		uint64_t m_LoopActivity = 0;
+		uint64_t m_LoopRetired = 0;
 	};
 }
 
@@ -0,0 +1,436 @@
+#include "debugger.hpp"
+#include <print>
+#include <string>
+#include <cctype>
+#include <algorithm>
+
+using namespace xe86;
+
+namespace {
+	struct NamedRegister {
+		std::string_view name;
+		Condition::Op op;
+		uint8_t index;
+	};
+
+	constexpr std::array<NamedRegister, 22> registers = {{
+		{ "ax", Condition::Op::Register, 0 }, { "cx", Condition::Op::Register, 1 },
+		{ "dx", Condition::Op::Register, 2 }, { "bx", Condition::Op::Register, 3 },
+		{ "sp", Condition::Op::Register, 4 }, { "bp", Condition::Op::Register, 5 },
+		{ "si", Condition::Op::Register, 6 }, { "di", Condition::Op::Register, 7 },
+		{ "es", Condition::Op::Register, 8 }, { "cs", Condition::Op::Register, 9 },
+		{ "ss", Condition::Op::Register, 10 }, { "ds", Condition::Op::Register, 11 },
+		{ "ip", Condition::Op::Register, Debugger::IP }, { "flags", Condition::Op::Register, Debugger::FLAGS },
+		{ "al", Condition::Op::Register8, 0 }, { "cl", Condition::Op::Register8, 1 },
+		{ "dl", Condition::Op::Register8, 2 }, { "bl", Condition::Op::Register8, 3 },
+		{ "ah", Condition::Op::Register8, 4 }, { "ch", Condition::Op::Register8, 5 },
+		{ "dh", Condition::Op::Register8, 6 }, { "bh", Condition::Op::Register8, 7 },
+	}};
+
+	// recursive descent, emitting postfix code as it goes
+	class Parser {
+	public:
+		Parser(std::string_view text, std::vector<Condition::Instruction>& code) : m_Text(text), m_Code(code) {}
+
+		bool Parse() {
+			Next();
+			if (!Expression(0)) {
+				return false;
+			}
+
+			if (!m_Token.empty()) {
+				return Fail("unexpected '{}'");
+			}
+
+			return true;
+		}
+
+		const std::string& GetError() const { return m_Error; }
+
+	private:
+		struct Binary {
+			std::string_view token;
+			int precedence;
+			Condition::Op op;
+		};
+
+		static constexpr std::array<Binary, 13> binaries = {{
+			{ "||", 1, Condition::Op::LogicalOr }, { "&&", 2, Condition::Op::LogicalAnd },
+			{ "|", 3, Condition::Op::Or }, { "^", 4, Condition::Op::Xor }, { "&", 5, Condition::Op::And },
+			{ "==", 6, Condition::Op::Eq }, { "!=", 6, Condition::Op::Ne },
+			{ "<", 7, Condition::Op::Lt }, { "<=", 7, Condition::Op::Le },
+			{ ">", 7, Condition::Op::Gt }, { ">=", 7, Condition::Op::Ge },
+			{ "+", 8, Condition::Op::Add }, { "-", 8, Condition::Op::Sub },
+		}};
+
+		void Next() {
+			while (m_Cursor < m_Text.size() && std::isspace(static_cast<unsigned char>(m_Text[m_Cursor]))) {
+				m_Cursor++;
+			}
+
+			size_t start = m_Cursor;
+			if (m_Cursor >= m_Text.size()) {
+				m_Token = {};
+				return;
+			}
+
+			char c = m_Text[m_Cursor];
+			if (std::isalnum(static_cast<unsigned char>(c)) || c == '_') {
+				while (m_Cursor < m_Text.size() && (std::isalnum(static_cast<unsigned char>(m_Text[m_Cursor])) || m_Text[m_Cursor] == '_')) {
+					m_Cursor++;
+				}
+			} else {
+				// two character operators first
+				std::string_view two = m_Text.substr(m_Cursor, 2);
+				m_Cursor += (two == "||" || two == "&&" || two == "==" || two == "!=" || two == "<=" || two == ">=") ? 2 : 1;
+			}
+
+			m_Token = m_Text.substr(start, m_Cursor - start);
+		}
+
+		void Emit(Condition::Op op, uint32_t operand = 0) {
+			m_Code.push_back({ op, operand });
+		}
+
+		bool Fail(std::string_view what) {
+			m_Error = std::string(what);
+			size_t at = m_Error.find("{}");
+			if (at != std::string::npos) {
+				m_Error.replace(at, 2, m_Token.empty() ? std::string_view("end of condition") : m_Token);
+			}
+
+			return false;
+		}
+
+		// precedence climbing over the binary operators
+		bool Expression(int minimum) {
+			if (!Unary()) {
+				return false;
+			}
+
+			while (true) {
+				auto binary = std::find_if(binaries.begin(), binaries.end(), [this](const Binary& b) { return b.token == m_Token; });
+				if (binary == binaries.end() || binary->precedence <= minimum) {
+					return true;
+				}
+
+				Next();
+				if (!Expression(binary->precedence)) {
+					return false;
+				}
+
+				Emit(binary->op);
+			}
+		}
+
+		bool Unary() {
+			Condition::Op op;
+			if (m_Token == "!") {
+				op = Condition::Op::Not;
+			} else if (m_Token == "-") {
+				op = Condition::Op::Negate;
+			} else if (m_Token == "~") {
+				op = Condition::Op::Complement;
+			} else {
+				return Primary();
+			}
+
+			Next();
+			if (!Unary()) {
+				return false;
+			}
+
+			Emit(op);
+			return true;
+		}
+
+		bool Primary() {
+			if (m_Token.empty()) {
+				return Fail("expected a value at {}");
+			}
+
+			if (m_Token == "(") {
+				Next();
+				if (!Expression(0)) {
+					return false;
+				}
+
+				if (m_Token != ")") {
+					return Fail("expected ')' at {}");
+				}
+
+				Next();
+				return true;
+			}
+
+			if (std::isdigit(static_cast<unsigned char>(m_Token[0]))) {
+				std::string number(m_Token);
+				size_t used = 0;
+				unsigned long value = 0;
+
+				try {
+					value = std::stoul(number, &used, 0);
+				} catch (...) {
+					used = 0;
+				}
+
+				if (used != number.size()) {
+					return Fail("bad number '{}'");
+				}
+
+				Emit(Condition::Op::Const, static_cast<uint32_t>(value));
+				Next();
+				return true;
+			}
+
+			if (m_Token == "byte" || m_Token == "word") {
+				Condition::Op op = m_Token == "byte" ? Condition::Op::LoadByte : Condition::Op::LoadWord;
+
+				Next();
+				if (m_Token != "[") {
+					return Fail("expected '[' at {}");
+				}
+
+				Next();
+				if (!Expression(0)) {
+					return false;
+				}
+
+				if (m_Token != "]") {
+					return Fail("expected ']' at {}");
+				}
+
+				Emit(op);
+				Next();
+				return true;
+			}
+
+			if (m_Token == "value" || m_Token == "address") {
+				Emit(m_Token == "value" ? Condition::Op::Value : Condition::Op::Address);
+				Next();
+				return true;
+			}
+
+			for (const NamedRegister& reg : registers) {
+				if (reg.name == m_Token) {
+					Emit(reg.op, reg.index);
+					Next();
+					return true;
+				}
+			}
+
+			return Fail("unknown name '{}'");
+		}
+
+	private:
+		std::string_view m_Text;
+		size_t m_Cursor = 0;
+		std::string_view m_Token;
+
+		std::vector<Condition::Instruction>& m_Code;
+		std::string m_Error;
+	};
+}
+
+std::optional<Condition> Condition::Compile(std::string_view text) {
+	Condition condition;
+	if (text.find_first_not_of(" \t") == std::string_view::npos) {
+		return condition;
+	}
+
+	Parser parser(text, condition.m_Code);
+	if (!parser.Parse()) {
+		std::println(stderr, "debugger: bad condition '{}': {}", text, parser.GetError());
+		return std::nullopt;
+	}
+
+	// every instruction pushes one value, binaries pop two. check the stack bound once here
+	size_t depth = 0;
+	for (const Instruction& instruction : condition.m_Code) {
+		if (instruction.op >= Op::Add) {
+			depth--;
+		} else if (instruction.op < Op::LoadByte) {
+			depth++;
+		}
+
+		if (depth > MaxDepth) {
+			std::println(stderr, "debugger: condition '{}' is nested too deeply", text);
+			return std::nullopt;
+		}
+	}
+
+	return condition;
+}
+
+bool Condition::Evaluate(const Context& context) const {
+	if (m_Code.empty()) {
+		return true;
+	}
+
+	std::array<uint32_t, MaxDepth> stack;
+	size_t top = 0;
+
+	auto read_register = [&context](uint8_t index) -> uint32_t {
+		return context.registers ? context.registers(index) : 0;
+	};
+
+	auto read_memory = [&context](uint32_t address) -> uint32_t {
+		return context.memory ? context.memory(address & 0xfffff) : 0;
+	};
+
+	for (const Instruction& instruction : m_Code) {
+		uint32_t b = top > 0 ? stack[top - 1] : 0;
+		uint32_t a = top > 1 ? stack[top - 2] : 0;
+
+		switch (instruction.op) {
+		case Op::Const: stack[top++] = instruction.operand; break;
+		case Op::Register: stack[top++] = read_register(static_cast<uint8_t>(instruction.operand)); break;
+		case Op::Register8: {
+			uint32_t word = read_register(instruction.operand & 0b11);
+			stack[top++] = (instruction.operand & 0b100 ? word >> 8 : word) & 0xff;
+			break;
+		}
+		case Op::Value: stack[top++] = context.value; break;
+		case Op::Address: stack[top++] = context.address; break;
+
+		case Op::LoadByte: stack[top - 1] = read_memory(b); break;
+		case Op::LoadWord: stack[top - 1] = read_memory(b) | (read_memory(b + 1) << 8); break;
+		case Op::Not: stack[top - 1] = !b; break;
+		case Op::Negate: stack[top - 1] = -b; break;
+		case Op::Complement: stack[top - 1] = ~b; break;
+
+		case Op::Add: stack[--top - 1] = a + b; break;
+		case Op::Sub: stack[--top - 1] = a - b; break;
+		case Op::And: stack[--top - 1] = a & b; break;
+		case Op::Or: stack[--top - 1] = a | b; break;
+		case Op::Xor: stack[--top - 1] = a ^ b; break;
+		case Op::Eq: stack[--top - 1] = a == b; break;
+		case Op::Ne: stack[--top - 1] = a != b; break;
+		case Op::Lt: stack[--top - 1] = a < b; break;
+		case Op::Le: stack[--top - 1] = a <= b; break;
+		case Op::Gt: stack[--top - 1] = a > b; break;
+		case Op::Ge: stack[--top - 1] = a >= b; break;
+		case Op::LogicalAnd: stack[--top - 1] = a && b; break;
+		case Op::LogicalOr: stack[--top - 1] = a || b; break;
+		}
+	}
+
+	return top > 0 && stack[top - 1] != 0;
+}
+
+Debugger::BreakpointId Debugger::Add(Breakpoint breakpoint, std::string_view condition) {
+	auto compiled = Condition::Compile(condition);
+	if (!compiled) {
+		return 0;
+	}
+
+	breakpoint.id = m_NextId++;
+	breakpoint.condition = std::move(*compiled);
+	m_Breakpoints.push_back(std::move(breakpoint));
+
+	UpdatePageFlags();
+	return m_Breakpoints.back().id;
+}
+
+Debugger::BreakpointId Debugger::AddBreakpoint(uint32_t address, std::string_view condition) {
+	address &= 0xfffff;
+	return Add({ 0, Execute, address, address, false, 0, 0, {} }, condition);
+}
+
+Debugger::BreakpointId Debugger::AddBreakpoint(uint16_t cs, uint16_t ip, std::string_view condition) {
+	uint32_t address = ((cs << 4) + ip) & 0xfffff;
+	return Add({ 0, Execute, address, address, true, cs, ip, {} }, condition);
+}
+
+Debugger::BreakpointId Debugger::AddWatchpoint(uint32_t start, uint32_t end, uint8_t access, std::string_view condition) {
+	start &= 0xfffff;
+	end &= 0xfffff;
+	return Add({ 0, static_cast<uint8_t>(access & (Read | Write)), start, std::max(start, end), false, 0, 0, {} }, condition);
+}
+
+bool Debugger::Remove(BreakpointId id) {
+	auto it = std::find_if(m_Breakpoints.begin(), m_Breakpoints.end(), [id](const Breakpoint& b) { return b.id == id; });
+	if (it == m_Breakpoints.end()) {
+		return false;
+	}
+
+	m_Breakpoints.erase(it);
+	UpdatePageFlags();
+	return true;
+}
+
+void Debugger::UpdatePageFlags() {
+	m_PageFlags.fill(0);
+	m_HasWatches = false;
+
+	for (const Breakpoint& breakpoint : m_Breakpoints) {
+		m_HasWatches |= (breakpoint.access & (Read | Write)) != 0;
+
+		for (size_t page = breakpoint.start >> PageShift; page <= breakpoint.end >> PageShift; page++) {
+			m_PageFlags[page] |= breakpoint.access;
+		}
+	}
+}
+
+bool Debugger::Test(const Breakpoint& breakpoint, uint32_t address, uint8_t value) const {
+	Condition::Context context{ m_Registers, m_Memory, address, value };
+	return breakpoint.condition.Evaluate(context);
+}
+
+bool Debugger::CheckBreakpoint(uint32_t address, uint16_t cs, uint16_t ip) {
+	address &= 0xfffff;
+
+	// resuming from this very breakpoint
+	if (m_Resume == address) {
+		m_Resume.reset();
+		return false;
+	}
+
+	for (const Breakpoint& breakpoint : m_Breakpoints) {
+		if (!(breakpoint.access & Execute) || breakpoint.start != address) {
+			continue;
+		}
+
+		if (breakpoint.match_cs_ip && (breakpoint.cs != cs || breakpoint.ip != ip)) {
+			continue;
+		}
+
+		if (Test(breakpoint, address, 0)) {
+			if (!m_Hit) {
+				m_Hit = Hit{ breakpoint.id, Execute, address, 0, cs, ip };
+			}
+
+			m_Resume = address;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void Debugger::CheckWatch(uint32_t address, uint8_t value, Access access) {
+	address &= 0xfffff;
+
+	for (const Breakpoint& breakpoint : m_Breakpoints) {
+		if (!(breakpoint.access & access) || address < breakpoint.start || address > breakpoint.end) {
+			continue;
+		}
+
+		if (Test(breakpoint, address, value)) {
+			// the first hit of an instruction is the one reported
+			if (!m_Hit) {
+				uint16_t cs = m_Registers ? m_Registers(9) : 0;
+				uint16_t ip = m_Registers ? m_Registers(IP) : 0;
+				m_Hit = Hit{ breakpoint.id, access, address, value, cs, ip };
+			}
+
+			return;
+		}
+	}
+}
+
+std::optional<Debugger::Hit> Debugger::TakeHit() {
+	auto hit = m_Hit;
+	m_Hit.reset();
+	return hit;
+}
\ No newline at end of file
@@ -0,0 +1,158 @@
+#ifndef DEBUGGER_HPP
+#define DEBUGGER_HPP
+
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <string_view>
+#include <functional>
+#include <optional>
+
+namespace xe86 {
+	/*
+	a condition compiled to a small stack machine. the language is C-like integer expressions:
+		registers	ax bx cx dx sp bp si di, al ... bh, cs ds ss es, ip, flags
+		access		value (the byte read or written), address (physical)
+		memory		byte[expr], word[expr] (physical addresses)
+		operators	|| && | ^ & == != < <= > >= + - and unary ! - ~, with C precedence
+		numbers		decimal, 0x hex
+	e.g. "cx == 0 && byte[0x400] != 0x20"
+	*/
+	class Condition {
+	public:
+		enum class Op : uint8_t {
+			Const, Register, Register8, Value, Address, LoadByte, LoadWord,
+			Not, Negate, Complement,
+			Add, Sub, And, Or, Xor, Eq, Ne, Lt, Le, Gt, Ge, LogicalAnd, LogicalOr,
+		};
+
+		struct Instruction {
+			Op op;
+			uint32_t operand;
+		};
+
+		// everything a condition can look at
+		struct Context {
+			const std::function<uint16_t(uint8_t)>& registers;
+			const std::function<uint8_t(uint32_t)>& memory;
+			uint32_t address;
+			uint8_t value;
+		};
+
+		static constexpr size_t MaxDepth = 32;
+
+		// returns nothing and says why on stderr if the text doesn't parse
+		static std::optional<Condition> Compile(std::string_view text);
+
+		bool Evaluate(const Context& context) const;
+
+		bool IsAlways() const { return m_Code.empty(); }
+
+	private:
+		std::vector<Instruction> m_Code;
+	};
+
+	/*
+	BREAKPOINTS AND WATCHPOINTS
+		execution breakpoints on a physical address or a CS:IP pair, and watchpoints on physical
+		ranges for reads, writes or both, each with an optional condition.
+
+		nothing is checked per instruction or per access against the list. each 4 KB page has a
+		flag byte saying whether it holds a breakpoint or a watched range; the cpu tests the execute
+		bit of the page it fetches an opcode from, and the bus tests the read or write bit of the
+		page it touches. only flagged pages go on to search the list, and the bus block accessors
+		stop their direct runs at watched pages so copies can't slip past a watch.
+
+		an execution breakpoint stops before the instruction runs. a watchpoint lets the
+		instruction finish, as data breakpoints on real hardware do. either way the hit waits in
+		TakeHit for whoever is driving the machine.
+	*/
+	class Debugger {
+	public:
+		using BreakpointId = uint32_t;
+
+		enum Access : uint8_t {
+			Execute = 0b001,
+			Read = 0b010,
+			Write = 0b100,
+		};
+
+		struct Hit {
+			BreakpointId id;
+			Access access;
+			uint32_t address;
+			uint8_t value;
+			uint16_t cs;
+			uint16_t ip;
+		};
+
+		// the cpu provides registers in the order AX CX DX BX SP BP SI DI, ES CS SS DS, IP, FLAGS,
+		// with IP being where the current instruction started
+		enum RegisterIndex : uint8_t {
+			IP = 12,
+			FLAGS = 13,
+		};
+
+		void SetRegisterReader(std::function<uint16_t(uint8_t)> reader) { m_Registers = std::move(reader); }
+		void SetMemoryReader(std::function<uint8_t(uint32_t)> reader) { m_Memory = std::move(reader); }
+
+		// 0 if the condition doesn't compile
+		BreakpointId AddBreakpoint(uint32_t address, std::string_view condition = {});
+		BreakpointId AddBreakpoint(uint16_t cs, uint16_t ip, std::string_view condition = {});
+		BreakpointId AddWatchpoint(uint32_t start, uint32_t end, uint8_t access, std::string_view condition = {});
+		bool Remove(BreakpointId id);
+
+		// the fast path checks
+		bool IsWatched(uint32_t address, Access access) const {
+			return m_PageFlags[(address & 0xfffff) >> PageShift] & access;
+		}
+
+		bool HasWatches() const { return m_HasWatches; }
+
+		bool HasBreakpoint(uint32_t address) const {
+			return m_PageFlags[(address & 0xfffff) >> PageShift] & Execute;
+		}
+
+		// the slow paths, only for flagged pages
+		bool CheckBreakpoint(uint32_t address, uint16_t cs, uint16_t ip);
+		void CheckWatch(uint32_t address, uint8_t value, Access access);
+
+		bool HasHit() const { return m_Hit.has_value(); }
+		std::optional<Hit> TakeHit();
+
+	private:
+		static constexpr size_t PageShift = 12;
+		static constexpr size_t PageCount = 0x100000 >> PageShift;
+
+		struct Breakpoint {
+			BreakpointId id;
+			uint8_t access;
+			uint32_t start;
+			uint32_t end;
+			bool match_cs_ip;
+			uint16_t cs;
+			uint16_t ip;
+			Condition condition;
+		};
+
+		BreakpointId Add(Breakpoint breakpoint, std::string_view condition);
+		void UpdatePageFlags();
+		bool Test(const Breakpoint& breakpoint, uint32_t address, uint8_t value) const;
+
+	private:
+		std::array<uint8_t, PageCount> m_PageFlags{};
+		bool m_HasWatches = false;
+		std::vector<Breakpoint> m_Breakpoints;
+		BreakpointId m_NextId = 1;
+
+		std::optional<Hit> m_Hit;
+
+		// the breakpoint the machine just stopped at is stepped over once when it resumes
+		std::optional<uint32_t> m_Resume;
+
+		std::function<uint16_t(uint8_t)> m_Registers;
+		std::function<uint8_t(uint32_t)> m_Memory;
+	};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,157 @@
+#include "dedup.hpp"
+#include "hash.hpp"
+
+using namespace xe86;
+
+PageDeduplicator::PageDeduplicator() {
+	// areas start out on the zero page already, this catches pages that are cleared later
+	auto& zero = MemoryArea::GetZeroPage();
+	m_Pages[Fnv1a64(zero->data(), zero->size())].push_back(zero);
+
+	m_Worker = std::thread([this]() { WorkerThread(); });
+}
+
+PageDeduplicator::~PageDeduplicator() {
+	{
+		std::lock_guard lock(m_Mutex);
+		m_Quit = true;
+	}
+
+	m_Wake.notify_all();
+	m_Worker.join();
+}
+
+void PageDeduplicator::Submit(std::weak_ptr<MemoryArea::MergeQueue> queue, std::vector<Frozen> pages) {
+	if (pages.empty()) {
+		return;
+	}
+
+	{
+		std::lock_guard lock(m_Mutex);
+		m_Pending.push_back({ std::move(queue), std::move(pages) });
+	}
+
+	m_Wake.notify_one();
+}
+
+size_t PageDeduplicator::GetUniquePages() const {
+	std::lock_guard lock(m_Mutex);
+
+	size_t count = 0;
+	for (auto& [hash, pages] : m_Pages) {
+		for (auto& page : pages) {
+			count += !page.expired();
+		}
+	}
+
+	return count;
+}
+
+void PageDeduplicator::WorkerThread() {
+	while (true) {
+		std::vector<Batch> batches;
+
+		{
+			std::unique_lock lock(m_Mutex);
+			m_Wake.wait(lock, [this]() { return m_Quit || !m_Pending.empty(); });
+
+			if (m_Quit) {
+				return;
+			}
+
+			batches.swap(m_Pending);
+		}
+
+		for (Batch& batch : batches) {
+			Process(batch);
+		}
+	}
+}
+
+void PageDeduplicator::Process(Batch& batch) {
+	std::vector<MemoryArea::Merge> merges;
+
+	// frozen pages are immutable, so hashing and comparing them needs no lock
+	for (Frozen& frozen : batch.pages) {
+		uint64_t hash = Fnv1a64(frozen.data->data(), frozen.data->size());
+		m_Hashed++;
+
+		std::lock_guard lock(m_Mutex);
+		auto& candidates = m_Pages[hash];
+
+		std::shared_ptr<const MemoryArea::Page> match;
+		for (auto& candidate : candidates) {
+			auto page = candidate.lock();
+			if (page && page != frozen.data && *page == *frozen.data) {
+				match = std::move(page);
+				break;
+			}
+		}
+
+		if (match) {
+			merges.push_back({ frozen.page, std::move(frozen.data), std::move(match) });
+		} else {
+			candidates.push_back(frozen.data);
+		}
+	}
+
+	// the area may have gone away in the meantime, its pages go with it
+	if (auto queue = batch.queue.lock(); queue && !merges.empty()) {
+		m_Merged += merges.size();
+
+		std::lock_guard lock(queue->mutex);
+		queue->merges.insert(queue->merges.end(), std::make_move_iterator(merges.begin()), std::make_move_iterator(merges.end()));
+	}
+
+	Prune();
+}
+
+void PageDeduplicator::Prune() {
+	std::lock_guard lock(m_Mutex);
+
+	// pages die as machines write to them or go away. sweep whenever the table has doubled
+	if (m_Pages.size() < 2 * m_PrunedAt + 1024) {
+		return;
+	}
+
+	for (auto it = m_Pages.begin(); it != m_Pages.end();) {
+		std::erase_if(it->second, [](auto& page) { return page.expired(); });
+		it = it->second.empty() ? m_Pages.erase(it) : std::next(it);
+	}
+
+	m_PrunedAt = m_Pages.size();
+}
+
+void MemoryArea::Share(PageDeduplicator& deduplicator) {
+	std::vector<Merge> merges;
+	{
+		std::lock_guard lock(m_Merges->mutex);
+		merges.swap(m_Merges->merges);
+	}
+
+	// a page written to since it was handed over has been copied back already, and stays as it is
+	for (Merge& merge : merges) {
+		if (m_Pages[merge.page] == merge.from) {
+			m_Read[merge.page] = merge.to->data();
+			m_Pages[merge.page] = std::move(merge.to);
+			m_MergeCount++;
+		}
+	}
+
+	// the first call only has versions to compare with next time
+	if (m_SharedVersions.size() != m_PageVersions.size()) {
+		m_SharedVersions = m_PageVersions;
+		return;
+	}
+
+	std::vector<PageDeduplicator::Frozen> frozen;
+	for (size_t page = 0; page < m_Pages.size(); page++) {
+		if (m_Write[page] && m_PageVersions[page] == m_SharedVersions[page]) {
+			m_Write[page] = nullptr;
+			frozen.push_back({ page, m_Pages[page] });
+		}
+	}
+
+	m_SharedVersions = m_PageVersions;
+	deduplicator.Submit(m_Merges, std::move(frozen));
+}
\ No newline at end of file
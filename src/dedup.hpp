@@ -0,0 +1,79 @@
+#ifndef DEDUP_HPP
+#define DEDUP_HPP
+
+#include "bus.hpp"
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <unordered_map>
+
+namespace xe86 {
+	/*
+	PAGE DEDUPLICATION
+		one of these can be shared by any number of machines in a process. every so often each
+		machine's memory areas freeze the pages nobody has written to since the last time, which
+		makes them immutable, and hand them over here. a background thread hashes them and looks
+		for an identical page it has seen before, from any machine. when it finds one, the area
+		is told to map that page instead and its own copy is freed once nothing else holds it.
+
+		a frozen page stays readable in place. the first write to it copies it back to a private
+		page, so pages that keep changing are never frozen for long and only memory that really
+		sits still ends up shared: zeroed ram, the bios data area, rom images, loaded programs.
+
+		nothing here touches guest-visible state. page versions don't change when a page is
+		frozen or merged, so rewind, dirty tracking and determinism are unaffected.
+	*/
+	class PageDeduplicator {
+	public:
+		PageDeduplicator();
+		~PageDeduplicator();
+
+		PageDeduplicator(const PageDeduplicator&) = delete;
+		PageDeduplicator& operator=(const PageDeduplicator&) = delete;
+
+		struct Frozen {
+			size_t page;
+			std::shared_ptr<const MemoryArea::Page> data;
+		};
+
+		// from MemoryArea::Share. merges for these pages come back through queue
+		void Submit(std::weak_ptr<MemoryArea::MergeQueue> queue, std::vector<Frozen> pages);
+
+		// distinct pages currently known, pages hashed so far, and merges handed out
+		size_t GetUniquePages() const;
+		uint64_t GetHashedPages() const { return m_Hashed; }
+		uint64_t GetMergedPages() const { return m_Merged; }
+
+	private:
+		struct Batch {
+			std::weak_ptr<MemoryArea::MergeQueue> queue;
+			std::vector<Frozen> pages;
+		};
+
+		void WorkerThread();
+		void Process(Batch& batch);
+		void Prune();
+
+	private:
+		mutable std::mutex m_Mutex;
+		std::condition_variable m_Wake;
+		std::vector<Batch> m_Pending;
+		bool m_Quit = false;
+
+		// by hash, every page that has been frozen and is still alive somewhere. only the worker
+		// thread changes it, under m_Mutex so GetUniquePages can look
+		std::unordered_map<uint64_t, std::vector<std::weak_ptr<const MemoryArea::Page>>> m_Pages;
+		size_t m_PrunedAt = 0;
+
+		std::atomic<uint64_t> m_Hashed = 0;
+		std::atomic<uint64_t> m_Merged = 0;
+
+		std::thread m_Worker;
+	};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,177 @@
+#include "diagnostics.hpp"
+#include <print>
+#include <vector>
+#include <algorithm>
+
+using namespace xe86;
+
+Diagnostics::Diagnostics() : m_LastRefill(std::chrono::steady_clock::now()) {}
+
+Diagnostics::~Diagnostics() {
+	if (m_Logger.joinable()) {
+		uint64_t evicted;
+		m_Queue.PushEvictOldest(Quit, evicted);
+		m_Logger.join();
+	}
+}
+
+void Diagnostics::SetSeverity(Severity severity) {
+	for (Category& category : m_Categories) {
+		category.severity = severity;
+	}
+}
+
+bool Diagnostics::ParseSeverity(std::string_view spec) {
+	std::string_view name;
+	size_t equals = spec.find('=');
+	if (equals != std::string_view::npos) {
+		name = spec.substr(0, equals);
+		spec = spec.substr(equals + 1);
+	}
+
+	Severity severity;
+	if (spec == "log") {
+		severity = Severity::Log;
+	} else if (spec == "count") {
+		severity = Severity::Count;
+	} else if (spec == "ignore") {
+		severity = Severity::Ignore;
+	} else {
+		return false;
+	}
+
+	if (name.empty()) {
+		SetSeverity(severity);
+		return true;
+	}
+
+	for (size_t i = 0; i < m_Categories.size(); i++) {
+		if (GetName(static_cast<Fault>(i)) == name) {
+			m_Categories[i].severity = severity;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+std::string_view Diagnostics::GetName(Fault fault) {
+	switch (fault) {
+	case Fault::UnmappedRead: return "unmapped-read";
+	case Fault::UnmappedWrite: return "unmapped-write";
+	case Fault::ProtectedRead: return "protected-read";
+	case Fault::ProtectedWrite: return "protected-write";
+	case Fault::UnknownPortRead: return "port-read";
+	case Fault::UnknownPortWrite: return "port-write";
+	default: return "unknown";
+	}
+}
+
+void Diagnostics::Log(Fault fault, uint32_t where, uint8_t value) {
+	auto now = std::chrono::steady_clock::now();
+	m_Tokens = std::min(BurstMessages, m_Tokens + std::chrono::duration<double>(now - m_LastRefill).count() * MessagesPerSecond);
+	m_LastRefill = now;
+
+	if (m_Tokens < 1) {
+		m_Suppressed++;
+		return;
+	}
+
+	m_Tokens -= 1;
+
+	// the logger only starts once there is something to log
+	if (!m_Logger.joinable()) {
+		m_Logger = std::thread([this]() { LoggerThread(); });
+	}
+
+	uint64_t message = (static_cast<uint64_t>(fault) << 28) | (static_cast<uint64_t>(value) << 20) | (where & 0xfffff);
+	if (!m_Queue.TryPush(message)) {
+		m_Suppressed++;
+	}
+}
+
+void Diagnostics::LoggerThread() {
+	while (true) {
+		uint64_t head = m_Queue.GetHead();
+
+		uint64_t message;
+		if (!m_Queue.TryPop(message)) {
+			m_Queue.WaitForPush(head);
+			continue;
+		}
+
+		if (message == Quit) {
+			break;
+		}
+
+		Print(message);
+		m_Logged.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+void Diagnostics::Print(uint64_t message) {
+	Fault fault = static_cast<Fault>(message >> 28);
+	uint8_t value = (message >> 20) & 0xff;
+	uint32_t where = message & 0xfffff;
+
+	switch (fault) {
+	case Fault::UnmappedRead:
+		std::println(stderr, "bus: read from unmapped memory @ {:05x}", where);
+		break;
+
+	case Fault::UnmappedWrite:
+		std::println(stderr, "bus: write of {:02x} to unmapped memory @ {:05x}", value, where);
+		break;
+
+	case Fault::ProtectedRead:
+		std::println(stderr, "bus: read from unreadable memory @ {:05x}", where);
+		break;
+
+	case Fault::ProtectedWrite:
+		std::println(stderr, "bus: write of {:02x} to read-only memory @ {:05x}", value, where);
+		break;
+
+	case Fault::UnknownPortRead:
+		std::println(stderr, "bus: read from unknown port {:04x}", where);
+		break;
+
+	case Fault::UnknownPortWrite:
+		std::println(stderr, "bus: write of {:02x} to unknown port {:04x}", value, where);
+		break;
+
+	default:
+		break;
+	}
+}
+
+void Diagnostics::PrintSummary() {
+	constexpr size_t Worst = 5;
+
+	for (size_t i = 0; i < m_Categories.size(); i++) {
+		const Category& category = m_Categories[i];
+		if (category.total == 0) {
+			continue;
+		}
+
+		Fault fault = static_cast<Fault>(i);
+		std::vector<std::pair<uint32_t, uint32_t>> places;
+		for (uint32_t where = 0; where < GetRange(fault); where++) {
+			if (category.counts[where]) {
+				places.push_back({ category.counts[where], where });
+			}
+		}
+
+		std::println(stderr, "bus: {} {} faults at {} {}", category.total, GetName(fault), places.size(),
+			IsPortFault(fault) ? "ports" : "addresses");
+
+		size_t shown = std::min(Worst, places.size());
+		std::partial_sort(places.begin(), places.begin() + shown, places.end(), std::greater<>());
+		for (size_t j = 0; j < shown; j++) {
+			std::println(stderr, "    {:05x}: {}", places[j].second, places[j].first);
+		}
+	}
+
+	if (m_Suppressed) {
+		std::println(stderr, "bus: {} fault messages suppressed by the rate limit", m_Suppressed);
+	}
+}
\ No newline at end of file
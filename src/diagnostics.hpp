@@ -0,0 +1,118 @@
+#ifndef DIAGNOSTICS_HPP
+#define DIAGNOSTICS_HPP
+
+#include "spsc_queue.hpp"
+
+#include <array>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+namespace xe86 {
+	enum class Fault : uint8_t {
+		UnmappedRead,		// no memory area at the address
+		UnmappedWrite,
+		ProtectedRead,		// the area exists but can't be read
+		ProtectedWrite,		// rom
+		UnknownPortRead,
+		UnknownPortWrite,
+		Count,
+	};
+
+	enum class Severity : uint8_t {
+		Ignore,		// not even counted
+		Count,		// counted per address or port, shown in the summary
+		Log,		// counted, and the first fault at each address or port is logged
+	};
+
+	/*
+	DIAGNOSTICS
+		bus faults are events, not messages. every fault is counted per address or port in a flat
+		array that is only allocated the first time its category faults, so the hot path is an
+		array increment. at Log severity the first fault at each address or port is also handed,
+		packed in 64 bits, to a logger thread through a bounded lock-free queue; messages beyond
+		a rate limit or a full queue are counted and dropped, never waited for. PrintSummary
+		reports the counts and the worst offenders of each category.
+	*/
+	class Diagnostics {
+	public:
+		Diagnostics();
+		~Diagnostics();
+
+		Diagnostics(const Diagnostics&) = delete;
+		Diagnostics& operator=(const Diagnostics&) = delete;
+
+		void SetSeverity(Fault fault, Severity severity) { m_Categories[static_cast<size_t>(fault)].severity = severity; }
+		void SetSeverity(Severity severity);
+
+		// "log", "count" or "ignore" for every category, or "<category>=<severity>" for one
+		bool ParseSeverity(std::string_view spec);
+
+		void Report(Fault fault, uint32_t where, uint8_t value = 0) {
+			Category& category = m_Categories[static_cast<size_t>(fault)];
+			if (category.severity == Severity::Ignore) {
+				return;
+			}
+
+			if (!category.counts) [[unlikely]] {
+				category.counts = std::make_unique<uint32_t[]>(GetRange(fault));
+			}
+
+			category.total++;
+			if (category.counts[where]++ == 0 && category.severity == Severity::Log) {
+				Log(fault, where, value);
+			}
+		}
+
+		uint64_t GetTotal(Fault fault) const { return m_Categories[static_cast<size_t>(fault)].total; }
+
+		uint32_t GetCount(Fault fault, uint32_t where) const {
+			const Category& category = m_Categories[static_cast<size_t>(fault)];
+			return category.counts ? category.counts[where] : 0;
+		}
+
+		void PrintSummary();
+
+	private:
+		static constexpr size_t QueueDepth = 1024;
+		static constexpr uint64_t Quit = ~0ull;
+
+		// token bucket: a burst of this many messages, then this many per second
+		static constexpr double BurstMessages = 50;
+		static constexpr double MessagesPerSecond = 20;
+
+		struct Category {
+			Severity severity = Severity::Log;
+			uint64_t total = 0;
+			std::unique_ptr<uint32_t[]> counts;
+		};
+
+		static constexpr bool IsPortFault(Fault fault) {
+			return fault == Fault::UnknownPortRead || fault == Fault::UnknownPortWrite;
+		}
+
+		static constexpr size_t GetRange(Fault fault) { return IsPortFault(fault) ? 1 << 16 : 1 << 20; }
+		static std::string_view GetName(Fault fault);
+
+		void Log(Fault fault, uint32_t where, uint8_t value);
+		void LoggerThread();
+		static void Print(uint64_t message);
+
+	private:
+		std::array<Category, static_cast<size_t>(Fault::Count)> m_Categories;
+
+		// emulation thread only
+		double m_Tokens = BurstMessages;
+		std::chrono::steady_clock::time_point m_LastRefill;
+		uint64_t m_Suppressed = 0;
+
+		// fault in bits 28-31, value in 20-27, address or port in 0-19
+		SpscQueue<uint64_t, QueueDepth> m_Queue;
+		std::atomic<uint64_t> m_Logged = 0;
+		std::thread m_Logger;
+	};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,52 @@
+#include "digest.hpp"
+#include "hash.hpp"
+
+using namespace xe86;
+
+uint64_t StateDigest::Mix(size_t area, size_t page, uint64_t hash) {
+	// splitmix64's finalizer, so pages with the same contents in different places don't cancel out
+	uint64_t x = hash + ((area << 20 | page) + 1) * 0x9e3779b97f4a7c15ull;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+	return x ^ (x >> 31);
+}
+
+uint64_t StateDigest::Update(CPU& cpu, Bus& bus) {
+	auto& areas = bus.GetMemoryAreas();
+	m_Areas.resize(areas.size());
+
+	for (size_t a = 0; a < areas.size(); a++) {
+		auto& versions = areas[a]->GetPageVersions();
+		Area& area = m_Areas[a];
+
+		// a page never seen before counts as changed
+		if (area.versions.size() != versions.size()) {
+			area.versions.assign(versions.size(), 0);
+			area.hashes.assign(versions.size(), 0);
+			for (size_t p = 0; p < versions.size(); p++) {
+				area.versions[p] = versions[p] - 1;
+				m_Memory ^= Mix(a, p, 0);
+			}
+		}
+
+		for (size_t p = 0; p < versions.size(); p++) {
+			if (versions[p] != area.versions[p]) {
+				std::span<const uint8_t> data = areas[a]->GetPage(p);
+				uint64_t hash = Fnv1a64(data.data(), data.size());
+
+				m_Memory ^= Mix(a, p, area.hashes[p]) ^ Mix(a, p, hash);
+				area.hashes[p] = hash;
+				area.versions[p] = versions[p];
+			}
+		}
+	}
+
+	// flags as the guest would see them, whatever a fused pair left pending
+	const Registers& r = cpu.GetRegisters();
+	const uint16_t registers[] = {
+		r.ax, r.cx, r.dx, r.bx, r.sp, r.bp, r.si, r.di,
+		r.es, r.cs, r.ss, r.ds, r.ip, static_cast<uint16_t>(r.flags)
+	};
+
+	return Fnv1a64(reinterpret_cast<const uint8_t*>(registers), sizeof(registers), m_Memory);
+}
\ No newline at end of file
@@ -0,0 +1,43 @@
+#ifndef DIGEST_HPP
+#define DIGEST_HPP
+
+#include "bus.hpp"
+#include "cpu.hpp"
+
+#include <vector>
+
+namespace xe86 {
+	/*
+	STATE DIGEST
+		a 64-bit hash of the cpu's registers and every page of memory, for telling whether two
+		machines are in the same state without comparing them byte for byte. each page's hash is
+		kept along with the page version it was taken at, and the memory part of the digest is
+		those hashes mixed with where each page is and xored together. an update only rehashes the
+		pages written since the last one and swaps their old hash out of the total for the new,
+		so it costs the registers plus whatever the guest wrote in between.
+	*/
+	class StateDigest {
+	public:
+		uint64_t Update(CPU& cpu, Bus& bus);
+
+		// what each page hashed to at the last update, to find which pages two digests disagree on
+		size_t GetAreaCount() const { return m_Areas.size(); }
+		size_t GetPageCount(size_t area) const { return m_Areas[area].hashes.size(); }
+		uint64_t GetPageHash(size_t area, size_t page) const { return m_Areas[area].hashes[page]; }
+
+	private:
+		struct Area {
+			std::vector<uint32_t> versions;
+			std::vector<uint64_t> hashes;
+		};
+
+		// a page's contribution to the memory digest
+		static uint64_t Mix(size_t area, size_t page, uint64_t hash);
+
+	private:
+		std::vector<Area> m_Areas;
+		uint64_t m_Memory = 0;
+	};
+}
+
+#endif
\ No newline at end of file
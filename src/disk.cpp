@@ -0,0 +1,237 @@
+#include "disk.hpp"
+#include <print>
+#include <algorithm>
+
+using namespace xe86;
+
+namespace {
+	struct FloppyFormat {
+		uint64_t size;
+		uint16_t cylinders;
+		uint8_t heads;
+		uint8_t sectors;
+		uint8_t type;
+	};
+
+	// by image size, with the drive type int 13h function 08h reports for each
+	constexpr FloppyFormat FloppyFormats[] = {
+		{ 160 * 1024, 40, 1, 8, 1 },
+		{ 180 * 1024, 40, 1, 9, 1 },
+		{ 320 * 1024, 40, 2, 8, 1 },
+		{ 360 * 1024, 40, 2, 9, 1 },
+		{ 720 * 1024, 80, 2, 9, 3 },
+		{ 1200 * 1024, 80, 2, 15, 2 },
+		{ 1440 * 1024, 80, 2, 18, 4 },
+		{ 2880 * 1024, 80, 2, 36, 6 },
+	};
+}
+
+Disk::Disk(std::shared_ptr<Bus> bus, CPU& cpu) : m_Bus(bus), m_Cpu(cpu) {
+	m_Cpu.SetInterruptHook(0x13, [this]() { return Int13(); });
+}
+
+bool Disk::Attach(uint8_t drive, std::unique_ptr<DiskImage> image) {
+	if (!image) {
+		return false;
+	}
+
+	bool floppy = drive < 0x80;
+	auto& drives = floppy ? m_Floppies : m_HardDisks;
+	if ((drive & 0x7f) >= drives.size()) {
+		std::println(stderr, "disk: there's no drive {:02x}h", drive);
+		return false;
+	}
+
+	Drive& d = drives[drive & 0x7f];
+	if (floppy) {
+		auto format = std::ranges::find(FloppyFormats, image->GetSize(), &FloppyFormat::size);
+		if (format == std::end(FloppyFormats)) {
+			std::println(stderr, "disk: a floppy image of {} bytes isn't any format a drive reads", image->GetSize());
+			return false;
+		}
+
+		d.cylinders = format->cylinders;
+		d.heads = format->heads;
+		d.sectors = format->sectors;
+		d.type = format->type;
+	} else {
+		// whatever fits in chs addressing, the rest of a larger image is out of reach
+		d.heads = 16;
+		d.sectors = 17;
+		if (image->GetSectorCount() / (d.heads * d.sectors) > 1024) {
+			d.heads = 255;
+			d.sectors = 63;
+		}
+
+		d.cylinders = static_cast<uint16_t>(std::clamp<uint64_t>(image->GetSectorCount() / (d.heads * d.sectors), 1, 1024));
+		d.type = 0;
+	}
+
+	d.image = std::move(image);
+	return true;
+}
+
+DiskImage* Disk::GetImage(uint8_t drive) {
+	Drive* d = Find(drive);
+	return d ? d->image.get() : nullptr;
+}
+
+Disk::Drive* Disk::Find(uint8_t drive) {
+	auto& drives = drive < 0x80 ? m_Floppies : m_HardDisks;
+	if ((drive & 0x7f) >= drives.size() || !drives[drive & 0x7f].image) {
+		return nullptr;
+	}
+
+	return &drives[drive & 0x7f];
+}
+
+bool Disk::Int13() {
+	Registers& r = m_Cpu.GetRegisters();
+	uint8_t function = r.ah;
+
+	Drive* drive = Find(r.dl);
+	if (!drive && function != 0x01 && function != 0x08 && function != 0x15) {
+		Finish(StatusTimeout);
+		return true;
+	}
+
+	switch (function) {
+		// reset
+		case 0x00: {
+			Finish(StatusOk);
+			break;
+		}
+
+		// status of the last operation
+		case 0x01: {
+			uint8_t status = m_Status;
+			Finish(StatusOk);
+			r.al = status;
+			break;
+		}
+
+		// read, write and verify sectors
+		case 0x02:
+		case 0x03:
+		case 0x04: {
+			Transfer(*drive, function == 0x03);
+			break;
+		}
+
+		// drive parameters. the count of drives is of the same kind as the one asked about
+		case 0x08: {
+			auto& drives = r.dl < 0x80 ? m_Floppies : m_HardDisks;
+			if (!drive) {
+				Finish(StatusTimeout);
+				break;
+			}
+
+			uint16_t cylinder = drive->cylinders - 1;
+			r.bl = drive->type;
+			r.ch = static_cast<uint8_t>(cylinder);
+			r.cl = static_cast<uint8_t>((cylinder >> 2 & 0xc0) | drive->sectors);
+			r.dh = drive->heads - 1;
+			r.dl = static_cast<uint8_t>(std::ranges::count_if(drives, [](const Drive& d) { return d.image != nullptr; }));
+			r.al = 0;
+			Finish(StatusOk);
+			break;
+		}
+
+		// disk type: none, a floppy with no change line, or a hard disk and its sectors in CX:DX
+		case 0x15: {
+			Finish(StatusOk);
+			if (!drive) {
+				r.ah = 0x00;
+			} else if (r.dl < 0x80) {
+				r.ah = 0x01;
+			} else {
+				uint32_t sectors = static_cast<uint32_t>(drive->cylinders) * drive->heads * drive->sectors;
+				r.cx = static_cast<uint16_t>(sectors >> 16);
+				r.dx = static_cast<uint16_t>(sectors);
+				r.ah = 0x03;
+			}
+
+			break;
+		}
+
+		// change line. images are never swapped under the guest
+		case 0x16: {
+			Finish(StatusOk);
+			break;
+		}
+
+		default: {
+			if (!m_Reported[function]) {
+				m_Reported[function] = true;
+				std::println(stderr, "disk: unsupported int 13h function {:02x}", function);
+			}
+
+			Finish(StatusBadCommand);
+			break;
+		}
+	}
+
+	return true;
+}
+
+void Disk::Transfer(Drive& drive, bool write) {
+	Registers& r = m_Cpu.GetRegisters();
+	bool verify = r.ah == 0x04;
+	uint8_t count = r.al;
+	uint16_t cylinder = static_cast<uint16_t>(r.ch | (r.cl & 0xc0) << 2);
+	uint8_t sector = r.cl & 0x3f;
+	uint8_t head = r.dh;
+
+	if (count == 0 || sector == 0 || sector > drive.sectors || head >= drive.heads || cylinder >= drive.cylinders) {
+		r.al = 0;
+		Finish(StatusSectorNotFound);
+		return;
+	}
+
+	if (write && !drive.image->IsWritable()) {
+		r.al = 0;
+		Finish(StatusWriteProtected);
+		return;
+	}
+
+	uint64_t lba = (static_cast<uint64_t>(cylinder) * drive.heads + head) * drive.sectors + sector - 1;
+	uint32_t address = Address20(r.es, r.bx);
+
+	// a sector at a time, so a transfer that runs off the end of the disk still did what it could
+	uint8_t buffer[DiskImage::SectorSize];
+	uint8_t done = 0;
+	uint8_t status = StatusOk;
+
+	for (; done < count; done++) {
+		if (write) {
+			m_Bus->ReadBlock(address, buffer);
+			if (!drive.image->Write(lba + done, buffer)) {
+				status = StatusSectorNotFound;
+				break;
+			}
+		} else {
+			if (!drive.image->Read(lba + done, buffer)) {
+				status = StatusSectorNotFound;
+				break;
+			}
+
+			if (!verify) {
+				m_Bus->WriteBlock(address, buffer);
+			}
+		}
+
+		address = (address + DiskImage::SectorSize) & 0xfffff;
+	}
+
+	r.al = done;
+	Finish(status);
+}
+
+void Disk::Finish(uint8_t status) {
+	Registers& r = m_Cpu.GetRegisters();
+	m_Status = status;
+	r.ah = status;
+
+	uint16_t flags = static_cast<uint16_t>(r.flags) & ~static_cast<uint16_t>(Flags::CF);
+	r.flags = static_cast<Flags>(flags | (status != StatusOk ? static_cast<uint16_t>(Flags::CF) : 0));
+}
\ No newline at end of file
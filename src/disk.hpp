@@ -0,0 +1,75 @@
+#ifndef DISK_HPP
+#define DISK_HPP
+
+#include "bus.hpp"
+#include "cpu.hpp"
+#include "diskimage.hpp"
+
+#include <array>
+#include <memory>
+
+namespace xe86 {
+	/*
+	BIOS DISK SERVICES
+		there's no floppy or hard disk controller, so INT 13h is answered on the host side by
+		hooking the INT instruction, as DOS does for INT 21h. reads and writes go straight between
+		guest memory at ES:BX and a disk image, and finish in no guest time at all.
+
+		two floppies (00h, 01h) and two hard disks (80h, 81h). the geometry comes from the size of
+		the image: the standard floppy formats by their size, anything else as a hard disk with 16
+		heads and 17 sectors a track, or 255 heads and 63 sectors once that runs out of cylinders.
+		functions:
+			00h reset, 01h last status, 02h read, 03h write, 04h verify, 08h parameters,
+			15h disk type, 16h change line
+		on failure AH has the status and CF is set, as a bios would leave them.
+
+		writes go to the image's overlay, so they're outside the machine's state: rewinding or
+		loading a snapshot doesn't take them back.
+	*/
+	class Disk {
+	public:
+		Disk(std::shared_ptr<Bus> bus, CPU& cpu);
+
+		Disk(const Disk&) = delete;
+		Disk& operator=(const Disk&) = delete;
+
+		// drive is the bios number, 00h or 01h for a floppy, 80h or 81h for a hard disk
+		bool Attach(uint8_t drive, std::unique_ptr<DiskImage> image);
+		DiskImage* GetImage(uint8_t drive);
+
+	private:
+		struct Drive {
+			std::unique_ptr<DiskImage> image;
+			uint16_t cylinders = 0;
+			uint8_t heads = 0;
+			uint8_t sectors = 0;
+			uint8_t type = 0;
+		};
+
+		// bios status codes
+		static constexpr uint8_t StatusOk = 0x00;
+		static constexpr uint8_t StatusBadCommand = 0x01;
+		static constexpr uint8_t StatusWriteProtected = 0x03;
+		static constexpr uint8_t StatusSectorNotFound = 0x04;
+		static constexpr uint8_t StatusTimeout = 0x80;
+
+		bool Int13();
+		Drive* Find(uint8_t drive);
+		void Transfer(Drive& drive, bool write);
+		void Finish(uint8_t status);
+
+	private:
+		std::shared_ptr<Bus> m_Bus;
+		CPU& m_Cpu;
+
+		std::array<Drive, 2> m_Floppies;
+		std::array<Drive, 2> m_HardDisks;
+
+		uint8_t m_Status = StatusOk;
+
+		// each unsupported function is only reported once
+		std::array<bool, 256> m_Reported{};
+	};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,357 @@
+#include "diskimage.hpp"
+#include "hash.hpp"
+#include <print>
+#include <algorithm>
+#include <filesystem>
+#include <bit>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace xe86;
+
+namespace {
+	void Put32(uint8_t* out, uint32_t value) {
+		for (int i = 0; i < 4; i++) {
+			out[i] = static_cast<uint8_t>(value >> (i * 8));
+		}
+	}
+
+	void Put64(uint8_t* out, uint64_t value) {
+		for (int i = 0; i < 8; i++) {
+			out[i] = static_cast<uint8_t>(value >> (i * 8));
+		}
+	}
+
+	uint32_t Get32(const uint8_t* in) {
+		uint32_t value = 0;
+		for (int i = 0; i < 4; i++) {
+			value |= static_cast<uint32_t>(in[i]) << (i * 8);
+		}
+
+		return value;
+	}
+
+	uint64_t Get64(const uint8_t* in) {
+		uint64_t value = 0;
+		for (int i = 0; i < 8; i++) {
+			value |= static_cast<uint64_t>(in[i]) << (i * 8);
+		}
+
+		return value;
+	}
+}
+
+DiskImage::~DiskImage() {
+	if (m_Overlay.is_open()) {
+		m_Overlay.flush();
+	}
+}
+
+std::unique_ptr<DiskImage> DiskImage::Open(std::string_view base, std::string_view overlay) {
+	auto image = std::unique_ptr<DiskImage>(new DiskImage());
+	image->m_BasePath = base;
+	image->m_OverlayPath = overlay;
+
+	image->m_Base.open(image->m_BasePath, std::ios::binary | std::ios::ate);
+	if (!image->m_Base) {
+		std::println(stderr, "disk: failed to open '{}'", base);
+		return nullptr;
+	}
+
+	image->m_Size = static_cast<uint64_t>(image->m_Base.tellg());
+	if (image->m_Size == 0 || image->m_Size % SectorSize != 0) {
+		std::println(stderr, "disk: '{}' isn't a whole number of sectors", base);
+		return nullptr;
+	}
+
+	std::vector<uint8_t> start(std::min<uint64_t>(image->m_Size, FingerprintBytes));
+	image->m_Base.seekg(0);
+	image->m_Base.read(reinterpret_cast<char*>(start.data()), start.size());
+	image->m_Fingerprint = Fnv1a64(start.data(), start.size(), Fnv1a64(reinterpret_cast<const uint8_t*>(&image->m_Size), sizeof(image->m_Size)));
+
+	image->m_Bitmap.assign((image->GetBlockCount() + 7) / 8, 0);
+
+	if (!overlay.empty()) {
+		bool opened = std::filesystem::exists(image->m_OverlayPath) ? image->OpenOverlay() : image->CreateOverlay();
+		if (!opened) {
+			return nullptr;
+		}
+	}
+
+	return image;
+}
+
+bool DiskImage::CreateOverlay() {
+	std::vector<uint8_t> header(BlockSize, 0);
+	std::copy(std::begin(Magic), std::end(Magic), header.begin());
+	Put32(&header[8], Version);
+	Put32(&header[12], BlockSize);
+	Put64(&header[16], m_Size);
+	Put64(&header[24], m_Fingerprint);
+	Put64(&header[32], BlockSize);
+	Put64(&header[40], GetDataOffset());
+
+	{
+		std::ofstream file(m_OverlayPath, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(header.data()), header.size());
+
+		// the bitmap is all clear, so the whole file is as long as its data and holes up to there
+		std::vector<uint8_t> bitmap(GetDataOffset() - BlockSize, 0);
+		file.write(reinterpret_cast<const char*>(bitmap.data()), bitmap.size());
+
+		if (!file) {
+			std::println(stderr, "disk: failed to create the overlay '{}'", m_OverlayPath);
+			return false;
+		}
+	}
+
+	m_Overlay.open(m_OverlayPath, std::ios::binary | std::ios::in | std::ios::out);
+	return m_Overlay.is_open();
+}
+
+bool DiskImage::OpenOverlay() {
+	m_Overlay.open(m_OverlayPath, std::ios::binary | std::ios::in | std::ios::out);
+	if (!m_Overlay) {
+		std::println(stderr, "disk: failed to open the overlay '{}'", m_OverlayPath);
+		return false;
+	}
+
+	uint8_t header[48];
+	m_Overlay.read(reinterpret_cast<char*>(header), sizeof(header));
+	if (!m_Overlay || !std::equal(std::begin(Magic), std::end(Magic), header)) {
+		std::println(stderr, "disk: '{}' isn't an overlay", m_OverlayPath);
+		return false;
+	}
+
+	if (Get32(&header[8]) != Version || Get32(&header[12]) != BlockSize || Get64(&header[32]) != BlockSize || Get64(&header[40]) != GetDataOffset()) {
+		std::println(stderr, "disk: the overlay '{}' has a layout this version doesn't read", m_OverlayPath);
+		return false;
+	}
+
+	if (Get64(&header[16]) != m_Size || Get64(&header[24]) != m_Fingerprint) {
+		std::println(stderr, "disk: the overlay '{}' was made for a different base than '{}'", m_OverlayPath, m_BasePath);
+		return false;
+	}
+
+	m_Overlay.seekg(BlockSize);
+	m_Overlay.read(reinterpret_cast<char*>(m_Bitmap.data()), m_Bitmap.size());
+	if (!m_Overlay) {
+		std::println(stderr, "disk: the overlay '{}' is cut short", m_OverlayPath);
+		return false;
+	}
+
+	return true;
+}
+
+bool DiskImage::Read(uint64_t sector, std::span<uint8_t> out) {
+	uint64_t offset = sector * SectorSize;
+	if (out.size() % SectorSize != 0 || offset + out.size() > m_Size) {
+		return false;
+	}
+
+	uint8_t block[BlockSize];
+	for (size_t done = 0; done < out.size();) {
+		uint64_t at = offset + done;
+		size_t within = static_cast<size_t>(at % BlockSize);
+		size_t length = std::min(out.size() - done, BlockSize - within);
+
+		if (!ReadBlock(at / BlockSize, block)) {
+			return false;
+		}
+
+		std::copy_n(block + within, length, out.data() + done);
+		done += length;
+	}
+
+	return true;
+}
+
+bool DiskImage::Write(uint64_t sector, std::span<const uint8_t> data) {
+	uint64_t offset = sector * SectorSize;
+	if (!IsWritable() || data.size() % SectorSize != 0 || offset + data.size() > m_Size) {
+		return false;
+	}
+
+	uint8_t block[BlockSize];
+	for (size_t done = 0; done < data.size();) {
+		uint64_t at = offset + done;
+		size_t within = static_cast<size_t>(at % BlockSize);
+		size_t length = std::min(data.size() - done, BlockSize - within);
+
+		// only a whole block can go into the overlay, the rest of it comes from wherever it is now
+		if (length != BlockSize && !ReadBlock(at / BlockSize, block)) {
+			return false;
+		}
+
+		std::copy_n(data.data() + done, length, block + within);
+		if (!WriteBlock(at / BlockSize, block)) {
+			return false;
+		}
+
+		done += length;
+	}
+
+	m_Overlay.flush();
+	return true;
+}
+
+bool DiskImage::ReadBlock(uint64_t block, std::span<uint8_t> out) {
+	if (!IsAllocated(block)) {
+		return ReadBaseBlock(block, out);
+	}
+
+	m_Overlay.seekg(GetDataOffset() + block * BlockSize);
+	m_Overlay.read(reinterpret_cast<char*>(out.data()), BlockSize);
+	if (!m_Overlay) {
+		m_Overlay.clear();
+		std::println(stderr, "disk: failed to read block {} of the overlay '{}'", block, m_OverlayPath);
+		return false;
+	}
+
+	return true;
+}
+
+bool DiskImage::ReadBaseBlock(uint64_t block, std::span<uint8_t> out) {
+	// the last block can be short, what's past the end of the disk reads as zero
+	uint64_t offset = block * BlockSize;
+	size_t length = static_cast<size_t>(std::min<uint64_t>(BlockSize, m_Size - offset));
+	std::fill(out.begin() + length, out.end(), 0);
+
+	m_Base.seekg(offset);
+	m_Base.read(reinterpret_cast<char*>(out.data()), length);
+	if (!m_Base) {
+		m_Base.clear();
+		std::println(stderr, "disk: failed to read '{}' at {}", m_BasePath, offset);
+		return false;
+	}
+
+	return true;
+}
+
+bool DiskImage::WriteBlock(uint64_t block, std::span<const uint8_t> data) {
+	// the data before the bit that says it's there
+	m_Overlay.seekp(GetDataOffset() + block * BlockSize);
+	m_Overlay.write(reinterpret_cast<const char*>(data.data()), BlockSize);
+	if (!m_Overlay) {
+		m_Overlay.clear();
+		std::println(stderr, "disk: failed to write block {} of the overlay '{}'", block, m_OverlayPath);
+		return false;
+	}
+
+	if (!IsAllocated(block)) {
+		SetAllocated(block, true);
+		if (!m_Overlay) {
+			m_Overlay.clear();
+			std::println(stderr, "disk: failed to mark block {} in the overlay '{}'", block, m_OverlayPath);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void DiskImage::SetAllocated(uint64_t block, bool allocated) {
+	uint8_t& byte = m_Bitmap[block >> 3];
+	byte = allocated ? byte | (1 << (block & 7)) : byte & ~(1 << (block & 7));
+
+	m_Overlay.seekp(BlockSize + (block >> 3));
+	m_Overlay.write(reinterpret_cast<const char*>(&byte), 1);
+}
+
+size_t DiskImage::GetAllocatedBlocks() const {
+	size_t count = 0;
+	for (uint8_t byte : m_Bitmap) {
+		count += std::popcount(byte);
+	}
+
+	return count;
+}
+
+size_t DiskImage::Compact() {
+	if (!IsWritable()) {
+		return 0;
+	}
+
+	std::vector<uint64_t> dropped;
+	uint8_t overlay[BlockSize];
+	uint8_t base[BlockSize];
+
+	for (uint64_t block = 0; block < GetBlockCount(); block++) {
+		if (IsAllocated(block) && ReadBlock(block, overlay) && ReadBaseBlock(block, base) && std::equal(overlay, overlay + BlockSize, base)) {
+			SetAllocated(block, false);
+
+			// a bit still set in the file has to keep its data
+			if (!m_Overlay) {
+				m_Overlay.clear();
+				continue;
+			}
+
+			dropped.push_back(block);
+		}
+	}
+
+	m_Overlay.flush();
+
+#ifdef __linux__
+	// the bitmap no longer points at them, so their space can go back to the file system
+	int fd = open(m_OverlayPath.c_str(), O_WRONLY | O_CLOEXEC);
+	if (fd >= 0) {
+		for (uint64_t block : dropped) {
+			fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, static_cast<off_t>(GetDataOffset() + block * BlockSize), BlockSize);
+		}
+
+		close(fd);
+	}
+#endif
+
+	return dropped.size();
+}
+
+bool DiskImage::Commit(std::string_view path) {
+	// the output replaces the file it's written to, which can't be one it's made from
+	std::error_code error;
+	for (const std::string& source : { m_BasePath, m_OverlayPath }) {
+		if (!source.empty() && std::filesystem::equivalent(path, source, error)) {
+			std::println(stderr, "disk: can't commit '{}' onto itself", source);
+			return false;
+		}
+	}
+
+	// into a file beside it and renamed at the end, so a failure leaves whatever was there
+	std::string temporary = std::string(path) + ".tmp";
+	std::ofstream file{ temporary, std::ios::binary | std::ios::trunc };
+	if (!file) {
+		std::println(stderr, "disk: failed to create '{}'", temporary);
+		return false;
+	}
+
+	uint8_t block[BlockSize];
+	for (uint64_t b = 0; b < GetBlockCount(); b++) {
+		if (!ReadBlock(b, block)) {
+			file.close();
+			std::filesystem::remove(temporary, error);
+			return false;
+		}
+
+		file.write(reinterpret_cast<const char*>(block), static_cast<std::streamsize>(std::min<uint64_t>(BlockSize, m_Size - b * BlockSize)));
+	}
+
+	file.close();
+	if (!file) {
+		std::println(stderr, "disk: failed to write '{}'", temporary);
+		std::filesystem::remove(temporary, error);
+		return false;
+	}
+
+	std::filesystem::rename(temporary, path, error);
+	if (error) {
+		std::println(stderr, "disk: failed to rename '{}' to '{}': {}", temporary, path, error.message());
+		std::filesystem::remove(temporary, error);
+		return false;
+	}
+
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,97 @@
+#ifndef DISKIMAGE_HPP
+#define DISKIMAGE_HPP
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace xe86 {
+	/*
+	COPY-ON-WRITE DISK IMAGE
+		a raw base image that is only ever read, so any number of machines and processes can share
+		one golden disk, plus an overlay file per machine with just the blocks it wrote. without an
+		overlay writes fail, as on a write protected disk.
+
+		the overlay is laid out so that it can be mapped straight into memory, and every block has
+		its place whether it was written or not:
+			0000	header, one block
+					"XE86COW1", then little-endian u32 version, u32 block size, u64 disk size,
+					u64 base fingerprint, u64 bitmap offset, u64 data offset
+			1000	allocation bitmap, a bit per block, set if the overlay has it. padded to a block
+			....	block n at data offset + n * block size
+		blocks that were never written are holes in a sparse file, so an overlay costs the disk
+		space of what was written. a sector written to a block the overlay doesn't have yet copies
+		the rest of the block up from the base first.
+
+		the fingerprint is the disk size and a hash of the start of the base, enough to refuse an
+		overlay made for a different base without reading all of it.
+	*/
+	class DiskImage {
+	public:
+		static constexpr size_t SectorSize = 512;
+		static constexpr size_t BlockSize = 4096;
+
+		~DiskImage();
+
+		DiskImage(const DiskImage&) = delete;
+		DiskImage& operator=(const DiskImage&) = delete;
+
+		// an overlay that doesn't exist yet is created, empty. null on failure
+		static std::unique_ptr<DiskImage> Open(std::string_view base, std::string_view overlay = {});
+
+		uint64_t GetSize() const { return m_Size; }
+		uint64_t GetSectorCount() const { return m_Size / SectorSize; }
+		bool IsWritable() const { return m_Overlay.is_open(); }
+
+		// whole sectors. false past the end of the disk, or for a write without an overlay
+		bool Read(uint64_t sector, std::span<uint8_t> out);
+		bool Write(uint64_t sector, std::span<const uint8_t> data);
+
+		size_t GetAllocatedBlocks() const;
+
+		// drop the overlay's blocks that are the same as the base's again, and give their space back
+		// where the platform can punch holes. returns how many were dropped
+		size_t Compact();
+
+		// write the base with the overlay applied to a new raw image, to make it the next golden disk.
+		// the image only replaces path once it's all written, and never the base or overlay itself
+		bool Commit(std::string_view path);
+
+	private:
+		static constexpr char Magic[8] = { 'X', 'E', '8', '6', 'C', 'O', 'W', '1' };
+		static constexpr uint32_t Version = 1;
+		static constexpr size_t FingerprintBytes = 64 * 1024;
+
+		DiskImage() = default;
+
+		bool CreateOverlay();
+		bool OpenOverlay();
+
+		bool ReadBlock(uint64_t block, std::span<uint8_t> out);
+		bool ReadBaseBlock(uint64_t block, std::span<uint8_t> out);
+		bool WriteBlock(uint64_t block, std::span<const uint8_t> data);
+
+		bool IsAllocated(uint64_t block) const { return (m_Bitmap[block >> 3] >> (block & 7)) & 1; }
+		void SetAllocated(uint64_t block, bool allocated);
+
+		uint64_t GetBlockCount() const { return (m_Size + BlockSize - 1) / BlockSize; }
+		uint64_t GetDataOffset() const { return BlockSize + (m_Bitmap.size() + BlockSize - 1) / BlockSize * BlockSize; }
+
+	private:
+		std::string m_BasePath;
+		std::string m_OverlayPath;
+
+		std::ifstream m_Base;
+		std::fstream m_Overlay;
+
+		uint64_t m_Size = 0;
+		uint64_t m_Fingerprint = 0;
+		std::vector<uint8_t> m_Bitmap;
+	};
+}
+
+#endif
\ No newline at end of file
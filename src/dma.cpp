@@ -0,0 +1,273 @@
+#include "dma.hpp"
+#include <algorithm>
+#include <vector>
+
+using namespace xe86;
+
+// page register port for each channel
+static constexpr std::array<uint16_t, 4> page_ports = { 0x87, 0x83, 0x81, 0x82 };
+
+DMA::DMA(std::shared_ptr<Bus> bus) : Component(bus, "DMA") {
+	for (uint8_t port = 0x00; port <= 0x0f; port++) {
+		m_Bus->AttachPort({
+			[this, port](uint8_t byte) { WriteRegister(port, byte); },
+			[this, port]() -> uint8_t { return ReadRegister(port); },
+			port
+		});
+	}
+
+	for (uint8_t channel = 0; channel < 4; channel++) {
+		m_Bus->AttachPort({
+			[this, channel](uint8_t byte) { m_Channels[channel].page = byte; },
+			[this, channel]() -> uint8_t { return m_Channels[channel].page; },
+			page_ports[channel]
+		});
+	}
+}
+
+void DMA::Reset() {
+	MasterClear();
+
+	for (Channel& c : m_Channels) {
+		c = Channel{};
+	}
+}
+
+void DMA::MasterClear() {
+	m_Command = 0;
+	m_Status = 0;
+	m_Mask = 0x0f;
+	m_Request = 0;
+	m_Temporary = 0;
+	m_HighByte = false;
+}
+
+void DMA::WriteRegister(uint8_t port, uint8_t byte) {
+	if (port < 0x08) {
+		// even ports are address, odd ports count, low byte then high byte
+		Channel& c = m_Channels[port >> 1];
+		uint16_t& base = (port & 1) ? c.base_count : c.base_address;
+		uint16_t& current = (port & 1) ? c.count : c.address;
+
+		base = m_HighByte ? (base & 0x00ff) | (byte << 8) : (base & 0xff00) | byte;
+		current = base;
+		m_HighByte = !m_HighByte;
+		return;
+	}
+
+	switch (port) {
+	case 0x08:
+		m_Command = byte;
+		break;
+
+	case 0x09:
+		if (byte & 0b100) {
+			m_Request |= 1 << (byte & 0b11);
+		} else {
+			m_Request &= ~(1 << (byte & 0b11));
+		}
+
+		// a software request on channel 0 is how a memory-to-memory copy starts
+		if ((m_Command & 0b01) && (m_Request & 0b01)) {
+			MemoryToMemory();
+		}
+
+		break;
+
+	case 0x0a:
+		if (byte & 0b100) {
+			m_Mask |= 1 << (byte & 0b11);
+		} else {
+			m_Mask &= ~(1 << (byte & 0b11));
+		}
+
+		break;
+
+	case 0x0b:
+		m_Channels[byte & 0b11].mode = byte;
+		break;
+
+	case 0x0c:
+		m_HighByte = false;
+		break;
+
+	case 0x0d:
+		MasterClear();
+		break;
+
+	case 0x0e:
+		m_Mask = 0;
+		break;
+
+	case 0x0f:
+		m_Mask = byte & 0x0f;
+		break;
+	}
+}
+
+uint8_t DMA::ReadRegister(uint8_t port) {
+	if (port < 0x08) {
+		const Channel& c = m_Channels[port >> 1];
+		uint16_t value = (port & 1) ? c.count : c.address;
+
+		uint8_t byte = m_HighByte ? value >> 8 : value & 0xff;
+		m_HighByte = !m_HighByte;
+		return byte;
+	}
+
+	switch (port) {
+	case 0x08: {
+		// reading the status clears the terminal count bits
+		uint8_t status = m_Status | (m_Request << 4);
+		m_Status &= 0xf0;
+		return status;
+	}
+
+	case 0x0d:
+		return m_Temporary;
+
+	default:
+		return 0xff;
+	}
+}
+
+size_t DMA::GetRun(const Channel& c, size_t length) const {
+	// the address counter is 16 bits and doesn't carry into the page register
+	size_t run = std::min<size_t>(length, c.count + 1);
+	return std::min<size_t>(run, c.IsDecrement() ? c.address + 1 : 0x10000 - c.address);
+}
+
+bool DMA::Advance(uint8_t channel, size_t n) {
+	Channel& c = m_Channels[channel];
+	bool terminal = n == static_cast<size_t>(c.count) + 1;
+
+	c.address = static_cast<uint16_t>(c.IsDecrement() ? c.address - n : c.address + n);
+	c.count = static_cast<uint16_t>(c.count - n);
+
+	if (terminal) {
+		m_Status |= 1 << channel;
+		m_Request &= ~(1 << channel);
+
+		if (c.IsAutoInit()) {
+			c.address = c.base_address;
+			c.count = c.base_count;
+		} else {
+			m_Mask |= 1 << channel;
+		}
+	}
+
+	return terminal;
+}
+
+size_t DMA::Transfer(uint8_t channel, std::span<uint8_t> buffer) {
+	size_t done = 0;
+
+	while (done < buffer.size() && !IsMasked(channel) && !(m_Command & 0b100)) {
+		Channel& c = m_Channels[channel];
+		size_t run = GetRun(c, buffer.size() - done);
+		std::span<uint8_t> part = buffer.subspan(done, run);
+
+		// a decrementing channel covers [address - run + 1, address] back to front
+		uint32_t physical = c.IsDecrement() ? c.GetPhysical() - run + 1 : c.GetPhysical();
+
+		switch (c.GetType()) {
+		case Write:
+			if (c.IsDecrement()) {
+				std::vector<uint8_t> reversed(part.rbegin(), part.rend());
+				m_Bus->WriteBlock(physical, reversed);
+			} else {
+				m_Bus->WriteBlock(physical, part);
+			}
+
+			break;
+
+		case Read:
+			m_Bus->ReadBlock(physical, part);
+			if (c.IsDecrement()) {
+				std::reverse(part.begin(), part.end());
+			}
+
+			break;
+
+		default:
+			break;
+		}
+
+		done += run;
+		if (Advance(channel, run)) {
+			break;
+		}
+	}
+
+	return done;
+}
+
+void DMA::MemoryToMemory() {
+	Channel& source = m_Channels[0];
+	Channel& target = m_Channels[1];
+	bool hold = m_Command & 0b10;
+
+	// software requests aren't masked, so this runs until channel 1 reaches terminal count
+	std::vector<uint8_t> buffer;
+	while (true) {
+		size_t run = GetRun(target, 0x10000);
+		if (!hold) {
+			run = GetRun(source, run);
+		}
+
+		// byte by byte, a copy onto a slightly higher address repeats the bytes in between, so
+		// never copy more at once than the distance between the two
+		if (!hold && !source.IsDecrement() && !target.IsDecrement() && target.GetPhysical() > source.GetPhysical()) {
+			run = std::min<size_t>(run, target.GetPhysical() - source.GetPhysical());
+		}
+
+		buffer.resize(run);
+		if (hold) {
+			std::fill(buffer.begin(), buffer.end(), m_Bus->ReadByte(source.GetPhysical()));
+		} else {
+			m_Bus->ReadBlock(source.IsDecrement() ? source.GetPhysical() - run + 1 : source.GetPhysical(), buffer);
+			if (source.IsDecrement()) {
+				std::reverse(buffer.begin(), buffer.end());
+			}
+		}
+
+		m_Temporary = buffer.back();
+
+		if (target.IsDecrement()) {
+			std::reverse(buffer.begin(), buffer.end());
+			m_Bus->WriteBlock(target.GetPhysical() - run + 1, buffer);
+		} else {
+			m_Bus->WriteBlock(target.GetPhysical(), buffer);
+		}
+
+		if (!hold) {
+			Advance(0, run);
+		}
+
+		if (Advance(1, run)) {
+			break;
+		}
+	}
+
+	m_Request &= ~0b01;
+}
+
+void DMA::SaveState(StateWriter& state) const {
+	state.Write(m_Channels);
+	state.Write(m_Command);
+	state.Write(m_Status);
+	state.Write(m_Mask);
+	state.Write(m_Request);
+	state.Write(m_Temporary);
+	state.Write(m_HighByte);
+}
+
+void DMA::LoadState(StateReader& state) {
+	state.Read(m_Channels);
+	state.Read(m_Command);
+	state.Read(m_Status);
+	state.Read(m_Mask);
+	state.Read(m_Request);
+	state.Read(m_Temporary);
+	state.Read(m_HighByte);
+}
\ No newline at end of file
@@ -0,0 +1,90 @@
+#ifndef DMA_HPP
+#define DMA_HPP
+
+#include "component.hpp"
+
+#include <array>
+#include <span>
+
+namespace xe86 {
+	/*
+	INTEL 8237 DMA CONTROLLER
+		four channels at 00h-0Fh, with the page registers that supply address bits 16-19 at 87h,
+		83h, 81h and 82h. channel 0 refreshes dram on a pc and channel 2 belongs to the floppy.
+
+		devices don't raise DREQ and wait to be clocked a byte at a time. they call Transfer with
+		the whole buffer and the controller moves as much as the channel is programmed for, in
+		runs that stop only at the 64 KB page boundary the 8237 can't carry across, using the bus
+		block accessors. memory-to-memory copies (channel 0 to channel 1) start when channel 0 is
+		requested in software and complete at once. transfers take no guest time.
+	*/
+	class DMA final : public Component {
+	public:
+		DMA(const DMA&) = delete;
+		DMA& operator=(const DMA&) = delete;
+
+		DMA(std::shared_ptr<Bus> bus);
+
+		void Reset() override;
+		void Step() override {}
+
+		// only does anything when a port is written or a device transfers
+		bool IsIdle() const override { return true; }
+
+		void SaveState(StateWriter& state) const override;
+		void LoadState(StateReader& state) override;
+
+		// device side. moves between buffer and memory in whichever direction the channel's mode says:
+		// a write transfer fills memory from the buffer, a read transfer fills the buffer from memory.
+		// returns how many bytes were moved, which is short of the buffer if terminal count was reached.
+		size_t Transfer(uint8_t channel, std::span<uint8_t> buffer);
+
+		bool IsMasked(uint8_t channel) const { return m_Mask & (1 << channel); }
+		bool IsTerminalCount(uint8_t channel) const { return m_Status & (1 << channel); }
+
+	private:
+		enum TransferType : uint8_t {
+			Verify = 0b00,
+			Write = 0b01,	// device to memory
+			Read = 0b10,	// memory to device
+		};
+
+		struct Channel {
+			uint16_t base_address = 0;
+			uint16_t base_count = 0;
+			uint16_t address = 0;
+			uint16_t count = 0;
+			uint8_t page = 0;
+			uint8_t mode = 0;
+
+			TransferType GetType() const { return static_cast<TransferType>((mode >> 2) & 0b11); }
+			bool IsAutoInit() const { return mode & 0b00010000; }
+			bool IsDecrement() const { return mode & 0b00100000; }
+			uint32_t GetPhysical() const { return ((page & 0x0f) << 16) | address; }
+		};
+
+		void WriteRegister(uint8_t port, uint8_t byte);
+		uint8_t ReadRegister(uint8_t port);
+		void MasterClear();
+
+		// the most the channel can move in one contiguous run, up to length
+		size_t GetRun(const Channel& c, size_t length) const;
+
+		// advance the channel past n bytes. returns true if that reached terminal count
+		bool Advance(uint8_t channel, size_t n);
+
+		void MemoryToMemory();
+
+	private:
+		std::array<Channel, 4> m_Channels;
+
+		uint8_t m_Command = 0;
+		uint8_t m_Status = 0;	// terminal count in bits 0-3, request in bits 4-7
+		uint8_t m_Mask = 0x0f;
+		uint8_t m_Request = 0;
+		uint8_t m_Temporary = 0;
+		bool m_HighByte = false;
+	};
+}
+
+#endif
\ No newline at end of file
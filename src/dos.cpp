@@ -0,0 +1,508 @@
+#include "dos.hpp"
+#include <print>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <vector>
+#include <cstdio>
+
+using namespace xe86;
+
+DOS::DOS(std::shared_ptr<Bus> bus, CPU& cpu) : m_Bus(bus), m_Cpu(cpu) {
+	m_Output = [](uint16_t handle, std::span<const uint8_t> data) {
+		std::FILE* stream = handle == 2 ? stderr : stdout;
+		std::fwrite(data.data(), 1, data.size(), stream);
+		std::fflush(stream);
+	};
+
+	m_Cpu.SetInterruptHook(0x20, [this]() {
+		Exit(0);
+		return true;
+	});
+
+	m_Cpu.SetInterruptHook(0x21, [this]() { return Int21(); });
+}
+
+bool DOS::Load(std::string_view path, std::string_view arguments) {
+	std::ifstream file{ std::string(path), std::ios::binary };
+	if (!file) {
+		std::println(stderr, "dos: failed to open '{}'", path);
+		return false;
+	}
+
+	std::vector<uint8_t> image{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+
+	// an IRET behind every vector, and somewhere to halt once the program is done
+	const uint8_t stub[] = {
+		0xcf,				// IRET
+		0xf4,				// HLT
+		0xeb, 0xfd,			// JMP back to the HLT
+	};
+
+	for (size_t i = 0; i < sizeof(stub); i++) {
+		WriteByte(StubSegment, static_cast<uint16_t>(i), stub[i]);
+	}
+
+	for (uint16_t vector = 0; vector < 256; vector++) {
+		WriteWord(0, vector * 4 + 0, 0x0000);
+		WriteWord(0, vector * 4 + 2, StubSegment);
+	}
+
+	// an empty environment, then the count of strings after it and the program's own path
+	WriteWord(EnvironmentSegment, 0, 0x0000);
+	WriteWord(EnvironmentSegment, 2, 0x0001);
+	for (size_t i = 0; i < path.size() && i < 0x7f; i++) {
+		WriteByte(EnvironmentSegment, static_cast<uint16_t>(4 + i), static_cast<uint8_t>(path[i]));
+	}
+
+	WriteByte(EnvironmentSegment, static_cast<uint16_t>(4 + std::min<size_t>(path.size(), 0x7f)), 0);
+
+	m_Exited = false;
+	m_ExitCode = 0;
+	m_DtaSegment = PspSegment;
+	m_DtaOffset = 0x80;
+
+	bool is_exe = image.size() >= 0x1c && ((image[0] == 'M' && image[1] == 'Z') || (image[0] == 'Z' && image[1] == 'M'));
+	if (!(is_exe ? LoadExe(image) : LoadCom(image))) {
+		return false;
+	}
+
+	BuildPsp(arguments);
+	m_Free = m_ProgramEnd;
+
+	// interrupts on, as DOS leaves them for a program
+	Registers& registers = m_Cpu.GetRegisters();
+	registers.flags = static_cast<Flags>(static_cast<uint16_t>(Flags::IF));
+	return true;
+}
+
+bool DOS::LoadCom(std::span<const uint8_t> image) {
+	// the whole segment, less the PSP and a word of stack
+	if (image.size() > 0x10000 - 0x100 - 2) {
+		std::println(stderr, "dos: a .com can't be larger than 65278 bytes");
+		return false;
+	}
+
+	m_Bus->WriteBlock(Address20(PspSegment, 0x100), image);
+	m_ProgramEnd = MemoryTop;
+	m_ImageStart = Address20(PspSegment, 0x100);
+	m_ImageSize = static_cast<uint32_t>(image.size());
+
+	// a RET from the program lands on the INT 20h at the start of the PSP
+	Registers& registers = m_Cpu.GetRegisters();
+	registers = {};
+	m_Cpu.SetSegment(CS, PspSegment);
+	m_Cpu.SetSegment(DS, PspSegment);
+	m_Cpu.SetSegment(ES, PspSegment);
+	m_Cpu.SetSegment(SS, PspSegment);
+
+	registers.ip = 0x100;
+	registers.sp = 0xfffe;
+	WriteWord(PspSegment, 0xfffe, 0x0000);
+
+	return true;
+}
+
+bool DOS::LoadExe(std::span<const uint8_t> image) {
+	auto word = [&](size_t offset) -> uint16_t { return image[offset] | (image[offset + 1] << 8); };
+
+	uint16_t last_page = word(0x02);
+	uint16_t pages = word(0x04);
+	uint16_t relocations = word(0x06);
+	uint16_t header = word(0x08);
+	uint16_t min_alloc = word(0x0a);
+	uint16_t max_alloc = word(0x0c);
+	uint16_t ss = word(0x0e);
+	uint16_t sp = word(0x10);
+	uint16_t ip = word(0x14);
+	uint16_t cs = word(0x16);
+	uint16_t relocation_table = word(0x18);
+
+	// the load module is everything the page count covers after the header
+	size_t size = pages * 512 - (last_page ? 512 - last_page : 0);
+	size_t start = header * 16;
+	if (size > image.size() || start > size || relocation_table + relocations * 4u > image.size()) {
+		std::println(stderr, "dos: the exe header doesn't match the file");
+		return false;
+	}
+
+	size_t module = size - start;
+	uint16_t load = PspSegment + PspSize;
+	uint32_t module_paragraphs = static_cast<uint32_t>((module + 15) / 16);
+	if (load + module_paragraphs + min_alloc > MemoryTop) {
+		std::println(stderr, "dos: the program needs more memory than there is");
+		return false;
+	}
+
+	m_Bus->WriteBlock(Address20(load, 0), image.subspan(start, module));
+	m_ImageStart = Address20(load, 0);
+	m_ImageSize = static_cast<uint32_t>(module);
+
+	// each relocation is a far pointer into the module to a word that gets the load segment added
+	for (uint16_t i = 0; i < relocations; i++) {
+		uint16_t offset = word(relocation_table + i * 4 + 0);
+		uint16_t segment = word(relocation_table + i * 4 + 2);
+		WriteWord(load + segment, offset, ReadWord(load + segment, offset) + load);
+	}
+
+	m_ProgramEnd = static_cast<uint16_t>(std::min<uint32_t>(MemoryTop, load + module_paragraphs + max_alloc));
+
+	Registers& registers = m_Cpu.GetRegisters();
+	registers = {};
+	m_Cpu.SetSegment(CS, load + cs);
+	m_Cpu.SetSegment(SS, load + ss);
+	m_Cpu.SetSegment(DS, PspSegment);
+	m_Cpu.SetSegment(ES, PspSegment);
+
+	registers.ip = ip;
+	registers.sp = sp;
+
+	return true;
+}
+
+void DOS::BuildPsp(std::string_view arguments) {
+	for (uint16_t offset = 0; offset < 0x100; offset++) {
+		WriteByte(PspSegment, offset, 0);
+	}
+
+	// INT 20h, then the first segment past the program's memory
+	WriteByte(PspSegment, 0x00, 0xcd);
+	WriteByte(PspSegment, 0x01, 0x20);
+	WriteWord(PspSegment, 0x02, m_ProgramEnd);
+
+	// terminate, ctrl-break and critical error addresses as the vectors have them
+	for (uint16_t i = 0; i < 3; i++) {
+		WriteWord(PspSegment, 0x0a + i * 4 + 0, 0x0000);
+		WriteWord(PspSegment, 0x0a + i * 4 + 2, StubSegment);
+	}
+
+	WriteWord(PspSegment, 0x16, PspSegment);	// parent, itself like COMMAND.COM
+	WriteWord(PspSegment, 0x2c, EnvironmentSegment);
+
+	// INT 21h, RETF for programs that call into DOS this way
+	WriteByte(PspSegment, 0x50, 0xcd);
+	WriteByte(PspSegment, 0x51, 0x21);
+	WriteByte(PspSegment, 0x52, 0xcb);
+
+	// blank file control blocks
+	for (uint16_t fcb : { 0x5c, 0x6c }) {
+		for (uint16_t i = 1; i <= 11; i++) {
+			WriteByte(PspSegment, fcb + i, ' ');
+		}
+	}
+
+	// the command tail, with the leading space DOS keeps
+	std::string tail = arguments.empty() ? std::string() : " " + std::string(arguments);
+	tail.resize(std::min<size_t>(tail.size(), 126));
+
+	WriteByte(PspSegment, 0x80, static_cast<uint8_t>(tail.size()));
+	for (size_t i = 0; i < tail.size(); i++) {
+		WriteByte(PspSegment, static_cast<uint16_t>(0x81 + i), static_cast<uint8_t>(tail[i]));
+	}
+
+	WriteByte(PspSegment, static_cast<uint16_t>(0x81 + tail.size()), 0x0d);
+}
+
+bool DOS::Int21() {
+	Registers& r = m_Cpu.GetRegisters();
+
+	switch (static_cast<uint8_t>(r.ah)) {
+		// terminate
+		case 0x00: {
+			Exit(0);
+			break;
+		}
+
+		// read a character with echo, and without
+		case 0x01:
+		case 0x07:
+		case 0x08: {
+			int c = m_Input();
+			r.al = c == EOF ? 0x1a : static_cast<uint8_t>(c);
+			if (r.ah == 0x01) {
+				uint8_t echo = r.al;
+				Write(1, std::span<const uint8_t>(&echo, 1));
+			}
+
+			break;
+		}
+
+		// write a character
+		case 0x02: {
+			uint8_t c = r.dl;
+			Write(1, std::span<const uint8_t>(&c, 1));
+			r.al = c;
+			break;
+		}
+
+		// direct console i/o. input never has anything waiting
+		case 0x06: {
+			if (r.dl == 0xff) {
+				r.al = 0;
+				r.flags = static_cast<Flags>(static_cast<uint16_t>(r.flags) | static_cast<uint16_t>(Flags::ZF));
+			} else {
+				uint8_t c = r.dl;
+				Write(1, std::span<const uint8_t>(&c, 1));
+				r.al = c;
+			}
+
+			break;
+		}
+
+		// write a string ending in '$'
+		case 0x09: {
+			std::vector<uint8_t> text;
+			for (uint16_t offset = r.dx; text.size() < 0x10000; offset++) {
+				uint8_t c = ReadByte(r.ds, offset);
+				if (c == '$') {
+					break;
+				}
+
+				text.push_back(c);
+			}
+
+			Write(1, text);
+			r.al = '$';
+			break;
+		}
+
+		// input status, nothing waiting
+		case 0x0b: {
+			r.al = 0x00;
+			break;
+		}
+
+		// current drive, C:
+		case 0x19: {
+			r.al = 0x02;
+			break;
+		}
+
+		// set and get the disk transfer address
+		case 0x1a: {
+			m_DtaSegment = r.ds;
+			m_DtaOffset = r.dx;
+			break;
+		}
+
+		case 0x2f: {
+			m_Cpu.SetSegment(ES, m_DtaSegment);
+			r.bx = m_DtaOffset;
+			break;
+		}
+
+		// set and get an interrupt vector
+		case 0x25: {
+			WriteWord(0, r.al * 4 + 0, r.dx);
+			WriteWord(0, r.al * 4 + 2, r.ds);
+			break;
+		}
+
+		case 0x35: {
+			r.bx = ReadWord(0, r.al * 4 + 0);
+			m_Cpu.SetSegment(ES, ReadWord(0, r.al * 4 + 2));
+			break;
+		}
+
+		// date, always 1 January 1980, a Tuesday
+		case 0x2a: {
+			r.cx = 1980;
+			r.dh = 1;
+			r.dl = 1;
+			r.al = 2;
+			break;
+		}
+
+		// time since midnight, in guest time
+		case 0x2c: {
+			uint64_t hundredths = m_Bus->GetScheduler().GetNow() * 100 / CyclesPerSecond;
+			r.ch = static_cast<uint8_t>(hundredths / 360000 % 24);
+			r.cl = static_cast<uint8_t>(hundredths / 6000 % 60);
+			r.dh = static_cast<uint8_t>(hundredths / 100 % 60);
+			r.dl = static_cast<uint8_t>(hundredths % 100);
+			break;
+		}
+
+		// version, 5.0
+		case 0x30: {
+			r.ax = 0x0005;
+			r.bx = 0x0000;
+			r.cx = 0x0000;
+			break;
+		}
+
+		// open and create, there are no files
+		case 0x3c:
+		case 0x3d: {
+			Fail(0x02);
+			break;
+		}
+
+		// close
+		case 0x3e: {
+			if (r.bx > 4) {
+				Fail(0x06);
+			} else {
+				SetCarry(false);
+			}
+
+			break;
+		}
+
+		// read from a handle, only stdin has anything
+		case 0x3f: {
+			if (r.bx != 0) {
+				Fail(0x06);
+				break;
+			}
+
+			uint16_t count = 0;
+			while (count < r.cx) {
+				int c = m_Input();
+				if (c == EOF) {
+					break;
+				}
+
+				WriteByte(r.ds, r.dx + count++, static_cast<uint8_t>(c));
+				if (c == '\n') {
+					break;
+				}
+			}
+
+			r.ax = count;
+			SetCarry(false);
+			break;
+		}
+
+		// write to a handle
+		case 0x40: {
+			if (r.bx < 1 || r.bx > 4) {
+				Fail(0x06);
+				break;
+			}
+
+			std::vector<uint8_t> data(r.cx);
+			m_Bus->ReadBlock(Address20(r.ds, r.dx), data);
+			Write(r.bx, data);
+
+			r.ax = r.cx;
+			SetCarry(false);
+			break;
+		}
+
+		// ioctl, device information: the standard handles are the console
+		case 0x44: {
+			if (r.al == 0x00 && r.bx <= 4) {
+				r.dx = r.bx <= 2 ? 0x80d3 : 0x80c0;
+				SetCarry(false);
+			} else {
+				Fail(0x01);
+			}
+
+			break;
+		}
+
+		// allocate memory, from whatever is past the program and earlier allocations
+		case 0x48: {
+			if (m_Free + r.bx <= MemoryTop) {
+				r.ax = m_Free;
+				m_Free += r.bx;
+				SetCarry(false);
+			} else {
+				r.bx = MemoryTop - m_Free;
+				Fail(0x08);
+			}
+
+			break;
+		}
+
+		// free memory. nothing is given back, there is only ever one program
+		case 0x49: {
+			SetCarry(false);
+			break;
+		}
+
+		// resize a block. the program's own can grow while nothing is allocated after it
+		case 0x4a: {
+			if (r.es != PspSegment) {
+				SetCarry(false);
+				break;
+			}
+
+			uint32_t end = PspSegment + r.bx;
+			uint16_t limit = m_Free == m_ProgramEnd ? MemoryTop : m_ProgramEnd;
+			if (end > limit) {
+				r.bx = limit - PspSegment;
+				Fail(0x08);
+				break;
+			}
+
+			if (m_Free == m_ProgramEnd) {
+				m_Free = static_cast<uint16_t>(end);
+			}
+
+			m_ProgramEnd = static_cast<uint16_t>(end);
+			SetCarry(false);
+			break;
+		}
+
+		// terminate with a return code
+		case 0x4c: {
+			Exit(r.al);
+			break;
+		}
+
+		// return code of the last child, there never is one
+		case 0x4d: {
+			r.ax = 0x0000;
+			break;
+		}
+
+		// current PSP
+		case 0x51:
+		case 0x62: {
+			r.bx = PspSegment;
+			break;
+		}
+
+		default: {
+			if (!m_Reported[r.ah]) {
+				m_Reported[r.ah] = true;
+				std::println(stderr, "dos: unsupported int 21h function {:02x}", static_cast<uint8_t>(r.ah));
+			}
+
+			Fail(0x01);
+			break;
+		}
+	}
+
+	return true;
+}
+
+void DOS::Exit(uint8_t code) {
+	m_Exited = true;
+	m_ExitCode = code;
+
+	// park the cpu on the HLT in the stub with interrupts off
+	Registers& registers = m_Cpu.GetRegisters();
+	m_Cpu.SetSegment(CS, StubSegment);
+	registers.ip = 0x0001;
+	registers.flags = static_cast<Flags>(static_cast<uint16_t>(registers.flags) & ~static_cast<uint16_t>(Flags::IF));
+}
+
+void DOS::Write(uint16_t handle, std::span<const uint8_t> data) {
+	if (m_Output && !data.empty()) {
+		m_Output(handle, data);
+	}
+}
+
+void DOS::SetCarry(bool carry) {
+	Registers& registers = m_Cpu.GetRegisters();
+	uint16_t flags = static_cast<uint16_t>(registers.flags) & ~static_cast<uint16_t>(Flags::CF);
+	registers.flags = static_cast<Flags>(flags | (carry ? static_cast<uint16_t>(Flags::CF) : 0));
+}
+
+void DOS::Fail(uint16_t error) {
+	m_Cpu.GetRegisters().ax = error;
+	SetCarry(true);
+}
\ No newline at end of file
@@ -0,0 +1,105 @@
+#ifndef DOS_HPP
+#define DOS_HPP
+
+#include "bus.hpp"
+#include "cpu.hpp"
+
+#include <array>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <functional>
+#include <span>
+
+namespace xe86 {
+	/*
+	DOS PROGRAM LOADER
+		runs a .COM or MZ .EXE straight away instead of booting the bios: the program goes into
+		ram after a PSP the way DOS would lay it out, every interrupt vector points at an IRET,
+		and the cpu starts at the program's entry point. nothing in the rom runs at all.
+
+		INT 20h and INT 21h are answered on the host side by hooking the INT instruction, for
+		the console, handle i/o on stdin/stdout/stderr, vectors, memory blocks, version, date and
+		time. there's no file system: opening files fails, as it would on an empty drive. the
+		date is fixed and the time counts from midnight in guest time, so a run is reproducible.
+
+		memory, from the bottom:
+			0000:0000	interrupt vector table
+			0070:0000	IRET for every vector, then HLT for after the program exits
+			0080:0000	environment
+			0090:0000	PSP, then the program
+	*/
+	class DOS {
+	public:
+		DOS(std::shared_ptr<Bus> bus, CPU& cpu);
+
+		DOS(const DOS&) = delete;
+		DOS& operator=(const DOS&) = delete;
+
+		// call after the machine has been reset. arguments is the command tail, as typed after the name
+		bool Load(std::string_view path, std::string_view arguments = {});
+
+		bool HasExited() const { return m_Exited; }
+		uint8_t GetExitCode() const { return m_ExitCode; }
+
+		// the linear addresses the program image was loaded to: a .COM's first byte at PSP:0100,
+		// an .EXE's load module at the segment after the PSP
+		uint32_t GetImageStart() const { return m_ImageStart; }
+		uint32_t GetImageSize() const { return m_ImageSize; }
+
+		// where the program's output goes, stdout and stderr by default
+		void SetOutput(std::function<void(uint16_t handle, std::span<const uint8_t> data)> output) { m_Output = std::move(output); }
+
+		// where the program's input comes from a byte at a time, EOF at the end. stdin by default
+		void SetInput(std::function<int()> input) { m_Input = std::move(input); }
+
+	private:
+		static constexpr uint16_t StubSegment = 0x0070;
+		static constexpr uint16_t EnvironmentSegment = 0x0080;
+		static constexpr uint16_t PspSegment = 0x0090;
+		static constexpr uint16_t MemoryTop = 0xa000;
+
+		// paragraphs
+		static constexpr uint16_t PspSize = 0x10;
+
+		bool LoadCom(std::span<const uint8_t> image);
+		bool LoadExe(std::span<const uint8_t> image);
+		void BuildPsp(std::string_view arguments);
+
+		bool Int21();
+		void Exit(uint8_t code);
+
+		void Write(uint16_t handle, std::span<const uint8_t> data);
+		void SetCarry(bool carry);
+		void Fail(uint16_t error);
+
+		uint8_t ReadByte(uint16_t segment, uint16_t offset) { return m_Bus->ReadByte(Address20(segment, offset)); }
+		uint16_t ReadWord(uint16_t segment, uint16_t offset) { return m_Bus->ReadWord(Address20(segment, offset)); }
+		void WriteByte(uint16_t segment, uint16_t offset, uint8_t byte) { m_Bus->WriteByte(Address20(segment, offset), byte); }
+		void WriteWord(uint16_t segment, uint16_t offset, uint16_t word) { m_Bus->WriteWord(Address20(segment, offset), word); }
+
+	private:
+		std::shared_ptr<Bus> m_Bus;
+		CPU& m_Cpu;
+
+		std::function<void(uint16_t, std::span<const uint8_t>)> m_Output;
+		std::function<int()> m_Input = [] { return std::getchar(); };
+
+		// one program's worth of memory management: everything from m_Free up is unallocated
+		uint16_t m_ProgramEnd = 0;
+		uint32_t m_ImageStart = 0;
+		uint32_t m_ImageSize = 0;
+		uint16_t m_Free = 0;
+
+		uint16_t m_DtaSegment = 0;
+		uint16_t m_DtaOffset = 0;
+
+		bool m_Exited = false;
+		uint8_t m_ExitCode = 0;
+
+		// each unsupported function is only reported once
+		std::array<bool, 256> m_Reported{};
+	};
+}
+
+#endif
\ No newline at end of file
@@ -3,21 +3,22 @@
 
 #include "bus.hpp"
 #include "component.hpp"
+#include "machine.hpp"
 
 #include <vector>
 #include <print>
 #include <string>
 
 namespace xe86 {
-	class EmulatorState {
+	class EmulatorState : public MachineBase<EmulatorState> {
 	public:
-		EmulatorState(std::string_view bios_rom) : m_Bus(std::make_shared<Bus>(bios_rom)) {}
-		EmulatorState(std::shared_ptr<Bus> bus) : m_Bus(bus) {}
+		EmulatorState(std::string_view bios_rom) : MachineBase(std::make_shared<Bus>(bios_rom)) {}
+		EmulatorState(std::shared_ptr<Bus> bus) : MachineBase(bus) {}
 
 		template <typename T>
 		void AttachComponent() {
 			auto component = std::make_unique<T>(m_Bus);
-			std::println("emulator: adding new component '{}'", component->GetHumanName());
+			std::println(stderr, "emulator: adding new component '{}'", component->GetHumanName());
 			m_Components.push_back(std::move(component));
 		}
 
@@ -27,14 +28,35 @@ namespace xe86 {
 			}
 		}
 
-		void Step() {
+		void StepComponents() {
 			for (auto& component : m_Components) {
 				component->Step();
 			}
 		}
 
+		bool IsIdle() const {
+			for (auto& component : m_Components) {
+				if (!component->IsIdle()) {
+					return false;
+				}
+			}
+
+			return !m_Components.empty();
+		}
+
+		void SaveComponents(StateWriter& state) {
+			for (auto& component : m_Components) {
+				component->SaveState(state);
+			}
+		}
+
+		void LoadComponents(StateReader& state) {
+			for (auto& component : m_Components) {
+				component->LoadState(state);
+			}
+		}
+
 	private:
-		std::shared_ptr<Bus> m_Bus;
 		std::vector<std::unique_ptr<Component>> m_Components;
 	};
 }
@@ -0,0 +1,912 @@
+#include "float80.hpp"
+
+#include <bit>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+
+using namespace xe86;
+
+namespace {
+	// wide enough for a full product or quotient plus the bits rounding needs
+	struct U128 {
+		uint64_t hi = 0;
+		uint64_t lo = 0;
+	};
+
+	bool IsZero(U128 v) {
+		return (v.hi | v.lo) == 0;
+	}
+
+	bool Less(U128 a, U128 b) {
+		return a.hi != b.hi ? a.hi < b.hi : a.lo < b.lo;
+	}
+
+	U128 AddWide(U128 a, U128 b, bool& carry) {
+		U128 r{ a.hi + b.hi, a.lo + b.lo };
+		carry = r.hi < a.hi;
+
+		if (r.lo < a.lo) {
+			r.hi++;
+			carry |= r.hi == 0;
+		}
+
+		return r;
+	}
+
+	// a >= b
+	U128 SubtractWide(U128 a, U128 b) {
+		return { a.hi - b.hi - (a.lo < b.lo), a.lo - b.lo };
+	}
+
+	U128 ShiftLeft(U128 v, int n) {
+		if (n == 0) return v;
+		if (n >= 128) return {};
+		if (n >= 64) return { v.lo << (n - 64), 0 };
+		return { (v.hi << n) | (v.lo >> (64 - n)), v.lo << n };
+	}
+
+	// anything shifted out is kept as a sticky bit in bit 0
+	U128 ShiftRightSticky(U128 v, int n) {
+		if (n == 0) return v;
+
+		U128 r;
+		bool sticky;
+		if (n >= 128) {
+			r = {};
+			sticky = !IsZero(v);
+		} else if (n >= 64) {
+			r = { 0, v.hi >> (n - 64) };
+			sticky = v.lo != 0 || (n > 64 && (v.hi << (128 - n)) != 0);
+		} else {
+			r = { v.hi >> n, (v.lo >> n) | (v.hi << (64 - n)) };
+			sticky = (v.lo << (64 - n)) != 0;
+		}
+
+		r.lo |= sticky;
+		return r;
+	}
+
+	int CountLeadingZeros(U128 v) {
+		return v.hi ? std::countl_zero(v.hi) : 64 + std::countl_zero(v.lo);
+	}
+
+	U128 MultiplyWide(uint64_t a, uint64_t b) {
+		uint64_t a0 = a & 0xffffffff, a1 = a >> 32;
+		uint64_t b0 = b & 0xffffffff, b1 = b >> 32;
+
+		uint64_t p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+		uint64_t middle = (p00 >> 32) + (p01 & 0xffffffff) + (p10 & 0xffffffff);
+
+		return { p11 + (p01 >> 32) + (p10 >> 32) + (middle >> 32), (middle << 32) | (p00 & 0xffffffff) };
+	}
+
+	int GetPrecisionBits(Precision precision) {
+		switch (precision) {
+			case Precision::Single: return 24;
+			case Precision::Double: return 53;
+			default: return 64;
+		}
+	}
+
+	enum class Outcome : uint8_t { Finite, Infinity, Largest };
+
+	struct Rounded {
+		Outcome outcome;
+		int32_t exponent;		// biased as the extended format is
+		uint64_t significand;	// integer bit in bit 63, clear if denormal
+	};
+
+	// significand has its integer bit at bit 127 and exponent applies to that bit. rounds to bits of
+	// precision within [min_exponent, max_exponent], going denormal below and overflowing above
+	Rounded Round(bool sign, int32_t exponent, U128 significand, int bits, int32_t min_exponent, int32_t max_exponent, FloatEnvironment& env) {
+		bool tiny = exponent < min_exponent;
+		if (tiny) {
+			significand = ShiftRightSticky(significand, std::min(min_exponent - exponent, 200));
+			exponent = min_exponent;
+		}
+
+		// bits is at most 64, so everything kept is in hi
+		int k = 64 - bits;
+		uint64_t kept = significand.hi >> k;
+
+		bool half, rest;
+		if (k == 0) {
+			half = significand.lo >> 63;
+			rest = (significand.lo << 1) != 0;
+		} else {
+			half = (significand.hi >> (k - 1)) & 1;
+			rest = (significand.hi & ((1ull << (k - 1)) - 1)) != 0 || significand.lo != 0;
+		}
+
+		bool inexact = half || rest;
+
+		bool increment = false;
+		switch (env.rounding) {
+			case Rounding::Nearest: increment = half && (rest || (kept & 1)); break;
+			case Rounding::Down: increment = inexact && sign; break;
+			case Rounding::Up: increment = inexact && !sign; break;
+			case Rounding::Chop: break;
+		}
+
+		uint64_t top = 1ull << (bits - 1);
+		if (increment) {
+			kept++;
+
+			// carried out of the top, 1.111... became 10.000...
+			if ((bits == 64 && kept == 0) || (bits < 64 && kept == top << 1)) {
+				kept = top;
+				exponent++;
+			}
+		}
+
+		if (exponent > max_exponent) {
+			env.flags |= FloatException::Overflow | FloatException::Precision;
+
+			bool infinity = false;
+			switch (env.rounding) {
+				case Rounding::Nearest: infinity = true; break;
+				case Rounding::Down: infinity = sign; break;
+				case Rounding::Up: infinity = !sign; break;
+				case Rounding::Chop: break;
+			}
+
+			if (infinity) {
+				return { Outcome::Infinity, 0, 0 };
+			}
+
+			uint64_t largest = bits == 64 ? ~0ull : ((top << 1) - 1) << k;
+			return { Outcome::Largest, max_exponent, largest };
+		}
+
+		if (inexact) {
+			env.flags |= FloatException::Precision;
+			if (tiny) {
+				env.flags |= FloatException::Underflow;
+			}
+		}
+
+		return { Outcome::Finite, exponent, kept << k };
+	}
+
+	Float80 PackExtended(bool sign, const Rounded& rounded) {
+		switch (rounded.outcome) {
+			case Outcome::Infinity: return Float80::Infinity(sign);
+			case Outcome::Largest: return Float80::Make(sign, static_cast<uint16_t>(rounded.exponent), rounded.significand);
+			case Outcome::Finite: break;
+		}
+
+		// denormals and zero keep a zero exponent
+		if (!(rounded.significand >> 63)) {
+			return Float80::Make(sign, 0, rounded.significand);
+		}
+
+		return Float80::Make(sign, static_cast<uint16_t>(rounded.exponent), rounded.significand);
+	}
+
+	Float80 RoundPack(bool sign, int32_t exponent, U128 significand, FloatEnvironment& env) {
+		if (IsZero(significand)) {
+			return Float80::Zero(sign);
+		}
+
+		int shift = CountLeadingZeros(significand);
+		significand = ShiftLeft(significand, shift);
+		exponent -= shift;
+
+		Rounded rounded = Round(sign, exponent, significand, GetPrecisionBits(env.precision), 1, Float80::MaxExponent - 1, env);
+		return PackExtended(sign, rounded);
+	}
+
+	// significand * 2^(exponent - 63) to an integer in the environment's direction. exponent below 64
+	uint64_t RoundMagnitude(uint64_t significand, int32_t exponent, bool sign, Rounding rounding, bool& inexact) {
+		if (exponent >= 63) {
+			inexact = false;
+			return significand;
+		}
+
+		int shift = 63 - exponent;
+		uint64_t integer;
+		bool half, rest;
+
+		if (shift > 64) {
+			integer = 0;
+			half = false;
+			rest = significand != 0;
+		} else if (shift == 64) {
+			integer = 0;
+			half = significand >> 63;
+			rest = (significand << 1) != 0;
+		} else {
+			integer = significand >> shift;
+			half = (significand >> (shift - 1)) & 1;
+			rest = (significand & ((1ull << (shift - 1)) - 1)) != 0;
+		}
+
+		inexact = half || rest;
+
+		switch (rounding) {
+			case Rounding::Nearest: integer += half && (rest || (integer & 1)); break;
+			case Rounding::Down: integer += inexact && sign; break;
+			case Rounding::Up: integer += inexact && !sign; break;
+			case Rounding::Chop: break;
+		}
+
+		return integer;
+	}
+
+	void CheckDenormal(Float80 a, FloatEnvironment& env) {
+		if (a.IsDenormal() || a.IsUnnormal()) {
+			env.flags |= FloatException::Denormal;
+		}
+	}
+}
+
+void SoftFloat::Unpack(Float80 a, int32_t& exponent, uint64_t& significand) {
+	exponent = a.GetExponent();
+	significand = a.significand;
+
+	// denormals are scaled like the smallest normal, then everything is normalized the same way
+	if (exponent == 0) {
+		exponent = 1;
+	}
+
+	int shift = std::countl_zero(significand);
+	significand <<= shift;
+	exponent -= shift;
+}
+
+Float80 SoftFloat::PropagateNaN(Float80 a, Float80 b, FloatEnvironment& env) {
+	if (a.IsSignalingNaN() || b.IsSignalingNaN()) {
+		env.flags |= FloatException::Invalid;
+	}
+
+	Float80 result;
+	if (a.IsNaN() && b.IsNaN()) {
+		result = a.significand >= b.significand ? a : b;
+	} else {
+		result = a.IsNaN() ? a : b;
+	}
+
+	result.significand |= 0xc000000000000000ull;
+	return result;
+}
+
+Float80 SoftFloat::Add(Float80 a, Float80 b, FloatEnvironment& env) {
+	if (a.IsNaN() || b.IsNaN()) {
+		return PropagateNaN(a, b, env);
+	}
+
+	if (a.IsInfinity() || b.IsInfinity()) {
+		if (a.IsInfinity() && b.IsInfinity()) {
+			if (!env.affine || a.GetSign() != b.GetSign()) {
+				env.flags |= FloatException::Invalid;
+				return Float80::Indefinite();
+			}
+
+			return a;
+		}
+
+		CheckDenormal(a.IsInfinity() ? b : a, env);
+		return a.IsInfinity() ? a : b;
+	}
+
+	CheckDenormal(a, env);
+	CheckDenormal(b, env);
+
+	if (a.IsZero() && b.IsZero()) {
+		bool sign = a.GetSign() == b.GetSign() ? a.GetSign() : env.rounding == Rounding::Down;
+		return Float80::Zero(sign);
+	}
+
+	// still rounded, to the precision in use
+	if (a.IsZero() || b.IsZero()) {
+		Float80 x = a.IsZero() ? b : a;
+		int32_t exponent;
+		uint64_t significand;
+		Unpack(x, exponent, significand);
+		return RoundPack(x.GetSign(), exponent, { significand, 0 }, env);
+	}
+
+	int32_t ea, eb;
+	uint64_t sa, sb;
+	Unpack(a, ea, sa);
+	Unpack(b, eb, sb);
+
+	bool sign_a = a.GetSign(), sign_b = b.GetSign();
+	if (ea < eb || (ea == eb && sa < sb)) {
+		std::swap(ea, eb);
+		std::swap(sa, sb);
+		std::swap(sign_a, sign_b);
+	}
+
+	U128 x{ sa, 0 };
+	U128 y = ShiftRightSticky({ sb, 0 }, std::min(ea - eb, 200));
+
+	if (sign_a == sign_b) {
+		bool carry;
+		U128 sum = AddWide(x, y, carry);
+		if (carry) {
+			sum = ShiftRightSticky(sum, 1);
+			sum.hi |= 1ull << 63;
+			ea++;
+		}
+
+		return RoundPack(sign_a, ea, sum, env);
+	}
+
+	U128 difference = SubtractWide(x, y);
+	if (IsZero(difference)) {
+		return Float80::Zero(env.rounding == Rounding::Down);
+	}
+
+	return RoundPack(sign_a, ea, difference, env);
+}
+
+Float80 SoftFloat::Subtract(Float80 a, Float80 b, FloatEnvironment& env) {
+	return Add(a, b.IsNaN() ? b : b.Negate(), env);
+}
+
+Float80 SoftFloat::Multiply(Float80 a, Float80 b, FloatEnvironment& env) {
+	if (a.IsNaN() || b.IsNaN()) {
+		return PropagateNaN(a, b, env);
+	}
+
+	bool sign = a.GetSign() != b.GetSign();
+
+	if (a.IsInfinity() || b.IsInfinity()) {
+		if (a.IsZero() || b.IsZero()) {
+			env.flags |= FloatException::Invalid;
+			return Float80::Indefinite();
+		}
+
+		CheckDenormal(a.IsInfinity() ? b : a, env);
+		return Float80::Infinity(sign);
+	}
+
+	CheckDenormal(a, env);
+	CheckDenormal(b, env);
+
+	if (a.IsZero() || b.IsZero()) {
+		return Float80::Zero(sign);
+	}
+
+	int32_t ea, eb;
+	uint64_t sa, sb;
+	Unpack(a, ea, sa);
+	Unpack(b, eb, sb);
+
+	// two significands in [1, 2) multiply to [1, 4), so the top bit of the product is 2^1 or 2^0
+	U128 product = MultiplyWide(sa, sb);
+	return RoundPack(sign, ea + eb - Float80::Bias + 1, product, env);
+}
+
+Float80 SoftFloat::Divide(Float80 a, Float80 b, FloatEnvironment& env) {
+	if (a.IsNaN() || b.IsNaN()) {
+		return PropagateNaN(a, b, env);
+	}
+
+	bool sign = a.GetSign() != b.GetSign();
+
+	if (a.IsInfinity()) {
+		if (b.IsInfinity()) {
+			env.flags |= FloatException::Invalid;
+			return Float80::Indefinite();
+		}
+
+		CheckDenormal(b, env);
+		return Float80::Infinity(sign);
+	}
+
+	if (b.IsInfinity()) {
+		CheckDenormal(a, env);
+		return Float80::Zero(sign);
+	}
+
+	if (b.IsZero()) {
+		if (a.IsZero()) {
+			env.flags |= FloatException::Invalid;
+			return Float80::Indefinite();
+		}
+
+		env.flags |= FloatException::ZeroDivide;
+		return Float80::Infinity(sign);
+	}
+
+	CheckDenormal(a, env);
+	CheckDenormal(b, env);
+
+	if (a.IsZero()) {
+		return Float80::Zero(sign);
+	}
+
+	int32_t ea, eb;
+	uint64_t sa, sb;
+	Unpack(a, ea, sa);
+	Unpack(b, eb, sb);
+
+	// long division, a bit at a time. the first bit of the quotient is worth 2^0. the partial
+	// remainder can reach 65 bits just before it's compared, carry is that bit
+	U128 quotient;
+	uint64_t remainder = sa;
+	bool carry = false;
+
+	for (int i = 0; i < 128; i++) {
+		bool bit = carry || remainder >= sb;
+		if (bit) {
+			remainder -= sb;
+		}
+
+		quotient = ShiftLeft(quotient, 1);
+		quotient.lo |= bit;
+
+		carry = remainder >> 63;
+		remainder <<= 1;
+	}
+
+	int32_t exponent = ea - eb + Float80::Bias;
+	if (!(quotient.hi >> 63)) {
+		quotient = ShiftLeft(quotient, 1);
+		exponent--;
+	}
+
+	quotient.lo |= remainder != 0 || carry;
+	return RoundPack(sign, exponent, quotient, env);
+}
+
+Float80 SoftFloat::SquareRoot(Float80 a, FloatEnvironment& env) {
+	if (a.IsNaN()) {
+		return PropagateNaN(a, a, env);
+	}
+
+	if (a.IsZero()) {
+		return a;
+	}
+
+	if (a.GetSign()) {
+		env.flags |= FloatException::Invalid;
+		return Float80::Indefinite();
+	}
+
+	if (a.IsInfinity()) {
+		if (!env.affine) {
+			env.flags |= FloatException::Invalid;
+			return Float80::Indefinite();
+		}
+
+		return a;
+	}
+
+	CheckDenormal(a, env);
+
+	int32_t ea;
+	uint64_t sa;
+	Unpack(a, ea, sa);
+
+	// a = m * 2^t with t even, m taken two bits at a time from the top and then zeros after
+	int32_t t = ea - Float80::Bias - 63;
+	U128 m{ 0, sa };
+	int length = 64;
+	if (t & 1) {
+		m = ShiftLeft(m, 1);
+		length = 66;
+		t--;
+	}
+
+	// 67 bits of root, enough to round to 64 and know whether anything is left over
+	constexpr int RootBits = 67;
+	U128 root, remainder;
+
+	for (int i = 0; i < RootBits; i++) {
+		int position = length - 2 - 2 * i;
+		uint64_t pair = 0;
+		if (position >= 0) {
+			pair = (position >= 64 ? (m.hi >> (position - 64)) : (m.lo >> position)) & 3;
+		}
+
+		remainder = ShiftLeft(remainder, 2);
+		remainder.lo |= pair;
+
+		U128 trial = ShiftLeft(root, 2);
+		trial.lo |= 1;
+
+		root = ShiftLeft(root, 1);
+		if (!Less(remainder, trial)) {
+			remainder = SubtractWide(remainder, trial);
+			root.lo |= 1;
+		}
+	}
+
+	// root is sqrt(m * 2^(2 * RootBits - length)), so a's root is root * 2^((t - (2 * RootBits - length)) / 2)
+	int top = 127 - CountLeadingZeros(root);
+	int32_t exponent = Float80::Bias + top + (t - (2 * RootBits - length)) / 2;
+
+	root = ShiftLeft(root, 127 - top);
+	root.lo |= !IsZero(remainder);
+	return RoundPack(false, exponent, root, env);
+}
+
+FloatOrder SoftFloat::Compare(Float80 a, Float80 b, FloatEnvironment& env) {
+	if (a.IsNaN() || b.IsNaN()) {
+		env.flags |= FloatException::Invalid;
+		return FloatOrder::Unordered;
+	}
+
+	CheckDenormal(a, env);
+	CheckDenormal(b, env);
+
+	if (a.IsInfinity() || b.IsInfinity()) {
+		// projective infinity has no sign, so it only equals itself
+		if (!env.affine) {
+			if (a.IsInfinity() && b.IsInfinity()) {
+				return FloatOrder::Equal;
+			}
+
+			env.flags |= FloatException::Invalid;
+			return FloatOrder::Unordered;
+		}
+	}
+
+	if (a.IsZero() && b.IsZero()) {
+		return FloatOrder::Equal;
+	}
+
+	bool sa = a.GetSign(), sb = b.GetSign();
+	if (a.IsZero()) return sb ? FloatOrder::Greater : FloatOrder::Less;
+	if (b.IsZero()) return sa ? FloatOrder::Less : FloatOrder::Greater;
+	if (sa != sb) return sa ? FloatOrder::Less : FloatOrder::Greater;
+
+	// same sign from here. infinity sorts above everything by its exponent alone
+	auto magnitude = [](Float80 x, int32_t& exponent, uint64_t& significand) {
+		if (x.IsInfinity()) {
+			exponent = Float80::MaxExponent;
+			significand = x.significand;
+		} else {
+			Unpack(x, exponent, significand);
+		}
+	};
+
+	int32_t ea, eb;
+	uint64_t ma, mb;
+	magnitude(a, ea, ma);
+	magnitude(b, eb, mb);
+
+	if (ea == eb && ma == mb) {
+		return FloatOrder::Equal;
+	}
+
+	bool less = ea != eb ? ea < eb : ma < mb;
+	return less != sa ? FloatOrder::Less : FloatOrder::Greater;
+}
+
+Float80 SoftFloat::RoundToInteger(Float80 a, FloatEnvironment& env) {
+	if (a.IsNaN()) {
+		return PropagateNaN(a, a, env);
+	}
+
+	if (a.IsInfinity() || a.IsZero()) {
+		return a;
+	}
+
+	CheckDenormal(a, env);
+
+	int32_t exponent;
+	uint64_t significand;
+	Unpack(a, exponent, significand);
+
+	if (exponent - Float80::Bias >= 63) {
+		return a;
+	}
+
+	bool inexact;
+	uint64_t magnitude = RoundMagnitude(significand, exponent - Float80::Bias, a.GetSign(), env.rounding, inexact);
+	if (inexact) {
+		env.flags |= FloatException::Precision;
+	}
+
+	if (magnitude == 0) {
+		return Float80::Zero(a.GetSign());
+	}
+
+	int shift = std::countl_zero(magnitude);
+	return Float80::Make(a.GetSign(), static_cast<uint16_t>(Float80::Bias + 63 - shift), magnitude << shift);
+}
+
+Float80 SoftFloat::Scale(Float80 a, int32_t n, FloatEnvironment& env) {
+	if (a.IsNaN()) {
+		return PropagateNaN(a, a, env);
+	}
+
+	if (a.IsInfinity() || a.IsZero()) {
+		return a;
+	}
+
+	CheckDenormal(a, env);
+
+	int32_t exponent;
+	uint64_t significand;
+	Unpack(a, exponent, significand);
+
+	n = std::clamp(n, -0x10000, 0x10000);
+	return RoundPack(a.GetSign(), exponent + n, { significand, 0 }, env);
+}
+
+Float80 SoftFloat::PartialRemainder(Float80 a, Float80 b, FloatEnvironment& env, bool& partial, uint8_t& quotient) {
+	partial = false;
+	quotient = 0;
+
+	if (a.IsNaN() || b.IsNaN()) {
+		return PropagateNaN(a, b, env);
+	}
+
+	if (a.IsInfinity() || b.IsZero()) {
+		env.flags |= FloatException::Invalid;
+		return Float80::Indefinite();
+	}
+
+	CheckDenormal(a, env);
+	CheckDenormal(b, env);
+
+	if (a.IsZero()) {
+		return a;
+	}
+
+	int32_t ea, eb;
+	uint64_t sa, sb;
+	Unpack(a, ea, sa);
+	Unpack(b, eb, sb);
+
+	// the remainder is exact, the precision control doesn't apply
+	FloatEnvironment exact = env;
+	exact.precision = Precision::Extended;
+
+	int32_t difference = ea - eb;
+	if (difference < 0 || b.IsInfinity()) {
+		Float80 result = RoundPack(a.GetSign(), ea, { sa, 0 }, exact);
+		env.flags |= exact.flags;
+		return result;
+	}
+
+	// too far apart to finish in one go: take off the top 63 bits of the quotient's worth and
+	// leave the rest for the next FPREM
+	if (difference >= 64) {
+		partial = true;
+		eb = ea - 63;
+		difference = 63;
+	}
+
+	// sa * 2^difference mod sb, a bit at a time. like Divide, carry is the remainder's 65th bit
+	uint64_t remainder = 0;
+	uint64_t q = 0;
+	for (int i = 63 + difference; i >= 0; i--) {
+		bool carry = remainder >> 63;
+		remainder = (remainder << 1) | (i >= difference ? (sa >> (i - difference)) & 1 : 0);
+
+		bool bit = carry || remainder >= sb;
+		if (bit) {
+			remainder -= sb;
+		}
+
+		q = (q << 1) | bit;
+	}
+
+	if (!partial) {
+		quotient = q & 7;
+	}
+
+	if (remainder == 0) {
+		return Float80::Zero(a.GetSign());
+	}
+
+	Float80 result = RoundPack(a.GetSign(), eb, { remainder, 0 }, exact);
+	env.flags |= exact.flags;
+	return result;
+}
+
+Float80 SoftFloat::FromInteger(int64_t value) {
+	if (value == 0) {
+		return Float80::Zero(false);
+	}
+
+	bool sign = value < 0;
+	uint64_t magnitude = sign ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+	int shift = std::countl_zero(magnitude);
+
+	return Float80::Make(sign, static_cast<uint16_t>(Float80::Bias + 63 - shift), magnitude << shift);
+}
+
+Float80 SoftFloat::FromFloat32(uint32_t bits, FloatEnvironment& env) {
+	bool sign = bits >> 31;
+	uint32_t exponent = (bits >> 23) & 0xff;
+	uint64_t fraction = bits & 0x7fffff;
+
+	if (exponent == 0xff) {
+		if (fraction == 0) {
+			return Float80::Infinity(sign);
+		}
+
+		if (!(fraction & 0x400000)) {
+			env.flags |= FloatException::Invalid;
+		}
+
+		return Float80::Make(sign, Float80::MaxExponent, 0xc000000000000000ull | (fraction << 40));
+	}
+
+	if (exponent == 0) {
+		if (fraction == 0) {
+			return Float80::Zero(sign);
+		}
+
+		env.flags |= FloatException::Denormal;
+
+		// fraction * 2^-149
+		int shift = std::countl_zero(fraction);
+		return Float80::Make(sign, static_cast<uint16_t>(Float80::Bias + 63 - shift - 149), fraction << shift);
+	}
+
+	return Float80::Make(sign, static_cast<uint16_t>(exponent - 127 + Float80::Bias), (1ull << 63) | (fraction << 40));
+}
+
+Float80 SoftFloat::FromFloat64(uint64_t bits, FloatEnvironment& env) {
+	bool sign = bits >> 63;
+	uint32_t exponent = (bits >> 52) & 0x7ff;
+	uint64_t fraction = bits & 0xfffffffffffffull;
+
+	if (exponent == 0x7ff) {
+		if (fraction == 0) {
+			return Float80::Infinity(sign);
+		}
+
+		if (!(fraction & 0x8000000000000ull)) {
+			env.flags |= FloatException::Invalid;
+		}
+
+		return Float80::Make(sign, Float80::MaxExponent, 0xc000000000000000ull | (fraction << 11));
+	}
+
+	if (exponent == 0) {
+		if (fraction == 0) {
+			return Float80::Zero(sign);
+		}
+
+		env.flags |= FloatException::Denormal;
+
+		// fraction * 2^-1074
+		int shift = std::countl_zero(fraction);
+		return Float80::Make(sign, static_cast<uint16_t>(Float80::Bias + 63 - shift - 1074), fraction << shift);
+	}
+
+	return Float80::Make(sign, static_cast<uint16_t>(exponent - 1023 + Float80::Bias), (1ull << 63) | (fraction << 11));
+}
+
+uint32_t SoftFloat::ToFloat32(Float80 a, FloatEnvironment& env) {
+	uint32_t sign = a.GetSign() ? 0x80000000u : 0;
+
+	if (a.IsNaN()) {
+		if (a.IsSignalingNaN()) {
+			env.flags |= FloatException::Invalid;
+		}
+
+		return sign | 0x7fc00000u | static_cast<uint32_t>((a.significand >> 40) & 0x7fffff);
+	}
+
+	if (a.IsInfinity()) return sign | 0x7f800000u;
+	if (a.IsZero()) return sign;
+
+	CheckDenormal(a, env);
+
+	int32_t exponent;
+	uint64_t significand;
+	Unpack(a, exponent, significand);
+
+	Rounded rounded = Round(a.GetSign(), exponent, { significand, 0 }, 24, Float80::Bias - 126, Float80::Bias + 127, env);
+	switch (rounded.outcome) {
+		case Outcome::Infinity: return sign | 0x7f800000u;
+		case Outcome::Largest: return sign | 0x7f7fffffu;
+		case Outcome::Finite: break;
+	}
+
+	uint32_t fraction = static_cast<uint32_t>(rounded.significand >> 40) & 0x7fffff;
+	if (!(rounded.significand >> 63)) {
+		return sign | fraction;
+	}
+
+	return sign | (static_cast<uint32_t>(rounded.exponent - (Float80::Bias - 127)) << 23) | fraction;
+}
+
+uint64_t SoftFloat::ToFloat64(Float80 a, FloatEnvironment& env) {
+	uint64_t sign = a.GetSign() ? 0x8000000000000000ull : 0;
+
+	if (a.IsNaN()) {
+		if (a.IsSignalingNaN()) {
+			env.flags |= FloatException::Invalid;
+		}
+
+		return sign | 0x7ff8000000000000ull | ((a.significand >> 11) & 0xfffffffffffffull);
+	}
+
+	if (a.IsInfinity()) return sign | 0x7ff0000000000000ull;
+	if (a.IsZero()) return sign;
+
+	CheckDenormal(a, env);
+
+	int32_t exponent;
+	uint64_t significand;
+	Unpack(a, exponent, significand);
+
+	Rounded rounded = Round(a.GetSign(), exponent, { significand, 0 }, 53, Float80::Bias - 1022, Float80::Bias + 1023, env);
+	switch (rounded.outcome) {
+		case Outcome::Infinity: return sign | 0x7ff0000000000000ull;
+		case Outcome::Largest: return sign | 0x7fefffffffffffffull;
+		case Outcome::Finite: break;
+	}
+
+	uint64_t fraction = (rounded.significand >> 11) & 0xfffffffffffffull;
+	if (!(rounded.significand >> 63)) {
+		return sign | fraction;
+	}
+
+	return sign | (static_cast<uint64_t>(rounded.exponent - (Float80::Bias - 1023)) << 52) | fraction;
+}
+
+bool SoftFloat::ToInteger(Float80 a, int bits, FloatEnvironment& env, int64_t& result) {
+	if (a.IsNaN() || a.IsInfinity()) {
+		env.flags |= FloatException::Invalid;
+		return false;
+	}
+
+	if (a.IsZero()) {
+		result = 0;
+		return true;
+	}
+
+	CheckDenormal(a, env);
+
+	int32_t exponent;
+	uint64_t significand;
+	Unpack(a, exponent, significand);
+
+	if (exponent - Float80::Bias > 63) {
+		env.flags |= FloatException::Invalid;
+		return false;
+	}
+
+	bool inexact;
+	uint64_t magnitude = RoundMagnitude(significand, exponent - Float80::Bias, a.GetSign(), env.rounding, inexact);
+
+	uint64_t limit = 1ull << (bits - 1);
+	if (magnitude > limit || (magnitude == limit && !a.GetSign())) {
+		env.flags |= FloatException::Invalid;
+		return false;
+	}
+
+	if (inexact) {
+		env.flags |= FloatException::Precision;
+	}
+
+	result = static_cast<int64_t>(a.GetSign() ? 0 - magnitude : magnitude);
+	return true;
+}
+
+long double SoftFloat::ToHost(Float80 a) {
+	if constexpr (std::numeric_limits<long double>::digits == 64) {
+		long double value = 0;
+		std::memcpy(&value, &a.significand, sizeof(a.significand));
+		std::memcpy(reinterpret_cast<uint8_t*>(&value) + sizeof(a.significand), &a.sign_exponent, sizeof(a.sign_exponent));
+		return value;
+	} else {
+		FloatEnvironment env;
+		return std::bit_cast<double>(ToFloat64(a, env));
+	}
+}
+
+Float80 SoftFloat::FromHost(long double value, FloatEnvironment& env) {
+	if constexpr (std::numeric_limits<long double>::digits == 64) {
+		static_cast<void>(env);
+		Float80 result;
+		std::memcpy(&result.significand, &value, sizeof(result.significand));
+		std::memcpy(&result.sign_exponent, reinterpret_cast<uint8_t*>(&value) + sizeof(result.significand), sizeof(result.sign_exponent));
+		return result;
+	} else {
+		return FromFloat64(std::bit_cast<uint64_t>(static_cast<double>(value)), env);
+	}
+}
\ No newline at end of file
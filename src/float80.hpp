@@ -0,0 +1,129 @@
+#ifndef FLOAT80_HPP
+#define FLOAT80_HPP
+
+#include <cstdint>
+
+namespace xe86 {
+	// a value in the 8087's 80-bit extended format, laid out as it is in memory
+	struct Float80 {
+		uint64_t significand = 0;	// the integer bit is explicit, bit 63
+		uint16_t sign_exponent = 0;	// sign in bit 15, exponent biased by 16383 below it
+
+		static constexpr int32_t Bias = 16383;
+		static constexpr uint16_t MaxExponent = 0x7fff;
+
+		static constexpr Float80 Make(bool sign, uint16_t exponent, uint64_t significand) {
+			return { significand, static_cast<uint16_t>((sign ? 0x8000 : 0) | (exponent & MaxExponent)) };
+		}
+
+		// what a masked invalid operation leaves behind
+		static constexpr Float80 Indefinite() { return Make(true, MaxExponent, 0xc000000000000000ull); }
+		static constexpr Float80 Infinity(bool sign) { return Make(sign, MaxExponent, 0x8000000000000000ull); }
+		static constexpr Float80 Zero(bool sign) { return Make(sign, 0, 0); }
+		static constexpr Float80 One() { return Make(false, Bias, 0x8000000000000000ull); }
+
+		bool GetSign() const { return (sign_exponent & 0x8000) != 0; }
+		uint16_t GetExponent() const { return sign_exponent & MaxExponent; }
+
+		Float80 Negate() const { return { significand, static_cast<uint16_t>(sign_exponent ^ 0x8000) }; }
+		Float80 Abs() const { return { significand, static_cast<uint16_t>(sign_exponent & MaxExponent) }; }
+
+		bool IsZero() const { return GetExponent() == 0 && significand == 0; }
+		bool IsDenormal() const { return GetExponent() == 0 && significand != 0; }
+		bool IsInfinity() const { return GetExponent() == MaxExponent && (significand << 1) == 0; }
+		bool IsNaN() const { return GetExponent() == MaxExponent && (significand << 1) != 0; }
+		bool IsSignalingNaN() const { return IsNaN() && !(significand & 0x4000000000000000ull); }
+
+		// the integer bit clear with a nonzero exponent. the 8087 computes with these, later chips refuse them
+		bool IsUnnormal() const { return GetExponent() != 0 && GetExponent() != MaxExponent && !(significand >> 63); }
+
+		bool IsNormal() const { return GetExponent() != 0 && GetExponent() != MaxExponent && (significand >> 63); }
+
+		bool operator==(const Float80&) const = default;
+	};
+
+	// rounding and precision control as the control word encodes them
+	enum class Rounding : uint8_t { Nearest, Down, Up, Chop };
+	enum class Precision : uint8_t { Single, Reserved, Double, Extended };
+
+	// exception flags, as the status word and control word masks have them
+	namespace FloatException {
+		constexpr uint8_t Invalid = 0x01;
+		constexpr uint8_t Denormal = 0x02;
+		constexpr uint8_t ZeroDivide = 0x04;
+		constexpr uint8_t Overflow = 0x08;
+		constexpr uint8_t Underflow = 0x10;
+		constexpr uint8_t Precision = 0x20;
+	}
+
+	struct FloatEnvironment {
+		Rounding rounding = Rounding::Nearest;
+		Precision precision = Precision::Extended;
+
+		// affine treats the infinities as signed, projective as the one point at both ends
+		bool affine = false;
+
+		// raised by each operation, never cleared by one
+		uint8_t flags = 0;
+	};
+
+	enum class FloatOrder : uint8_t { Less, Equal, Greater, Unordered };
+
+	/*
+	IEEE-style 80-bit arithmetic in software, exact to the bit. every result is rounded once, to
+	the precision and in the direction the environment says, with the exponent range of the
+	extended format whatever the precision. exceptions get their masked response: the flag is
+	raised and the result is what the chip would produce with the exception masked.
+
+	denormal and unnormal operands raise the denormal flag and are worked with at full value, as
+	if normalized first. NaNs propagate as on the 80387, which the 8087 agrees with for all but
+	the choice between two NaNs.
+	*/
+	class SoftFloat {
+	public:
+		static Float80 Add(Float80 a, Float80 b, FloatEnvironment& env);
+		static Float80 Subtract(Float80 a, Float80 b, FloatEnvironment& env);
+		static Float80 Multiply(Float80 a, Float80 b, FloatEnvironment& env);
+		static Float80 Divide(Float80 a, Float80 b, FloatEnvironment& env);
+		static Float80 SquareRoot(Float80 a, FloatEnvironment& env);
+
+		// a compare with a NaN raises invalid, with quiet ones too
+		static FloatOrder Compare(Float80 a, Float80 b, FloatEnvironment& env);
+
+		// FRNDINT, to an integral value in the environment's rounding direction
+		static Float80 RoundToInteger(Float80 a, FloatEnvironment& env);
+
+		// FSCALE: a * 2^n
+		static Float80 Scale(Float80 a, int32_t n, FloatEnvironment& env);
+
+		// FPREM: the remainder of a truncated division. a difference in exponents of 64 or more is
+		// only partly reduced, in which case partial is set and the instruction has to run again.
+		// quotient gets the low three bits of the quotient otherwise
+		static Float80 PartialRemainder(Float80 a, Float80 b, FloatEnvironment& env, bool& partial, uint8_t& quotient);
+
+		// loads are exact. stores round to the format's precision and range
+		static Float80 FromInteger(int64_t value);
+		static Float80 FromFloat32(uint32_t bits, FloatEnvironment& env);
+		static Float80 FromFloat64(uint64_t bits, FloatEnvironment& env);
+
+		static uint32_t ToFloat32(Float80 a, FloatEnvironment& env);
+		static uint64_t ToFloat64(Float80 a, FloatEnvironment& env);
+
+		// rounded to an integer in the environment's direction. false, with invalid raised, if the
+		// result doesn't fit in bits as a two's complement integer, NaNs and infinities included
+		static bool ToInteger(Float80 a, int bits, FloatEnvironment& env, int64_t& result);
+
+		// the host's long double, for the transcendentals. exact when the host has an x87
+		static long double ToHost(Float80 a);
+		static Float80 FromHost(long double value, FloatEnvironment& env);
+
+		// a finite nonzero value with the integer bit set, whatever the encoding. exponent is biased
+		// and goes below 1 for denormals
+		static void Unpack(Float80 a, int32_t& exponent, uint64_t& significand);
+
+		// NaN operands produce a NaN, raising invalid for signaling ones
+		static Float80 PropagateNaN(Float80 a, Float80 b, FloatEnvironment& env);
+	};
+}
+
+#endif
\ No newline at end of file
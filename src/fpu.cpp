@@ -0,0 +1,1109 @@
+#include "fpu.hpp"
+
+#include <bit>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <numbers>
+
+using namespace xe86;
+
+namespace {
+	// operations past the ones the reg field numbers
+	constexpr uint8_t SquareRoot = 8;
+
+	// constants as the 8087 has them, rounded to nearest
+	constexpr std::array<Float80, 7> constants = {
+		Float80::One(),											// FLD1
+		Float80::Make(false, 0x4000, 0xd49a784bcd1b8afeull),	// FLDL2T
+		Float80::Make(false, 0x3fff, 0xb8aa3b295c17f0bcull),	// FLDL2E
+		Float80::Make(false, 0x4000, 0xc90fdaa22168c235ull),	// FLDPI
+		Float80::Make(false, 0x3ffd, 0x9a209a84fbcff799ull),	// FLDLG2
+		Float80::Make(false, 0x3ffe, 0xb17217f7d1cf79acull),	// FLDLN2
+		Float80::Zero(false),									// FLDZ
+	};
+
+	/*
+	error-free transforms: the exact rounding error of a host add or multiply, as another host
+	value. nonzero means the operation was inexact. they hold as long as nothing overflows or
+	underflows along the way, which the exponent margins below make sure of
+	*/
+	template <typename T>
+	T SumError(T a, T b, T sum) {
+		T bb = sum - a;
+		return (a - (sum - bb)) + (b - bb);
+	}
+
+	template <typename T>
+	T ProductError(T a, T b, T product) {
+		// splits a value into two halves whose products with each other are exact
+		constexpr T factor = std::numeric_limits<T>::digits == 64 ? static_cast<T>(4294967297.0L) : static_cast<T>(134217729.0);
+		auto split = [&](T x, T& hi, T& lo) {
+			T c = factor * x;
+			hi = c - (c - x);
+			lo = x - hi;
+		};
+
+		T ah, al, bh, bl;
+		split(a, ah, al);
+		split(b, bh, bl);
+
+		return ((ah * bh - product) + ah * bl + al * bh) + al * bl;
+	}
+
+	// the host result of an operation and whether it was exact
+	template <typename T>
+	T Compute(uint8_t operation, T a, T b, bool& exact) {
+		// the remainder of a division, a - q * b, is representable. a - (q * b rounded) is exact
+		// because the two are so close, then it's exact only if that's the product's error too
+		auto quotient = [&exact](T x, T y) {
+			T q = x / y;
+			T product = q * y;
+			exact = x - product == ProductError(q, y, product);
+			return q;
+		};
+
+		T result{};
+		switch (operation) {
+			case 0: result = a + b; exact = SumError(a, b, result) == 0; break;
+			case 1: result = a * b; exact = ProductError(a, b, result) == 0; break;
+			case 4: result = a - b; exact = SumError(a, -b, result) == 0; break;
+			case 5: result = b - a; exact = SumError(b, -a, result) == 0; break;
+			case 6: result = quotient(a, b); break;
+			case 7: result = quotient(b, a); break;
+
+			case SquareRoot: {
+				result = std::sqrt(a);
+				T square = result * result;
+				exact = square == a && ProductError(result, result, square) == 0;
+				break;
+			}
+		}
+
+		return result;
+	}
+
+	// the host can only stand in when it rounds each operation once, at the precision it claims
+	constexpr bool HostExtended = std::numeric_limits<long double>::digits == 64;
+	constexpr bool HostDouble = FLT_EVAL_METHOD == 0;
+
+	// how far from 2^0 an operand's exponent can be for any result, and everything the error-free
+	// transforms compute on the way, to stay normal
+	constexpr int32_t ExtendedMargin = 4096;
+	constexpr int32_t DoubleMargin = 250;
+
+	bool IsOrdinary(Float80 value, int32_t margin, bool zero) {
+		if (value.IsZero()) {
+			return zero;
+		}
+
+		return value.IsNormal() && std::abs(value.GetExponent() - Float80::Bias) < margin;
+	}
+}
+
+void FPU::Reset() {
+	m_Stack = {};
+	m_Tags.fill(Tag::Empty);
+	m_Top = 0;
+
+	// every exception masked, interrupts disabled, 64 bits, round to nearest, projective
+	m_Control = 0x03ff;
+	m_Status = 0;
+
+	m_InstructionPointer = 0;
+	m_OperandPointer = 0;
+	m_Opcode = 0;
+}
+
+FloatEnvironment FPU::GetEnvironment() const {
+	FloatEnvironment env;
+	env.rounding = static_cast<Rounding>((m_Control >> 10) & 3);
+	env.precision = static_cast<Precision>((m_Control >> 8) & 3);
+	env.affine = (m_Control & ControlAffine) != 0;
+	return env;
+}
+
+bool FPU::Raise(uint8_t flags) {
+	m_Status |= flags;
+
+	uint8_t unmasked = flags & ~m_Control & 0x3f;
+	if (unmasked) {
+		m_Status |= StatusRequest;
+	}
+
+	return !(unmasked & (FloatException::Invalid | FloatException::Denormal | FloatException::ZeroDivide));
+}
+
+bool FPU::StackFault() {
+	return Raise(FloatException::Invalid);
+}
+
+bool FPU::Fetch(uint8_t i, Float80& value) {
+	if (IsEmpty(i)) {
+		value = Float80::Indefinite();
+		return StackFault();
+	}
+
+	value = GetStack(i);
+	return true;
+}
+
+void FPU::Push(Float80 value) {
+	m_Top = (m_Top - 1) & 7;
+
+	if (m_Tags[m_Top] != Tag::Empty) {
+		if (!StackFault()) {
+			m_Top = (m_Top + 1) & 7;
+			return;
+		}
+
+		value = Float80::Indefinite();
+	}
+
+	Store(0, value);
+}
+
+void FPU::Pop() {
+	m_Tags[m_Top] = Tag::Empty;
+	m_Top = (m_Top + 1) & 7;
+}
+
+void FPU::Exchange(uint8_t i) {
+	// empty ones become the indefinite if the fault is masked
+	if (IsEmpty(0) || IsEmpty(i)) {
+		if (!StackFault()) {
+			return;
+		}
+
+		if (IsEmpty(0)) Store(0, Float80::Indefinite());
+		if (IsEmpty(i)) Store(i, Float80::Indefinite());
+	}
+
+	Float80 value = GetStack(0);
+	Store(0, GetStack(i));
+	Store(i, value);
+}
+
+Float80 FPU::Arithmetic(uint8_t operation, Float80 a, Float80 b, FloatEnvironment& env) {
+	Float80 result;
+	if (m_FastMath) {
+		if (TryHost(operation, a, b, result, env)) {
+			m_FastCount++;
+			return result;
+		}
+
+		m_SlowCount++;
+	}
+
+	switch (operation) {
+		case 0: return SoftFloat::Add(a, b, env);
+		case 1: return SoftFloat::Multiply(a, b, env);
+		case 4: return SoftFloat::Subtract(a, b, env);
+		case 5: return SoftFloat::Subtract(b, a, env);
+		case 6: return SoftFloat::Divide(a, b, env);
+		case 7: return SoftFloat::Divide(b, a, env);
+		case SquareRoot: return SoftFloat::SquareRoot(a, env);
+	}
+
+	return Float80::Indefinite();
+}
+
+bool FPU::TryHost(uint8_t operation, Float80 a, Float80 b, Float80& result, FloatEnvironment& env) {
+	if (env.rounding != Rounding::Nearest) {
+		return false;
+	}
+
+	// zeros are fine anywhere but as a divisor or under a square root
+	bool zero_a = operation != SquareRoot && operation != 7;
+	bool zero_b = operation != 6;
+
+	bool exact = false;
+	if (HostExtended && env.precision == Precision::Extended) {
+		if (!IsOrdinary(a, ExtendedMargin, zero_a) || (operation != SquareRoot && !IsOrdinary(b, ExtendedMargin, zero_b))) {
+			return false;
+		}
+
+		if (operation == SquareRoot && a.GetSign()) {
+			return false;
+		}
+
+		FloatEnvironment scratch;
+		result = SoftFloat::FromHost(Compute(operation, SoftFloat::ToHost(a), SoftFloat::ToHost(b), exact), scratch);
+	} else if (HostDouble && env.precision == Precision::Double) {
+		// only values a double holds exactly, it has 11 fewer bits
+		auto fits = [](Float80 value) { return (value.significand & 0x7ff) == 0; };
+
+		if (!IsOrdinary(a, DoubleMargin, zero_a) || !fits(a) || (operation != SquareRoot && (!IsOrdinary(b, DoubleMargin, zero_b) || !fits(b)))) {
+			return false;
+		}
+
+		if (operation == SquareRoot && a.GetSign()) {
+			return false;
+		}
+
+		// both ways are exact, there's nothing to round
+		auto to_double = [](Float80 value) {
+			if (value.IsZero()) {
+				return value.GetSign() ? -0.0 : 0.0;
+			}
+
+			uint64_t exponent = static_cast<uint64_t>(value.GetExponent() - Float80::Bias + 1023);
+			return std::bit_cast<double>((static_cast<uint64_t>(value.GetSign()) << 63) | (exponent << 52) | ((value.significand >> 11) & 0xfffffffffffffull));
+		};
+
+		auto from_double = [](double value) {
+			uint64_t bits = std::bit_cast<uint64_t>(value);
+			uint16_t exponent = (bits >> 52) & 0x7ff;
+			if ((bits << 1) == 0) {
+				return Float80::Zero(bits >> 63);
+			}
+
+			// denormals and infinities can't come out inside the margins. if they did, the
+			// indefinite sends the operation back to SoftFloat
+			if (exponent == 0 || exponent == 0x7ff) {
+				return Float80::Indefinite();
+			}
+
+			return Float80::Make(bits >> 63, static_cast<uint16_t>(exponent - 1023 + Float80::Bias), (1ull << 63) | (bits << 11));
+		};
+
+		result = from_double(Compute(operation, to_double(a), to_double(b), exact));
+	} else {
+		return false;
+	}
+
+	// can't happen inside the margins, but nothing else is known to match
+	if (!result.IsNormal() && !result.IsZero()) {
+		return false;
+	}
+
+	if (!exact) {
+		env.flags |= FloatException::Precision;
+	}
+
+	return true;
+}
+
+void FPU::Compare(Float80 a, Float80 b, FloatEnvironment& env) {
+	switch (SoftFloat::Compare(a, b, env)) {
+		case FloatOrder::Greater: SetConditions(0); break;
+		case FloatOrder::Less: SetConditions(StatusC0); break;
+		case FloatOrder::Equal: SetConditions(StatusC3); break;
+		case FloatOrder::Unordered: SetConditions(StatusC3 | StatusC2 | StatusC0); break;
+	}
+}
+
+Float80 FPU::Load(uint8_t opcode, uint32_t address, FloatEnvironment& env) {
+	switch (opcode & 0xfe) {
+		case 0xd8: return SoftFloat::FromFloat32(static_cast<uint32_t>(Read(address, 4)), env);
+		case 0xda: return SoftFloat::FromInteger(static_cast<int32_t>(Read(address, 4)));
+		case 0xdc: return SoftFloat::FromFloat64(Read(address, 8), env);
+		default: return SoftFloat::FromInteger(static_cast<int16_t>(Read(address, 2)));
+	}
+}
+
+Cycles FPU::Execute(uint8_t opcode, uint8_t modrm, uint32_t address, uint32_t instruction) {
+	uint8_t reg = (modrm >> 3) & 7;
+	uint8_t rm = modrm & 7;
+	bool memory = (modrm >> 6) != 0b11;
+
+	// control instructions leave the pointers at the last numeric instruction, for an exception
+	// handler to find with FSTENV
+	bool control = (opcode == 0xd9 && memory && reg >= 4) || (opcode == 0xdb && !memory && reg == 4) ||
+		(opcode == 0xdd && memory && reg >= 4) || (opcode == 0xdf && !memory && reg == 4);
+
+	if (!control) {
+		m_InstructionPointer = instruction;
+		m_Opcode = static_cast<uint16_t>(((opcode & 7) << 8) | modrm);
+		if (memory) {
+			m_OperandPointer = address;
+		}
+	}
+
+	FloatEnvironment env = GetEnvironment();
+
+	switch (opcode) {
+		case 0xd8:
+		case 0xda:
+		case 0xdc:
+		case 0xde: {
+			return ExecuteArithmetic(opcode, modrm, address, env);
+		}
+
+		case 0xd9: {
+			if (memory) {
+				switch (reg) {
+					// FLD m32
+					case 0: {
+						Float80 value = Load(opcode, address, env);
+						if (Raise(env.flags)) {
+							Push(value);
+						}
+
+						return 43;
+					}
+
+					// FST m32, FSTP m32
+					case 2: StoreReal(address, 4, false); return 84;
+					case 3: StoreReal(address, 4, true); return 86;
+
+					// FLDENV
+					case 4: LoadEnvironment(address); return 40;
+
+					// FLDCW
+					case 5: m_Control = static_cast<uint16_t>(Read(address, 2)); return 8;
+
+					// FSTENV, which masks everything afterwards like the handler it's usually in wants
+					case 6: {
+						StoreEnvironment(address);
+						m_Control |= 0x3f;
+						return 40;
+					}
+
+					// FSTCW
+					case 7: Write(address, 2, m_Control); return 14;
+				}
+
+				return 2;
+			}
+
+			switch (reg) {
+				// FLD ST(i)
+				case 0: {
+					Float80 value;
+					if (Fetch(rm, value)) {
+						Push(value);
+					}
+
+					return 20;
+				}
+
+				// FXCH ST(i)
+				case 1: Exchange(rm); return 12;
+
+				// FNOP
+				case 2: return 13;
+
+				// FSTP ST(i), an alias the 8087 decodes
+				case 3: {
+					Float80 value;
+					if (Fetch(0, value)) {
+						Store(rm, value);
+						Pop();
+					}
+
+					return 20;
+				}
+
+				case 4: return ExecuteSign(rm, env);
+
+				// FLD1, FLDL2T, FLDL2E, FLDPI, FLDLG2, FLDLN2, FLDZ
+				case 5: {
+					if (rm < constants.size()) {
+						Push(constants[rm]);
+					}
+
+					return 18;
+				}
+
+				case 6: return ExecuteTranscendental(rm, env);
+				case 7: return ExecuteMiscellaneous(rm, env);
+			}
+
+			return 2;
+		}
+
+		case 0xdb: {
+			if (memory) {
+				switch (reg) {
+					// FILD m32
+					case 0: Push(SoftFloat::FromInteger(static_cast<int32_t>(Read(address, 4)))); return 56;
+
+					// FIST m32, FISTP m32
+					case 2: StoreInteger(address, 4, false); return 88;
+					case 3: StoreInteger(address, 4, true); return 90;
+
+					// FLD m80, no conversion so nothing to raise
+					case 5: Push(ReadFloat80(address)); return 57;
+
+					// FSTP m80
+					case 7: StoreReal(address, 10, true); return 55;
+				}
+
+				return 2;
+			}
+
+			if (reg == 4) {
+				switch (rm) {
+					// FENI, FDISI
+					case 0: m_Control &= ~ControlInterruptMask; break;
+					case 1: m_Control |= ControlInterruptMask; break;
+
+					// FCLEX
+					case 2: m_Status &= ~(0x3f | StatusRequest | StatusBusy); break;
+
+					// FINIT
+					case 3: Reset(); break;
+				}
+			}
+
+			return 5;
+		}
+
+		case 0xdd: {
+			if (memory) {
+				switch (reg) {
+					// FLD m64
+					case 0: {
+						Float80 value = Load(opcode, address, env);
+						if (Raise(env.flags)) {
+							Push(value);
+						}
+
+						return 46;
+					}
+
+					// FST m64, FSTP m64
+					case 2: StoreReal(address, 8, false); return 100;
+					case 3: StoreReal(address, 8, true); return 102;
+
+					// FRSTOR
+					case 4: {
+						LoadEnvironment(address);
+						for (uint8_t i = 0; i < 8; i++) {
+							m_Stack[Physical(i)] = ReadFloat80(address + 14 + 10 * i);
+						}
+
+						return 205;
+					}
+
+					// FSAVE, then FINIT
+					case 6: {
+						StoreEnvironment(address);
+						for (uint8_t i = 0; i < 8; i++) {
+							WriteFloat80(address + 14 + 10 * i, GetStack(i));
+						}
+
+						Reset();
+						return 205;
+					}
+
+					// FSTSW m16
+					case 7: Write(address, 2, GetStatusWord()); return 14;
+				}
+
+				return 2;
+			}
+
+			switch (reg) {
+				// FFREE ST(i)
+				case 0: m_Tags[Physical(rm)] = Tag::Empty; return 11;
+
+				// FXCH ST(i), an alias
+				case 1: Exchange(rm); return 12;
+
+				// FST ST(i), FSTP ST(i)
+				case 2:
+				case 3: {
+					Float80 value;
+					if (Fetch(0, value)) {
+						Store(rm, value);
+						if (reg == 3) {
+							Pop();
+						}
+					}
+
+					return 18;
+				}
+			}
+
+			return 2;
+		}
+
+		case 0xdf: {
+			// FSTSW AX on the 80287 is the cpu's to finish, there's nothing to do here
+			if (!memory) {
+				return 2;
+			}
+
+			switch (reg) {
+				// FILD m16
+				case 0: Push(Load(opcode, address, env)); return 46;
+
+				// FIST m16, FISTP m16
+				case 2: StoreInteger(address, 2, false); return 86;
+				case 3: StoreInteger(address, 2, true); return 88;
+
+				// FBLD
+				case 4: Push(LoadBcd(address)); return 300;
+
+				// FILD m64
+				case 5: Push(SoftFloat::FromInteger(static_cast<int64_t>(Read(address, 8)))); return 64;
+
+				// FBSTP
+				case 6: StoreBcd(address); return 530;
+
+				// FISTP m64
+				case 7: StoreInteger(address, 8, true); return 100;
+			}
+
+			return 2;
+		}
+	}
+
+	return 2;
+}
+
+Cycles FPU::ExecuteArithmetic(uint8_t opcode, uint8_t modrm, uint32_t address, FloatEnvironment& env) {
+	constexpr std::array<Cycles, 8> cycles = { 85, 97, 45, 47, 85, 87, 198, 199 };
+
+	uint8_t operation = (modrm >> 3) & 7;
+	uint8_t rm = modrm & 7;
+	bool memory = (modrm >> 6) != 0b11;
+
+	// register forms: D8h works on ST, DCh and DEh on ST(i), and DEh pops after
+	bool pop = opcode == 0xde && !memory;
+	uint8_t destination = (opcode == 0xd8 || memory) ? 0 : rm;
+
+	// the memory formats, m32 real, m32 int, m64 real and m16 int, take longer the more converting they need
+	Cycles total = cycles[operation];
+	if (memory) {
+		constexpr std::array<Cycles, 4> conversion = { 20, 35, 25, 30 };
+		total += conversion[(opcode >> 1) & 3];
+	}
+
+	bool empty = IsEmpty(0) || (!memory && IsEmpty(rm));
+	Float80 a = GetStack(0);
+	Float80 b = memory ? Load(opcode, address, env) : GetStack(rm);
+
+	// FCOM, FCOMP, and FCOMPP in DEh D9h
+	if (operation == 2 || operation == 3) {
+		if (empty) {
+			env.flags |= FloatException::Invalid;
+			SetConditions(StatusC3 | StatusC2 | StatusC0);
+		} else {
+			Compare(a, b, env);
+		}
+
+		if (Raise(env.flags)) {
+			if (operation == 3) Pop();
+			if (pop) Pop();
+		}
+
+		return total;
+	}
+
+	Float80 result;
+	if (empty) {
+		env.flags |= FloatException::Invalid;
+		result = Float80::Indefinite();
+	} else {
+		result = Arithmetic(operation, a, b, env);
+	}
+
+	if (Raise(env.flags)) {
+		Store(destination, result);
+		if (pop) {
+			Pop();
+		}
+	}
+
+	return total;
+}
+
+Cycles FPU::ExecuteSign(uint8_t rm, FloatEnvironment& env) {
+	switch (rm) {
+		// FCHS, FABS
+		case 0:
+		case 1: {
+			Float80 value;
+			if (Fetch(0, value)) {
+				Store(0, rm == 0 ? value.Negate() : value.Abs());
+			}
+
+			return 15;
+		}
+
+		// FTST
+		case 4: {
+			Float80 value;
+			if (IsEmpty(0)) {
+				env.flags |= FloatException::Invalid;
+				SetConditions(StatusC3 | StatusC2 | StatusC0);
+			} else {
+				Compare(GetStack(0), Float80::Zero(false), env);
+			}
+
+			Raise(env.flags);
+			return 42;
+		}
+
+		// FXAM, which never faults, empty is just another class
+		case 5: {
+			Float80 value = GetStack(0);
+			uint16_t conditions = value.GetSign() ? StatusC1 : 0;
+
+			if (IsEmpty(0)) conditions |= StatusC3 | StatusC0;
+			else if (value.IsNaN()) conditions |= StatusC0;
+			else if (value.IsInfinity()) conditions |= StatusC2 | StatusC0;
+			else if (value.IsZero()) conditions |= StatusC3;
+			else if (value.IsDenormal()) conditions |= StatusC3 | StatusC2;
+			else if (value.IsNormal()) conditions |= StatusC2;
+
+			SetConditions(conditions);
+			return 17;
+		}
+	}
+
+	return 2;
+}
+
+Cycles FPU::ExecuteTranscendental(uint8_t rm, FloatEnvironment& env) {
+	// the host's result, with precision raised for anything that isn't obviously exact
+	auto host = [&env](long double value) {
+		Float80 result = SoftFloat::FromHost(value, env);
+		if (!result.IsZero() && !result.IsInfinity() && !result.IsNaN()) {
+			env.flags |= FloatException::Precision;
+		}
+
+		return result;
+	};
+
+	switch (rm) {
+		// F2XM1: 2^ST - 1
+		case 0: {
+			Float80 x;
+			if (!Fetch(0, x)) {
+				return 500;
+			}
+
+			Float80 result = x.IsNaN() ? SoftFloat::PropagateNaN(x, x, env) : host(std::expm1(SoftFloat::ToHost(x) * std::numbers::ln2_v<long double>));
+			if (Raise(env.flags)) {
+				Store(0, result);
+			}
+
+			return 500;
+		}
+
+		// FYL2X: ST(1) * log2(ST), popped. FYL2XP1 is the same with log2(ST + 1)
+		case 1: {
+			return ExecuteLogarithm(false, env);
+		}
+
+		// FPTAN. the 8087 leaves a ratio y / x with x pushed, like the 80387 this pushes 1
+		case 2: {
+			Float80 x;
+			if (!Fetch(0, x)) {
+				return 450;
+			}
+
+			Float80 result;
+			if (x.IsNaN()) {
+				result = SoftFloat::PropagateNaN(x, x, env);
+			} else if (x.IsInfinity()) {
+				env.flags |= FloatException::Invalid;
+				result = Float80::Indefinite();
+			} else {
+				result = host(std::tan(SoftFloat::ToHost(x)));
+			}
+
+			if (Raise(env.flags)) {
+				Store(0, result);
+				Push(result.IsNaN() ? result : Float80::One());
+			}
+
+			return 450;
+		}
+
+		// FPATAN: atan(ST(1) / ST) in the right quadrant, popped
+		case 3: {
+			Float80 x, y;
+			if (!Fetch(0, x) || !Fetch(1, y)) {
+				return 650;
+			}
+
+			Float80 result;
+			if (x.IsNaN() || y.IsNaN()) {
+				result = SoftFloat::PropagateNaN(y, x, env);
+			} else {
+				result = host(std::atan2(SoftFloat::ToHost(y), SoftFloat::ToHost(x)));
+			}
+
+			if (Raise(env.flags)) {
+				Store(1, result);
+				Pop();
+			}
+
+			return 650;
+		}
+
+		// FXTRACT: ST becomes its exponent, then its significand is pushed
+		case 4: {
+			Float80 x;
+			if (!Fetch(0, x)) {
+				return 50;
+			}
+
+			Float80 exponent, significand;
+			if (x.IsNaN()) {
+				exponent = significand = SoftFloat::PropagateNaN(x, x, env);
+			} else if (x.IsInfinity()) {
+				exponent = Float80::Infinity(false);
+				significand = x;
+			} else if (x.IsZero()) {
+				env.flags |= FloatException::ZeroDivide;
+				exponent = Float80::Infinity(true);
+				significand = x;
+			} else {
+				if (!x.IsNormal()) {
+					env.flags |= FloatException::Denormal;
+				}
+
+				int32_t e;
+				uint64_t s;
+				SoftFloat::Unpack(x, e, s);
+				exponent = SoftFloat::FromInteger(e - Float80::Bias);
+				significand = Float80::Make(x.GetSign(), Float80::Bias, s);
+			}
+
+			if (Raise(env.flags)) {
+				Store(0, exponent);
+				Push(significand);
+			}
+
+			return 50;
+		}
+
+		// FDECSTP, FINCSTP
+		case 6: m_Top = (m_Top - 1) & 7; return 9;
+		case 7: m_Top = (m_Top + 1) & 7; return 9;
+	}
+
+	return 2;
+}
+
+Cycles FPU::ExecuteLogarithm(bool plus_one, FloatEnvironment& env) {
+	Float80 x, y;
+	if (!Fetch(0, x) || !Fetch(1, y)) {
+		return 950;
+	}
+
+	Float80 result;
+	if (x.IsNaN() || y.IsNaN()) {
+		result = SoftFloat::PropagateNaN(y, x, env);
+	} else {
+		long double hx = SoftFloat::ToHost(x);
+		long double hy = SoftFloat::ToHost(y);
+
+		long double logarithm = plus_one ? std::log1p(hx) / std::numbers::ln2_v<long double> : std::log2(hx);
+		long double value = hy * logarithm;
+
+		// out of the domain, or zero times infinity
+		if (std::isnan(value)) {
+			env.flags |= FloatException::Invalid;
+			result = Float80::Indefinite();
+		} else {
+			if (std::isinf(logarithm) && !x.IsInfinity()) {
+				env.flags |= FloatException::ZeroDivide;
+			}
+
+			result = SoftFloat::FromHost(value, env);
+			if (!result.IsZero() && !result.IsInfinity()) {
+				env.flags |= FloatException::Precision;
+			}
+		}
+	}
+
+	if (Raise(env.flags)) {
+		Store(1, result);
+		Pop();
+	}
+
+	return 950;
+}
+
+Cycles FPU::ExecuteMiscellaneous(uint8_t rm, FloatEnvironment& env) {
+	switch (rm) {
+		// FPREM, the quotient's low bits go to C0, C3 and C1
+		case 0: {
+			Float80 a, b;
+			if (!Fetch(0, a) || !Fetch(1, b)) {
+				return 125;
+			}
+
+			bool partial;
+			uint8_t quotient;
+			Float80 result = SoftFloat::PartialRemainder(a, b, env, partial, quotient);
+
+			if (Raise(env.flags)) {
+				Store(0, result);
+				SetConditions(
+					(partial ? StatusC2 : 0) |
+					((quotient & 4) ? StatusC0 : 0) |
+					((quotient & 2) ? StatusC3 : 0) |
+					((quotient & 1) ? StatusC1 : 0)
+				);
+			}
+
+			return 125;
+		}
+
+		// FYL2XP1
+		case 1: return ExecuteLogarithm(true, env);
+
+		// FSQRT
+		case 2: {
+			Float80 value;
+			if (!Fetch(0, value)) {
+				return 183;
+			}
+
+			Float80 result = Arithmetic(SquareRoot, value, value, env);
+			if (Raise(env.flags)) {
+				Store(0, result);
+			}
+
+			return 183;
+		}
+
+		// FRNDINT
+		case 4: {
+			Float80 value;
+			if (!Fetch(0, value)) {
+				return 45;
+			}
+
+			Float80 result = SoftFloat::RoundToInteger(value, env);
+			if (Raise(env.flags)) {
+				Store(0, result);
+			}
+
+			return 45;
+		}
+
+		// FSCALE: ST * 2^n, n being ST(1) chopped to an integer
+		case 5: {
+			Float80 a, b;
+			if (!Fetch(0, a) || !Fetch(1, b)) {
+				return 35;
+			}
+
+			Float80 result;
+			if (b.IsNaN()) {
+				result = SoftFloat::PropagateNaN(a, b, env);
+			} else {
+				// anything past the exponent range is as good as infinite
+				FloatEnvironment chop = env;
+				chop.rounding = Rounding::Chop;
+
+				int64_t n = 0;
+				if (!SoftFloat::ToInteger(b, 32, chop, n)) {
+					n = b.GetSign() ? -0x10000 : 0x10000;
+				}
+
+				env.flags |= chop.flags & FloatException::Denormal;
+				result = SoftFloat::Scale(a, static_cast<int32_t>(n), env);
+			}
+
+			if (Raise(env.flags)) {
+				Store(0, result);
+			}
+
+			return 35;
+		}
+	}
+
+	return 2;
+}
+
+void FPU::StoreReal(uint32_t address, int bytes, bool pop) {
+	Float80 value;
+	if (!Fetch(0, value)) {
+		return;
+	}
+
+	FloatEnvironment env = GetEnvironment();
+	switch (bytes) {
+		case 4: {
+			uint32_t bits = SoftFloat::ToFloat32(value, env);
+			if (!Raise(env.flags)) return;
+			Write(address, 4, bits);
+			break;
+		}
+
+		case 8: {
+			uint64_t bits = SoftFloat::ToFloat64(value, env);
+			if (!Raise(env.flags)) return;
+			Write(address, 8, bits);
+			break;
+		}
+
+		default: {
+			WriteFloat80(address, value);
+			break;
+		}
+	}
+
+	if (pop) {
+		Pop();
+	}
+}
+
+void FPU::StoreInteger(uint32_t address, int bytes, bool pop) {
+	Float80 value;
+	if (!Fetch(0, value)) {
+		return;
+	}
+
+	FloatEnvironment env = GetEnvironment();
+
+	// the integer indefinite is the most negative value
+	int64_t integer;
+	if (!SoftFloat::ToInteger(value, bytes * 8, env, integer)) {
+		integer = static_cast<int64_t>(1ull << (bytes * 8 - 1));
+	}
+
+	if (!Raise(env.flags)) {
+		return;
+	}
+
+	Write(address, bytes, static_cast<uint64_t>(integer));
+	if (pop) {
+		Pop();
+	}
+}
+
+void FPU::StoreBcd(uint32_t address) {
+	Float80 value;
+	if (!Fetch(0, value)) {
+		return;
+	}
+
+	FloatEnvironment env = GetEnvironment();
+	constexpr int64_t Limit = 999999999999999999;
+
+	int64_t integer;
+	if (!SoftFloat::ToInteger(value, 64, env, integer) || integer > Limit || integer < -Limit) {
+		env.flags |= FloatException::Invalid;
+		if (!Raise(env.flags)) {
+			return;
+		}
+
+		// the packed decimal indefinite
+		Write(address, 8, 0xc000000000000000ull);
+		Write(address + 8, 2, 0xffff);
+		Pop();
+		return;
+	}
+
+	if (!Raise(env.flags)) {
+		return;
+	}
+
+	// two digits a byte, least significant first, and the sign on its own in the tenth
+	uint64_t magnitude = static_cast<uint64_t>(integer < 0 ? -integer : integer);
+	for (uint32_t i = 0; i < 9; i++) {
+		uint8_t low = magnitude % 10;
+		magnitude /= 10;
+		uint8_t high = magnitude % 10;
+		magnitude /= 10;
+
+		Write(address + i, 1, static_cast<uint8_t>((high << 4) | low));
+	}
+
+	Write(address + 9, 1, value.GetSign() ? 0x80 : 0x00);
+	Pop();
+}
+
+Float80 FPU::LoadBcd(uint32_t address) {
+	int64_t magnitude = 0;
+	for (int i = 8; i >= 0; i--) {
+		uint8_t digits = static_cast<uint8_t>(Read(address + i, 1));
+		magnitude = magnitude * 100 + (digits >> 4) * 10 + (digits & 0x0f);
+	}
+
+	// a negative zero stays negative
+	Float80 value = SoftFloat::FromInteger(magnitude);
+	return (Read(address + 9, 1) & 0x80) ? value.Negate() : value;
+}
+
+void FPU::StoreEnvironment(uint32_t address) {
+	uint16_t tags = 0;
+	for (int i = 0; i < 8; i++) {
+		tags |= static_cast<uint16_t>(static_cast<uint16_t>(m_Tags[i]) << (2 * i));
+	}
+
+	// the real mode layout, with the top four bits of each 20-bit pointer in a word of its own
+	Write(address + 0, 2, m_Control);
+	Write(address + 2, 2, GetStatusWord());
+	Write(address + 4, 2, tags);
+	Write(address + 6, 2, m_InstructionPointer & 0xffff);
+	Write(address + 8, 2, ((m_InstructionPointer >> 4) & 0xf000) | (m_Opcode & 0x07ff));
+	Write(address + 10, 2, m_OperandPointer & 0xffff);
+	Write(address + 12, 2, (m_OperandPointer >> 4) & 0xf000);
+}
+
+void FPU::LoadEnvironment(uint32_t address) {
+	m_Control = static_cast<uint16_t>(Read(address + 0, 2));
+
+	uint16_t status = static_cast<uint16_t>(Read(address + 2, 2));
+	m_Status = status & ~StatusTop;
+	m_Top = (status >> 11) & 7;
+
+	uint16_t tags = static_cast<uint16_t>(Read(address + 4, 2));
+	for (int i = 0; i < 8; i++) {
+		m_Tags[i] = static_cast<Tag>((tags >> (2 * i)) & 3);
+	}
+
+	uint32_t instruction_high = static_cast<uint32_t>(Read(address + 8, 2));
+	m_InstructionPointer = static_cast<uint32_t>(Read(address + 6, 2)) | ((instruction_high & 0xf000) << 4);
+	m_Opcode = instruction_high & 0x07ff;
+	m_OperandPointer = static_cast<uint32_t>(Read(address + 10, 2)) | ((static_cast<uint32_t>(Read(address + 12, 2)) & 0xf000) << 4);
+}
+
+uint64_t FPU::Read(uint32_t address, int bytes) const {
+	uint64_t value = 0;
+	for (int i = bytes - 1; i >= 0; i--) {
+		value = (value << 8) | m_Bus.ReadByte((address + i) & 0xfffff);
+	}
+
+	return value;
+}
+
+void FPU::Write(uint32_t address, int bytes, uint64_t value) {
+	for (int i = 0; i < bytes; i++) {
+		m_Bus.WriteByte((address + i) & 0xfffff, static_cast<uint8_t>(value >> (8 * i)));
+	}
+}
+
+Float80 FPU::ReadFloat80(uint32_t address) const {
+	return { Read(address, 8), static_cast<uint16_t>(Read(address + 8, 2)) };
+}
+
+void FPU::WriteFloat80(uint32_t address, Float80 value) {
+	Write(address, 8, value.significand);
+	Write(address + 8, 2, value.sign_exponent);
+}
+
+void FPU::SaveState(StateWriter& state) const {
+	state.Write(m_Stack);
+	state.Write(m_Tags);
+	state.Write(m_Top);
+	state.Write(m_Control);
+	state.Write(m_Status);
+	state.Write(m_InstructionPointer);
+	state.Write(m_OperandPointer);
+	state.Write(m_Opcode);
+}
+
+void FPU::LoadState(StateReader& state) {
+	state.Read(m_Stack);
+	state.Read(m_Tags);
+	state.Read(m_Top);
+	state.Read(m_Control);
+	state.Read(m_Status);
+	state.Read(m_InstructionPointer);
+	state.Read(m_OperandPointer);
+	state.Read(m_Opcode);
+}
\ No newline at end of file
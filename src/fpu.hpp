@@ -0,0 +1,174 @@
+#ifndef FPU_HPP
+#define FPU_HPP
+
+#include "bus.hpp"
+#include "float80.hpp"
+#include "scheduler.hpp"
+#include "state.hpp"
+
+#include <array>
+
+namespace xe86 {
+	/*
+	8087 NUMERIC COPROCESSOR
+		the cpu hands every ESC instruction (D8h-DFh) over here with its ModR/M byte and the
+		operand's physical address, already worked out. the 8087 runs alongside the cpu, so an
+		instruction only returns how long the 8087 is busy with it and the cpu makes WAIT sit out
+		whatever is left of that.
+
+		there are two ways to do the arithmetic. exact mode does everything in SoftFloat, bit for
+		bit what the chip would produce. fast mode gives add, subtract, multiply, divide and
+		square root to the host instead, when the control word asks for round to nearest at a
+		precision the host has (64 bits with an x87 long double, 53 with double) and the operands
+		are ordinary enough that the host can't disagree: normal, well inside the exponent range,
+		and for double exactly representable. the precision flag comes from error-free transforms
+		of the host result, so the status word is the same either way. anything else falls back
+		to SoftFloat.
+
+		the transcendentals go through the host's long double in both modes and are only as good
+		as its libm. unmasked exceptions are recorded in the status word but not signalled, the
+		interrupt line isn't wired to anything.
+	*/
+	class FPU {
+	public:
+		FPU(Bus& bus) : m_Bus(bus) {
+			Reset();
+		}
+
+		FPU(const FPU&) = delete;
+		FPU& operator=(const FPU&) = delete;
+
+		// the state after FINIT, which is also what RESET leaves
+		void Reset();
+
+		// one ESC instruction. address is the operand's physical address when the ModR/M byte has
+		// one, instruction is the linear address of the ESC itself. returns the 8087's clocks
+		Cycles Execute(uint8_t opcode, uint8_t modrm, uint32_t address, uint32_t instruction);
+
+		void SetFastMath(bool enabled) { m_FastMath = enabled; }
+
+		uint16_t GetStatusWord() const { return static_cast<uint16_t>((m_Status & ~StatusTop) | (m_Top << 11)); }
+		uint16_t GetControlWord() const { return m_Control; }
+
+		// ST(i), and whether it's empty
+		Float80 GetStack(uint8_t i) const { return m_Stack[Physical(i)]; }
+		bool IsEmpty(uint8_t i) const { return m_Tags[Physical(i)] == Tag::Empty; }
+
+		// operations the host did, and the ones it passed back to SoftFloat
+		uint64_t GetFastCount() const { return m_FastCount; }
+		uint64_t GetSlowCount() const { return m_SlowCount; }
+
+		void SaveState(StateWriter& state) const;
+		void LoadState(StateReader& state);
+
+	private:
+		enum class Tag : uint8_t { Valid, Zero, Special, Empty };
+
+		static constexpr uint16_t StatusC0 = 0x0100;
+		static constexpr uint16_t StatusC1 = 0x0200;
+		static constexpr uint16_t StatusC2 = 0x0400;
+		static constexpr uint16_t StatusC3 = 0x4000;
+		static constexpr uint16_t StatusTop = 0x3800;
+		static constexpr uint16_t StatusConditions = StatusC0 | StatusC1 | StatusC2 | StatusC3;
+
+		// interrupt request on the 8087, error summary on later chips, and busy
+		static constexpr uint16_t StatusRequest = 0x0080;
+		static constexpr uint16_t StatusBusy = 0x8000;
+
+		static constexpr uint16_t ControlInterruptMask = 0x0080;
+		static constexpr uint16_t ControlAffine = 0x1000;
+
+		static Tag GetTag(Float80 value) {
+			if (value.IsZero()) return Tag::Zero;
+			if (value.IsNormal()) return Tag::Valid;
+			return Tag::Special;
+		}
+
+		uint8_t Physical(uint8_t i) const { return (m_Top + i) & 7; }
+
+		// the environment the control word sets up, with no flags raised yet
+		FloatEnvironment GetEnvironment() const;
+
+		// raise flags in the status word. true if none of them were unmasked invalid, denormal or
+		// zero divide, which leave the destination alone
+		bool Raise(uint8_t flags);
+
+		// a masked stack fault's result is the indefinite, an unmasked one leaves things as they are
+		bool StackFault();
+
+		// ST(i) for reading, raising a stack fault if it's empty
+		bool Fetch(uint8_t i, Float80& value);
+
+		void Store(uint8_t i, Float80 value) {
+			m_Stack[Physical(i)] = value;
+			m_Tags[Physical(i)] = GetTag(value);
+		}
+
+		void Push(Float80 value);
+		void Pop();
+		void Exchange(uint8_t i);
+
+		void SetConditions(uint16_t conditions) { m_Status = static_cast<uint16_t>((m_Status & ~StatusConditions) | conditions); }
+
+		// a op b, op as the reg field of D8h-DEh numbers it (add, mul, -, -, sub, subr, div, divr)
+		// or square root. on the host if it's allowed to and can be, SoftFloat if not
+		Float80 Arithmetic(uint8_t operation, Float80 a, Float80 b, FloatEnvironment& env);
+		bool TryHost(uint8_t operation, Float80 a, Float80 b, Float80& result, FloatEnvironment& env);
+
+		// sets C3, C2 and C0 as FCOM does
+		void Compare(Float80 a, Float80 b, FloatEnvironment& env);
+
+		// a value read from memory in the format the opcode pair has: m32 real for D8h and D9h, then
+		// m32 int, m64 real and m16 int
+		Float80 Load(uint8_t opcode, uint32_t address, FloatEnvironment& env);
+
+		// D8h, DAh, DCh and DEh: arithmetic and compares, with ST and a memory operand or ST(i)
+		Cycles ExecuteArithmetic(uint8_t opcode, uint8_t modrm, uint32_t address, FloatEnvironment& env);
+
+		// D9h E0h-E7h, D9h F0h-F7h and D9h F8h-FFh by the rm field
+		Cycles ExecuteSign(uint8_t rm, FloatEnvironment& env);
+		Cycles ExecuteTranscendental(uint8_t rm, FloatEnvironment& env);
+		Cycles ExecuteMiscellaneous(uint8_t rm, FloatEnvironment& env);
+
+		// FYL2X, or FYL2XP1
+		Cycles ExecuteLogarithm(bool plus_one, FloatEnvironment& env);
+
+		// ST to memory, rounded for the format and popped if asked to
+		void StoreReal(uint32_t address, int bytes, bool pop);
+		void StoreInteger(uint32_t address, int bytes, bool pop);
+
+		// 18 packed decimal digits and a sign byte. FBSTP always pops
+		void StoreBcd(uint32_t address);
+		Float80 LoadBcd(uint32_t address);
+
+		void StoreEnvironment(uint32_t address);
+		void LoadEnvironment(uint32_t address);
+
+		uint64_t Read(uint32_t address, int bytes) const;
+		void Write(uint32_t address, int bytes, uint64_t value);
+
+		Float80 ReadFloat80(uint32_t address) const;
+		void WriteFloat80(uint32_t address, Float80 value);
+
+	private:
+		Bus& m_Bus;
+
+		std::array<Float80, 8> m_Stack{};
+		std::array<Tag, 8> m_Tags{};
+		uint8_t m_Top = 0;
+
+		uint16_t m_Control = 0;
+		uint16_t m_Status = 0;
+
+		// of the last instruction that wasn't a control instruction
+		uint32_t m_InstructionPointer = 0;
+		uint32_t m_OperandPointer = 0;
+		uint16_t m_Opcode = 0;
+
+		bool m_FastMath = false;
+		uint64_t m_FastCount = 0;
+		uint64_t m_SlowCount = 0;
+	};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,19 @@
+#ifndef HASH_HPP
+#define HASH_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+namespace xe86 {
+	// FNV-1a, 64-bit. used to identify rom images and similar, not for anything adversarial
+	inline uint64_t Fnv1a64(const uint8_t* data, size_t length, uint64_t hash = 0xcbf29ce484222325ull) {
+		for (size_t i = 0; i < length; i++) {
+			hash ^= data[i];
+			hash *= 0x100000001b3ull;
+		}
+
+		return hash;
+	}
+}
+
+#endif
\ No newline at end of file
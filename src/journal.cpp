@@ -0,0 +1,249 @@
+#include "journal.hpp"
+#include <print>
+#include <fstream>
+#include <cstring>
+
+using namespace xe86;
+
+static constexpr char Magic[8] = { 'X', 'E', '8', '6', 'J', 'R', 'N', 'L' };
+
+std::unique_ptr<InputJournal> InputJournal::CreateRecording(std::string_view filename, uint64_t rom_hash) {
+	std::ofstream file(std::string(filename), std::ios::binary | std::ios::trunc);
+	if (!file) {
+		std::println(stderr, "journal: failed to create '{}'", filename);
+		return nullptr;
+	}
+
+	auto journal = std::unique_ptr<InputJournal>(new InputJournal(Mode::Record));
+	journal->m_Filename = filename;
+	journal->m_RomHash = rom_hash;
+
+	file.write(Magic, sizeof(Magic));
+	file.write(reinterpret_cast<const char*>(&Version), sizeof(Version));
+	file.write(reinterpret_cast<const char*>(&rom_hash), sizeof(rom_hash));
+	return journal;
+}
+
+std::unique_ptr<InputJournal> InputJournal::OpenReplay(std::string_view filename) {
+	std::ifstream file(std::string(filename), std::ios::binary | std::ios::ate);
+	if (!file) {
+		std::println(stderr, "journal: failed to open '{}'", filename);
+		return nullptr;
+	}
+
+	size_t size = file.tellg();
+	file.seekg(0, std::ios::beg);
+
+	char magic[8];
+	uint32_t version = 0;
+	uint64_t rom_hash = 0;
+
+	file.read(magic, sizeof(magic));
+	file.read(reinterpret_cast<char*>(&version), sizeof(version));
+	file.read(reinterpret_cast<char*>(&rom_hash), sizeof(rom_hash));
+
+	if (!file || std::memcmp(magic, Magic, sizeof(Magic)) != 0 || version != Version) {
+		std::println(stderr, "journal: '{}' is not a version {} input journal", filename, Version);
+		return nullptr;
+	}
+
+	auto journal = std::unique_ptr<InputJournal>(new InputJournal(Mode::Replay));
+	journal->m_Filename = filename;
+	journal->m_RomHash = rom_hash;
+
+	size_t header = sizeof(magic) + sizeof(version) + sizeof(rom_hash);
+	journal->m_Data.resize(size - header);
+	file.read(reinterpret_cast<char*>(journal->m_Data.data()), journal->m_Data.size());
+
+	journal->PeekNext();
+	return journal;
+}
+
+InputJournal::~InputJournal() {
+	if (m_Mode == Mode::Record) {
+		Flush();
+	}
+}
+
+void InputJournal::Flush() {
+	if (m_Mode != Mode::Record || m_Data.empty()) {
+		return;
+	}
+
+	std::ofstream file(m_Filename, std::ios::binary | std::ios::app);
+	file.write(reinterpret_cast<const char*>(m_Data.data()), m_Data.size());
+	m_Data.clear();
+}
+
+void InputJournal::SaveState(StateWriter& state) const {
+	state.Write<uint64_t>(m_Cursor);
+	state.Write(m_Last);
+	state.Write(m_NextKind);
+	state.Write(m_NextAt);
+	state.Write(m_Diverged);
+}
+
+void InputJournal::LoadState(StateReader& state) {
+	m_Cursor = state.Read<uint64_t>();
+	state.Read(m_Last);
+	state.Read(m_NextKind);
+	state.Read(m_NextAt);
+	state.Read(m_Diverged);
+}
+
+void InputJournal::WriteVarint(uint64_t value) {
+	while (value >= 0x80) {
+		m_Data.push_back(static_cast<uint8_t>(value) | 0x80);
+		value >>= 7;
+	}
+
+	m_Data.push_back(static_cast<uint8_t>(value));
+}
+
+uint64_t InputJournal::ReadVarint() {
+	uint64_t value = 0;
+	for (int shift = 0; m_Cursor < m_Data.size() && shift < 64; shift += 7) {
+		uint8_t byte = m_Data[m_Cursor++];
+		value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+
+		if (!(byte & 0x80)) {
+			break;
+		}
+	}
+
+	return value;
+}
+
+void InputJournal::BeginRecord(RecordKind kind, uint64_t instruction) {
+	if (m_Data.size() >= FlushThreshold) {
+		Flush();
+	}
+
+	m_Data.push_back(static_cast<uint8_t>(kind));
+	WriteVarint(instruction - m_Last);
+	m_Last = instruction;
+}
+
+void InputJournal::RecordPortRead(uint64_t instruction, PortAddress16 port, uint8_t value) {
+	BeginRecord(RecordKind::PortRead, instruction);
+	WriteVarint(port);
+	m_Data.push_back(value);
+}
+
+void InputJournal::RecordInterrupt(uint64_t instruction, uint8_t vector) {
+	BeginRecord(RecordKind::Interrupt, instruction);
+	m_Data.push_back(vector);
+}
+
+void InputJournal::RecordHostInput(uint64_t instruction, uint8_t channel, std::span<const uint8_t> data) {
+	BeginRecord(RecordKind::HostInput, instruction);
+	m_Data.push_back(channel);
+	WriteVarint(data.size());
+	m_Data.insert(m_Data.end(), data.begin(), data.end());
+}
+
+void InputJournal::RecordEnd(uint64_t instruction) {
+	BeginRecord(RecordKind::End, instruction);
+	Flush();
+}
+
+void InputJournal::PeekNext() {
+	while (m_Cursor < m_Data.size()) {
+		m_NextKind = static_cast<RecordKind>(m_Data[m_Cursor++]);
+		m_NextAt = m_Last + ReadVarint();
+
+		if (m_NextKind != RecordKind::HostInput) {
+			return;
+		}
+
+		SkipHostInputs();
+	}
+
+	m_NextAt = NoRecord;
+}
+
+void InputJournal::SkipHostInputs() {
+	m_Last = m_NextAt;
+
+	if (m_Cursor >= m_Data.size()) {
+		Malformed("host input record ends before its channel");
+		return;
+	}
+
+	uint8_t channel = m_Data[m_Cursor++];
+	size_t length = ReadVarint();
+	if (length > m_Data.size() - m_Cursor) {
+		Malformed("host input record runs past the end");
+		return;
+	}
+
+	std::span<const uint8_t> data(m_Data.data() + m_Cursor, length);
+	m_Cursor += length;
+
+	if (m_HostInputHandler) {
+		m_HostInputHandler(m_Last, channel, data);
+	}
+}
+
+void InputJournal::Diverge(std::string_view what, uint64_t instruction) {
+	if (!m_Diverged) {
+		std::println(stderr, "journal: replay diverged at instruction {}: {}", instruction, what);
+	}
+
+	m_Diverged = true;
+}
+
+void InputJournal::Malformed(std::string_view what) {
+	std::println(stderr, "journal: '{}' is malformed after instruction {}: {}", m_Filename, m_Last, what);
+
+	// nothing after it can be trusted, so the replay stops here
+	m_Cursor = m_Data.size();
+	m_Diverged = true;
+}
+
+uint8_t InputJournal::ReplayPortRead(uint64_t instruction, PortAddress16 port) {
+	if (m_NextAt == NoRecord) {
+		Diverge("port read past the end of the journal", instruction);
+		return 0xff;
+	}
+
+	if (m_NextKind != RecordKind::PortRead) {
+		Diverge("port read where the journal has something else", instruction);
+		return 0xff;
+	}
+
+	if (m_NextAt != instruction) {
+		Diverge("port read at a different instruction than recorded", instruction);
+	}
+
+	m_Last = m_NextAt;
+	PortAddress16 recorded = static_cast<PortAddress16>(ReadVarint());
+	if (m_Cursor >= m_Data.size()) {
+		Malformed("port read record ends before its value");
+		PeekNext();
+		return 0xff;
+	}
+
+	uint8_t value = m_Data[m_Cursor++];
+
+	if (recorded != port) {
+		Diverge("read from a different port than recorded", instruction);
+	}
+
+	PeekNext();
+	return value;
+}
+
+uint8_t InputJournal::ReplayInterrupt() {
+	m_Last = m_NextAt;
+	if (m_Cursor >= m_Data.size()) {
+		Malformed("interrupt record ends before its vector");
+		PeekNext();
+		return 0;
+	}
+
+	uint8_t vector = m_Data[m_Cursor++];
+
+	PeekNext();
+	return vector;
+}
\ No newline at end of file
@@ -0,0 +1,124 @@
+#ifndef JOURNAL_HPP
+#define JOURNAL_HPP
+
+#include "types.hpp"
+#include "state.hpp"
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <functional>
+#include <span>
+#include <limits>
+#include <memory>
+
+namespace xe86 {
+	/*
+	INPUT JOURNAL
+		everything the guest can observe that doesn't come from its own code: port reads, the
+		instruction count at which each interrupt was taken, and input injected by the host.
+		recording it is enough to re-run the machine bit-for-bit with no devices attached.
+
+		file layout: "XE86JRNL", u32 version, u64 rom hash, then a stream of records
+			u8 kind, varint instructions since the previous record, payload
+		payloads
+			PortRead	varint port, u8 value
+			Interrupt	u8 vector
+			HostInput	u8 channel, varint length, bytes
+			End			(none) - the recording stopped at this instruction
+	*/
+	class InputJournal {
+	public:
+		enum class Mode {
+			Record,
+			Replay,
+		};
+
+		enum class RecordKind : uint8_t {
+			PortRead = 0,
+			Interrupt = 1,
+			HostInput = 2,
+			End = 3,
+		};
+
+		// record into filename, rom_hash identifies the machine so a replay can't use the wrong rom
+		static std::unique_ptr<InputJournal> CreateRecording(std::string_view filename, uint64_t rom_hash);
+		static std::unique_ptr<InputJournal> OpenReplay(std::string_view filename);
+
+		~InputJournal();
+
+		Mode GetMode() const { return m_Mode; }
+		bool IsReplaying() const { return m_Mode == Mode::Replay; }
+		uint64_t GetRomHash() const { return m_RomHash; }
+
+		// replay has reached the point where the recording stopped
+		bool IsFinished(uint64_t instruction) const {
+			return m_Mode == Mode::Replay && (m_NextAt == NoRecord || (m_NextKind == RecordKind::End && instruction >= m_NextAt));
+		}
+		bool HasDiverged() const { return m_Diverged; }
+
+		void Flush();
+
+		// replay position, so a rewound machine reads the same inputs again
+		void SaveState(StateWriter& state) const;
+		void LoadState(StateReader& state);
+
+	public:
+		// recording
+		void RecordPortRead(uint64_t instruction, PortAddress16 port, uint8_t value);
+		void RecordInterrupt(uint64_t instruction, uint8_t vector);
+		void RecordHostInput(uint64_t instruction, uint8_t channel, std::span<const uint8_t> data);
+		void RecordEnd(uint64_t instruction);
+
+		// replay
+		uint8_t ReplayPortRead(uint64_t instruction, PortAddress16 port);
+
+		bool IsInterruptDue(uint64_t instruction) const {
+			return m_NextKind == RecordKind::Interrupt && m_NextAt == instruction;
+		}
+
+		uint8_t ReplayInterrupt();
+
+		// host input has no effect on replay (the devices it fed aren't given it, their outputs
+		// are already in the journal) but it is skipped over in order, and can be inspected
+		void SetHostInputHandler(std::function<void(uint64_t, uint8_t, std::span<const uint8_t>)> handler) {
+			m_HostInputHandler = std::move(handler);
+		}
+
+	private:
+		InputJournal(Mode mode) : m_Mode(mode) {}
+
+		void BeginRecord(RecordKind kind, uint64_t instruction);
+		void WriteVarint(uint64_t value);
+		uint64_t ReadVarint();
+
+		// replay: decode the header of the next record into m_NextKind/m_NextAt
+		void PeekNext();
+		void SkipHostInputs();
+		void Diverge(std::string_view what, uint64_t instruction);
+		void Malformed(std::string_view what);
+
+	private:
+		static constexpr uint32_t Version = 1;
+		static constexpr size_t FlushThreshold = 64 * 1024;
+		static constexpr uint64_t NoRecord = std::numeric_limits<uint64_t>::max();
+
+		Mode m_Mode;
+		std::string m_Filename;
+		uint64_t m_RomHash = 0;
+
+		std::vector<uint8_t> m_Data;
+		size_t m_Cursor = 0;
+
+		// instruction count of the last record written or consumed
+		uint64_t m_Last = 0;
+
+		RecordKind m_NextKind = RecordKind::PortRead;
+		uint64_t m_NextAt = NoRecord;
+
+		bool m_Diverged = false;
+		std::function<void(uint64_t, uint8_t, std::span<const uint8_t>)> m_HostInputHandler;
+	};
+}
+
+#endif
\ No newline at end of file
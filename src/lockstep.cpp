@@ -0,0 +1,161 @@
+#include "lockstep.hpp"
+#include <print>
+#include <limits>
+#include <algorithm>
+#include <cstdio>
+
+using namespace xe86;
+
+Lockstep::Lockstep(PC& checked, PC& reference, uint64_t interval)
+	: m_Checked(checked), m_Reference(reference), m_Interval(std::max<uint64_t>(interval, 1)) {
+	m_Checked.EnableRewind(m_Interval, RewindBudget);
+	m_Reference.EnableRewind(m_Interval, RewindBudget);
+
+	m_LastMatch = m_Checked.GetBus()->GetScheduler().GetInstructionCount();
+	m_NextCheck = m_LastMatch + m_Interval;
+}
+
+bool Lockstep::Compare() {
+	m_Checks++;
+	CatchUp();
+
+	uint64_t now = m_Checked.GetBus()->GetScheduler().GetInstructionCount();
+	if (Matches()) {
+		m_LastMatch = now;
+		m_NextCheck = now + m_Interval;
+		return true;
+	}
+
+	Bisect(m_LastMatch, now);
+	return false;
+}
+
+void Lockstep::CatchUp() {
+	uint64_t target = m_Checked.GetBus()->GetScheduler().GetInstructionCount();
+	Scheduler& scheduler = m_Reference.GetBus()->GetScheduler();
+
+	// the checked machine can get past a check in the middle of a translated block or a fused
+	// pair, the reference stops exactly where it did
+	scheduler.SetInstructionLimit(target);
+	while (scheduler.GetInstructionCount() < target) {
+		m_Reference.Step();
+
+		if (m_Reference.IsStalled()) {
+			break;
+		}
+	}
+
+	scheduler.SetInstructionLimit(std::numeric_limits<uint64_t>::max());
+}
+
+bool Lockstep::Matches() {
+	if (m_Checked.GetBus()->GetScheduler().GetInstructionCount() != m_Reference.GetBus()->GetScheduler().GetInstructionCount()) {
+		return false;
+	}
+
+	return m_CheckedDigest.Update(m_Checked.Get<CPU>(), *m_Checked.GetBus()) ==
+		m_ReferenceDigest.Update(m_Reference.Get<CPU>(), *m_Reference.GetBus());
+}
+
+std::function<int()> Lockstep::GetInput(PC& machine) {
+	InputCursor& cursor = m_InputCursors[&machine == &m_Checked ? 0 : 1];
+	Scheduler& scheduler = machine.GetBus()->GetScheduler();
+
+	return [this, &cursor, &scheduler]() {
+		uint64_t instruction = scheduler.GetInstructionCount();
+		cursor.position = instruction == cursor.instruction ? cursor.position + 1 : 0;
+		cursor.instruction = instruction;
+
+		auto [it, read] = m_Input.try_emplace({ instruction, cursor.position }, 0);
+		if (read) {
+			it->second = std::getchar();
+		}
+
+		return it->second;
+	};
+}
+
+bool Lockstep::RewindTo(uint64_t instruction) {
+	m_InputCursors.fill({});
+	return m_Checked.RewindTo(instruction) && m_Reference.RewindTo(instruction);
+}
+
+void Lockstep::Bisect(uint64_t good, uint64_t bad) {
+	Divergence divergence{};
+	divergence.exact = true;
+
+	// the oldest snapshots may have been dropped to stay within budget
+	uint64_t oldest = std::max(m_Checked.GetRewindBuffer()->GetOldestInstruction(), m_Reference.GetRewindBuffer()->GetOldestInstruction());
+	if (oldest > good) {
+		good = oldest;
+		divergence.exact = good < bad && RewindTo(good) && Matches();
+	}
+
+	while (divergence.exact && bad - good > 1) {
+		uint64_t middle = good + (bad - good) / 2;
+		if (!RewindTo(middle)) {
+			divergence.exact = false;
+			break;
+		}
+
+		if (Matches()) {
+			good = middle;
+		} else {
+			bad = middle;
+		}
+	}
+
+	// where the instruction that made the difference starts, the same on both
+	if (divergence.exact && RewindTo(bad - 1)) {
+		const Registers& registers = m_Checked.Get<CPU>().GetRegisters();
+		divergence.cs = registers.cs;
+		divergence.ip = registers.ip;
+	}
+
+	divergence.first = bad;
+	if (RewindTo(bad)) {
+		Matches();
+	}
+
+	divergence.checked = m_Checked.Get<CPU>().GetRegisters();
+	divergence.reference = m_Reference.Get<CPU>().GetRegisters();
+
+	auto& areas = m_Checked.GetBus()->GetMemoryAreas();
+	for (size_t a = 0; a < std::min(m_CheckedDigest.GetAreaCount(), m_ReferenceDigest.GetAreaCount()); a++) {
+		for (size_t p = 0; p < std::min(m_CheckedDigest.GetPageCount(a), m_ReferenceDigest.GetPageCount(a)); p++) {
+			if (m_CheckedDigest.GetPageHash(a, p) != m_ReferenceDigest.GetPageHash(a, p)) {
+				divergence.pages.push_back(areas[a]->GetStartAddress() + static_cast<uint32_t>(p * MemoryArea::PageSize));
+			}
+		}
+	}
+
+	m_Divergence = std::move(divergence);
+}
+
+void Lockstep::PrintDivergence() const {
+	if (!m_Divergence) {
+		return;
+	}
+
+	const Divergence& d = *m_Divergence;
+	if (d.exact) {
+		std::println("lockstep: diverged at instruction {}, the one at {:04x}:{:04x}", d.first, d.cs, d.ip);
+	} else {
+		std::println("lockstep: diverged at or before instruction {}, the rewind buffers don't go back far enough to say where", d.first);
+	}
+
+	for (auto [name, r] : { std::pair<const char*, const Registers*>{ "checked", &d.checked }, { "reference", &d.reference } }) {
+		std::println("lockstep: {:>9} ax={:04x} bx={:04x} cx={:04x} dx={:04x} sp={:04x} bp={:04x} si={:04x} di={:04x} "
+			"cs={:04x} ds={:04x} ss={:04x} es={:04x} ip={:04x} flags={:04x}",
+			name,
+			static_cast<uint16_t>(r->ax), static_cast<uint16_t>(r->bx), static_cast<uint16_t>(r->cx), static_cast<uint16_t>(r->dx),
+			static_cast<uint16_t>(r->sp), static_cast<uint16_t>(r->bp), static_cast<uint16_t>(r->si), static_cast<uint16_t>(r->di),
+			static_cast<uint16_t>(r->cs), static_cast<uint16_t>(r->ds), static_cast<uint16_t>(r->ss), static_cast<uint16_t>(r->es),
+			static_cast<uint16_t>(r->ip), static_cast<uint16_t>(r->flags)
+		);
+	}
+
+	for (uint32_t page : d.pages) {
+		std::println("lockstep: memory differs in {:05x}-{:05x}", page, page + MemoryArea::PageSize - 1);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,122 @@
+#ifndef LOCKSTEP_HPP
+#define LOCKSTEP_HPP
+
+#include "pc.hpp"
+#include "digest.hpp"
+
+#include <optional>
+#include <vector>
+#include <array>
+#include <map>
+#include <functional>
+
+namespace xe86 {
+	/*
+	LOCKSTEP
+		runs a reference machine alongside the one being checked, to catch a fast path (ahead of
+		time translation, fusion, the 8087 on the host) doing something the plain interpreter
+		wouldn't. both start from the same state with nothing coming in from the host, so the
+		only thing that can tell them apart is how they execute.
+
+		every interval instructions the reference is brought up to exactly where the checked
+		machine is and their state digests are compared. the digests only rehash what was
+		written, so that is cheap enough to leave on. both machines keep a rewind buffer, and
+		when the digests differ the instructions since the last match are bisected, rewinding and
+		replaying both, down to the first one after which they aren't in the same state.
+
+		a dos program's stdin is the one thing that does come in from the host. each byte is read
+		once and kept, keyed by the instruction it was read at and how many came before it in that
+		instruction, so the reference and every replay while bisecting see the same input.
+	*/
+	class Lockstep {
+	public:
+		static constexpr size_t RewindBudget = 64 << 20;
+
+		// the reference should have every fast path off. both must have been reset and loaded the same way
+		Lockstep(PC& checked, PC& reference, uint64_t interval);
+
+		Lockstep(const Lockstep&) = delete;
+		Lockstep& operator=(const Lockstep&) = delete;
+
+		// after every step of the checked machine. false once the two have diverged
+		bool Check() {
+			if (m_Divergence) {
+				return false;
+			}
+
+			if (m_Checked.GetBus()->GetScheduler().GetInstructionCount() >= m_NextCheck) [[unlikely]] {
+				return Compare();
+			}
+
+			return true;
+		}
+
+		// compares right away, for the instructions since the last check when the run is over
+		bool CheckNow() { return m_Divergence ? false : Compare(); }
+
+		struct Divergence {
+			// the machines agreed after first - 1 instructions and not after first
+			uint64_t first;
+
+			// false if the rewind buffers didn't go back far enough to narrow it down to one
+			bool exact;
+
+			uint16_t cs;
+			uint16_t ip;
+
+			Registers checked;
+			Registers reference;
+
+			// linear addresses of the pages that differ
+			std::vector<uint32_t> pages;
+		};
+
+		// for DOS::SetInput on either machine
+		std::function<int()> GetInput(PC& machine);
+
+		const std::optional<Divergence>& GetDivergence() const { return m_Divergence; }
+		uint64_t GetCheckCount() const { return m_Checks; }
+
+		void PrintDivergence() const;
+
+	private:
+		bool Compare();
+
+		// the reference up to where the checked machine is
+		void CatchUp();
+
+		bool Matches();
+
+		// both machines to exactly this many instructions, through their rewind buffers
+		bool RewindTo(uint64_t instruction);
+
+		void Bisect(uint64_t good, uint64_t bad);
+
+	private:
+		PC& m_Checked;
+		PC& m_Reference;
+		uint64_t m_Interval;
+
+		StateDigest m_CheckedDigest;
+		StateDigest m_ReferenceDigest;
+
+		uint64_t m_NextCheck;
+		uint64_t m_LastMatch;
+		uint64_t m_Checks = 0;
+
+		std::optional<Divergence> m_Divergence;
+
+		// stdin as read so far, by instruction and position within it
+		std::map<std::pair<uint64_t, size_t>, int> m_Input;
+
+		// each machine's last read, so a rewind starts counting positions over
+		struct InputCursor {
+			uint64_t instruction = ~0ull;
+			size_t position = 0;
+		};
+
+		std::array<InputCursor, 2> m_InputCursors;
+	};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,179 @@
+#ifndef MACHINE_HPP
+#define MACHINE_HPP
+
+#include "bus.hpp"
+#include "component.hpp"
+#include "rewind.hpp"
+#include "dedup.hpp"
+
+#include <tuple>
+#include <vector>
+#include <print>
+#include <string>
+#include <memory>
+
+namespace xe86 {
+	// everything a machine does around its components: running the clock, idling and rewind.
+	// Derived supplies StepComponents(), IsIdle() and SaveComponents()/LoadComponents().
+	template <typename Derived>
+	class MachineBase {
+	public:
+		MachineBase(std::shared_ptr<Bus> bus) : m_Bus(bus) {}
+
+		void Step() {
+			Self().StepComponents();
+
+			Scheduler& scheduler = m_Bus->GetScheduler();
+			scheduler.RunDueEvents();
+
+			if (m_Rewind && m_Rewind->IsDue(scheduler.GetInstructionCount())) {
+				m_Rewind->Capture(scheduler.GetInstructionCount(), SaveMachineState(), *m_Bus);
+			}
+
+			// counted in steps rather than instructions, so a machine sitting idle still gets its memory shared
+			if (m_Deduplicator && ++m_StepsSinceShare >= m_ShareInterval) {
+				m_StepsSinceShare = 0;
+				for (auto& area : m_Bus->GetMemoryAreas()) {
+					area->Share(*m_Deduplicator);
+				}
+			}
+
+			// everything is waiting on a device, so there is nothing to emulate until the next event
+			m_Stalled = false;
+			if (Self().IsIdle()) {
+				m_Stalled = !scheduler.FastForward();
+			}
+		}
+
+		// idle with nothing scheduled: only the host can wake the guest now
+		bool IsStalled() const {
+			return m_Stalled;
+		}
+
+		std::shared_ptr<Bus> GetBus() { return m_Bus; }
+
+		std::vector<uint8_t> SaveMachineState() {
+			StateWriter state;
+			m_Bus->SaveState(state);
+			Self().SaveComponents(state);
+
+			return std::move(state.GetData());
+		}
+
+		void LoadMachineState(std::span<const uint8_t> data) {
+			StateReader state(data);
+			m_Bus->LoadState(state);
+			Self().LoadComponents(state);
+		}
+
+		// keep a snapshot every interval instructions, in at most budget bytes
+		void EnableRewind(uint64_t interval, size_t budget) {
+			m_Rewind = std::make_unique<RewindBuffer>(interval, budget);
+		}
+
+		RewindBuffer* GetRewindBuffer() { return m_Rewind.get(); }
+
+		// offer memory that hasn't changed for interval steps to a deduplicator, usually one shared
+		// by every machine in the process. see GetBus()->GetMemoryStats() for what it saves
+		void EnableDeduplication(std::shared_ptr<PageDeduplicator> deduplicator, uint64_t interval = 1000000) {
+			m_Deduplicator = std::move(deduplicator);
+			m_ShareInterval = interval;
+			m_StepsSinceShare = 0;
+		}
+
+		// restore the nearest snapshot at or before instruction and execute forward up to it
+		bool RewindTo(uint64_t instruction) {
+			if (!m_Rewind) {
+				std::println(stderr, "emulator: rewind is not enabled");
+				return false;
+			}
+
+			auto journal = m_Bus->GetJournal();
+			if (journal && !journal->IsReplaying()) {
+				std::println(stderr, "emulator: can't rewind while recording a journal");
+				return false;
+			}
+
+			auto restored = m_Rewind->Restore(instruction, *m_Bus);
+			if (!restored) {
+				std::println(stderr, "emulator: instruction {} is older than the rewind buffer", instruction);
+				return false;
+			}
+
+			LoadMachineState(restored->machine);
+
+			Scheduler& scheduler = m_Bus->GetScheduler();
+			scheduler.SetInstructionLimit(instruction);
+			while (scheduler.GetInstructionCount() < instruction) {
+				Step();
+
+				if (m_Stalled) {
+					break;
+				}
+			}
+
+			scheduler.SetInstructionLimit(std::numeric_limits<uint64_t>::max());
+
+			return scheduler.GetInstructionCount() == instruction;
+		}
+
+	protected:
+		std::shared_ptr<Bus> m_Bus;
+
+	private:
+		Derived& Self() { return static_cast<Derived&>(*this); }
+
+		bool m_Stalled = false;
+		std::unique_ptr<RewindBuffer> m_Rewind;
+
+		std::shared_ptr<PageDeduplicator> m_Deduplicator;
+		uint64_t m_ShareInterval = 0;
+		uint64_t m_StepsSinceShare = 0;
+	};
+
+	/*
+	a machine whose components are fixed at compile time, e.g. Machine<CPU, PIC, PIT>.
+	components are stored by value and stepped in order with direct calls, so nothing goes
+	through the vtable per instruction. EmulatorState is the dynamic alternative.
+	*/
+	template <typename... Ts>
+	class Machine : public MachineBase<Machine<Ts...>> {
+	public:
+		Machine(std::string_view bios_rom) : Machine(std::make_shared<Bus>(bios_rom)) {}
+
+		// each component is constructed in place from the bus, they are never moved
+		Machine(std::shared_ptr<Bus> bus) : MachineBase<Machine<Ts...>>(bus), m_Components((static_cast<void>(sizeof(Ts)), bus)...) {
+			(std::println(stderr, "emulator: adding new component '{}'", Get<Ts>().GetHumanName()), ...);
+		}
+
+		template <typename T>
+		T& Get() {
+			return std::get<T>(m_Components);
+		}
+
+		void Reset() {
+			(Get<Ts>().Reset(), ...);
+		}
+
+		void StepComponents() {
+			(Get<Ts>().Step(), ...);
+		}
+
+		bool IsIdle() {
+			return (Get<Ts>().IsIdle() && ...);
+		}
+
+		void SaveComponents(StateWriter& state) {
+			(Get<Ts>().SaveState(state), ...);
+		}
+
+		void LoadComponents(StateReader& state) {
+			(Get<Ts>().LoadState(state), ...);
+		}
+
+	private:
+		std::tuple<Ts...> m_Components;
+	};
+}
+
+#endif
\ No newline at end of file
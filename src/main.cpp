@@ -1,15 +1,527 @@
-#include "emulator.hpp"
-#include "cpu.hpp"
+#include "pc.hpp"
+#include "journal.hpp"
+#include "video.hpp"
+#include "audio.hpp"
+#include "profiler.hpp"
+#include "dos.hpp"
+#include "disk.hpp"
+#include "pacer.hpp"
+#include "coverage.hpp"
+#include "lockstep.hpp"
+#include "textscreen.hpp"
 
 #include <print>
 #include <memory>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <csignal>
+#include <string_view>
+#include <string>
+#include <fstream>
+#include <vector>
+#include <cctype>
+#include <cstdlib>
+#include <cstdio>
 
-int main() {
-	xe86::EmulatorState emulator("roms/GLABIOS_0.4.1_8T.ROM");
-	emulator.AttachComponent<xe86::CPU>();
+static std::atomic<bool> g_Running = true;
+
+static bool ParseHex(std::string_view text, uint32_t& value) {
+	if (text.empty()) {
+		return false;
+	}
+
+	value = 0;
+	for (char c : text) {
+		int digit = std::isdigit(c) ? c - '0' : (std::tolower(c) >= 'a' && std::tolower(c) <= 'f') ? std::tolower(c) - 'a' + 10 : -1;
+		if (digit < 0) {
+			return false;
+		}
+
+		value = (value << 4) | digit;
+	}
+
+	return true;
+}
+
+// "<address | segment:offset> [if <condition>]" for breakpoints,
+// "<start>[-<end>] [r | w | rw] [if <condition>]" for watchpoints. addresses are hex.
+static bool AddDebugSpec(xe86::Debugger& debugger, std::string_view spec, bool watch) {
+	std::string_view condition;
+	size_t at = spec.find(" if ");
+	if (at != std::string_view::npos) {
+		condition = spec.substr(at + 4);
+		spec = spec.substr(0, at);
+	}
+
+	std::string_view where = spec.substr(0, spec.find(' '));
+	std::string_view access = spec.size() > where.size() ? spec.substr(where.size() + 1) : "rw";
+
+	if (!watch) {
+		size_t colon = where.find(':');
+		uint32_t segment, offset;
+		if (colon != std::string_view::npos) {
+			return ParseHex(where.substr(0, colon), segment) && ParseHex(where.substr(colon + 1), offset) &&
+				debugger.AddBreakpoint(static_cast<uint16_t>(segment), static_cast<uint16_t>(offset), condition) != 0;
+		}
+
+		return ParseHex(where, offset) && debugger.AddBreakpoint(offset, condition) != 0;
+	}
+
+	size_t dash = where.find('-');
+	uint32_t start, end;
+	if (!ParseHex(where.substr(0, dash), start)) {
+		return false;
+	}
+
+	end = start;
+	if (dash != std::string_view::npos && !ParseHex(where.substr(dash + 1), end)) {
+		return false;
+	}
+
+	uint8_t mode = (access.find('r') != std::string_view::npos ? xe86::Debugger::Read : 0) |
+		(access.find('w') != std::string_view::npos ? xe86::Debugger::Write : 0);
+
+	return mode != 0 && debugger.AddWatchpoint(start, end, mode, condition) != 0;
+}
+
+int main(int argc, char** argv) {
+	std::string_view record_path;
+	std::string_view replay_path;
+	std::string_view video_path;
+	std::string_view font_path;
+	std::string_view audio_path;
+	std::vector<std::string_view> fault_specs;
+	std::vector<std::string_view> break_specs;
+	std::vector<std::string_view> watch_specs;
+	std::string_view profile_path;
+	std::vector<std::string_view> symbol_paths;
+	xe86::Cycles profile_interval = 1000;
+	unsigned video_scale = 1;
+	bool show_stats = false;
+	bool fusion = true;
+	bool translation = true;
+	std::string_view fpu_mode = "fast";
+	std::string_view com1_spec;
+	std::string_view com2_spec;
+	bool serial_paced = true;
+	double speed = 0;
+	std::string_view coverage_path;
+	std::vector<std::string_view> listing_specs;
+	uint64_t lockstep_interval = 0;
+	std::vector<std::string_view> floppy_specs;
+	std::vector<std::string_view> hard_disk_specs;
+	std::string_view until_text;
+	std::string_view screen_text_path;
+	std::string_view program_path;
+	std::string_view program_arguments;
+
+	for (int i = 1; i < argc; i++) {
+		std::string_view arg = argv[i];
+
+		if (arg == "--record" && i + 1 < argc) {
+			record_path = argv[++i];
+		} else if (arg == "--replay" && i + 1 < argc) {
+			replay_path = argv[++i];
+		} else if (arg == "--video" && i + 1 < argc) {
+			video_path = argv[++i];
+		} else if (arg == "--font" && i + 1 < argc) {
+			font_path = argv[++i];
+		} else if (arg == "--scale" && i + 1 < argc) {
+			video_scale = std::stoul(argv[++i]);
+		} else if (arg == "--audio" && i + 1 < argc) {
+			audio_path = argv[++i];
+		} else if (arg == "--faults" && i + 1 < argc) {
+			fault_specs.push_back(argv[++i]);
+		} else if (arg == "--break" && i + 1 < argc) {
+			break_specs.push_back(argv[++i]);
+		} else if (arg == "--watch" && i + 1 < argc) {
+			watch_specs.push_back(argv[++i]);
+		} else if (arg == "--profile" && i + 1 < argc) {
+			profile_path = argv[++i];
+		} else if (arg == "--symbols" && i + 1 < argc) {
+			symbol_paths.push_back(argv[++i]);
+		} else if (arg == "--profile-interval" && i + 1 < argc) {
+			profile_interval = std::stoull(argv[++i]);
+		} else if (arg == "--run" && i + 1 < argc) {
+			program_path = argv[++i];
+		} else if (arg == "--args" && i + 1 < argc) {
+			program_arguments = argv[++i];
+		} else if (arg == "--com1" && i + 1 < argc) {
+			com1_spec = argv[++i];
+		} else if (arg == "--com2" && i + 1 < argc) {
+			com2_spec = argv[++i];
+		} else if (arg == "--serial-unpaced") {
+			serial_paced = false;
+		} else if (arg == "--speed" && i + 1 < argc && (std::string_view(argv[i + 1]) == "max" || std::strtod(argv[i + 1], nullptr) > 0)) {
+			// a multiple of 4.77 MHz, or max for as fast as the host goes
+			speed = std::string_view(argv[++i]) == "max" ? 0 : std::strtod(argv[i], nullptr);
+		} else if (arg == "--coverage" && i + 1 < argc) {
+			coverage_path = argv[++i];
+		} else if (arg == "--listing" && i + 1 < argc) {
+			listing_specs.push_back(argv[++i]);
+		} else if (arg == "--lockstep" && i + 1 < argc && std::strtoull(argv[i + 1], nullptr, 10) > 0) {
+			lockstep_interval = std::strtoull(argv[++i], nullptr, 10);
+		} else if (arg == "--floppy" && i + 1 < argc) {
+			floppy_specs.push_back(argv[++i]);
+		} else if (arg == "--hard-disk" && i + 1 < argc) {
+			hard_disk_specs.push_back(argv[++i]);
+		} else if (arg == "--until-text" && i + 1 < argc) {
+			until_text = argv[++i];
+		} else if (arg == "--screen-text" && i + 1 < argc) {
+			screen_text_path = argv[++i];
+		} else if (arg == "--stats") {
+			show_stats = true;
+		} else if (arg == "--no-fusion") {
+			fusion = false;
+		} else if (arg == "--no-translation") {
+			translation = false;
+		} else if (arg == "--fpu" && i + 1 < argc && (std::string_view(argv[i + 1]) == "exact" || std::string_view(argv[i + 1]) == "fast" || std::string_view(argv[i + 1]) == "none")) {
+			fpu_mode = argv[++i];
+		} else {
+			std::println(stderr, "usage: xe86 [--record <journal> | --replay <journal>] [--video <out.ppm> [--font <8x8.bin>] [--scale <n>]] [--audio <out.wav>] [--faults [<category>=]<log|count|ignore>]... [--break \"<addr|seg:off> [if <cond>]\"]... [--watch \"<start>[-<end>] [r|w|rw] [if <cond>]\"]... [--profile <out.folded> [--symbols <file.map>]... [--profile-interval <cycles>]] [--run <program.com|exe> [--args \"<command tail>\"]] [--stats] [--no-fusion] [--no-translation] [--fpu <exact|fast|none>] [--com1 <pty|unix:path>] [--com2 <pty|unix:path>] [--serial-unpaced] [--speed <multiple|max>] [--coverage <out.info|out.txt> [--listing <file.lst>[@<hex base>]]...] [--lockstep <instructions>] [--floppy <image>[+<overlay>]]... [--hard-disk <image>[+<overlay>]]... [--until-text <text>] [--screen-text <out.txt>]");
+			return 1;
+		}
+	}
+
+	// lockstep needs both machines to see exactly the same inputs, which is none
+	if (lockstep_interval && (!record_path.empty() || !replay_path.empty() || !com1_spec.empty() || !com2_spec.empty() || !floppy_specs.empty() || !hard_disk_specs.empty())) {
+		std::println(stderr, "emulator: --lockstep can't be used with a journal, a serial bridge or a disk");
+		return 1;
+	}
+
+	// the journal doesn't hold what int 13h reads, and an overlay keeps what the last run wrote
+	if ((!record_path.empty() || !replay_path.empty()) && (!floppy_specs.empty() || !hard_disk_specs.empty())) {
+		std::println(stderr, "emulator: a journal can't be recorded or replayed with a disk");
+		return 1;
+	}
+
+	// nor a dos program's stdin, or which program was run
+	if ((!record_path.empty() || !replay_path.empty()) && !program_path.empty()) {
+		std::println(stderr, "emulator: a journal can't be recorded or replayed with --run");
+		return 1;
+	}
+
+	constexpr std::string_view rom_path = "roms/GLABIOS_0.4.1_8T.ROM";
+	auto bus = std::make_shared<xe86::Bus>(rom_path);
+	for (std::string_view spec : fault_specs) {
+		if (!bus->GetDiagnostics().ParseSeverity(spec)) {
+			std::println(stderr, "emulator: bad fault severity '{}'", spec);
+			return 1;
+		}
+	}
+
+	for (std::string_view spec : break_specs) {
+		if (!AddDebugSpec(bus->GetDebugger(), spec, false)) {
+			std::println(stderr, "emulator: bad breakpoint '{}'", spec);
+			return 1;
+		}
+	}
+
+	for (std::string_view spec : watch_specs) {
+		if (!AddDebugSpec(bus->GetDebugger(), spec, true)) {
+			std::println(stderr, "emulator: bad watchpoint '{}'", spec);
+			return 1;
+		}
+	}
+
+	std::shared_ptr<xe86::InputJournal> journal;
+
+	if (!record_path.empty()) {
+		journal = xe86::InputJournal::CreateRecording(record_path, bus->GetRomHash());
+	} else if (!replay_path.empty()) {
+		journal = xe86::InputJournal::OpenReplay(replay_path);
+		if (journal && journal->GetRomHash() != bus->GetRomHash()) {
+			std::println(stderr, "emulator: journal was recorded with a different rom");
+			return 1;
+		}
+	}
+
+	if ((!record_path.empty() || !replay_path.empty()) && !journal) {
+		return 1;
+	}
+
+	bus->SetJournal(journal);
+
+	// in a replay every port read and interrupt comes from the journal instead of the devices
+	xe86::PC emulator(bus);
+	xe86::ConnectPC(emulator);
+
+	for (auto [uart, spec] : { std::pair<xe86::UART*, std::string_view>{ &emulator.Get<xe86::COM1>(), com1_spec }, { &emulator.Get<xe86::COM2>(), com2_spec } }) {
+		uart->SetPaced(serial_paced);
+
+		// a replay's serial input comes from the journal
+		if (spec.empty() || !replay_path.empty()) {
+			continue;
+		}
+
+		auto bridge = xe86::SerialBridge::Open(spec);
+		if (!bridge) {
+			return 1;
+		}
+
+		std::println("emulator: {} is on {}", uart->GetHumanName(), bridge->GetName());
+		uart->AttachBridge(std::move(bridge));
+	}
+	emulator.Get<xe86::CPU>().SetFusion(fusion);
+	emulator.Get<xe86::CPU>().SetTranslation(translation);
+	emulator.Get<xe86::CPU>().SetFpu(fpu_mode != "none");
+	emulator.Get<xe86::CPU>().SetFastMath(fpu_mode == "fast");
+
+	if (!video_path.empty()) {
+		auto presenter = std::make_shared<xe86::VideoPresenter>(video_path, video_scale);
+		if (!font_path.empty()) {
+			presenter->LoadFont(font_path);
+		}
+
+		emulator.Get<xe86::CGA>().AttachPresenter(presenter);
+	}
+
+	if (!audio_path.empty()) {
+		emulator.Get<xe86::Speaker>().AttachSink(std::make_shared<xe86::AudioSink>(audio_path));
+	}
+
+	// samples every profile_interval cycles, written out as collapsed stacks at exit
+	std::unique_ptr<xe86::Profiler> profiler;
+	if (!profile_path.empty()) {
+		profiler = std::make_unique<xe86::Profiler>(bus, emulator.Get<xe86::CPU>(), profile_interval);
+		for (std::string_view path : symbol_paths) {
+			profiler->LoadSymbols(path);
+		}
+	}
+
+	std::signal(SIGINT, [](int) { g_Running = false; });
 
 	emulator.Reset();
-	while (true) {
+
+	// disk images behind int 13h, each read-only unless it has an overlay for its writes
+	std::unique_ptr<xe86::Disk> disk;
+	if (!floppy_specs.empty() || !hard_disk_specs.empty()) {
+		disk = std::make_unique<xe86::Disk>(bus, emulator.Get<xe86::CPU>());
+		for (auto [first, specs] : { std::pair<uint8_t, const std::vector<std::string_view>*>{ 0x00, &floppy_specs }, { 0x80, &hard_disk_specs } }) {
+			for (size_t n = 0; n < specs->size(); n++) {
+				std::string_view spec = (*specs)[n];
+				size_t plus = spec.rfind('+');
+				std::string_view base = plus == std::string_view::npos ? spec : spec.substr(0, plus);
+				std::string_view overlay = plus == std::string_view::npos ? std::string_view() : spec.substr(plus + 1);
+
+				if (!disk->Attach(static_cast<uint8_t>(first + n), xe86::DiskImage::Open(base, overlay))) {
+					return 1;
+				}
+			}
+		}
+	}
+
+	// straight into a dos program, skipping the bios entirely
+	std::unique_ptr<xe86::DOS> dos;
+	if (!program_path.empty()) {
+		dos = std::make_unique<xe86::DOS>(bus, emulator.Get<xe86::CPU>());
+		if (!dos->Load(program_path, program_arguments)) {
+			return 1;
+		}
+	}
+
+	// instructions executed in the rom and the program, written out at exit. a listing is based
+	// at the program's image unless it says otherwise
+	std::unique_ptr<xe86::Coverage> coverage;
+	if (!coverage_path.empty()) {
+		coverage = std::make_unique<xe86::Coverage>(emulator.Get<xe86::CPU>());
+		for (const auto& area : bus->GetMemoryAreas()) {
+			if (!area->IsWritable()) {
+				coverage->AddRegion("rom", area->GetStartAddress(), area->GetEndAddress());
+			}
+		}
+
+		if (dos && dos->GetImageSize()) {
+			coverage->AddRegion(program_path, dos->GetImageStart(), dos->GetImageStart() + dos->GetImageSize() - 1);
+		}
+
+		for (std::string_view spec : listing_specs) {
+			size_t at = spec.rfind('@');
+			uint32_t base = dos ? dos->GetImageStart() : 0;
+			if (at != std::string_view::npos && !ParseHex(spec.substr(at + 1), base)) {
+				std::println(stderr, "emulator: bad listing base in '{}'", spec);
+				return 1;
+			}
+
+			if (!coverage->LoadListing(spec.substr(0, at), base)) {
+				return 1;
+			}
+		}
+	}
+
+	// the same machine again with every fast path off, to check this one against
+	std::unique_ptr<xe86::PC> reference;
+	std::unique_ptr<xe86::DOS> reference_dos;
+	std::unique_ptr<xe86::Lockstep> lockstep;
+	if (lockstep_interval) {
+		auto reference_bus = std::make_shared<xe86::Bus>(rom_path);
+		reference_bus->GetDiagnostics().SetSeverity(xe86::Severity::Ignore);
+
+		reference = std::make_unique<xe86::PC>(reference_bus);
+		xe86::ConnectPC(*reference);
+
+		xe86::CPU& cpu = reference->Get<xe86::CPU>();
+		cpu.SetFusion(false);
+		cpu.SetTranslation(false);
+		cpu.SetFpu(fpu_mode != "none");
+		cpu.SetFastMath(false);
+		reference->Reset();
+
+		if (dos) {
+			reference_dos = std::make_unique<xe86::DOS>(reference_bus, cpu);
+			reference_dos->SetOutput([](uint16_t, std::span<const uint8_t>) {});
+			if (!reference_dos->Load(program_path, program_arguments)) {
+				return 1;
+			}
+
+			// bisecting replays the program, and what it writes then has been seen already
+			dos->SetOutput([&lockstep](uint16_t handle, std::span<const uint8_t> data) {
+				if (!lockstep || !lockstep->GetDivergence()) {
+					std::FILE* stream = handle == 2 ? stderr : stdout;
+					std::fwrite(data.data(), 1, data.size(), stream);
+					std::fflush(stream);
+				}
+			});
+		}
+
+		lockstep = std::make_unique<xe86::Lockstep>(emulator, *reference, lockstep_interval);
+		if (dos) {
+			dos->SetInput(lockstep->GetInput(emulator));
+			reference_dos->SetInput(lockstep->GetInput(*reference));
+		}
+	}
+
+	// emulates in slices of a host millisecond and waits out the rest of each one
+	std::unique_ptr<xe86::Pacer> pacer;
+	if (speed > 0) {
+		pacer = std::make_unique<xe86::Pacer>(speed);
+	}
+
+	// what's on a text mode screen, for stopping once a prompt shows up and for leaving behind
+	std::unique_ptr<xe86::TextScreen> screen;
+	if (!until_text.empty() || !screen_text_path.empty()) {
+		screen = std::make_unique<xe86::TextScreen>(emulator.Get<xe86::CGA>());
+	}
+
+	while (g_Running) {
 		emulator.Step();
+
+		if (pacer) {
+			pacer->Pace(bus->GetScheduler().GetNow());
+		}
+
+		if (lockstep && !lockstep->Check()) {
+			lockstep->PrintDivergence();
+			break;
+		}
+
+		if (dos && dos->HasExited()) {
+			break;
+		}
+
+		if (!until_text.empty() && screen->Update() && screen->Contains(until_text)) {
+			std::println("emulator: \"{}\" on the screen after {} instructions", until_text, bus->GetScheduler().GetInstructionCount());
+			break;
+		}
+
+		if (journal && journal->IsReplaying() && (journal->IsFinished(bus->GetScheduler().GetInstructionCount()) || journal->HasDiverged())) {
+			std::println("emulator: replay {} after {} instructions",
+				journal->HasDiverged() ? "diverged" : "finished",
+				bus->GetScheduler().GetInstructionCount()
+			);
+
+			break;
+		}
+
+		if (bus->GetDebugger().HasHit()) {
+			auto hit = bus->GetDebugger().TakeHit();
+			std::println("emulator: {} {} hit at {:04x}:{:04x}, address {:05x} value {:02x}, after {} instructions",
+				hit->access == xe86::Debugger::Execute ? "breakpoint" : hit->access == xe86::Debugger::Read ? "read watchpoint" : "write watchpoint",
+				hit->id, hit->cs, hit->ip, hit->address, hit->value,
+				bus->GetScheduler().GetInstructionCount()
+			);
+
+			break;
+		}
+
+		if (emulator.IsStalled()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	// whatever ran since the last check
+	if (lockstep && !lockstep->GetDivergence() && !lockstep->CheckNow()) {
+		lockstep->PrintDivergence();
+	}
+
+	if (journal && !journal->IsReplaying()) {
+		journal->RecordEnd(bus->GetScheduler().GetInstructionCount());
+	}
+
+	if (profiler) {
+		profiler->WriteCollapsed(profile_path);
+		std::println("emulator: {} profile samples, {} lost", profiler->GetSampleCount(), profiler->GetLostSamples());
+	}
+
+	if (!screen_text_path.empty()) {
+		screen->Update();
+
+		std::ofstream file{ std::string(screen_text_path), std::ios::binary };
+		file << screen->GetText();
+		if (!file) {
+			std::println(stderr, "emulator: failed to write the screen to '{}'", screen_text_path);
+		}
+	}
+
+	if (coverage) {
+		bool lcov = coverage_path.ends_with(".info");
+		if (lcov ? coverage->WriteLcov(coverage_path) : coverage->WriteText(coverage_path)) {
+			std::println("emulator: {} of {} listed code lines executed", coverage->GetExecutedLines(), coverage->GetCodeLines());
+		}
 	}
+
+	if (show_stats) {
+		const xe86::CPU& cpu = emulator.Get<xe86::CPU>();
+		std::println("emulator: {} instructions in {} cycles, {} of them translated ahead of time",
+			bus->GetScheduler().GetInstructionCount(), bus->GetScheduler().GetNow(), cpu.GetTranslatedInstructions()
+		);
+
+		for (size_t pair = 0; pair < static_cast<size_t>(xe86::CPU::Fusion::Count); pair++) {
+			for (uint8_t condition = 0; condition < 16; condition++) {
+				uint64_t count = cpu.GetFusionCount(static_cast<xe86::CPU::Fusion>(pair), condition);
+				if (count) {
+					std::println("emulator: fused {}+{} {} times",
+						xe86::CPU::GetFusionName(static_cast<xe86::CPU::Fusion>(pair)), xe86::CPU::GetConditionName(condition), count
+					);
+				}
+			}
+		}
+
+		const xe86::FPU& fpu = cpu.GetFpu();
+		if (fpu.GetFastCount() || fpu.GetSlowCount()) {
+			std::println("emulator: {} fpu operations on the host, {} in software", fpu.GetFastCount(), fpu.GetSlowCount());
+		}
+
+		if (lockstep) {
+			std::println("emulator: lockstep compared {} times", lockstep->GetCheckCount());
+		}
+
+		if (pacer) {
+			std::println("emulator: paced {} slices, {:.1f}% of the time asleep and {:.1f}% spinning, {}us late on average and {}us at worst, {} resyncs",
+				pacer->GetSlices(), pacer->GetSleepShare() * 100, pacer->GetSpinShare() * 100,
+				std::chrono::duration_cast<std::chrono::microseconds>(pacer->GetMeanLateness()).count(),
+				std::chrono::duration_cast<std::chrono::microseconds>(pacer->GetMaxLateness()).count(),
+				pacer->GetResyncs()
+			);
+		}
+	}
+
+	bus->GetDiagnostics().PrintSummary();
+
+	if (lockstep && lockstep->GetDivergence()) {
+		return 1;
+	}
+
+	return dos ? dos->GetExitCode() : 0;
 }
\ No newline at end of file
@@ -0,0 +1,72 @@
+#include "pacer.hpp"
+#include <thread>
+#include <algorithm>
+
+using namespace xe86;
+
+Pacer::Pacer(double speed, Clock::duration slice)
+	: m_CyclesPerSecond(CyclesPerSecond * speed),
+	  m_SliceCycles(std::max<Cycles>(1, static_cast<Cycles>(std::chrono::duration<double>(slice).count() * m_CyclesPerSecond))),
+	  m_MaxSpin(std::max<Clock::duration>(slice / 2, MinSpin)), m_Started(Clock::now()) {
+	m_OriginTime = m_Started;
+	m_SliceEnd = m_SliceCycles;
+}
+
+void Pacer::Rebase(Cycles now) {
+	m_Origin = now;
+	m_OriginTime = Clock::now();
+	m_SliceEnd = now + m_SliceCycles;
+}
+
+void Pacer::EndSlice(Cycles now) {
+	if (now < m_Origin) {
+		Rebase(now);
+		return;
+	}
+
+	Clock::time_point deadline = GetDeadline(now);
+	Clock::time_point current = Clock::now();
+
+	if (current > deadline + MaxLag) {
+		m_Resyncs++;
+		Rebase(now);
+		return;
+	}
+
+	if (current < deadline) {
+		Clock::time_point wake = deadline - m_SpinMargin;
+		if (current < wake) {
+			std::this_thread::sleep_until(wake);
+
+			Clock::time_point woke = Clock::now();
+			m_Slept += woke - current;
+			current = woke;
+
+			Clock::duration overshoot = std::max(Clock::duration::zero(), woke - wake);
+			m_Overshoot = (m_Overshoot * 7 + overshoot) / 8;
+			m_SpinMargin = std::clamp<Clock::duration>(m_Overshoot * 2, MinSpin, m_MaxSpin);
+		}
+
+		Clock::time_point spinning = current;
+		while ((current = Clock::now()) < deadline) {
+			std::this_thread::yield();
+		}
+
+		m_Spun += current - spinning;
+	}
+
+	Clock::duration lateness = current - deadline;
+	m_TotalLateness += lateness;
+	m_MaxLateness = std::max(m_MaxLateness, lateness);
+	m_Slices++;
+
+	m_SliceEnd = now + m_SliceCycles;
+}
+
+double Pacer::GetSleepShare() const {
+	return std::chrono::duration<double>(m_Slept) / std::chrono::duration<double>(Clock::now() - m_Started);
+}
+
+double Pacer::GetSpinShare() const {
+	return std::chrono::duration<double>(m_Spun) / std::chrono::duration<double>(Clock::now() - m_Started);
+}
\ No newline at end of file
@@ -0,0 +1,86 @@
+#ifndef PACER_HPP
+#define PACER_HPP
+
+#include "scheduler.hpp"
+
+#include <chrono>
+
+namespace xe86 {
+	/*
+	REAL-TIME PACER
+		holds the guest to a multiple of its own clock. the machine runs flat out for a slice of
+		guest time (a millisecond of host time at the target speed), then the pacer waits until
+		the host clock catches up with where the guest is: it sleeps for most of the wait and
+		spins, yielding, for the last stretch, because a sleep can wake late but not early. how
+		long it spins follows how late recent sleeps have woken, so a quiet host spins for little
+		more than the scheduler's slack and a noisy one never spins for more than half a slice.
+
+		an idle guest fast forwards through its idle time, so a machine paced to 1x only uses as
+		much of the host as its guest is busy. a guest that falls more than MaxLag behind (the
+		host is too slow, or was stopped) is resynchronized instead of raced to catch up, and guest
+		time going backwards (a rewind or a loaded state) starts over from there.
+	*/
+	class Pacer {
+	public:
+		using Clock = std::chrono::steady_clock;
+
+		static constexpr Clock::duration MaxLag = std::chrono::milliseconds(100);
+		static constexpr Clock::duration MinSpin = std::chrono::microseconds(50);
+
+		// speed is a multiple of the guest clock, more than 0
+		Pacer(double speed, Clock::duration slice = std::chrono::milliseconds(1));
+
+		Pacer(const Pacer&) = delete;
+		Pacer& operator=(const Pacer&) = delete;
+
+		// after every step, with the guest's time. does nothing until the slice is over
+		void Pace(Cycles now) {
+			if (now >= m_SliceEnd || now < m_Origin) [[unlikely]] {
+				EndSlice(now);
+			}
+		}
+
+		uint64_t GetSlices() const { return m_Slices; }
+		uint64_t GetResyncs() const { return m_Resyncs; }
+
+		// how far past its deadline each slice ended, on average and at worst. resyncs not included
+		Clock::duration GetMeanLateness() const { return m_Slices ? m_TotalLateness / static_cast<Clock::rep>(m_Slices) : Clock::duration::zero(); }
+		Clock::duration GetMaxLateness() const { return m_MaxLateness; }
+
+		// share of the host time since the pacer started spent asleep, and spinning
+		double GetSleepShare() const;
+		double GetSpinShare() const;
+
+	private:
+		void EndSlice(Cycles now);
+		void Rebase(Cycles now);
+
+		Clock::time_point GetDeadline(Cycles now) const {
+			return m_OriginTime + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>((now - m_Origin) / m_CyclesPerSecond));
+		}
+
+	private:
+		double m_CyclesPerSecond;
+		Cycles m_SliceCycles;
+
+		// guest time m_Origin is due at host time m_OriginTime, and everything after it in step
+		Cycles m_Origin = 0;
+		Clock::time_point m_OriginTime;
+		Cycles m_SliceEnd = 0;
+
+		// how much of a wait is spun rather than slept: twice the average overshoot, at most half a slice
+		Clock::duration m_Overshoot = std::chrono::microseconds(100);
+		Clock::duration m_SpinMargin = std::chrono::microseconds(200);
+		Clock::duration m_MaxSpin;
+
+		Clock::time_point m_Started;
+		uint64_t m_Slices = 0;
+		uint64_t m_Resyncs = 0;
+		Clock::duration m_TotalLateness{};
+		Clock::duration m_MaxLateness{};
+		Clock::duration m_Slept{};
+		Clock::duration m_Spun{};
+	};
+}
+
+#endif
\ No newline at end of file
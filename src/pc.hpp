@@ -0,0 +1,29 @@
+#ifndef PC_HPP
+#define PC_HPP
+
+#include "machine.hpp"
+#include "cpu.hpp"
+#include "pic.hpp"
+#include "dma.hpp"
+#include "pit.hpp"
+#include "speaker.hpp"
+#include "cga.hpp"
+#include "uart.hpp"
+
+namespace xe86 {
+	// the machine xe86 runs and libxe86 embeds: an xt with a cga card and two serial ports
+	using PC = Machine<CPU, PIC, DMA, PIT, Speaker, CGA, COM1, COM2>;
+
+	// what the motherboard connects between them. timer channel 0 is on irq 0, COM1 on irq 4
+	// and COM2 on irq 3, and timer channel 2 drives the speaker
+	inline void ConnectPC(PC& pc) {
+		pc.Get<Speaker>().ConnectTimer(pc.Get<PIT>());
+
+		PIC& pic = pc.Get<PIC>();
+		pc.Get<PIT>().SetOutputHandler(0, [&pic]() { pic.TriggerIRQ(0); });
+		pc.Get<COM1>().SetInterruptHandler([&pic](bool level) { pic.SetIRQ(4, level); });
+		pc.Get<COM2>().SetInterruptHandler([&pic](bool level) { pic.SetIRQ(3, level); });
+	}
+}
+
+#endif
\ No newline at end of file
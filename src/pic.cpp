@@ -0,0 +1,271 @@
+#include "pic.hpp"
+
+using namespace xe86;
+
+PIC::PIC(std::shared_ptr<Bus> bus) : Component(bus, "PIC") {
+	m_Bus->AttachPort({
+		[this](uint8_t byte) { WriteCommand(byte); },
+		[this]() -> uint8_t { return ReadCommand(); },
+		0x20
+	});
+
+	m_Bus->AttachPort({
+		[this](uint8_t byte) { WriteData(byte); },
+		[this]() -> uint8_t { return ReadData(); },
+		0x21
+	});
+
+	m_Bus->SetInterruptController([this]() { return Acknowledge(); });
+}
+
+void PIC::Reset() {
+	// the inputs are wired to other hardware and keep their levels
+	m_Requests = 0;
+	m_InService = 0;
+	m_Mask = 0;
+	m_VectorBase = 0;
+	m_LowestPriority = 7;
+	m_LevelTriggered = false;
+	m_AutoEoi = false;
+	m_RotateOnAutoEoi = false;
+	m_InitStep = 0;
+	m_NeedIcw3 = false;
+	m_NeedIcw4 = false;
+	m_ReadInService = false;
+	m_Poll = false;
+
+	Update();
+}
+
+void PIC::SetIRQ(uint8_t irq, bool level) {
+	uint8_t bit = 1 << irq;
+	if (((m_Lines & bit) != 0) == level) {
+		return;
+	}
+
+	// a request dropped before the cpu got to it never happened, in either trigger mode
+	m_Lines ^= bit;
+	if (level) {
+		m_Requests |= bit;
+	} else {
+		m_Requests &= ~bit;
+	}
+
+	Update();
+}
+
+void PIC::TriggerIRQ(uint8_t irq) {
+	m_Requests |= 1 << irq;
+	Update();
+}
+
+uint8_t PIC::ReadCommand() {
+	if (m_Poll) {
+		// the same as an acknowledge, with the level in the low bits and bit 7 saying there was one
+		m_Poll = false;
+
+		if (GetPending() < 0) {
+			return 0;
+		}
+
+		return 0x80 | (Acknowledge() & 0b111);
+	}
+
+	return m_ReadInService ? m_InService : m_Requests;
+}
+
+uint8_t PIC::ReadData() {
+	return m_Mask;
+}
+
+void PIC::WriteCommand(uint8_t byte) {
+	if (byte & 0x10) {
+		// ICW1 starts initialization over
+		m_NeedIcw4 = byte & 0x01;
+		m_NeedIcw3 = !(byte & 0x02);
+		m_LevelTriggered = byte & 0x08;
+
+		m_Requests = m_LevelTriggered ? m_Lines : 0;
+		m_InService = 0;
+		m_Mask = 0;
+		m_LowestPriority = 7;
+		m_AutoEoi = false;
+		m_RotateOnAutoEoi = false;
+		m_ReadInService = false;
+		m_Poll = false;
+		m_InitStep = 2;
+
+		Update();
+		return;
+	}
+
+	if (byte & 0x08) {
+		// OCW3
+		if (byte & 0x02) {
+			m_ReadInService = byte & 0x01;
+		}
+
+		m_Poll = byte & 0x04;
+		return;
+	}
+
+	// OCW2
+	uint8_t level = byte & 0b111;
+	switch (byte >> 5) {
+	case 0b001:
+	case 0b101: {
+		int irq = GetHighestInService();
+		if (irq >= 0) {
+			EndOfInterrupt(static_cast<uint8_t>(irq), byte & 0x80);
+		}
+
+		break;
+	}
+
+	case 0b011:
+	case 0b111:
+		EndOfInterrupt(level, byte & 0x80);
+		break;
+
+	case 0b000:
+	case 0b100:
+		m_RotateOnAutoEoi = byte & 0x80;
+		break;
+
+	case 0b110:
+		m_LowestPriority = level;
+		Update();
+		break;
+
+	default:
+		break;
+	}
+}
+
+void PIC::WriteData(uint8_t byte) {
+	switch (m_InitStep) {
+	case 2:
+		m_VectorBase = byte & 0xf8;
+		m_InitStep = m_NeedIcw3 ? 3 : m_NeedIcw4 ? 4 : 0;
+		break;
+
+	case 3:
+		// there's never a second controller to cascade to
+		m_InitStep = m_NeedIcw4 ? 4 : 0;
+		break;
+
+	case 4:
+		m_AutoEoi = byte & 0x02;
+		m_InitStep = 0;
+		break;
+
+	default:
+		// OCW1
+		m_Mask = byte;
+		Update();
+		break;
+	}
+}
+
+int PIC::GetPending() const {
+	uint8_t requests = m_Requests & ~m_Mask;
+
+	for (uint8_t i = 1; i <= 8; i++) {
+		uint8_t irq = (m_LowestPriority + i) & 7;
+		if (m_InService & (1 << irq)) {
+			return -1;
+		}
+
+		if (requests & (1 << irq)) {
+			return irq;
+		}
+	}
+
+	return -1;
+}
+
+int PIC::GetHighestInService() const {
+	for (uint8_t i = 1; i <= 8; i++) {
+		uint8_t irq = (m_LowestPriority + i) & 7;
+		if (m_InService & (1 << irq)) {
+			return irq;
+		}
+	}
+
+	return -1;
+}
+
+uint8_t PIC::Acknowledge() {
+	int pending = GetPending();
+
+	// the request went away between INTR and the acknowledge: the 8259A answers with irq 7
+	if (pending < 0) {
+		return m_VectorBase | 7;
+	}
+
+	uint8_t irq = static_cast<uint8_t>(pending);
+	uint8_t bit = 1 << irq;
+
+	// a level triggered request stays in IRR for as long as the input is high
+	if (!m_LevelTriggered) {
+		m_Requests &= ~bit;
+	}
+
+	if (!m_AutoEoi) {
+		m_InService |= bit;
+	} else if (m_RotateOnAutoEoi) {
+		m_LowestPriority = irq;
+	}
+
+	Update();
+	return m_VectorBase | irq;
+}
+
+void PIC::EndOfInterrupt(uint8_t irq, bool rotate) {
+	m_InService &= ~(1 << irq);
+	if (rotate) {
+		m_LowestPriority = irq;
+	}
+
+	Update();
+}
+
+void PIC::Update() {
+	m_Bus->SetINTR(GetPending() >= 0);
+}
+
+void PIC::SaveState(StateWriter& state) const {
+	state.Write(m_Lines);
+	state.Write(m_Requests);
+	state.Write(m_InService);
+	state.Write(m_Mask);
+	state.Write(m_VectorBase);
+	state.Write(m_LowestPriority);
+	state.Write(m_LevelTriggered);
+	state.Write(m_AutoEoi);
+	state.Write(m_RotateOnAutoEoi);
+	state.Write(m_InitStep);
+	state.Write(m_NeedIcw3);
+	state.Write(m_NeedIcw4);
+	state.Write(m_ReadInService);
+	state.Write(m_Poll);
+}
+
+void PIC::LoadState(StateReader& state) {
+	state.Read(m_Lines);
+	state.Read(m_Requests);
+	state.Read(m_InService);
+	state.Read(m_Mask);
+	state.Read(m_VectorBase);
+	state.Read(m_LowestPriority);
+	state.Read(m_LevelTriggered);
+	state.Read(m_AutoEoi);
+	state.Read(m_RotateOnAutoEoi);
+	state.Read(m_InitStep);
+	state.Read(m_NeedIcw3);
+	state.Read(m_NeedIcw4);
+	state.Read(m_ReadInService);
+	state.Read(m_Poll);
+
+	Update();
+}
\ No newline at end of file
@@ -0,0 +1,85 @@
+#ifndef PIC_HPP
+#define PIC_HPP
+
+#include "component.hpp"
+
+#include <array>
+
+namespace xe86 {
+	/*
+	INTEL 8259A PROGRAMMABLE INTERRUPT CONTROLLER
+		a single controller at 20h-21h, as on a pc or xt, drives the cpu's INTR line and hands it
+		a vector when the interrupt is acknowledged. initialization is ICW1-ICW4 (ICW3 only in
+		cascade mode, which is otherwise ignored), then OCW1 is the mask, OCW2 the end of
+		interrupt and priority commands and OCW3 selects IRR, ISR or poll for the next read of 20h.
+
+		devices either drive an input's level, and an edge triggered request they drop again
+		before it was acknowledged is withdrawn, or only ever report rising edges, which latch
+		until the cpu takes them. special mask mode is not supported.
+	*/
+	class PIC final : public Component {
+	public:
+		PIC(const PIC&) = delete;
+		PIC& operator=(const PIC&) = delete;
+
+		PIC(std::shared_ptr<Bus> bus);
+
+		void Reset() override;
+		void Step() override {}
+
+		// inputs only change from device events and port writes
+		bool IsIdle() const override { return true; }
+
+		void SaveState(StateWriter& state) const override;
+		void LoadState(StateReader& state) override;
+
+		// the level on an irq input
+		void SetIRQ(uint8_t irq, bool level);
+
+		// a rising edge on an irq input, for sources that don't report the falling one
+		void TriggerIRQ(uint8_t irq);
+
+		uint8_t GetMask() const { return m_Mask; }
+		uint8_t GetRequests() const { return m_Requests; }
+		uint8_t GetInService() const { return m_InService; }
+
+	private:
+		uint8_t ReadCommand();
+		uint8_t ReadData();
+		void WriteCommand(uint8_t byte);
+		void WriteData(uint8_t byte);
+
+		// the next irq to go in service, if any isn't blocked by the mask or by one of higher priority
+		int GetPending() const;
+
+		// the irq in service with the highest priority, or -1
+		int GetHighestInService() const;
+
+		uint8_t Acknowledge();
+		void EndOfInterrupt(uint8_t irq, bool rotate);
+		void Update();
+
+	private:
+		uint8_t m_Lines = 0;		// input levels
+		uint8_t m_Requests = 0;		// IRR
+		uint8_t m_InService = 0;	// ISR
+		uint8_t m_Mask = 0;			// IMR
+
+		uint8_t m_VectorBase = 0;		// ICW2, low three bits cleared
+		uint8_t m_LowestPriority = 7;	// irq (m_LowestPriority + 1) & 7 is the highest
+
+		bool m_LevelTriggered = false;
+		bool m_AutoEoi = false;
+		bool m_RotateOnAutoEoi = false;
+
+		// 0 once initialized, otherwise the ICW expected next on 21h
+		uint8_t m_InitStep = 0;
+		bool m_NeedIcw3 = false;
+		bool m_NeedIcw4 = false;
+
+		bool m_ReadInService = false;
+		bool m_Poll = false;
+	};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,371 @@
+#include "pit.hpp"
+#include <algorithm>
+
+using namespace xe86;
+
+PIT::PIT(std::shared_ptr<Bus> bus) : Component(bus, "PIT") {
+	// counters read back a value that moves with the clock, so polling them is never idle
+	for (uint8_t channel = 0; channel < 3; channel++) {
+		m_Bus->AttachPort({
+			[this, channel](uint8_t byte) { WriteCounter(channel, byte); },
+			[this, channel]() -> uint8_t { return ReadCounter(channel); },
+			static_cast<uint16_t>(0x40 + channel),
+			true
+		});
+	}
+
+	m_Bus->AttachPort({
+		[this](uint8_t byte) { WriteControl(byte); },
+		[]() -> uint8_t { return 0xff; },
+		0x43
+	});
+}
+
+void PIT::Reset() {
+	for (uint8_t channel = 0; channel < 3; channel++) {
+		Channel& c = m_Channels[channel];
+		Changing(channel);
+
+		if (c.edge_scheduled) {
+			m_Bus->GetScheduler().Cancel(c.edge_event);
+		}
+
+		// gates are inputs wired to other hardware, and the handlers belong to whoever set them
+		c = Channel{
+			.gate = c.gate,
+			.on_output = std::move(c.on_output),
+			.on_change = std::move(c.on_change)
+		};
+	}
+}
+
+void PIT::WriteControl(uint8_t byte) {
+	uint8_t channel = byte >> 6;
+
+	// 11 is the 8254's read-back command
+	if (channel == 3) {
+		return;
+	}
+
+	Channel& c = m_Channels[channel];
+	uint8_t access = (byte >> 4) & 0b11;
+
+	if (access == 0) {
+		// counter latch: freeze the current count until it has been read
+		if (!c.latched) {
+			c.latch = GetCount(channel);
+			c.latched = true;
+			c.read_high = false;
+		}
+
+		return;
+	}
+
+	Changing(channel);
+
+	uint8_t mode = (byte >> 1) & 0b111;
+	c.mode = mode > 5 ? mode - 4 : mode;
+	c.access = access;
+	c.loaded = false;
+	c.write_high = false;
+	c.read_high = false;
+	c.latched = false;
+
+	ScheduleEdge(channel);
+}
+
+void PIT::WriteCounter(uint8_t channel, uint8_t byte) {
+	Channel& c = m_Channels[channel];
+
+	switch (c.access) {
+	case 0b01:
+		Load(channel, byte);
+		break;
+
+	case 0b10:
+		Load(channel, byte << 8);
+		break;
+
+	default:
+		if (!c.write_high) {
+			c.write_low = byte;
+			c.write_high = true;
+		} else {
+			c.write_high = false;
+			Load(channel, c.write_low | (byte << 8));
+		}
+
+		break;
+	}
+}
+
+uint8_t PIT::ReadCounter(uint8_t channel) {
+	Channel& c = m_Channels[channel];
+	uint16_t count = c.latched ? c.latch : GetCount(channel);
+
+	uint8_t byte;
+	switch (c.access) {
+	case 0b01:
+		byte = count & 0xff;
+		c.latched = false;
+		break;
+
+	case 0b10:
+		byte = count >> 8;
+		c.latched = false;
+		break;
+
+	default:
+		byte = c.read_high ? count >> 8 : count & 0xff;
+		if (c.read_high) {
+			c.latched = false;
+		}
+
+		c.read_high = !c.read_high;
+		break;
+	}
+
+	return byte;
+}
+
+void PIT::Load(uint8_t channel, uint16_t value) {
+	Changing(channel);
+
+	Channel& c = m_Channels[channel];
+	c.reload = value;
+	c.loaded = true;
+	c.start = m_Bus->GetScheduler().GetNow();
+
+	ScheduleEdge(channel);
+}
+
+void PIT::SetGate(uint8_t channel, bool gate) {
+	Channel& c = m_Channels[channel];
+	if (c.gate == gate) {
+		return;
+	}
+
+	Changing(channel);
+
+	// a rising gate (re)starts the count in every mode the gate triggers
+	if (gate && c.mode != 0 && c.mode != 4) {
+		c.start = m_Bus->GetScheduler().GetNow();
+	}
+
+	c.gate = gate;
+	ScheduleEdge(channel);
+}
+
+void PIT::Changing(uint8_t channel) {
+	if (m_Channels[channel].on_change) {
+		m_Channels[channel].on_change();
+	}
+}
+
+bool PIT::IsRunning(const Channel& c) const {
+	return c.loaded && (c.gate || c.mode == 0 || c.mode == 4);
+}
+
+uint64_t PIT::GetTicks(const Channel& c, Cycles time) const {
+	return time > c.start ? (time - c.start) / TickCycles : 0;
+}
+
+bool PIT::OutputAt(const Channel& c, uint64_t tick) {
+	uint64_t period = GetPeriod(c);
+
+	switch (c.mode) {
+	case 0:
+	case 1:
+		return tick >= period;
+
+	case 2:
+		return tick % period != period - 1;
+
+	case 3:
+		return tick % period < (period + 1) / 2;
+
+	default:
+		return tick != period;
+	}
+}
+
+uint64_t PIT::HighTicksBefore(const Channel& c, uint64_t tick) {
+	uint64_t period = GetPeriod(c);
+
+	switch (c.mode) {
+	case 0:
+	case 1:
+		return tick > period ? tick - period : 0;
+
+	case 2:
+		return tick / period * (period - 1) + std::min(tick % period, period - 1);
+
+	case 3: {
+		uint64_t high = (period + 1) / 2;
+		return tick / period * high + std::min(tick % period, high);
+	}
+
+	default:
+		return tick > period ? tick - 1 : tick;
+	}
+}
+
+bool PIT::GetOutput(uint8_t channel) {
+	const Channel& c = m_Channels[channel];
+	if (!IsRunning(c)) {
+		// mode 0 drops its output as soon as it is programmed, the rest idle high
+		return c.mode != 0;
+	}
+
+	return OutputAt(c, GetTicks(c, m_Bus->GetScheduler().GetNow()));
+}
+
+Cycles PIT::GetHighCycles(uint8_t channel, Cycles from, Cycles to) {
+	const Channel& c = m_Channels[channel];
+	if (to <= from) {
+		return 0;
+	}
+
+	if (!IsRunning(c)) {
+		return c.mode != 0 ? to - from : 0;
+	}
+
+	// before the count started the output sat at its idle level
+	Cycles before = 0;
+	if (from < c.start) {
+		Cycles end = std::min(to, c.start);
+		before = c.mode != 0 ? end - from : 0;
+		from = end;
+	}
+
+	// whole ticks from the pattern, plus the part of the tick each end falls in
+	auto high_until = [&c](Cycles time) {
+		Cycles elapsed = time - c.start;
+		uint64_t tick = elapsed / TickCycles;
+		Cycles high = HighTicksBefore(c, tick) * TickCycles;
+		return OutputAt(c, tick) ? high + elapsed % TickCycles : high;
+	};
+
+	return before + high_until(to) - high_until(from);
+}
+
+uint16_t PIT::GetCount(uint8_t channel) {
+	const Channel& c = m_Channels[channel];
+	if (!IsRunning(c)) {
+		return c.reload;
+	}
+
+	uint64_t period = GetPeriod(c);
+	uint64_t tick = GetTicks(c, m_Bus->GetScheduler().GetNow());
+
+	switch (c.mode) {
+	case 2:
+		return static_cast<uint16_t>(period - tick % period);
+
+	case 3:
+		// counts down by two, twice per period
+		return static_cast<uint16_t>(period - (tick * 2) % period) & 0xfffe;
+
+	default:
+		return static_cast<uint16_t>(period - tick);
+	}
+}
+
+void PIT::SetOutputHandler(uint8_t channel, std::function<void()> handler) {
+	m_Channels[channel].on_output = std::move(handler);
+	ScheduleEdge(channel);
+}
+
+void PIT::ScheduleEdge(uint8_t channel) {
+	Channel& c = m_Channels[channel];
+	Scheduler& scheduler = m_Bus->GetScheduler();
+
+	if (c.edge_scheduled) {
+		scheduler.Cancel(c.edge_event);
+		c.edge_scheduled = false;
+	}
+
+	if (!c.on_output || !IsRunning(c)) {
+		return;
+	}
+
+	uint64_t period = GetPeriod(c);
+	uint64_t tick = GetTicks(c, scheduler.GetNow());
+	uint64_t edge;
+
+	switch (c.mode) {
+	case 0:
+	case 1:
+		edge = period;
+		break;
+
+	case 2:
+	case 3:
+		edge = (tick / period + 1) * period;
+		break;
+
+	default:
+		edge = period + 1;
+		break;
+	}
+
+	// one-shot modes only rise once per count
+	if (c.start + edge * TickCycles <= scheduler.GetNow()) {
+		return;
+	}
+
+	c.edge_event = scheduler.Schedule(c.start + edge * TickCycles, [this, channel]() { Edge(channel); });
+	c.edge_scheduled = true;
+}
+
+void PIT::Edge(uint8_t channel) {
+	Channel& c = m_Channels[channel];
+	c.edge_scheduled = false;
+
+	if (c.on_output) {
+		c.on_output();
+	}
+
+	// only the periodic modes rise again
+	if (c.mode == 2 || c.mode == 3) {
+		ScheduleEdge(channel);
+	}
+}
+
+void PIT::SaveState(StateWriter& state) const {
+	for (const Channel& c : m_Channels) {
+		state.Write(c.mode);
+		state.Write(c.access);
+		state.Write(c.reload);
+		state.Write(c.loaded);
+		state.Write(c.start);
+		state.Write(c.gate);
+		state.Write(c.write_high);
+		state.Write(c.write_low);
+		state.Write(c.read_high);
+		state.Write(c.latched);
+		state.Write(c.latch);
+	}
+}
+
+void PIT::LoadState(StateReader& state) {
+	for (uint8_t channel = 0; channel < 3; channel++) {
+		Channel& c = m_Channels[channel];
+		Changing(channel);
+
+		state.Read(c.mode);
+		state.Read(c.access);
+		state.Read(c.reload);
+		state.Read(c.loaded);
+		state.Read(c.start);
+		state.Read(c.gate);
+		state.Read(c.write_high);
+		state.Read(c.write_low);
+		state.Read(c.read_high);
+		state.Read(c.latched);
+		state.Read(c.latch);
+
+		// the pending edge belonged to the timeline we left
+		ScheduleEdge(channel);
+	}
+}
\ No newline at end of file
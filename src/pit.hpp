@@ -0,0 +1,97 @@
+#ifndef PIT_HPP
+#define PIT_HPP
+
+#include "component.hpp"
+
+#include <array>
+#include <functional>
+
+namespace xe86 {
+	/*
+	INTEL 8253 PROGRAMMABLE INTERVAL TIMER
+		three 16-bit counters at 40h-42h, control word at 43h, clocked at 1.193182 MHz (a quarter
+		of the cpu clock). nothing is counted per instruction: a counter remembers when it was
+		loaded and its value and output are worked out from the clock whenever someone asks.
+		channel 0 drives IRQ 0 and channel 2 the speaker on a pc.
+
+		modes 0-5 are supported, counting is always binary, and the gate only affects the modes
+		it triggers (1, 2, 3, 5), where holding it low stops the count with the output high.
+	*/
+	class PIT final : public Component {
+	public:
+		static constexpr Cycles TickCycles = 4;
+
+		PIT(const PIT&) = delete;
+		PIT& operator=(const PIT&) = delete;
+
+		PIT(std::shared_ptr<Bus> bus);
+
+		void Reset() override;
+		void Step() override {}
+
+		// everything happens on port access or at scheduled output edges
+		bool IsIdle() const override { return true; }
+
+		void SaveState(StateWriter& state) const override;
+		void LoadState(StateReader& state) override;
+
+		void SetGate(uint8_t channel, bool gate);
+
+		bool GetOutput(uint8_t channel);
+
+		// how many cycles of [from, to) the output is high for, as currently programmed
+		Cycles GetHighCycles(uint8_t channel, Cycles from, Cycles to);
+
+		// called at every rising edge of the output, which is what the pic's irq input sees
+		void SetOutputHandler(uint8_t channel, std::function<void()> handler);
+
+		// called just before the channel is reprogrammed or gated, while its old settings still hold
+		void SetChangeHandler(uint8_t channel, std::function<void()> handler) {
+			m_Channels[channel].on_change = std::move(handler);
+		}
+
+	private:
+		struct Channel {
+			uint8_t mode = 0;
+			uint8_t access = 0b11;	// 01 low byte, 10 high byte, 11 low then high
+			uint16_t reload = 0;
+			bool loaded = false;	// a count has been written since the mode was set
+			Cycles start = 0;		// when counting from reload began
+			bool gate = true;
+
+			bool write_high = false;
+			uint8_t write_low = 0;
+			bool read_high = false;
+			bool latched = false;
+			uint16_t latch = 0;
+
+			Scheduler::EventId edge_event = 0;
+			bool edge_scheduled = false;
+
+			std::function<void()> on_output;
+			std::function<void()> on_change;
+		};
+
+		void WriteControl(uint8_t byte);
+		void WriteCounter(uint8_t channel, uint8_t byte);
+		uint8_t ReadCounter(uint8_t channel);
+
+		void Load(uint8_t channel, uint16_t value);
+		void Changing(uint8_t channel);
+
+		uint16_t GetCount(uint8_t channel);
+		bool IsRunning(const Channel& c) const;
+		uint64_t GetTicks(const Channel& c, Cycles time) const;
+		static uint64_t GetPeriod(const Channel& c) { return c.reload ? c.reload : 0x10000; }
+		static bool OutputAt(const Channel& c, uint64_t tick);
+		static uint64_t HighTicksBefore(const Channel& c, uint64_t tick);
+
+		void ScheduleEdge(uint8_t channel);
+		void Edge(uint8_t channel);
+
+	private:
+		std::array<Channel, 3> m_Channels;
+	};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,178 @@
+#include "profiler.hpp"
+#include "hash.hpp"
+#include <print>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+using namespace xe86;
+
+Profiler::Profiler(std::shared_ptr<Bus> bus, const CPU& cpu, Cycles interval)
+	: m_Bus(bus), m_Cpu(cpu), m_Interval(interval ? interval : 1), m_Slots(std::make_unique<Slot[]>(Capacity)) {
+	m_Event = m_Bus->GetScheduler().ScheduleIn(m_Interval, [this]() { Sample(); });
+}
+
+Profiler::~Profiler() {
+	m_Bus->GetScheduler().Cancel(m_Event);
+}
+
+void Profiler::Sample() {
+	std::array<uint32_t, MaxFrames> frames;
+	auto stack = m_Cpu.GetCallStack();
+
+	// the innermost calls matter most when the stack is too deep to keep whole
+	size_t depth = std::min(stack.size(), MaxFrames - 1);
+	size_t skip = stack.size() - depth;
+	for (size_t i = 0; i < depth; i++) {
+		frames[i] = stack[skip + i].target;
+	}
+
+	frames[depth] = m_Cpu.GetLinearIP();
+	Count(std::span<const uint32_t>(frames.data(), depth + 1));
+
+	m_Event = m_Bus->GetScheduler().ScheduleIn(m_Interval, [this]() { Sample(); });
+}
+
+void Profiler::Count(std::span<const uint32_t> frames) {
+	m_Samples.fetch_add(1, std::memory_order_relaxed);
+
+	uint64_t key = Fnv1a64(reinterpret_cast<const uint8_t*>(frames.data()), frames.size_bytes());
+	if (key == Empty || key == Busy) {
+		key = 1;
+	}
+
+	for (size_t probe = 0; probe < Capacity; probe++) {
+		Slot& slot = m_Slots[(key + probe) & (Capacity - 1)];
+		uint64_t current = slot.key.load(std::memory_order_acquire);
+
+		if (current == key) {
+			slot.count.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		if (current == Empty && slot.key.compare_exchange_strong(current, Busy, std::memory_order_acq_rel)) {
+			slot.depth = static_cast<uint8_t>(frames.size());
+			std::copy(frames.begin(), frames.end(), slot.frames.begin());
+			slot.count.store(1, std::memory_order_relaxed);
+			slot.key.store(key, std::memory_order_release);
+			return;
+		}
+	}
+
+	m_Lost.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool Profiler::LoadSymbols(std::string_view filename, uint32_t base) {
+	std::ifstream file{ std::string(filename) };
+	if (!file) {
+		std::println(stderr, "profiler: failed to open '{}'", filename);
+		return false;
+	}
+
+	auto is_hex = [](std::string_view text) {
+		return !text.empty() && text.find_first_not_of("0123456789abcdefABCDEF") == std::string_view::npos;
+	};
+
+	size_t loaded = 0;
+	std::string line;
+	while (std::getline(file, line)) {
+		std::istringstream words(line);
+		std::string where, name;
+		if (!(words >> where >> name)) {
+			continue;
+		}
+
+		// MASM and LINK mark absolute symbols, the name follows
+		if (name == "Abs" && !(words >> name)) {
+			continue;
+		}
+
+		uint32_t address;
+		size_t colon = where.find(':');
+		if (colon != std::string::npos) {
+			std::string_view segment = std::string_view(where).substr(0, colon);
+			std::string_view offset = std::string_view(where).substr(colon + 1);
+			if (!is_hex(segment) || !is_hex(offset) || segment.size() > 4 || offset.size() > 4) {
+				continue;
+			}
+
+			address = (std::stoul(std::string(segment), nullptr, 16) << 4) + std::stoul(std::string(offset), nullptr, 16);
+		} else {
+			if (!is_hex(where) || where.size() > 8) {
+				continue;
+			}
+
+			address = std::stoul(where, nullptr, 16);
+		}
+
+		m_Symbols.push_back({ (address + base) & 0xfffff, name });
+		loaded++;
+	}
+
+	// maps list publics both by name and by value
+	std::sort(m_Symbols.begin(), m_Symbols.end(), [](const Symbol& a, const Symbol& b) {
+		return a.address != b.address ? a.address < b.address : a.name < b.name;
+	});
+
+	m_Symbols.erase(std::unique(m_Symbols.begin(), m_Symbols.end(), [](const Symbol& a, const Symbol& b) {
+		return a.address == b.address;
+	}), m_Symbols.end());
+
+	if (loaded == 0) {
+		std::println(stderr, "profiler: no symbols in '{}'", filename);
+		return false;
+	}
+
+	return true;
+}
+
+std::string Profiler::Describe(uint32_t address, bool exact) const {
+	auto it = std::upper_bound(m_Symbols.begin(), m_Symbols.end(), address, [](uint32_t a, const Symbol& s) {
+		return a < s.address;
+	});
+
+	if (it == m_Symbols.begin()) {
+		std::string hex(5, '0');
+		for (int i = 4; i >= 0; i--, address >>= 4) {
+			hex[i] = "0123456789abcdef"[address & 0xf];
+		}
+
+		return hex;
+	}
+
+	// a call target gets its offset into the symbol, a sampled address is counted against the symbol
+	const Symbol& symbol = *std::prev(it);
+	if (!exact || symbol.address == address) {
+		return symbol.name;
+	}
+
+	std::ostringstream named;
+	named << symbol.name << "+0x" << std::hex << (address - symbol.address);
+	return named.str();
+}
+
+bool Profiler::WriteCollapsed(std::string_view filename) const {
+	std::ofstream file{ std::string(filename), std::ios::trunc };
+	if (!file) {
+		std::println(stderr, "profiler: failed to create '{}'", filename);
+		return false;
+	}
+
+	for (size_t i = 0; i < Capacity; i++) {
+		const Slot& slot = m_Slots[i];
+		uint64_t key = slot.key.load(std::memory_order_acquire);
+		if (key == Empty || key == Busy) {
+			continue;
+		}
+
+		// identical lines after naming are fine, flamegraph.pl adds them up
+		for (size_t frame = 0; frame < slot.depth; frame++) {
+			bool leaf = frame + 1 == slot.depth;
+			file << (frame ? ";" : "") << Describe(slot.frames[frame], !leaf);
+		}
+
+		file << ' ' << slot.count.load(std::memory_order_relaxed) << '\n';
+	}
+
+	return true;
+}
\ No newline at end of file
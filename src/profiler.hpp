@@ -0,0 +1,83 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include "bus.hpp"
+#include "cpu.hpp"
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace xe86 {
+	/*
+	SAMPLING PROFILER
+		every N guest cycles a scheduled event takes CS:IP and the cpu's call stack. nothing is
+		traced per instruction, and idle time is sampled wherever the cpu idles.
+
+		samples are counted in a fixed-size open-addressing hash map keyed by a hash of the stack.
+		slots are claimed with a compare and swap and counts are atomic adds, so the map can be
+		written out from another thread while the machine runs. stacks are kept as raw linear
+		addresses and only named when written out, as collapsed stacks for flamegraph.pl:
+			outermost;...;innermost count
+		symbols come from linker .MAP files ("SSSS:OOOO name" publics) or plain "address name" lists.
+	*/
+	class Profiler {
+	public:
+		Profiler(std::shared_ptr<Bus> bus, const CPU& cpu, Cycles interval);
+		~Profiler();
+
+		Profiler(const Profiler&) = delete;
+		Profiler& operator=(const Profiler&) = delete;
+
+		// base is added to every address, for images linked at a different address than they run at
+		bool LoadSymbols(std::string_view filename, uint32_t base = 0);
+
+		bool WriteCollapsed(std::string_view filename) const;
+
+		uint64_t GetSampleCount() const { return m_Samples.load(std::memory_order_relaxed); }
+		uint64_t GetLostSamples() const { return m_Lost.load(std::memory_order_relaxed); }
+
+	private:
+		static constexpr size_t Capacity = 1 << 14;
+		static constexpr size_t MaxFrames = 32;
+
+		// slot keys. a slot is Busy while its stack is being written, before its key is published
+		static constexpr uint64_t Empty = 0;
+		static constexpr uint64_t Busy = ~0ull;
+
+		struct Slot {
+			std::atomic<uint64_t> key = Empty;
+			std::atomic<uint64_t> count = 0;
+			uint8_t depth = 0;
+			std::array<uint32_t, MaxFrames> frames{};	// call targets outermost first, then the sampled address
+		};
+
+		void Sample();
+		void Count(std::span<const uint32_t> frames);
+		std::string Describe(uint32_t address, bool exact) const;
+
+	private:
+		std::shared_ptr<Bus> m_Bus;
+		const CPU& m_Cpu;
+		Cycles m_Interval;
+
+		Scheduler::EventId m_Event = 0;
+
+		std::unique_ptr<Slot[]> m_Slots;
+		std::atomic<uint64_t> m_Samples = 0;
+		std::atomic<uint64_t> m_Lost = 0;
+
+		struct Symbol {
+			uint32_t address;
+			std::string name;
+		};
+
+		// sorted by address
+		std::vector<Symbol> m_Symbols;
+	};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,257 @@
+#include "rewind.hpp"
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace xe86;
+
+RewindBuffer::RewindBuffer(uint64_t interval, size_t budget) : m_Interval(interval), m_Budget(budget) {
+	m_Compressor = std::thread([this]() { CompressorThread(); });
+}
+
+RewindBuffer::~RewindBuffer() {
+	{
+		std::lock_guard lock(m_Mutex);
+		m_Quit = true;
+	}
+
+	m_Wake.notify_all();
+	m_Compressor.join();
+}
+
+void RewindBuffer::Capture(uint64_t instruction, std::vector<uint8_t> machine, Bus& bus) {
+	Snapshot snapshot{ instruction, std::move(machine), {} };
+
+	auto& areas = bus.GetMemoryAreas();
+	m_LastVersions.resize(areas.size());
+
+	for (size_t a = 0; a < areas.size(); a++) {
+		auto& area = areas[a];
+		if (!area->IsWritable()) {
+			continue;
+		}
+
+		auto& versions = area->GetPageVersions();
+		auto& last = m_LastVersions[a];
+
+		// nothing to compare against yet, so this one has to be a complete image
+		bool full = last.size() != versions.size();
+
+		for (size_t p = 0; p < versions.size(); p++) {
+			if (full || versions[p] != last[p]) {
+				std::span<const uint8_t> data = area->GetPage(p);
+				snapshot.pages.push_back(std::make_shared<Page>(Page{ a, p, std::vector<uint8_t>(data.begin(), data.end()) }));
+			}
+		}
+
+		last = versions;
+	}
+
+	{
+		std::lock_guard lock(m_Mutex);
+		m_Bytes += SnapshotBytes(snapshot);
+		m_Pending.insert(m_Pending.end(), snapshot.pages.begin(), snapshot.pages.end());
+		m_Snapshots.push_back(std::move(snapshot));
+		EnforceBudget();
+	}
+
+	m_Wake.notify_one();
+	m_NextCapture = instruction + m_Interval;
+}
+
+std::optional<RewindBuffer::Restored> RewindBuffer::Restore(uint64_t instruction, Bus& bus) {
+	std::lock_guard lock(m_Mutex);
+
+	size_t target = m_Snapshots.size();
+	while (target > 0 && m_Snapshots[target - 1].instruction > instruction) {
+		target--;
+	}
+
+	if (target == 0) {
+		return std::nullopt;
+	}
+
+	target--;
+
+	// the newest copy of each page at or before the target. the oldest snapshot is complete,
+	// so every page is found somewhere.
+	std::unordered_map<uint64_t, Page*> newest;
+	for (size_t i = 0; i <= target; i++) {
+		for (auto& page : m_Snapshots[i].pages) {
+			newest[(static_cast<uint64_t>(page->area) << 32) | page->index] = page.get();
+		}
+	}
+
+	auto& areas = bus.GetMemoryAreas();
+	std::vector<uint8_t> buffer(MemoryArea::PageSize);
+
+	for (auto& [key, page] : newest) {
+		auto& area = areas[page->area];
+		if (page->compressed) {
+			Decompress(page->data, buffer);
+			area->WritePage(page->index, buffer);
+		} else {
+			area->WritePage(page->index, page->data);
+		}
+	}
+
+	Restored restored{ m_Snapshots[target].instruction, m_Snapshots[target].machine };
+
+	// the future we came from no longer happens
+	while (m_Snapshots.size() > target + 1) {
+		m_Bytes -= SnapshotBytes(m_Snapshots.back());
+		m_Snapshots.pop_back();
+	}
+
+	// memory now matches the newest snapshot, so the next one only needs what changes from here
+	for (size_t a = 0; a < areas.size(); a++) {
+		if (areas[a]->IsWritable()) {
+			m_LastVersions[a] = areas[a]->GetPageVersions();
+		}
+	}
+
+	m_NextCapture = restored.instruction + m_Interval;
+	return restored;
+}
+
+void RewindBuffer::EnforceBudget() {
+	while (m_Bytes > m_Budget && m_Snapshots.size() > 1) {
+		Snapshot& oldest = m_Snapshots[0];
+		Snapshot& next = m_Snapshots[1];
+
+		std::unordered_set<uint64_t> present;
+		for (auto& page : next.pages) {
+			present.insert((static_cast<uint64_t>(page->area) << 32) | page->index);
+		}
+
+		// pages the next snapshot didn't change still have to come from somewhere
+		m_Bytes -= oldest.machine.size();
+		for (auto& page : oldest.pages) {
+			if (present.contains((static_cast<uint64_t>(page->area) << 32) | page->index)) {
+				m_Bytes -= page->data.size();
+			} else {
+				next.pages.push_back(std::move(page));
+			}
+		}
+
+		m_Snapshots.pop_front();
+	}
+}
+
+size_t RewindBuffer::SnapshotBytes(const Snapshot& snapshot) const {
+	size_t bytes = snapshot.machine.size();
+	for (auto& page : snapshot.pages) {
+		bytes += page->data.size();
+	}
+
+	return bytes;
+}
+
+size_t RewindBuffer::GetMemoryUsage() const {
+	std::lock_guard lock(m_Mutex);
+	return m_Bytes;
+}
+
+size_t RewindBuffer::GetSnapshotCount() const {
+	std::lock_guard lock(m_Mutex);
+	return m_Snapshots.size();
+}
+
+uint64_t RewindBuffer::GetOldestInstruction() const {
+	std::lock_guard lock(m_Mutex);
+	return m_Snapshots.empty() ? 0 : m_Snapshots.front().instruction;
+}
+
+void RewindBuffer::CompressorThread() {
+	while (true) {
+		std::shared_ptr<Page> page;
+
+		{
+			std::unique_lock lock(m_Mutex);
+			m_Wake.wait(lock, [this]() { return m_Quit || !m_Pending.empty(); });
+
+			if (m_Quit) {
+				return;
+			}
+
+			page = std::move(m_Pending.front());
+			m_Pending.pop_front();
+		}
+
+		// raw page data is only ever read until it is swapped out below, so this can run unlocked
+		std::vector<uint8_t> packed = Compress(page->data);
+		if (packed.size() >= page->data.size()) {
+			continue;
+		}
+
+		std::lock_guard lock(m_Mutex);
+
+		// only counted while a snapshot still holds it
+		if (page.use_count() > 1) {
+			m_Bytes -= page->data.size();
+			m_Bytes += packed.size();
+		}
+
+		page->data = std::move(packed);
+		page->compressed = true;
+	}
+}
+
+/*
+	run-length encoding, packbits style. a control byte with the top bit set repeats the next
+	byte (c & 0x7f) + 1 times, otherwise c + 1 literal bytes follow. ram is mostly zeroes and
+	fills, which this handles well enough without pulling in a compression library.
+*/
+std::vector<uint8_t> RewindBuffer::Compress(std::span<const uint8_t> data) {
+	std::vector<uint8_t> out;
+	size_t i = 0;
+
+	while (i < data.size()) {
+		size_t run = 1;
+		while (i + run < data.size() && run < 128 && data[i + run] == data[i]) {
+			run++;
+		}
+
+		if (run >= 3) {
+			out.push_back(static_cast<uint8_t>(0x80 | (run - 1)));
+			out.push_back(data[i]);
+			i += run;
+			continue;
+		}
+
+		// gather literals up to the next run worth encoding
+		size_t start = i;
+		while (i < data.size() && i - start < 128) {
+			if (i + 2 < data.size() && data[i] == data[i + 1] && data[i] == data[i + 2]) {
+				break;
+			}
+
+			i++;
+		}
+
+		out.push_back(static_cast<uint8_t>(i - start - 1));
+		out.insert(out.end(), data.begin() + start, data.begin() + i);
+	}
+
+	return out;
+}
+
+void RewindBuffer::Decompress(std::span<const uint8_t> data, std::span<uint8_t> out) {
+	size_t i = 0;
+	size_t o = 0;
+
+	while (i < data.size() && o < out.size()) {
+		uint8_t control = data[i++];
+
+		if (control & 0x80) {
+			size_t run = std::min<size_t>((control & 0x7f) + 1, out.size() - o);
+			uint8_t byte = i < data.size() ? data[i++] : 0;
+			std::fill_n(out.begin() + o, run, byte);
+			o += run;
+		} else {
+			size_t literal = std::min<size_t>({ static_cast<size_t>(control) + 1, out.size() - o, data.size() - i });
+			std::copy_n(data.begin() + i, literal, out.begin() + o);
+			i += literal;
+			o += literal;
+		}
+	}
+}
\ No newline at end of file
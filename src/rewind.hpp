@@ -0,0 +1,87 @@
+#ifndef REWIND_HPP
+#define REWIND_HPP
+
+#include "bus.hpp"
+
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <optional>
+
+namespace xe86 {
+	/*
+	REWIND BUFFER
+		a bounded history of machine states, one every N instructions. each snapshot keeps the
+		machine state blob (registers, devices, clock) and only the ram pages written since the
+		snapshot before it, so the oldest snapshot in the ring is always a complete image.
+
+		pages are copied raw on the cpu thread (a memcpy per dirty page) and compressed on a
+		background thread. when the budget is exceeded the oldest snapshot is dropped and any of
+		its pages still needed are handed to the next one, which becomes the new complete image.
+	*/
+	class RewindBuffer {
+	public:
+		RewindBuffer(uint64_t interval, size_t budget);
+		~RewindBuffer();
+
+		bool IsDue(uint64_t instruction) const { return instruction >= m_NextCapture; }
+
+		void Capture(uint64_t instruction, std::vector<uint8_t> machine, Bus& bus);
+
+		// puts the ram of the newest snapshot at or before instruction back into the bus, drops every
+		// snapshot after it, and returns that snapshot's instruction count and machine state blob
+		struct Restored {
+			uint64_t instruction;
+			std::vector<uint8_t> machine;
+		};
+
+		std::optional<Restored> Restore(uint64_t instruction, Bus& bus);
+
+		size_t GetMemoryUsage() const;
+		size_t GetSnapshotCount() const;
+		uint64_t GetOldestInstruction() const;
+
+	private:
+		struct Page {
+			size_t area;
+			size_t index;
+			std::vector<uint8_t> data;
+			bool compressed = false;
+		};
+
+		struct Snapshot {
+			uint64_t instruction;
+			std::vector<uint8_t> machine;
+			std::vector<std::shared_ptr<Page>> pages;
+		};
+
+		void CompressorThread();
+		void EnforceBudget();
+		size_t SnapshotBytes(const Snapshot& snapshot) const;
+
+		static std::vector<uint8_t> Compress(std::span<const uint8_t> data);
+		static void Decompress(std::span<const uint8_t> data, std::span<uint8_t> out);
+
+	private:
+		uint64_t m_Interval;
+		size_t m_Budget;
+		uint64_t m_NextCapture = 0;
+
+		// page versions of each area as of the newest snapshot
+		std::vector<std::vector<uint32_t>> m_LastVersions;
+
+		mutable std::mutex m_Mutex;
+		std::condition_variable m_Wake;
+		std::deque<Snapshot> m_Snapshots;
+		std::deque<std::shared_ptr<Page>> m_Pending;
+		size_t m_Bytes = 0;
+		bool m_Quit = false;
+
+		std::thread m_Compressor;
+	};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,130 @@
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include "state.hpp"
+
+#include <cstdint>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <limits>
+
+namespace xe86 {
+	using Cycles = uint64_t;
+
+	// a third of the 14.31818 MHz crystal
+	static constexpr Cycles CyclesPerSecond = 4772727;
+
+	// guest time, measured in cpu clock cycles. devices never poll the clock every step,
+	// they schedule a callback for the cycle at which something actually happens.
+	class Scheduler {
+	public:
+		using EventId = uint32_t;
+
+		static constexpr Cycles Never = std::numeric_limits<Cycles>::max();
+
+		EventId Schedule(Cycles when, std::function<void()> callback) {
+			EventId id = m_NextId++;
+			Event event{ when, id, std::move(callback) };
+
+			// kept sorted latest-first so the next event is always at the back
+			auto it = std::upper_bound(m_Events.begin(), m_Events.end(), event, [](const Event& a, const Event& b) {
+				return a.when != b.when ? a.when > b.when : a.id > b.id;
+			});
+
+			m_Events.insert(it, std::move(event));
+			m_NextEvent = m_Events.back().when;
+			return id;
+		}
+
+		EventId ScheduleIn(Cycles delay, std::function<void()> callback) {
+			return Schedule(m_Now + delay, std::move(callback));
+		}
+
+		void Cancel(EventId id) {
+			std::erase_if(m_Events, [id](const Event& e) { return e.id == id; });
+			m_NextEvent = m_Events.empty() ? Never : m_Events.back().when;
+		}
+
+		// called once per retired instruction
+		void Retire(Cycles cycles) {
+			m_Now += cycles;
+			m_Instructions++;
+		}
+
+		// time passing with the cpu halted. nothing retires, so instruction counts come out the
+		// same whether a halt was waited out or fast-forwarded
+		void Idle(Cycles cycles) {
+			m_Now += cycles;
+		}
+
+		void RunDueEvents() {
+			while (m_Now >= m_NextEvent) {
+				Event event = std::move(m_Events.back());
+				m_Events.pop_back();
+				m_NextEvent = m_Events.empty() ? Never : m_Events.back().when;
+
+				event.callback();
+			}
+		}
+
+		// skip guest time straight to the next event. returns false if nothing is scheduled,
+		// in which case nothing can ever change unless the host does something.
+		bool FastForward() {
+			if (m_NextEvent == Never) {
+				return false;
+			}
+
+			if (m_NextEvent > m_Now) {
+				m_Skipped += m_NextEvent - m_Now;
+				m_Now = m_NextEvent;
+			}
+
+			RunDueEvents();
+			return true;
+		}
+
+		bool HasPendingEvents() const { return m_NextEvent != Never; }
+		Cycles GetNextEventTime() const { return m_NextEvent; }
+
+		Cycles GetNow() const { return m_Now; }
+		Cycles GetSkippedCycles() const { return m_Skipped; }
+		uint64_t GetInstructionCount() const { return m_Instructions; }
+
+		// a step that retires several instructions at once (a fused pair, a translated block)
+		// asks first, so anything stepping to an exact instruction count doesn't overshoot it
+		void SetInstructionLimit(uint64_t limit) { m_InstructionLimit = limit; }
+		bool CanRetire(uint64_t instructions) const { return m_Instructions + instructions <= m_InstructionLimit; }
+
+		// only the clock. pending events belong to the devices that posted them
+		void SaveState(StateWriter& state) const {
+			state.Write(m_Now);
+			state.Write(m_Skipped);
+			state.Write(m_Instructions);
+		}
+
+		void LoadState(StateReader& state) {
+			state.Read(m_Now);
+			state.Read(m_Skipped);
+			state.Read(m_Instructions);
+		}
+
+	private:
+		struct Event {
+			Cycles when;
+			EventId id;
+			std::function<void()> callback;
+		};
+
+		std::vector<Event> m_Events;
+		Cycles m_NextEvent = Never;
+		EventId m_NextId = 0;
+		uint64_t m_InstructionLimit = std::numeric_limits<uint64_t>::max();
+
+		Cycles m_Now = 0;
+		Cycles m_Skipped = 0;
+		uint64_t m_Instructions = 0;
+	};
+}
+
+#endif
\ No newline at end of file
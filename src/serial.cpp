@@ -0,0 +1,297 @@
+#include "serial.hpp"
+#include <print>
+#include <algorithm>
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+using namespace xe86;
+
+#ifdef __linux__
+
+std::unique_ptr<SerialBridge> SerialBridge::Open(std::string_view spec) {
+	auto bridge = std::unique_ptr<SerialBridge>(new SerialBridge());
+
+	bridge->m_Epoll = epoll_create1(EPOLL_CLOEXEC);
+	bridge->m_Wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (bridge->m_Epoll < 0 || bridge->m_Wake < 0) {
+		std::println(stderr, "serial: failed to set up epoll: {}", std::strerror(errno));
+		return nullptr;
+	}
+
+	epoll_event wake = { .events = EPOLLIN, .data = { .fd = bridge->m_Wake } };
+	epoll_ctl(bridge->m_Epoll, EPOLL_CTL_ADD, bridge->m_Wake, &wake);
+
+	if (spec == "pty") {
+		int master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+		if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+			std::println(stderr, "serial: failed to open a pty: {}", std::strerror(errno));
+			if (master >= 0) {
+				close(master);
+			}
+
+			return nullptr;
+		}
+
+		bridge->m_Peer = master;
+		bridge->m_Name = ptsname(master);
+
+		// raw, so bytes pass through the line discipline untouched whoever opens the other end
+		bridge->m_Slave = open(bridge->m_Name.c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC);
+		if (bridge->m_Slave >= 0) {
+			termios attributes;
+			if (tcgetattr(bridge->m_Slave, &attributes) == 0) {
+				cfmakeraw(&attributes);
+				tcsetattr(bridge->m_Slave, TCSANOW, &attributes);
+			}
+		}
+
+		epoll_event peer = { .events = EPOLLIN, .data = { .fd = master } };
+		epoll_ctl(bridge->m_Epoll, EPOLL_CTL_ADD, master, &peer);
+	} else if (spec.starts_with("unix:")) {
+		bridge->m_Name = spec.substr(5);
+		bridge->m_Socket = true;
+
+		sockaddr_un address{};
+		address.sun_family = AF_UNIX;
+		if (bridge->m_Name.empty() || bridge->m_Name.size() >= sizeof(address.sun_path)) {
+			std::println(stderr, "serial: bad socket path '{}'", bridge->m_Name);
+			return nullptr;
+		}
+
+		std::copy(bridge->m_Name.begin(), bridge->m_Name.end(), address.sun_path);
+
+		// a socket left behind by an earlier run would make bind fail
+		unlink(bridge->m_Name.c_str());
+
+		bridge->m_Listen = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (bridge->m_Listen < 0 ||
+			bind(bridge->m_Listen, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+			listen(bridge->m_Listen, 1) != 0) {
+			std::println(stderr, "serial: failed to listen on '{}': {}", bridge->m_Name, std::strerror(errno));
+			return nullptr;
+		}
+
+		epoll_event listen = { .events = EPOLLIN, .data = { .fd = bridge->m_Listen } };
+		epoll_ctl(bridge->m_Epoll, EPOLL_CTL_ADD, bridge->m_Listen, &listen);
+	} else {
+		std::println(stderr, "serial: unknown bridge '{}', expected pty or unix:<path>", spec);
+		return nullptr;
+	}
+
+	bridge->m_Thread = std::thread([bridge = bridge.get()]() { bridge->BridgeThread(); });
+	return bridge;
+}
+
+SerialBridge::~SerialBridge() {
+	if (m_Thread.joinable()) {
+		m_Quit = true;
+
+		uint64_t one = 1;
+		[[maybe_unused]] ssize_t written = write(m_Wake, &one, sizeof(one));
+		m_Thread.join();
+	}
+
+	for (int fd : { m_Peer, m_Slave, m_Listen, m_Wake, m_Epoll }) {
+		if (fd >= 0) {
+			close(fd);
+		}
+	}
+
+	if (m_Socket && m_Listen >= 0) {
+		unlink(m_Name.c_str());
+	}
+}
+
+bool SerialBridge::TryWrite(uint8_t byte) {
+	if (!m_Transmit.TryPush(byte)) {
+		return false;
+	}
+
+	// pairs with the fence in BridgeThread: either it sees the byte before sleeping or we see it asleep
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (m_Sleeping.load(std::memory_order_relaxed) && m_Sleeping.exchange(false)) {
+		uint64_t one = 1;
+		[[maybe_unused]] ssize_t written = write(m_Wake, &one, sizeof(one));
+	}
+
+	return true;
+}
+
+void SerialBridge::BridgeThread() {
+	while (!m_Quit.load(std::memory_order_relaxed)) {
+		if (m_Peer >= 0) {
+			if (!Transmit()) {
+				Disconnect();
+			}
+		} else {
+			// nobody to send to
+			uint8_t byte;
+			while (m_Transmit.TryPop(byte)) {
+			}
+		}
+
+		m_Sleeping.store(true);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		// bytes arrived while we were busy, and the host can take them
+		if (m_Transmit.GetSize() != 0 && m_Pending.empty()) {
+			m_Sleeping.store(false, std::memory_order_relaxed);
+			continue;
+		}
+
+		// with the guest's queue full nothing is read, but something has to notice it emptying
+		epoll_event events[4];
+		int count = epoll_wait(m_Epoll, events, 4, m_Reading ? -1 : 1);
+		m_Sleeping.store(false, std::memory_order_relaxed);
+
+		for (int i = 0; i < count; i++) {
+			int fd = events[i].data.fd;
+
+			if (fd == m_Wake) {
+				uint64_t value;
+				[[maybe_unused]] ssize_t got = read(m_Wake, &value, sizeof(value));
+			} else if (fd == m_Listen) {
+				Accept();
+			} else if (fd == m_Peer) {
+				if (m_Reading && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+					if (!Receive()) {
+						Disconnect();
+					}
+				} else if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+					Disconnect();
+				}
+			}
+		}
+
+		if (!m_Reading && m_Peer >= 0 && m_Received.GetSize() < QueueDepth / 2) {
+			Watch(true, m_Writing);
+		}
+	}
+}
+
+bool SerialBridge::Receive() {
+	uint8_t buffer[4096];
+	size_t room = QueueDepth - m_Received.GetSize();
+
+	ssize_t got = read(m_Peer, buffer, std::min(room, sizeof(buffer)));
+	if (got == 0) {
+		return false;
+	}
+
+	if (got < 0) {
+		return errno == EAGAIN || errno == EINTR;
+	}
+
+	// we are the only producer, so the room is still there
+	for (ssize_t i = 0; i < got; i++) {
+		m_Received.TryPush(buffer[i]);
+	}
+
+	if (m_Received.GetSize() == QueueDepth) {
+		Watch(false, m_Writing);
+	}
+
+	return true;
+}
+
+bool SerialBridge::Transmit() {
+	uint8_t byte;
+	while (m_Pending.size() < 4096 && m_Transmit.TryPop(byte)) {
+		m_Pending.push_back(static_cast<char>(byte));
+	}
+
+	if (m_Pending.empty()) {
+		return true;
+	}
+
+	ssize_t sent = write(m_Peer, m_Pending.data(), m_Pending.size());
+	if (sent < 0 && errno != EAGAIN && errno != EINTR) {
+		return false;
+	}
+
+	if (sent > 0) {
+		m_Pending.erase(0, sent);
+	}
+
+	// the rest waits until the host makes room
+	Watch(m_Reading, !m_Pending.empty());
+	return true;
+}
+
+void SerialBridge::Accept() {
+	int client = accept4(m_Listen, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+	if (client < 0) {
+		return;
+	}
+
+	// one at a time, like a real cable
+	if (m_Peer >= 0) {
+		close(client);
+		return;
+	}
+
+	m_Peer = client;
+	m_Reading = true;
+	m_Writing = false;
+
+	epoll_event peer = { .events = EPOLLIN, .data = { .fd = client } };
+	epoll_ctl(m_Epoll, EPOLL_CTL_ADD, client, &peer);
+}
+
+void SerialBridge::Disconnect() {
+	if (!m_Socket) {
+		// a pty only goes away if something is badly wrong, and then there is nothing left to do
+		std::println(stderr, "serial: lost the pty '{}'", m_Name);
+	}
+
+	epoll_ctl(m_Epoll, EPOLL_CTL_DEL, m_Peer, nullptr);
+	close(m_Peer);
+
+	m_Peer = -1;
+	m_Pending.clear();
+	m_Reading = true;
+	m_Writing = false;
+}
+
+void SerialBridge::Watch(bool reading, bool writing) {
+	if (reading == m_Reading && writing == m_Writing) {
+		return;
+	}
+
+	m_Reading = reading;
+	m_Writing = writing;
+
+	epoll_event peer = {
+		.events = (reading ? uint32_t(EPOLLIN) : 0u) | (writing ? uint32_t(EPOLLOUT) : 0u),
+		.data = { .fd = m_Peer }
+	};
+
+	epoll_ctl(m_Epoll, EPOLL_CTL_MOD, m_Peer, &peer);
+}
+
+#else
+
+std::unique_ptr<SerialBridge> SerialBridge::Open(std::string_view spec) {
+	std::println(stderr, "serial: can't bridge to '{}', host bridges are only supported on linux", spec);
+	return nullptr;
+}
+
+SerialBridge::~SerialBridge() {
+}
+
+bool SerialBridge::TryWrite(uint8_t) {
+	return false;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,91 @@
+#ifndef SERIAL_HPP
+#define SERIAL_HPP
+
+#include "spsc_queue.hpp"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <atomic>
+
+namespace xe86 {
+	/*
+	SERIAL BRIDGE
+		connects a uart to the host, either as a pseudo-terminal ("pty", whose name is printed
+		for a terminal program to open) or as a unix domain socket ("unix:<path>") that takes
+		one client at a time. all host i/o happens on the bridge's own thread, which sleeps in
+		epoll, and bytes cross over through two lock-free queues, so the emulation thread never
+		makes a system call unless it has to wake the bridge for bytes to send.
+
+		bytes the guest hasn't taken yet stay in the queue and the bridge stops reading from the
+		host while it's full, which is flow control as far as the host can tell. bytes sent while
+		nothing is connected to the socket are dropped, as if the cable were unplugged.
+
+		only on linux.
+	*/
+	class SerialBridge {
+	public:
+		static constexpr size_t QueueDepth = 64 * 1024;
+
+		// "pty" or "unix:<path>". null, with the reason printed, if it can't be set up
+		static std::unique_ptr<SerialBridge> Open(std::string_view spec);
+
+		~SerialBridge();
+
+		SerialBridge(const SerialBridge&) = delete;
+		SerialBridge& operator=(const SerialBridge&) = delete;
+
+		// emulation thread
+		bool HasInput() const { return m_Received.GetSize() != 0; }
+		bool TryRead(uint8_t& byte) { return m_Received.TryPop(byte); }
+
+		// false if the bridge is that far behind, the byte should be offered again later
+		bool TryWrite(uint8_t byte);
+
+		// the pty's device path, or the socket's path
+		const std::string& GetName() const { return m_Name; }
+
+	private:
+		SerialBridge() = default;
+
+		void BridgeThread();
+
+		// one read from the host into m_Received. false once the other end is gone
+		bool Receive();
+
+		// as much of m_Transmit as the host takes without blocking. false once the other end is gone
+		bool Transmit();
+
+		void Accept();
+		void Disconnect();
+
+		// which of input and output on m_Peer epoll reports
+		void Watch(bool reading, bool writing);
+
+	private:
+		SpscQueue<uint8_t, QueueDepth> m_Received;
+		SpscQueue<uint8_t, QueueDepth> m_Transmit;
+
+		std::string m_Name;
+		bool m_Socket = false;
+
+		int m_Epoll = -1;
+		int m_Wake = -1;		// eventfd the emulation thread pokes when the bridge is asleep and there is something to send
+		int m_Listen = -1;		// the socket being listened on
+		int m_Peer = -1;		// the pty master, or the connected client
+		int m_Slave = -1;		// held open so the pty doesn't hang up while no terminal has it
+
+		// bridge thread only. taken off m_Transmit but not accepted by the host yet
+		std::string m_Pending;
+		bool m_Reading = true;
+		bool m_Writing = false;
+
+		// set by the bridge before it sleeps, so the emulation thread knows to wake it
+		std::atomic<bool> m_Sleeping = false;
+		std::atomic<bool> m_Quit = false;
+		std::thread m_Thread;
+	};
+}
+
+#endif
\ No newline at end of file
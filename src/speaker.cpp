@@ -0,0 +1,119 @@
+#include "speaker.hpp"
+
+using namespace xe86;
+
+Speaker::Speaker(std::shared_ptr<Bus> bus) : Component(bus, "Speaker") {
+	// bit 5 follows the timer output, so polling it is never idle
+	m_Bus->AttachPort({
+		[this](uint8_t byte) { WriteControl(byte); },
+		[this]() -> uint8_t { return ReadControl(); },
+		0x61,
+		true
+	});
+}
+
+void Speaker::ConnectTimer(PIT& timer) {
+	m_Timer = &timer;
+
+	// catch up with the old settings before channel 2 is reprogrammed
+	m_Timer->SetChangeHandler(2, [this]() { Synthesize(); });
+	m_Timer->SetGate(2, m_Control & 0b01);
+}
+
+void Speaker::AttachSink(std::shared_ptr<AudioSink> sink) {
+	m_Sink = sink;
+	Restart();
+}
+
+void Speaker::Reset() {
+	Synthesize();
+	m_Control = 0;
+
+	if (m_Timer) {
+		m_Timer->SetGate(2, false);
+	}
+
+	Restart();
+}
+
+uint8_t Speaker::ReadControl() {
+	bool output = m_Timer ? m_Timer->GetOutput(2) : false;
+	return (m_Control & 0b11011111) | (output ? 0b00100000 : 0);
+}
+
+void Speaker::WriteControl(uint8_t byte) {
+	Synthesize();
+	m_Control = byte;
+
+	if (m_Timer) {
+		m_Timer->SetGate(2, byte & 0b01);
+	}
+}
+
+void Speaker::Synthesize() {
+	if (!m_Sink) {
+		return;
+	}
+
+	Cycles now = m_Bus->GetScheduler().GetNow();
+	while (m_SampleTime + AudioBatch::SampleCycles <= now) {
+		AudioBatch& batch = m_Sink->BeginBatch();
+		if (m_Filled == 0) {
+			batch.time = m_SampleTime;
+		}
+
+		Cycles end = m_SampleTime + AudioBatch::SampleCycles;
+		Cycles on = 0;
+
+		if (m_Control & 0b10) {
+			on = m_Timer ? m_Timer->GetHighCycles(2, m_SampleTime, end) : AudioBatch::SampleCycles;
+		}
+
+		batch.samples[m_Filled++] = static_cast<int16_t>(on * Amplitude / AudioBatch::SampleCycles);
+		m_SampleTime = end;
+
+		if (m_Filled == AudioBatch::Capacity) {
+			batch.count = m_Filled;
+			m_Sink->PublishBatch();
+			m_Filled = 0;
+		}
+	}
+}
+
+void Speaker::ScheduleBatch() {
+	Scheduler& scheduler = m_Bus->GetScheduler();
+	if (m_BatchScheduled) {
+		scheduler.Cancel(m_BatchEvent);
+		m_BatchScheduled = false;
+	}
+
+	if (!m_Sink) {
+		return;
+	}
+
+	// when the batch being filled will be full
+	Cycles when = m_SampleTime + (AudioBatch::Capacity - m_Filled) * AudioBatch::SampleCycles;
+	m_BatchEvent = scheduler.Schedule(when, [this]() {
+		m_BatchScheduled = false;
+		Synthesize();
+		ScheduleBatch();
+	});
+
+	m_BatchScheduled = true;
+}
+
+void Speaker::Restart() {
+	// whatever was half filled belongs to a timeline we left, the sink copes with the jump
+	m_SampleTime = m_Bus->GetScheduler().GetNow();
+	m_Filled = 0;
+	ScheduleBatch();
+}
+
+void Speaker::SaveState(StateWriter& state) const {
+	state.Write(m_Control);
+}
+
+void Speaker::LoadState(StateReader& state) {
+	state.Read(m_Control);
+	Restart();
+}
\ No newline at end of file
@@ -0,0 +1,66 @@
+#ifndef SPEAKER_HPP
+#define SPEAKER_HPP
+
+#include "component.hpp"
+#include "pit.hpp"
+#include "audio.hpp"
+
+#include <memory>
+
+namespace xe86 {
+	/*
+	PC SPEAKER
+		the speaker is driven by timer channel 2 AND'ed with bit 1 of port 61h, and bit 0 of the same
+		port gates the timer. bit 5 reads back the timer output, as on an at.
+
+		samples are never made per instruction. whatever has sounded since the last time is
+		synthesized in one go, from the timer's programming, when the speaker or channel 2 is about
+		to change and at a scheduled event once per batch, so audio costs the emulation thread one
+		sync per buffer period. each sample is the share of its 108 cycles the speaker was on, which
+		keeps square waves from aliasing and lets software that toggles bit 1 by hand play samples.
+	*/
+	class Speaker final : public Component {
+	public:
+		static constexpr int16_t Amplitude = 8192;
+
+		Speaker(const Speaker&) = delete;
+		Speaker& operator=(const Speaker&) = delete;
+
+		Speaker(std::shared_ptr<Bus> bus);
+
+		void Reset() override;
+		void Step() override {}
+
+		// only does anything on port access or once per batch, which is scheduled
+		bool IsIdle() const override { return true; }
+
+		void SaveState(StateWriter& state) const override;
+		void LoadState(StateReader& state) override;
+
+		void ConnectTimer(PIT& timer);
+		void AttachSink(std::shared_ptr<AudioSink> sink);
+
+	private:
+		uint8_t ReadControl();
+		void WriteControl(uint8_t byte);
+
+		void Synthesize();
+		void ScheduleBatch();
+		void Restart();
+
+	private:
+		PIT* m_Timer = nullptr;
+		std::shared_ptr<AudioSink> m_Sink;
+
+		uint8_t m_Control = 0;
+
+		// guest time of the next sample, and how many are already in the batch being filled
+		Cycles m_SampleTime = 0;
+		uint32_t m_Filled = 0;
+
+		Scheduler::EventId m_BatchEvent = 0;
+		bool m_BatchScheduled = false;
+	};
+}
+
+#endif
\ No newline at end of file
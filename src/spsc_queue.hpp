@@ -0,0 +1,93 @@
+#ifndef SPSC_QUEUE_HPP
+#define SPSC_QUEUE_HPP
+
+#include <atomic>
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+
+namespace xe86 {
+	/*
+	bounded lock-free queue for exactly one producer thread and one consumer thread. meant for
+	small trivially copyable values (buffer indices, bytes, sample batches' handles), so a slot
+	can be read and written atomically.
+
+	besides plain TryPush, the producer can PushEvictOldest: when the queue is full it takes the
+	oldest entry back itself instead of waiting. the consumer claims entries with a compare and
+	swap on the tail, so whichever side gets there first owns the entry and the other moves on.
+	*/
+	template <typename T, size_t N>
+	class SpscQueue {
+		static_assert(std::is_trivially_copyable_v<T>);
+		static_assert((N & (N - 1)) == 0, "capacity must be a power of two");
+
+	public:
+		bool TryPush(T value) {
+			uint64_t head = m_Head.load(std::memory_order_relaxed);
+			if (head - m_Tail.load(std::memory_order_acquire) >= N) {
+				return false;
+			}
+
+			m_Slots[head & (N - 1)].store(value, std::memory_order_relaxed);
+			m_Head.store(head + 1, std::memory_order_release);
+			m_Head.notify_one();
+			return true;
+		}
+
+		// never fails. returns true and sets evicted if the oldest entry had to make room
+		bool PushEvictOldest(T value, T& evicted) {
+			bool dropped = false;
+			uint64_t head = m_Head.load(std::memory_order_relaxed);
+			uint64_t tail = m_Tail.load(std::memory_order_acquire);
+
+			while (head - tail >= N) {
+				T oldest = m_Slots[tail & (N - 1)].load(std::memory_order_relaxed);
+				if (m_Tail.compare_exchange_weak(tail, tail + 1, std::memory_order_acq_rel)) {
+					evicted = oldest;
+					dropped = true;
+					break;
+				}
+			}
+
+			m_Slots[head & (N - 1)].store(value, std::memory_order_relaxed);
+			m_Head.store(head + 1, std::memory_order_release);
+			m_Head.notify_one();
+			return dropped;
+		}
+
+		bool TryPop(T& value) {
+			uint64_t tail = m_Tail.load(std::memory_order_acquire);
+
+			while (tail != m_Head.load(std::memory_order_acquire)) {
+				T candidate = m_Slots[tail & (N - 1)].load(std::memory_order_relaxed);
+				if (m_Tail.compare_exchange_weak(tail, tail + 1, std::memory_order_acq_rel)) {
+					value = candidate;
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		// consumer side: sleep until something has been pushed since last_head was read
+		void WaitForPush(uint64_t last_head) const {
+			m_Head.wait(last_head, std::memory_order_acquire);
+		}
+
+		uint64_t GetHead() const { return m_Head.load(std::memory_order_acquire); }
+
+		size_t GetSize() const {
+			return m_Head.load(std::memory_order_acquire) - m_Tail.load(std::memory_order_acquire);
+		}
+
+	private:
+		std::array<std::atomic<T>, N> m_Slots{};
+
+		// on separate cache lines so the two threads don't fight over one
+		alignas(64) std::atomic<uint64_t> m_Head = 0;
+		alignas(64) std::atomic<uint64_t> m_Tail = 0;
+	};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,71 @@
+#ifndef STATE_HPP
+#define STATE_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <span>
+#include <type_traits>
+
+namespace xe86 {
+	// flat binary machine state. components write their fields in a fixed order and read them
+	// back in the same order, there is no tagging or versioning - it only has to survive the process.
+	class StateWriter {
+	public:
+		template <typename T> requires std::is_trivially_copyable_v<T>
+		void Write(const T& value) {
+			const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+			m_Data.insert(m_Data.end(), bytes, bytes + sizeof(T));
+		}
+
+		void WriteBytes(std::span<const uint8_t> bytes) {
+			Write<uint64_t>(bytes.size());
+			m_Data.insert(m_Data.end(), bytes.begin(), bytes.end());
+		}
+
+		std::vector<uint8_t>& GetData() { return m_Data; }
+
+	private:
+		std::vector<uint8_t> m_Data;
+	};
+
+	class StateReader {
+	public:
+		StateReader(std::span<const uint8_t> data) : m_Data(data) {}
+
+		template <typename T> requires std::is_trivially_copyable_v<T>
+		void Read(T& value) {
+			if (m_Cursor + sizeof(T) > m_Data.size()) {
+				m_Cursor = m_Data.size();
+				return;
+			}
+
+			std::memcpy(&value, m_Data.data() + m_Cursor, sizeof(T));
+			m_Cursor += sizeof(T);
+		}
+
+		template <typename T> requires std::is_trivially_copyable_v<T>
+		T Read() {
+			T value{};
+			Read(value);
+			return value;
+		}
+
+		std::span<const uint8_t> ReadBytes() {
+			uint64_t length = Read<uint64_t>();
+			if (length > m_Data.size() - m_Cursor) {
+				length = m_Data.size() - m_Cursor;
+			}
+
+			std::span<const uint8_t> bytes = m_Data.subspan(m_Cursor, length);
+			m_Cursor += length;
+			return bytes;
+		}
+
+	private:
+		std::span<const uint8_t> m_Data;
+		size_t m_Cursor = 0;
+	};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,137 @@
+#include "textscreen.hpp"
+#include <algorithm>
+
+using namespace xe86;
+
+namespace {
+	// code page 437 as unicode, for the characters that aren't ascii. the control codes are the
+	// symbols the character rom has for them, and 00h is blank
+	constexpr char16_t Controls[32] = {
+		0x0020, 0x263a, 0x263b, 0x2665, 0x2666, 0x2663, 0x2660, 0x2022, 0x25d8, 0x25cb, 0x25d9, 0x2642, 0x2640, 0x266a, 0x266b, 0x263c,
+		0x25ba, 0x25c4, 0x2195, 0x203c, 0x00b6, 0x00a7, 0x25ac, 0x21a8, 0x2191, 0x2193, 0x2192, 0x2190, 0x221f, 0x2194, 0x25b2, 0x25bc,
+	};
+
+	constexpr char16_t Upper[128] = {
+		0x00c7, 0x00fc, 0x00e9, 0x00e2, 0x00e4, 0x00e0, 0x00e5, 0x00e7, 0x00ea, 0x00eb, 0x00e8, 0x00ef, 0x00ee, 0x00ec, 0x00c4, 0x00c5,
+		0x00c9, 0x00e6, 0x00c6, 0x00f4, 0x00f6, 0x00f2, 0x00fb, 0x00f9, 0x00ff, 0x00d6, 0x00dc, 0x00a2, 0x00a3, 0x00a5, 0x20a7, 0x0192,
+		0x00e1, 0x00ed, 0x00f3, 0x00fa, 0x00f1, 0x00d1, 0x00aa, 0x00ba, 0x00bf, 0x2310, 0x00ac, 0x00bd, 0x00bc, 0x00a1, 0x00ab, 0x00bb,
+		0x2591, 0x2592, 0x2593, 0x2502, 0x2524, 0x2561, 0x2562, 0x2556, 0x2555, 0x2563, 0x2551, 0x2557, 0x255d, 0x255c, 0x255b, 0x2510,
+		0x2514, 0x2534, 0x252c, 0x251c, 0x2500, 0x253c, 0x255e, 0x255f, 0x255a, 0x2554, 0x2569, 0x2566, 0x2560, 0x2550, 0x256c, 0x2567,
+		0x2568, 0x2564, 0x2565, 0x2559, 0x2558, 0x2552, 0x2553, 0x256b, 0x256a, 0x2518, 0x250c, 0x2588, 0x2584, 0x258c, 0x2590, 0x2580,
+		0x03b1, 0x00df, 0x0393, 0x03c0, 0x03a3, 0x03c3, 0x00b5, 0x03c4, 0x03a6, 0x0398, 0x03a9, 0x03b4, 0x221e, 0x03c6, 0x03b5, 0x2229,
+		0x2261, 0x00b1, 0x2265, 0x2264, 0x2320, 0x2321, 0x00f7, 0x2248, 0x00b0, 0x2219, 0x00b7, 0x221a, 0x207f, 0x00b2, 0x25a0, 0x00a0,
+	};
+
+	void AppendUtf8(std::string& out, uint8_t character) {
+		char16_t c = character < 0x20 ? Controls[character] : character == 0x7f ? u'\u2302' : character >= 0x80 ? Upper[character - 0x80] : character;
+
+		// everything in code page 437 is in the basic multilingual plane
+		if (c < 0x80) {
+			out += static_cast<char>(c);
+		} else if (c < 0x800) {
+			out += static_cast<char>(0xc0 | c >> 6);
+			out += static_cast<char>(0x80 | (c & 0x3f));
+		} else {
+			out += static_cast<char>(0xe0 | c >> 12);
+			out += static_cast<char>(0x80 | (c >> 6 & 0x3f));
+			out += static_cast<char>(0x80 | (c & 0x3f));
+		}
+	}
+}
+
+TextScreen::TextScreen(CGA& cga) : m_Cga(cga) {
+}
+
+bool TextScreen::Update() {
+	if (m_Built && m_Cga.GetMode() == m_Mode && m_Cga.GetStartAddress() == m_Start) {
+		auto& versions = m_Cga.GetVideoMemory()->GetPageVersions();
+		uint8_t visible = GetVisiblePages();
+
+		bool written = false;
+		for (size_t page = 0; page < VideoFrame::VramPages; page++) {
+			written |= (visible >> page & 1) && versions[page] != m_Versions[page];
+		}
+
+		if (!written) {
+			return false;
+		}
+	}
+
+	std::string previous = std::move(m_Text);
+	Rebuild();
+	return m_Text != previous;
+}
+
+void TextScreen::Rebuild() {
+	m_Built = true;
+	m_Mode = m_Cga.GetMode();
+	m_Start = m_Cga.GetStartAddress();
+
+	auto& vram = *m_Cga.GetVideoMemory();
+	std::copy(vram.GetPageVersions().begin(), vram.GetPageVersions().begin() + VideoFrame::VramPages, m_Versions.begin());
+
+	m_Text.clear();
+
+	// video off, or a graphics mode
+	if (!(m_Mode & 0b00001000) || (m_Mode & 0b00000010)) {
+		m_Columns = 0;
+		return;
+	}
+
+	m_Columns = (m_Mode & 0b00000001) ? 80 : 40;
+
+	for (unsigned row = 0; row < Rows; row++) {
+		// the row without the spaces and blanks it ends in
+		unsigned length = 0;
+		uint8_t characters[80];
+
+		for (unsigned column = 0; column < m_Columns; column++) {
+			uint16_t cell = static_cast<uint16_t>(m_Start + row * m_Columns + column);
+			characters[column] = vram.GetPage((cell * 2 & (VideoFrame::VramSize - 1)) >> MemoryArea::PageShift)[cell * 2 & MemoryArea::PageMask];
+
+			if (characters[column] != 0x00 && characters[column] != 0x20) {
+				length = column + 1;
+			}
+		}
+
+		for (unsigned column = 0; column < length; column++) {
+			AppendUtf8(m_Text, characters[column]);
+		}
+
+		m_Text += '\n';
+	}
+}
+
+uint8_t TextScreen::GetVisiblePages() const {
+	uint32_t columns = (m_Mode & 0b00000001) ? 80 : 40;
+	uint32_t at = (m_Start * 2u) & (VideoFrame::VramSize - 1);
+	uint32_t left = Rows * columns * 2;
+	uint8_t pages = 0;
+
+	// the screen wraps around the end of video ram
+	while (left) {
+		uint32_t run = std::min<uint32_t>(left, MemoryArea::PageSize - (at & MemoryArea::PageMask));
+		pages |= 1 << (at >> MemoryArea::PageShift);
+		at = (at + run) & (VideoFrame::VramSize - 1);
+		left -= run;
+	}
+
+	return pages;
+}
+
+bool TextScreen::WaitForText(PC& pc, std::string_view pattern, Cycles budget) {
+	Scheduler& scheduler = pc.GetBus()->GetScheduler();
+	Cycles end = scheduler.GetNow() + budget;
+
+	Update();
+	while (!Contains(pattern)) {
+		if (scheduler.GetNow() >= end || pc.IsStalled()) {
+			return false;
+		}
+
+		pc.Step();
+		Update();
+	}
+
+	return true;
+}
\ No newline at end of file
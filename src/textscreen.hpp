@@ -0,0 +1,66 @@
+#ifndef TEXTSCREEN_HPP
+#define TEXTSCREEN_HPP
+
+#include "cga.hpp"
+#include "pc.hpp"
+
+#include <array>
+#include <string>
+#include <string_view>
+
+namespace xe86 {
+	/*
+	TEXT SCREEN
+		what a text mode screen says, read straight out of video ram instead of from pixels, for
+		scripts that wait for a prompt and tests that check output. the 40 or 80 by 25 characters
+		at the crtc start address become utf-8, code page 437 the way the character rom draws it,
+		one line per row with the spaces at the end of each row left off. attributes and the
+		cursor are ignored. a graphics mode, or video turned off, reads as no text at all.
+
+		the text is only rebuilt when a video ram page the screen shows has been written since
+		the last look, or the mode or start address changed, so checking after every instruction
+		costs a few compares while the guest isn't drawing.
+	*/
+	class TextScreen {
+	public:
+		static constexpr unsigned Rows = 25;
+
+		TextScreen(CGA& cga);
+
+		TextScreen(const TextScreen&) = delete;
+		TextScreen& operator=(const TextScreen&) = delete;
+
+		// true if the text changed since the last update
+		bool Update();
+
+		bool IsTextMode() const { return m_Columns != 0; }
+		unsigned GetColumns() const { return m_Columns; }
+
+		// as of the last update
+		const std::string& GetText() const { return m_Text; }
+		bool Contains(std::string_view pattern) const { return m_Text.find(pattern) != std::string::npos; }
+
+		// runs the pc until the pattern is on the screen, for at most budget cycles. false if it
+		// wasn't there by then, or the pc stalled with the screen showing something else
+		bool WaitForText(PC& pc, std::string_view pattern, Cycles budget);
+
+	private:
+		void Rebuild();
+
+		// bit per page of video ram the screen shows
+		uint8_t GetVisiblePages() const;
+
+	private:
+		CGA& m_Cga;
+
+		unsigned m_Columns = 0;
+		std::string m_Text;
+
+		bool m_Built = false;
+		uint8_t m_Mode = 0;
+		uint16_t m_Start = 0;
+		std::array<uint32_t, VideoFrame::VramPages> m_Versions{};
+	};
+}
+
+#endif
\ No newline at end of file
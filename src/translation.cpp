@@ -0,0 +1,78 @@
+#include "translation.hpp"
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+using namespace xe86;
+
+namespace {
+	// a function-local static, so registrars in other translation units can run first
+	std::vector<const RomTranslation*>& GetRegistry() {
+		static std::vector<const RomTranslation*> registry;
+		return registry;
+	}
+
+	// tables by rom hash, null for a rom that has no translation. only ever added to
+	struct TableCache {
+		std::shared_mutex mutex;
+		std::unordered_map<uint64_t, std::unique_ptr<const TranslationTable>> tables;
+	};
+
+	TableCache& GetTableCache() {
+		static TableCache cache;
+		return cache;
+	}
+}
+
+RomTranslationRegistrar::RomTranslationRegistrar(const RomTranslation& translation) {
+	GetRegistry().push_back(&translation);
+}
+
+const RomTranslation* xe86::FindRomTranslation(uint64_t rom_hash) {
+	LinkTranslatedRom();
+
+	for (const RomTranslation* translation : GetRegistry()) {
+		if (translation->rom_hash == rom_hash) {
+			return translation;
+		}
+	}
+
+	return nullptr;
+}
+
+const TranslationTable* xe86::GetTranslationTable(uint64_t rom_hash) {
+	TableCache& cache = GetTableCache();
+
+	{
+		std::shared_lock lock(cache.mutex);
+		auto it = cache.tables.find(rom_hash);
+		if (it != cache.tables.end()) {
+			return it->second.get();
+		}
+	}
+
+	std::unique_lock lock(cache.mutex);
+
+	// another thread may have built it while we waited
+	auto [it, inserted] = cache.tables.try_emplace(rom_hash);
+	if (!inserted) {
+		return it->second.get();
+	}
+
+	const RomTranslation* translation = FindRomTranslation(rom_hash);
+	if (translation) {
+		auto table = std::make_unique<TranslationTable>();
+		table->base = translation->base;
+		table->blocks.resize(translation->size);
+		for (const TranslatedBlock& block : translation->blocks) {
+			table->blocks[block.offset] = block.run;
+		}
+
+		it->second = std::move(table);
+	}
+
+	return it->second.get();
+}
\ No newline at end of file
@@ -0,0 +1,135 @@
+#ifndef TRANSLATION_HPP
+#define TRANSLATION_HPP
+
+#include "cpu.hpp"
+#include "bus.hpp"
+
+#include <span>
+#include <vector>
+
+namespace xe86 {
+	/*
+	AHEAD-OF-TIME ROM TRANSLATION
+		the bios rom can't change at runtime, so tools/translate.cpp disassembles it at build time,
+		following control flow from the reset vector and any entry points it's given, and writes
+		each basic block out as a C++ function. the build compiles those into xe86, and the cpu
+		picks them up when the rom on the bus hashes the same as the one translated.
+
+		a block runs its instructions one after another inside a single cpu step. moves and
+		branches are written out natively; anything else is dispatched straight to the
+		interpreter's handler, already decoded as far as where it is and how long it is. every
+		instruction still retires on its own and a block stops as soon as anything could happen
+		between two instructions: a scheduled event, an interrupt, a breakpoint or watch hit, a
+		halt, or a change of control flow it didn't expect. code the translator never reached
+		is interpreted as before.
+
+		the only thing shared between machines is the dispatch table built from a translation,
+		one per rom hash for the whole process. nothing is decoded or translated at runtime: the
+		interpreter decodes as it executes, so there is no decoded form of a block to cache. a rom
+		that wasn't translated at build time, and any code in ram, is interpreted by each machine
+		on its own.
+	*/
+	class TranslationContext {
+	public:
+		TranslationContext(CPU& cpu) : m_Cpu(cpu), m_Scheduler(cpu.m_Bus->GetScheduler()) {}
+
+		Registers& GetRegisters() { return m_Cpu.m_Registers; }
+
+		// before the first instruction of a block the cpu has already checked everything
+		bool Continue() {
+			if (m_Scheduler.GetNow() >= m_Scheduler.GetNextEventTime() || !m_Scheduler.CanRetire(1)) {
+				return false;
+			}
+
+			if (m_Cpu.m_Halted || m_Cpu.m_SpinIdle) {
+				return false;
+			}
+
+			if (m_Cpu.GetFlag(Flags::IF) && m_Cpu.m_Bus->IsINTRAsserted()) {
+				return false;
+			}
+
+			Debugger& debugger = m_Cpu.m_Bus->GetDebugger();
+			if (debugger.HasHit() || debugger.HasBreakpoint(m_Cpu.GetLinearIP())) {
+				return false;
+			}
+
+			m_Cpu.m_Cycles = 0;
+			return true;
+		}
+
+		// a natively translated instruction, between Begin and Retire. IP is advanced past the
+		// instruction by the translation itself
+		void Begin(uint8_t opcode) {
+			m_Cpu.m_InstructionStart = m_Cpu.m_Registers.ip;
+			m_Cpu.m_Cycles += timings[opcode];
+			m_Cpu.MarkCovered(m_Cpu.GetLinearIP());
+		}
+
+		void Retire() {
+			m_Scheduler.Retire(m_Cpu.m_Cycles);
+			m_Cpu.m_TranslatedInstructions++;
+		}
+
+		// one instruction through the interpreter. returns false if it didn't end up at the
+		// instruction after it, in which case the block is done
+		bool Interpret(uint16_t length) {
+			uint32_t next = (m_Cpu.GetLinearIP() + length) & 0xfffff;
+			uint64_t retired = m_Scheduler.GetInstructionCount();
+			m_Cpu.m_InstructionStart = m_Cpu.m_Registers.ip;
+			m_Cpu.MarkCovered(m_Cpu.GetLinearIP());
+			m_Cpu.Execute();
+
+			// two, if it fused with a jump
+			m_Cpu.m_TranslatedInstructions += m_Scheduler.GetInstructionCount() - retired;
+
+			return m_Cpu.GetLinearIP() == next;
+		}
+
+		bool GetFlag(Flags flag) const { return m_Cpu.GetFlag(flag); }
+		void ClearFlag(Flags flag) { m_Cpu.ClearFlag(flag); }
+		void JumpRelative(bool condition, int16_t rel) { m_Cpu.JumpRelative16(condition, rel); }
+
+	private:
+		CPU& m_Cpu;
+		Scheduler& m_Scheduler;
+	};
+
+	struct TranslatedBlock {
+		uint32_t offset;	// from the start of the rom
+		void (*run)(TranslationContext&);
+	};
+
+	struct RomTranslation {
+		uint64_t rom_hash;	// as Bus::GetRomHash computes it
+		uint32_t base;		// physical address the rom is mapped at
+		uint32_t size;
+		std::span<const TranslatedBlock> blocks;
+	};
+
+	// translations register themselves from their own translation units
+	struct RomTranslationRegistrar {
+		RomTranslationRegistrar(const RomTranslation& translation);
+	};
+
+	const RomTranslation* FindRomTranslation(uint64_t rom_hash);
+
+	// a translation's blocks by offset from its base, null where none starts
+	struct TranslationTable {
+		uint32_t base;
+		std::vector<void (*)(TranslationContext&)> blocks;
+	};
+
+	// the table for the rom with this hash, or null if it wasn't translated ahead of time. each
+	// one is built the first time a cpu anywhere in the process asks for it and kept until the
+	// process exits, so a thousand machines running the same bios share a single table. safe to
+	// call from any thread
+	const TranslationTable* GetTranslationTable(uint64_t rom_hash);
+
+	// defined by the build's translated_rom.cpp, or by an empty stand-in when there is no rom to
+	// translate. that file is otherwise only reached through its registrar, which a link against
+	// libxe86 as a static library would leave out along with the rest of the file
+	void LinkTranslatedRom();
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,457 @@
+#include "uart.hpp"
+#include <algorithm>
+
+using namespace xe86;
+
+UART::UART(std::shared_ptr<Bus> bus, std::string human_name, uint16_t base, uint8_t host_channel)
+	: Component(bus, human_name), m_Base(base), m_HostChannel(host_channel) {
+	// a loop polling the line status waits on our own scheduled events, which the idle
+	// detection already knows about, so none of these change with guest time alone
+	for (uint8_t reg = 0; reg < 8; reg++) {
+		m_Bus->AttachPort({
+			[this, reg](uint8_t byte) { Write(reg, byte); },
+			[this, reg]() -> uint8_t { return Read(reg); },
+			static_cast<uint16_t>(base + reg)
+		});
+	}
+
+	m_Bus->AttachHostInput(host_channel, [this](std::span<const uint8_t> data) {
+		for (uint8_t byte : data) {
+			Receive(byte);
+		}
+	});
+}
+
+void UART::AttachBridge(std::unique_ptr<SerialBridge> bridge) {
+	m_Bridge = std::move(bridge);
+}
+
+void UART::Reset() {
+	CancelEvents();
+
+	m_Divisor = 12;
+	m_InterruptEnable = 0;
+	m_LineControl = 0;
+	m_ModemControl = 0;
+	m_LineStatus = LsrHoldingEmpty | LsrTransmitterEmpty;
+	m_ModemStatus = 0;
+	m_Scratch = 0;
+	m_FifoEnabled = false;
+	m_Trigger = 1;
+	m_Receive.Clear();
+	m_Transmit.Clear();
+	m_Transmitting = false;
+	m_HoldingEmptyPending = false;
+	m_Timeout = false;
+	m_NextReceive = 0;
+
+	Update();
+}
+
+void UART::CancelEvents() {
+	Scheduler& scheduler = m_Bus->GetScheduler();
+	if (m_ReceiveScheduled) {
+		scheduler.Cancel(m_ReceiveEvent);
+	}
+
+	if (m_TransmitScheduled) {
+		scheduler.Cancel(m_TransmitEvent);
+	}
+
+	if (m_TimeoutScheduled) {
+		scheduler.Cancel(m_TimeoutEvent);
+	}
+
+	m_ReceiveScheduled = false;
+	m_TransmitScheduled = false;
+	m_TimeoutScheduled = false;
+}
+
+uint8_t UART::Read(uint8_t reg) {
+	switch (reg) {
+	case 0:
+		return (m_LineControl & LcrDlab) ? m_Divisor & 0xff : ReadReceive();
+
+	case 1:
+		return (m_LineControl & LcrDlab) ? m_Divisor >> 8 : m_InterruptEnable;
+
+	case 2: {
+		uint8_t id = GetInterruptId();
+		if (id == 0x02) {
+			m_HoldingEmptyPending = false;
+			Update();
+		}
+
+		return id | (m_FifoEnabled ? 0xc0 : 0);
+	}
+
+	case 3:
+		return m_LineControl;
+
+	case 4:
+		return m_ModemControl;
+
+	case 5: {
+		// the error bits only report once
+		uint8_t status = m_LineStatus;
+		m_LineStatus &= ~(LsrOverrun | LsrBreak | LsrFifoError | 0x0c);
+		Update();
+		return status;
+	}
+
+	case 6: {
+		uint8_t status = GetModemInputs() | (m_ModemStatus & 0x0f);
+		m_ModemStatus = 0;
+		Update();
+		return status;
+	}
+
+	default:
+		return m_Scratch;
+	}
+}
+
+void UART::Write(uint8_t reg, uint8_t byte) {
+	switch (reg) {
+	case 0:
+		if (m_LineControl & LcrDlab) {
+			m_Divisor = (m_Divisor & 0xff00) | byte;
+		} else {
+			WriteTransmit(byte);
+		}
+
+		break;
+
+	case 1:
+		if (m_LineControl & LcrDlab) {
+			m_Divisor = static_cast<uint16_t>((m_Divisor & 0x00ff) | (byte << 8));
+			break;
+		}
+
+		// enabling the transmitter interrupt with the holding register already empty raises it
+		if ((byte & IerTransmit) && !(m_InterruptEnable & IerTransmit) && (m_LineStatus & LsrHoldingEmpty)) {
+			m_HoldingEmptyPending = true;
+		}
+
+		m_InterruptEnable = byte & 0x0f;
+		Update();
+		break;
+
+	case 2:
+		WriteFifoControl(byte);
+		break;
+
+	case 3:
+		m_LineControl = byte;
+		break;
+
+	case 4:
+		WriteModemControl(byte);
+		break;
+
+	case 7:
+		m_Scratch = byte;
+		break;
+
+	default:
+		// the status registers are read only
+		break;
+	}
+}
+
+uint8_t UART::ReadReceive() {
+	if (m_Receive.count == 0) {
+		// the last byte again
+		return m_Receive.bytes[(m_Receive.head - 1) & 15];
+	}
+
+	uint8_t byte = m_Receive.Pop();
+	if (m_Receive.count == 0) {
+		m_LineStatus &= ~LsrDataReady;
+	}
+
+	RestartTimeout();
+	Update();
+	return byte;
+}
+
+void UART::WriteTransmit(uint8_t byte) {
+	m_HoldingEmptyPending = false;
+
+	if (m_Transmit.count < GetCapacity()) {
+		m_Transmit.Push(byte);
+	} else if (!m_FifoEnabled) {
+		// the 8250's one holding register is simply overwritten, a full fifo drops the byte
+		m_Transmit.Clear();
+		m_Transmit.Push(byte);
+	}
+
+	m_LineStatus &= ~(LsrHoldingEmpty | LsrTransmitterEmpty);
+	if (!m_Transmitting) {
+		StartTransmit();
+	}
+
+	Update();
+}
+
+void UART::WriteFifoControl(uint8_t byte) {
+	bool enable = byte & 0x01;
+
+	// switching the fifos on or off empties them
+	if (enable != m_FifoEnabled) {
+		byte |= 0x06;
+	}
+
+	m_FifoEnabled = enable;
+
+	if (byte & 0x02) {
+		m_Receive.Clear();
+		m_LineStatus &= ~LsrDataReady;
+		m_Timeout = false;
+	}
+
+	if (byte & 0x04) {
+		m_Transmit.Clear();
+		m_LineStatus |= LsrHoldingEmpty;
+		if (!m_Transmitting) {
+			m_LineStatus |= LsrTransmitterEmpty;
+		}
+	}
+
+	static constexpr uint8_t Triggers[] = { 1, 4, 8, 14 };
+	m_Trigger = Triggers[byte >> 6];
+
+	Update();
+}
+
+void UART::WriteModemControl(uint8_t byte) {
+	uint8_t before = GetModemInputs();
+	m_ModemControl = byte & 0x1f;
+	uint8_t after = GetModemInputs();
+
+	// CTS, DSR and DCD report any change, RI only its trailing edge
+	uint8_t changed = before ^ after;
+	m_ModemStatus |= ((changed >> 4) & 0b1011) | ((before & ~after & 0x40) ? 0b0100 : 0);
+
+	Update();
+}
+
+Cycles UART::GetCharacterCycles() const {
+	// a start bit, five to eight data bits, maybe parity and one or two stop bits
+	uint64_t bits = 1 + 5 + (m_LineControl & 0b11) + ((m_LineControl & 0x08) ? 1 : 0) + ((m_LineControl & 0x04) ? 2 : 1);
+	uint64_t divisor = m_Divisor ? m_Divisor : 0x10000;
+
+	return bits * 16 * divisor * CyclesPerSecond / ClockHz;
+}
+
+uint8_t UART::GetModemInputs() const {
+	if (m_ModemControl & McrLoopback) {
+		return ((m_ModemControl & McrRts) ? 0x10 : 0) | ((m_ModemControl & McrDtr) ? 0x20 : 0) |
+			((m_ModemControl & McrOut1) ? 0x40 : 0) | ((m_ModemControl & McrOut2) ? 0x80 : 0);
+	}
+
+	// CTS, DSR and DCD: there is always someone at the other end of a bridge
+	return m_Bridge ? 0xb0 : 0;
+}
+
+void UART::Receive(uint8_t byte) {
+	if (m_Receive.count < GetCapacity()) {
+		m_Receive.Push(byte);
+	} else {
+		m_LineStatus |= LsrOverrun;
+
+		// the 8250's buffer is overwritten, the fifo keeps what it has
+		if (!m_FifoEnabled) {
+			m_Receive.Clear();
+			m_Receive.Push(byte);
+		}
+	}
+
+	m_LineStatus |= LsrDataReady;
+	RestartTimeout();
+	Update();
+}
+
+void UART::ScheduleReceive() {
+	Scheduler& scheduler = m_Bus->GetScheduler();
+
+	m_ReceiveEvent = scheduler.Schedule(std::max(scheduler.GetNow(), m_NextReceive), [this]() {
+		m_ReceiveScheduled = false;
+		ReceiveFromHost();
+	});
+
+	m_ReceiveScheduled = true;
+}
+
+void UART::ReceiveFromHost() {
+	// one byte per character time, or all the fifo has room for
+	// the guest may have dropped DTR and RTS since this was scheduled
+	size_t room = IsReadyForHost() ? GetCapacity() - m_Receive.count : 0;
+	if (m_Paced) {
+		room = std::min<size_t>(room, 1);
+	}
+
+	std::array<uint8_t, 16> bytes;
+	size_t count = 0;
+	while (count < room && m_Bridge->TryRead(bytes[count])) {
+		count++;
+	}
+
+	if (count) {
+		m_Bus->InjectHostInput(m_HostChannel, std::span<const uint8_t>(bytes.data(), count));
+	}
+
+	m_NextReceive = m_Bus->GetScheduler().GetNow() + (m_Paced ? GetCharacterCycles() : 0);
+}
+
+void UART::StartTransmit() {
+	m_Shifting = m_Transmit.Pop();
+	m_Transmitting = true;
+
+	if (m_Transmit.count == 0) {
+		m_LineStatus |= LsrHoldingEmpty;
+		m_HoldingEmptyPending = true;
+	}
+
+	ScheduleTransmit(m_Paced ? GetCharacterCycles() : 0);
+}
+
+void UART::ScheduleTransmit(Cycles delay) {
+	m_TransmitEvent = m_Bus->GetScheduler().ScheduleIn(delay, [this]() {
+		m_TransmitScheduled = false;
+		FinishTransmit();
+	});
+
+	m_TransmitScheduled = true;
+}
+
+void UART::FinishTransmit() {
+	if (m_ModemControl & McrLoopback) {
+		Receive(m_Shifting);
+	} else if (m_Bridge && !m_Bridge->TryWrite(m_Shifting)) {
+		// the host is behind: hold the line, as if it had dropped CTS, and try again a character later
+		ScheduleTransmit(GetCharacterCycles());
+		return;
+	}
+
+	m_Transmitting = false;
+	if (m_Transmit.count) {
+		StartTransmit();
+	} else {
+		m_LineStatus |= LsrTransmitterEmpty;
+	}
+
+	Update();
+}
+
+void UART::RestartTimeout() {
+	Scheduler& scheduler = m_Bus->GetScheduler();
+	if (m_TimeoutScheduled) {
+		scheduler.Cancel(m_TimeoutEvent);
+		m_TimeoutScheduled = false;
+	}
+
+	m_Timeout = false;
+	if (!m_FifoEnabled || m_Receive.count == 0) {
+		return;
+	}
+
+	m_TimeoutEvent = scheduler.ScheduleIn(4 * GetCharacterCycles(), [this]() {
+		m_TimeoutScheduled = false;
+		m_Timeout = m_Receive.count != 0;
+		Update();
+	});
+
+	m_TimeoutScheduled = true;
+}
+
+uint8_t UART::GetInterruptId() const {
+	if ((m_InterruptEnable & IerLine) && (m_LineStatus & (LsrOverrun | LsrBreak | 0x0c))) {
+		return 0x06;
+	}
+
+	if (m_InterruptEnable & IerReceive) {
+		if (m_Receive.count >= (m_FifoEnabled ? m_Trigger : 1)) {
+			return 0x04;
+		}
+
+		if (m_Timeout && m_Receive.count) {
+			return 0x0c;
+		}
+	}
+
+	if ((m_InterruptEnable & IerTransmit) && m_HoldingEmptyPending) {
+		return 0x02;
+	}
+
+	if ((m_InterruptEnable & IerModem) && (m_ModemStatus & 0x0f)) {
+		return 0x00;
+	}
+
+	return 0x01;
+}
+
+void UART::Update() {
+	// a pc gates the interrupt with OUT2, which loopback disconnects from the pin
+	bool output = GetInterruptId() != 0x01 && (m_ModemControl & (McrOut2 | McrLoopback)) == McrOut2;
+	if (output == m_Output) {
+		return;
+	}
+
+	m_Output = output;
+	if (m_OnInterrupt) {
+		m_OnInterrupt(output);
+	}
+}
+
+void UART::SaveState(StateWriter& state) const {
+	state.Write(m_Divisor);
+	state.Write(m_InterruptEnable);
+	state.Write(m_LineControl);
+	state.Write(m_ModemControl);
+	state.Write(m_LineStatus);
+	state.Write(m_ModemStatus);
+	state.Write(m_Scratch);
+	state.Write(m_FifoEnabled);
+	state.Write(m_Trigger);
+	state.Write(m_Receive);
+	state.Write(m_Transmit);
+	state.Write(m_Shifting);
+	state.Write(m_Transmitting);
+	state.Write(m_HoldingEmptyPending);
+	state.Write(m_Timeout);
+	state.Write(m_Output);
+}
+
+void UART::LoadState(StateReader& state) {
+	CancelEvents();
+
+	state.Read(m_Divisor);
+	state.Read(m_InterruptEnable);
+	state.Read(m_LineControl);
+	state.Read(m_ModemControl);
+	state.Read(m_LineStatus);
+	state.Read(m_ModemStatus);
+	state.Read(m_Scratch);
+	state.Read(m_FifoEnabled);
+	state.Read(m_Trigger);
+	state.Read(m_Receive);
+	state.Read(m_Transmit);
+	state.Read(m_Shifting);
+	state.Read(m_Transmitting);
+	state.Read(m_HoldingEmptyPending);
+	state.Read(m_Timeout);
+	state.Read(m_Output);
+
+	// the byte being shifted out starts over, and the timeout from now. the pic has the
+	// interrupt output's level in its own state
+	m_NextReceive = m_Bus->GetScheduler().GetNow();
+
+	if (m_Transmitting) {
+		ScheduleTransmit(m_Paced ? GetCharacterCycles() : 0);
+	}
+
+	if (!m_Timeout) {
+		RestartTimeout();
+	}
+}
\ No newline at end of file
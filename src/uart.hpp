@@ -0,0 +1,202 @@
+#ifndef UART_HPP
+#define UART_HPP
+
+#include "component.hpp"
+#include "serial.hpp"
+
+#include <array>
+#include <functional>
+
+namespace xe86 {
+	/*
+	NS 16550A UART
+		eight registers from the base port: receive buffer / transmit holding (divisor latch low
+		with DLAB set), interrupt enable (divisor high), interrupt identification / fifo control,
+		line control, modem control, line status, modem status and scratch. with the fifos off it
+		behaves as an 8250, one byte each way.
+
+		the transmitter moves a byte every character time, worked out from the divisor and the
+		line control word as a 1.8432 MHz crystal would have it. the receiver takes bytes from
+		the host at the same pace, and only while the guest raises DTR or RTS and has room for
+		them, so nothing the host sends is lost to an overrun or to the guest still setting up.
+		unpaced, both go as fast as the guest keeps up. nothing happens per instruction besides
+		asking the bridge whether there is input, the rest is scheduled.
+
+		the interrupt output goes to the pic through OUT2, as a pc wires it. bytes from the host
+		reach the guest through Bus::InjectHostInput, so they are journaled.
+	*/
+	class UART : public Component {
+	public:
+		static constexpr uint32_t ClockHz = 1843200;
+
+		UART(const UART&) = delete;
+		UART& operator=(const UART&) = delete;
+
+		// host_channel is what the bus journals its input under
+		UART(std::shared_ptr<Bus> bus, std::string human_name, uint16_t base, uint8_t host_channel);
+
+		void Reset() override;
+
+		void Step() override {
+			// the only thing polled: has the host sent anything while we were waiting for it
+			if (m_Bridge && !m_ReceiveScheduled && m_Bridge->HasInput() && IsReadyForHost()) {
+				ScheduleReceive();
+			}
+		}
+
+		bool IsIdle() const override {
+			return !m_Bridge || m_ReceiveScheduled || !m_Bridge->HasInput() || !IsReadyForHost();
+		}
+
+		void SaveState(StateWriter& state) const override;
+		void LoadState(StateReader& state) override;
+
+		void AttachBridge(std::unique_ptr<SerialBridge> bridge);
+
+		// a byte the host sends takes as long as the line speed says, or no time at all
+		void SetPaced(bool paced) { m_Paced = paced; }
+
+		// the level of the interrupt output, after OUT2
+		void SetInterruptHandler(std::function<void(bool)> handler) {
+			m_OnInterrupt = std::move(handler);
+		}
+
+		uint16_t GetBase() const { return m_Base; }
+
+	private:
+		// 16 bytes with the fifos on, one without
+		struct Fifo {
+			std::array<uint8_t, 16> bytes{};
+			uint8_t head = 0;
+			uint8_t count = 0;
+
+			void Push(uint8_t byte) { bytes[(head + count++) & 15] = byte; }
+
+			uint8_t Pop() {
+				uint8_t byte = bytes[head];
+				head = (head + 1) & 15;
+				count--;
+				return byte;
+			}
+
+			void Clear() { head = count = 0; }
+		};
+
+		static constexpr uint8_t LcrDlab = 0x80;
+
+		static constexpr uint8_t McrDtr = 0x01;
+		static constexpr uint8_t McrRts = 0x02;
+		static constexpr uint8_t McrOut1 = 0x04;
+		static constexpr uint8_t McrOut2 = 0x08;
+		static constexpr uint8_t McrLoopback = 0x10;
+
+		static constexpr uint8_t LsrDataReady = 0x01;
+		static constexpr uint8_t LsrOverrun = 0x02;
+		static constexpr uint8_t LsrBreak = 0x10;
+		static constexpr uint8_t LsrHoldingEmpty = 0x20;
+		static constexpr uint8_t LsrTransmitterEmpty = 0x40;
+		static constexpr uint8_t LsrFifoError = 0x80;
+
+		static constexpr uint8_t IerReceive = 0x01;
+		static constexpr uint8_t IerTransmit = 0x02;
+		static constexpr uint8_t IerLine = 0x04;
+		static constexpr uint8_t IerModem = 0x08;
+
+		// scheduled events aren't part of the state, Reset and LoadState start over without them
+		void CancelEvents();
+
+		uint8_t Read(uint8_t reg);
+		void Write(uint8_t reg, uint8_t byte);
+
+		uint8_t ReadReceive();
+		void WriteTransmit(uint8_t byte);
+		void WriteFifoControl(uint8_t byte);
+		void WriteModemControl(uint8_t byte);
+
+		uint8_t GetCapacity() const { return m_FifoEnabled ? 16 : 1; }
+		// DTR or RTS says the guest wants data, the way hardware flow control would, and it has room.
+		// loopback disconnects the receiver from the line
+		bool IsReadyForHost() const {
+			return (m_ModemControl & (McrDtr | McrRts)) && !(m_ModemControl & McrLoopback) && m_Receive.count < GetCapacity();
+		}
+
+		// cycles to send or receive one character at the programmed speed and frame
+		Cycles GetCharacterCycles() const;
+
+		// the modem inputs: looped back from MCR, or all asserted when a bridge is connected
+		uint8_t GetModemInputs() const;
+
+		// a byte arriving at the receiver, from the host or looped back
+		void Receive(uint8_t byte);
+		void ScheduleReceive();
+		void ReceiveFromHost();
+
+		// the shift register finishing a byte, and starting the next one from the fifo if any
+		void StartTransmit();
+		void ScheduleTransmit(Cycles delay);
+		void FinishTransmit();
+
+		void RestartTimeout();
+
+		// IIR's interrupt id, 0x01 if nothing is pending
+		uint8_t GetInterruptId() const;
+		void Update();
+
+	private:
+		uint16_t m_Base;
+		uint8_t m_HostChannel;
+
+		std::unique_ptr<SerialBridge> m_Bridge;
+		std::function<void(bool)> m_OnInterrupt;
+		bool m_Paced = true;
+
+		uint16_t m_Divisor = 12;
+		uint8_t m_InterruptEnable = 0;
+		uint8_t m_LineControl = 0;
+		uint8_t m_ModemControl = 0;
+		uint8_t m_LineStatus = LsrHoldingEmpty | LsrTransmitterEmpty;
+		uint8_t m_ModemStatus = 0;
+		uint8_t m_Scratch = 0;
+
+		bool m_FifoEnabled = false;
+		uint8_t m_Trigger = 1;
+
+		Fifo m_Receive;
+		Fifo m_Transmit;
+
+		// the byte in the transmit shift register, while m_Transmitting
+		uint8_t m_Shifting = 0;
+		bool m_Transmitting = false;
+
+		// the transmitter interrupt, which reading IIR clears while it is the one reported
+		bool m_HoldingEmptyPending = false;
+
+		// nothing has moved through the receive fifo for four character times
+		bool m_Timeout = false;
+
+		bool m_Output = false;
+
+		Scheduler::EventId m_ReceiveEvent = 0;
+		Scheduler::EventId m_TransmitEvent = 0;
+		Scheduler::EventId m_TimeoutEvent = 0;
+		bool m_ReceiveScheduled = false;
+		bool m_TransmitScheduled = false;
+		bool m_TimeoutScheduled = false;
+
+		// when the receiver can take the next byte from the host
+		Cycles m_NextReceive = 0;
+	};
+
+	// as a pc has them
+	class COM1 final : public UART {
+	public:
+		COM1(std::shared_ptr<Bus> bus) : UART(bus, "COM1", 0x3f8, 1) {}
+	};
+
+	class COM2 final : public UART {
+	public:
+		COM2(std::shared_ptr<Bus> bus) : UART(bus, "COM2", 0x2f8, 2) {}
+	};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,216 @@
+#include "video.hpp"
+#include <print>
+#include <string>
+
+using namespace xe86;
+
+// RGBI, with the 5153's dark yellow turned brown
+static constexpr std::array<std::array<uint8_t, 3>, 16> palette = {{
+	{ 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0xaa }, { 0x00, 0xaa, 0x00 }, { 0x00, 0xaa, 0xaa },
+	{ 0xaa, 0x00, 0x00 }, { 0xaa, 0x00, 0xaa }, { 0xaa, 0x55, 0x00 }, { 0xaa, 0xaa, 0xaa },
+	{ 0x55, 0x55, 0x55 }, { 0x55, 0x55, 0xff }, { 0x55, 0xff, 0x55 }, { 0x55, 0xff, 0xff },
+	{ 0xff, 0x55, 0x55 }, { 0xff, 0x55, 0xff }, { 0xff, 0xff, 0x55 }, { 0xff, 0xff, 0xff },
+}};
+
+VideoPresenter::VideoPresenter(std::string_view output, unsigned scale)
+	: m_Frames(QueueDepth + 2), m_Output(std::string(output), std::ios::binary | std::ios::trunc),
+	  m_Scale(scale ? scale : 1), m_Pixels(Width * Height, 0) {
+	if (!m_Output) {
+		std::println(stderr, "video: failed to create '{}'", output);
+	}
+
+	for (size_t i = 0; i < m_Frames.size(); i++) {
+		m_Free.push_back(static_cast<uint8_t>(i));
+	}
+
+	m_Thread = std::thread([this]() { PresenterThread(); });
+}
+
+VideoPresenter::~VideoPresenter() {
+	uint8_t evicted;
+	m_Queue.PushEvictOldest(Quit, evicted);
+	m_Thread.join();
+}
+
+bool VideoPresenter::LoadFont(std::string_view filename) {
+	std::ifstream file(std::string(filename), std::ios::binary);
+	if (!file.read(reinterpret_cast<char*>(m_Font.data()), m_Font.size())) {
+		std::println(stderr, "video: failed to load a 2048 byte font from '{}'", filename);
+		return false;
+	}
+
+	m_HasFont = true;
+	return true;
+}
+
+VideoFrame& VideoPresenter::BeginFrame() {
+	if (m_Filling == Quit) {
+		// the pool is sized so there is always one either free or on its way back
+		uint8_t index;
+		while (m_Returned.TryPop(index)) {
+			m_Free.push_back(index);
+		}
+
+		m_Filling = m_Free.back();
+		m_Free.pop_back();
+	}
+
+	return m_Frames[m_Filling];
+}
+
+void VideoPresenter::PublishFrame() {
+	uint8_t evicted;
+	if (m_Queue.PushEvictOldest(m_Filling, evicted)) {
+		m_Free.push_back(evicted);
+		m_Dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	m_Filling = Quit;
+}
+
+void VideoPresenter::PresenterThread() {
+	while (true) {
+		uint64_t head = m_Queue.GetHead();
+
+		uint8_t index;
+		if (!m_Queue.TryPop(index)) {
+			m_Queue.WaitForPush(head);
+			continue;
+		}
+
+		if (index == Quit) {
+			break;
+		}
+
+		Convert(m_Frames[index]);
+		m_Returned.TryPush(index);
+
+		Write();
+		m_Presented.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	m_Output.flush();
+}
+
+void VideoPresenter::Convert(const VideoFrame& frame) {
+	// nothing written and no register changed, the last conversion still stands
+	if (m_HavePrevious && frame.versions == m_PreviousVersions && frame.mode == m_PreviousMode && frame.color == m_PreviousColor &&
+		frame.start == m_PreviousStart && frame.cursor == m_PreviousCursor && frame.cursor_start == m_PreviousCursorStart) {
+		return;
+	}
+
+	m_HavePrevious = true;
+	m_PreviousMode = frame.mode;
+	m_PreviousColor = frame.color;
+	m_PreviousStart = frame.start;
+	m_PreviousCursor = frame.cursor;
+	m_PreviousCursorStart = frame.cursor_start;
+	m_PreviousVersions = frame.versions;
+
+	// video disabled
+	if (!(frame.mode & 0b00001000)) {
+		std::fill(m_Pixels.begin(), m_Pixels.end(), 0);
+	} else if (frame.mode & 0b00000010) {
+		ConvertGraphics(frame);
+	} else {
+		ConvertText(frame);
+	}
+
+	// scale up. cga pixels are twice as tall as they are wide, so rows are doubled as well
+	unsigned width = Width * m_Scale;
+	unsigned height = Height * m_Scale * 2;
+	m_Scaled.resize(width * height * 3);
+
+	for (unsigned y = 0; y < height; y++) {
+		const uint8_t* source = &m_Pixels[(y / (m_Scale * 2)) * Width];
+		uint8_t* row = &m_Scaled[y * width * 3];
+
+		for (unsigned x = 0; x < width; x++) {
+			const auto& rgb = palette[source[x / m_Scale]];
+			row[x * 3 + 0] = rgb[0];
+			row[x * 3 + 1] = rgb[1];
+			row[x * 3 + 2] = rgb[2];
+		}
+	}
+}
+
+void VideoPresenter::ConvertText(const VideoFrame& frame) {
+	unsigned columns = (frame.mode & 0b00000001) ? 80 : 40;
+	unsigned cell_width = Width / columns;	// 40 column cells are drawn double width
+	bool blink = frame.mode & 0b00100000;
+	bool cursor_on = (frame.cursor_start & 0b01100000) != 0b00100000;
+
+	for (unsigned row = 0; row < 25; row++) {
+		for (unsigned column = 0; column < columns; column++) {
+			uint16_t cell = frame.start + row * columns + column;
+			uint8_t character = frame.vram[(cell * 2 + 0) & (VideoFrame::VramSize - 1)];
+			uint8_t attribute = frame.vram[(cell * 2 + 1) & (VideoFrame::VramSize - 1)];
+
+			uint8_t fg = attribute & 0x0f;
+			uint8_t bg = blink ? (attribute >> 4) & 0x07 : attribute >> 4;
+
+			for (unsigned line = 0; line < 8; line++) {
+				uint8_t bits;
+				if (m_HasFont) {
+					bits = m_Font[character * 8 + line];
+				} else {
+					// no character rom, so just show where there is something
+					bits = (character == 0x00 || character == 0x20 || character == 0xff) ? 0x00 : 0xff;
+				}
+
+				if (cursor_on && cell == frame.cursor && line >= 6) {
+					bits = 0xff;
+				}
+
+				uint8_t* pixels = &m_Pixels[(row * 8 + line) * Width + column * cell_width];
+				for (unsigned x = 0; x < cell_width; x++) {
+					pixels[x] = (bits & (0x80 >> (x * 8 / cell_width))) ? fg : bg;
+				}
+			}
+		}
+	}
+}
+
+void VideoPresenter::ConvertGraphics(const VideoFrame& frame) {
+	for (unsigned y = 0; y < Height; y++) {
+		// even lines in the first 8 KB, odd lines in the second
+		const uint8_t* line = &frame.vram[(y & 1) * 0x2000 + (y >> 1) * 80];
+		uint8_t* pixels = &m_Pixels[y * Width];
+
+		// 640x200, one bit per pixel
+		if (frame.mode & 0b00010000) {
+			uint8_t fg = frame.color & 0x0f;
+			for (unsigned x = 0; x < Width; x++) {
+				pixels[x] = (line[x >> 3] & (0x80 >> (x & 7))) ? fg : 0;
+			}
+
+			continue;
+		}
+
+		// 320x200, two bits per pixel, each drawn twice as wide
+		bool intense = frame.color & 0b00010000;
+		uint8_t set = (frame.mode & 0b00000100) ? 2 : (frame.color & 0b00100000) ? 1 : 0;
+
+		static constexpr std::array<std::array<uint8_t, 3>, 3> sets = {{
+			{ 2, 4, 6 },	// green, red, brown
+			{ 3, 5, 7 },	// cyan, magenta, white
+			{ 3, 4, 7 },	// cyan, red, white
+		}};
+
+		for (unsigned x = 0; x < 320; x++) {
+			uint8_t value = (line[x >> 2] >> ((3 - (x & 3)) * 2)) & 0b11;
+			uint8_t color = value == 0 ? frame.color & 0x0f : sets[set][value - 1] | (intense ? 0x08 : 0x00);
+			pixels[x * 2 + 0] = color;
+			pixels[x * 2 + 1] = color;
+		}
+	}
+}
+
+void VideoPresenter::Write() {
+	unsigned width = Width * m_Scale;
+	unsigned height = Height * m_Scale * 2;
+
+	std::string header = "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+	m_Output.write(header.data(), header.size());
+	m_Output.write(reinterpret_cast<const char*>(m_Scaled.data()), m_Scaled.size());
+}
\ No newline at end of file
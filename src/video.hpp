@@ -0,0 +1,111 @@
+#ifndef VIDEO_HPP
+#define VIDEO_HPP
+
+#include "scheduler.hpp"
+#include "spsc_queue.hpp"
+
+#include <array>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <fstream>
+#include <thread>
+#include <atomic>
+
+namespace xe86 {
+	// everything needed to draw one frame, captured at vertical retrace
+	struct VideoFrame {
+		static constexpr size_t VramSize = 0x4000;
+		static constexpr size_t VramPages = VramSize >> 12;
+
+		uint64_t number;
+		Cycles time;
+
+		uint8_t mode;		// 3D8
+		uint8_t color;		// 3D9
+		uint16_t start;		// crtc start address
+		uint16_t cursor;	// crtc cursor address
+		uint8_t cursor_start;
+
+		// version of each 4 KB page of video ram. page versions only go up, so comparing them with
+		// the last frame converted is right however many frames were dropped in between
+		std::array<uint32_t, VramPages> versions;
+
+		std::array<uint8_t, VramSize> vram;
+	};
+
+	/*
+	VIDEO PRESENTER
+		turns frames into pixels on its own thread so conversion, scaling and output never stall
+		the emulation thread. the emulation thread fills a frame buffer from a small pool and hands
+		its index over through a lock-free queue; if the presenter falls behind, the oldest queued
+		frame is dropped rather than making the emulation wait.
+
+		output is a stream of binary ppm images, which ffmpeg reads directly (-f image2pipe).
+	*/
+	class VideoPresenter {
+	public:
+		VideoPresenter(std::string_view output, unsigned scale = 1);
+		~VideoPresenter();
+
+		// 8x8 character set, 256 glyphs of 8 bytes. without one text is drawn as blocks.
+		// must be loaded before the first frame is published.
+		bool LoadFont(std::string_view filename);
+
+		// emulation thread. BeginFrame hands out a buffer to fill, PublishFrame queues it
+		VideoFrame& BeginFrame();
+		void PublishFrame();
+
+		uint64_t GetDroppedFrames() const { return m_Dropped.load(std::memory_order_relaxed); }
+		uint64_t GetPresentedFrames() const { return m_Presented.load(std::memory_order_relaxed); }
+
+	private:
+		static constexpr size_t QueueDepth = 4;
+		static constexpr uint8_t Quit = 0xff;
+
+		// native cga resolution, every mode is converted to this before scaling
+		static constexpr unsigned Width = 640;
+		static constexpr unsigned Height = 200;
+
+		void PresenterThread();
+		void Convert(const VideoFrame& frame);
+		void ConvertText(const VideoFrame& frame);
+		void ConvertGraphics(const VideoFrame& frame);
+		void Write();
+
+	private:
+		// queued + one being presented + one being filled
+		std::vector<VideoFrame> m_Frames;
+		SpscQueue<uint8_t, QueueDepth> m_Queue;
+		SpscQueue<uint8_t, QueueDepth * 2> m_Returned;
+
+		// emulation thread only
+		std::vector<uint8_t> m_Free;
+		uint8_t m_Filling = Quit;
+
+		// presenter thread only
+		std::ofstream m_Output;
+		unsigned m_Scale;
+		std::array<uint8_t, 2048> m_Font{};
+		bool m_HasFont = false;
+
+		std::vector<uint8_t> m_Pixels;	// Width * Height palette indices
+		std::vector<uint8_t> m_Scaled;	// rgb, scaled
+
+		// registers of the last converted frame, so an unchanged screen isn't converted again
+		bool m_HavePrevious = false;
+		uint8_t m_PreviousMode = 0;
+		uint8_t m_PreviousColor = 0;
+		uint16_t m_PreviousStart = 0;
+		uint16_t m_PreviousCursor = 0;
+		uint8_t m_PreviousCursorStart = 0;
+		std::array<uint32_t, VideoFrame::VramPages> m_PreviousVersions{};
+
+		std::atomic<uint64_t> m_Dropped = 0;
+		std::atomic<uint64_t> m_Presented = 0;
+
+		std::thread m_Thread;
+	};
+}
+
+#endif
\ No newline at end of file
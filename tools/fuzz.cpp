@@ -0,0 +1,121 @@
+// xe86-fuzz: libFuzzer harness for the cpu. build with -DXE86_FUZZ=ON using clang, then
+//
+//	xe86-fuzz [corpus dir] [-jobs=n ...]
+//
+// an input is a little-endian 16-bit code length, that many bytes of code, and then the bytes
+// port reads return in order (0xff once they run out). the code runs from 0000:7C00 on a bare
+// machine, a cpu with ram and a rom that only jumps there, until it halts, hits an opcode the
+// cpu doesn't implement, or uses up its instruction budget.
+//
+// the machine is built once. between inputs only the ram pages the last input wrote to are
+// copied back from a pristine image, found by comparing page versions, and the cpu and clock
+// are put back from a snapshot taken right after the reset jump.
+
+#include "machine.hpp"
+#include "cpu.hpp"
+
+#include <cstdint>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+namespace {
+	constexpr uint32_t CodeAddress = 0x7c00;
+
+	// what still fits in the code segment above the load address
+	constexpr size_t MaxCodeLength = 0x10000 - CodeAddress;
+
+	constexpr uint64_t InstructionBudget = 10000;
+
+	class FuzzMachine {
+	public:
+		FuzzMachine() : m_Bus(std::make_shared<xe86::Bus>()), m_Machine(m_Bus) {
+			// faults are expected all the time here and not what's being looked for
+			m_Bus->GetDiagnostics().SetSeverity(xe86::Severity::Ignore);
+
+			// JMP FAR 0000:7C00 at the reset vector
+			xe86::MemoryArea& rom = *m_Bus->GetMemoryAreas()[0];
+			const uint8_t jump[] = { 0xea, CodeAddress & 0xff, CodeAddress >> 8, 0x00, 0x00 };
+			rom.CopyIn(rom.GetLength() - 16, jump);
+
+			m_Bus->SetUnclaimedPortHandler(
+				[this](xe86::PortAddress16) -> uint8_t { return m_Input < m_Ports.size() ? m_Ports[m_Input++] : 0xff; },
+				[](xe86::PortAddress16, uint8_t) {}
+			);
+
+			xe86::CPU& cpu = m_Machine.Get<xe86::CPU>();
+			cpu.SetInvalidOpcodeHandler([this]() { m_Stopped = true; });
+
+			m_Machine.Reset();
+			m_Machine.Step();
+			m_Snapshot = m_Machine.SaveMachineState();
+
+			m_Ram = m_Bus->GetMemoryAreas()[1].get();
+			m_Pristine.resize(m_Ram->GetLength());
+			m_Ram->CopyOut(0, m_Pristine);
+			m_Versions = m_Ram->GetPageVersions();
+		}
+
+		void Run(std::span<const uint8_t> data) {
+			Restore();
+
+			size_t length = 0;
+			if (data.size() >= 2) {
+				length = std::min<size_t>({ static_cast<size_t>(data[0] | (data[1] << 8)), data.size() - 2, MaxCodeLength });
+				data = data.subspan(2);
+			}
+
+			m_Ram->CopyIn(CodeAddress, data.first(length));
+
+			m_Ports = data.subspan(length);
+			m_Input = 0;
+			m_Stopped = false;
+
+			xe86::Scheduler& scheduler = m_Bus->GetScheduler();
+			uint64_t end = scheduler.GetInstructionCount() + InstructionBudget;
+			while (scheduler.GetInstructionCount() < end && !m_Stopped) {
+				m_Machine.Step();
+
+				// halted or spinning with nothing scheduled to ever change that
+				if (m_Machine.IsStalled()) {
+					break;
+				}
+			}
+		}
+
+	private:
+		void Restore() {
+			const std::vector<uint32_t>& versions = m_Ram->GetPageVersions();
+			for (size_t page = 0; page < versions.size(); page++) {
+				if (versions[page] != m_Versions[page]) {
+					size_t start = page << xe86::MemoryArea::PageShift;
+					size_t length = std::min(xe86::MemoryArea::PageSize, m_Pristine.size() - start);
+					m_Ram->WritePage(page, std::span<const uint8_t>(m_Pristine).subspan(start, length));
+					m_Versions[page] = versions[page];
+				}
+			}
+
+			m_Machine.LoadMachineState(m_Snapshot);
+		}
+
+	private:
+		std::shared_ptr<xe86::Bus> m_Bus;
+		xe86::Machine<xe86::CPU> m_Machine;
+
+		std::vector<uint8_t> m_Snapshot;
+
+		xe86::MemoryArea* m_Ram = nullptr;
+		std::vector<uint8_t> m_Pristine;
+		std::vector<uint32_t> m_Versions;
+
+		std::span<const uint8_t> m_Ports;
+		size_t m_Input = 0;
+		bool m_Stopped = false;
+	};
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+	static FuzzMachine machine;
+	machine.Run(std::span<const uint8_t>(data, size));
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+// xe86-overlay: looks after the copy-on-write overlays of a disk image. see src/diskimage.hpp
+//
+//	xe86-overlay info <base> <overlay>
+//	xe86-overlay compact <base> <overlay>
+//	xe86-overlay commit <base> <overlay> <out>
+//
+// compact drops the blocks an overlay has that are the same as the base's again. commit writes
+// the base with the overlay applied as a new raw image, which can then be the base for new overlays.
+
+#include "diskimage.hpp"
+
+#include <string_view>
+#include <filesystem>
+#include <print>
+#include <cstdio>
+
+int main(int argc, char** argv) {
+	std::string_view command = argc > 1 ? argv[1] : "";
+	bool valid = (argc == 4 && (command == "info" || command == "compact")) || (argc == 5 && command == "commit");
+	if (!valid) {
+		std::println(stderr, "usage: xe86-overlay <info | compact> <base> <overlay> | commit <base> <overlay> <out>");
+		return 1;
+	}
+
+	// opening creates an overlay that isn't there, which none of these want
+	if (!std::filesystem::exists(argv[3])) {
+		std::println(stderr, "xe86-overlay: there's no overlay '{}'", argv[3]);
+		return 1;
+	}
+
+	auto image = xe86::DiskImage::Open(argv[2], argv[3]);
+	if (!image) {
+		return 1;
+	}
+
+	if (command == "compact") {
+		size_t dropped = image->Compact();
+		std::println("xe86-overlay: dropped {} blocks, {} left", dropped, image->GetAllocatedBlocks());
+	} else if (command == "commit") {
+		if (!image->Commit(argv[4])) {
+			return 1;
+		}
+	} else {
+		size_t blocks = (image->GetSize() + xe86::DiskImage::BlockSize - 1) / xe86::DiskImage::BlockSize;
+		std::println("xe86-overlay: {} byte disk, {} of its {} blocks in the overlay", image->GetSize(), image->GetAllocatedBlocks(), blocks);
+	}
+
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,499 @@
+// xe86-translate: turns a rom image into C++ for xe86 to compile in. see src/translation.hpp
+//
+//	xe86-translate <rom> <out.cpp> [--base <hex>] [--entry <seg:off | hex address>]...
+//
+// the reset vector is always an entry point. anything else only reached through an interrupt
+// vector the rom installs at runtime needs an --entry to be translated, and is interpreted if not.
+
+#include "hash.hpp"
+
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <map>
+#include <string>
+#include <string_view>
+#include <fstream>
+#include <iterator>
+#include <print>
+#include <cstdio>
+
+namespace {
+	// how instructions continue, for following control flow
+	enum class Flow : uint8_t {
+		Next,		// falls through
+		Jump,		// relative, always taken
+		Branch,		// relative, taken or falls through
+		Call,		// relative, returns to the next instruction
+		FarJump,
+		FarCall,
+		Interrupt,	// goes through the vector table, returns to the next instruction
+		Stop,		// returns or halts, nowhere to follow
+	};
+
+	// operand layout, enough to know how long an instruction is
+	enum class Form : uint8_t {
+		Unknown,	// the interpreter doesn't implement it either
+		None,
+		Imm8,
+		Imm16,
+		Far,		// offset then segment
+		ModRM,
+		ModRMImm8,
+		ModRMImm16,
+		Group3,		// TEST Ev, Iv has an immediate, the rest of the group don't
+	};
+
+	struct Opcode {
+		Form form = Form::Unknown;
+		Flow flow = Flow::Next;
+	};
+
+	// the opcodes src/cpu.cpp implements
+	constexpr std::array<Opcode, 256> opcodes = [] {
+		std::array<Opcode, 256> o{};
+
+		for (int op : { 0x00, 0x01, 0x02, 0x03, 0x08, 0x09, 0x0a, 0x0b, 0x20, 0x21, 0x22, 0x23, 0x33, 0x85 }) o[op] = { Form::ModRM };
+		for (int op : { 0x88, 0x89, 0x8a, 0x8b, 0x8c, 0x8e }) o[op] = { Form::ModRM };
+		for (int op : { 0x04, 0x0c, 0x24, 0xe4, 0xe5, 0xe6, 0xe7 }) o[op] = { Form::Imm8 };
+		for (int op : { 0x05, 0x0d, 0x25, 0xa0, 0xa1, 0xa2, 0xa3 }) o[op] = { Form::Imm16 };
+		for (int op : { 0x9b, 0xa4, 0xa5, 0xac, 0xad, 0xec, 0xed, 0xee, 0xef, 0xfa, 0xfc }) o[op] = { Form::None };
+		for (int op = 0x40; op <= 0x4f; op++) o[op] = { Form::None };
+		for (int op = 0xd8; op <= 0xdf; op++) o[op] = { Form::ModRM };
+		for (int op = 0xb0; op <= 0xb7; op++) o[op] = { Form::Imm8 };
+		for (int op = 0xb8; op <= 0xbf; op++) o[op] = { Form::Imm16 };
+		for (int op = 0x70; op <= 0x7f; op++) o[op] = { Form::Imm8, Flow::Branch };
+
+		o[0x81] = { Form::ModRMImm16 };
+		o[0xc6] = { Form::ModRMImm8 };
+		o[0xc7] = { Form::ModRMImm16 };
+		o[0xf7] = { Form::Group3 };
+
+		o[0xe2] = { Form::Imm8, Flow::Branch };
+		o[0xeb] = { Form::Imm8, Flow::Jump };
+		o[0xe9] = { Form::Imm16, Flow::Jump };
+		o[0xe8] = { Form::Imm16, Flow::Call };
+		o[0xea] = { Form::Far, Flow::FarJump };
+		o[0x9a] = { Form::Far, Flow::FarCall };
+		o[0xc2] = { Form::Imm16, Flow::Stop };
+		o[0xca] = { Form::Imm16, Flow::Stop };
+		o[0xc3] = { Form::None, Flow::Stop };
+		o[0xcb] = { Form::None, Flow::Stop };
+		o[0xf4] = { Form::None, Flow::Stop };
+		o[0xcc] = { Form::None, Flow::Interrupt };
+		o[0xcd] = { Form::Imm8, Flow::Interrupt };
+		o[0xcf] = { Form::None, Flow::Stop };
+
+		return o;
+	}();
+
+	constexpr const char* r8_names[] = { "al", "cl", "dl", "bl", "ah", "ch", "dh", "bh" };
+	constexpr const char* r16_names[] = { "ax", "cx", "dx", "bx", "sp", "bp", "si", "di" };
+	constexpr const char* sreg_names[] = { "es", "cs", "ss", "ds" };
+
+	// Jcc conditions, as cpu.cpp tests them
+	constexpr const char* conditions[] = {
+		"t.GetFlag(Flags::OF)",
+		"!t.GetFlag(Flags::OF)",
+		"t.GetFlag(Flags::CF)",
+		"!t.GetFlag(Flags::CF)",
+		"t.GetFlag(Flags::ZF)",
+		"!t.GetFlag(Flags::ZF)",
+		"t.GetFlag(Flags::CF) || t.GetFlag(Flags::ZF)",
+		"!t.GetFlag(Flags::CF) && !t.GetFlag(Flags::ZF)",
+		"t.GetFlag(Flags::SF)",
+		"!t.GetFlag(Flags::SF)",
+		"t.GetFlag(Flags::PF)",
+		"!t.GetFlag(Flags::PF)",
+		"t.GetFlag(Flags::SF) != t.GetFlag(Flags::OF)",
+		"t.GetFlag(Flags::SF) == t.GetFlag(Flags::OF)",
+		"t.GetFlag(Flags::ZF) || (t.GetFlag(Flags::SF) != t.GetFlag(Flags::OF))",
+		"!t.GetFlag(Flags::ZF) && (t.GetFlag(Flags::SF) == t.GetFlag(Flags::OF))",
+	};
+
+	// long blocks stop here and carry on in a block of their own
+	constexpr size_t MaxBlockInstructions = 64;
+
+	struct Instruction {
+		uint32_t address;
+		uint8_t length;
+		std::array<uint8_t, 6> bytes;
+	};
+
+	class Translator {
+	public:
+		Translator(std::vector<uint8_t> rom, uint32_t base) : m_Rom(std::move(rom)), m_Base(base) {}
+
+		void AddEntry(uint32_t address) {
+			if (Contains(address)) {
+				m_Pending.push_back(address);
+			}
+		}
+
+		void Run() {
+			while (!m_Pending.empty()) {
+				uint32_t address = m_Pending.back();
+				m_Pending.pop_back();
+
+				if (!m_Blocks.contains(address)) {
+					Translate(address);
+				}
+			}
+		}
+
+		bool Write(std::string_view path, std::string_view rom_name) const;
+
+		size_t GetBlockCount() const { return m_Blocks.size(); }
+
+	private:
+		bool Contains(uint32_t address) const {
+			return address >= m_Base && address - m_Base < m_Rom.size();
+		}
+
+		uint8_t At(uint32_t address) const {
+			return Contains(address) ? m_Rom[address - m_Base] : 0;
+		}
+
+		// 0 if the instruction is unknown or runs off the end of the rom
+		uint8_t Length(uint32_t address) const;
+
+		void Translate(uint32_t start);
+
+		void WriteBlock(std::FILE* file, uint32_t address, const std::vector<Instruction>& block) const;
+		bool WriteNative(std::FILE* file, const Instruction& instruction) const;
+
+	private:
+		std::vector<uint8_t> m_Rom;
+		uint32_t m_Base;
+
+		std::vector<uint32_t> m_Pending;
+
+		// the instructions of every block, by address
+		std::map<uint32_t, std::vector<Instruction>> m_Blocks;
+	};
+
+	uint8_t Translator::Length(uint32_t address) const {
+		uint8_t opcode = At(address);
+		const Opcode& info = opcodes[opcode];
+
+		auto modrm_length = [&]() -> uint8_t {
+			uint8_t modrm = At(address + 1);
+			uint8_t mod = modrm >> 6;
+			if (mod == 0b01) return 2;
+			if (mod == 0b10 || (mod == 0b00 && (modrm & 0b111) == 0b110)) return 3;
+			return 1;
+		};
+
+		uint8_t length = 0;
+		switch (info.form) {
+			case Form::Unknown: return 0;
+			case Form::None: length = 1; break;
+			case Form::Imm8: length = 2; break;
+			case Form::Imm16: length = 3; break;
+			case Form::Far: length = 5; break;
+			case Form::ModRM: length = 1 + modrm_length(); break;
+			case Form::ModRMImm8: length = 2 + modrm_length(); break;
+			case Form::ModRMImm16: length = 3 + modrm_length(); break;
+			case Form::Group3: {
+				length = 1 + modrm_length();
+				if (((At(address + 1) >> 3) & 0b111) == 0) {
+					length += 2;
+				}
+
+				break;
+			}
+		}
+
+		return Contains(address + length - 1) ? length : 0;
+	}
+
+	void Translator::Translate(uint32_t start) {
+		std::vector<Instruction> block;
+		uint32_t address = start;
+
+		while (block.size() < MaxBlockInstructions) {
+			uint8_t length = Length(address);
+			if (length == 0) {
+				break;
+			}
+
+			Instruction instruction{ address, length, {} };
+			for (uint8_t i = 0; i < length; i++) {
+				instruction.bytes[i] = At(address + i);
+			}
+
+			block.push_back(instruction);
+			uint32_t next = address + length;
+
+			// follow control flow. relative targets assume IP doesn't wrap inside the rom
+			const uint8_t* b = instruction.bytes.data();
+			uint16_t imm16 = b[1] | (b[2] << 8);
+			switch (opcodes[b[0]].flow) {
+				case Flow::Next: {
+					address = next;
+					continue;
+				}
+
+				case Flow::Jump:
+				case Flow::Call: {
+					int32_t rel = length == 2 ? static_cast<int8_t>(b[1]) : static_cast<int16_t>(imm16);
+					AddEntry(next + rel);
+					if (opcodes[b[0]].flow == Flow::Call) {
+						AddEntry(next);
+					}
+
+					break;
+				}
+
+				case Flow::Branch: {
+					AddEntry(next + static_cast<int8_t>(b[1]));
+					AddEntry(next);
+					break;
+				}
+
+				case Flow::FarJump:
+				case Flow::FarCall: {
+					uint16_t segment = b[3] | (b[4] << 8);
+					AddEntry(((segment << 4) + imm16) & 0xfffff);
+					if (opcodes[b[0]].flow == Flow::FarCall) {
+						AddEntry(next);
+					}
+
+					break;
+				}
+
+				case Flow::Interrupt: {
+					AddEntry(next);
+					break;
+				}
+
+				case Flow::Stop: {
+					break;
+				}
+			}
+
+			m_Blocks[start] = std::move(block);
+			return;
+		}
+
+		// ran out of instructions it knows, or of room in the block
+		if (!block.empty()) {
+			AddEntry(address);
+			m_Blocks[start] = std::move(block);
+		}
+	}
+
+	// an instruction written out natively. false if it has to go through the interpreter
+	bool Translator::WriteNative(std::FILE* file, const Instruction& instruction) const {
+		const uint8_t* b = instruction.bytes.data();
+		uint8_t opcode = b[0];
+		uint8_t reg = (b[1] >> 3) & 0b111;
+		uint8_t rm = b[1] & 0b111;
+		bool register_form = (b[1] >> 6) == 0b11;
+
+		uint16_t imm16 = b[1] | (b[2] << 8);
+		int rel8 = static_cast<int8_t>(b[1]);
+		int rel16 = static_cast<int16_t>(imm16);
+
+		auto begin = [&]() {
+			std::print(file, "\t\tt.Begin(0x{:02x});\n\t\tr.ip += {};\n", opcode, instruction.length);
+		};
+
+		if (opcode >= 0xb0 && opcode <= 0xb7) {
+			begin();
+			std::print(file, "\t\tr.{} = 0x{:02x};\n", r8_names[opcode & 0b111], b[1]);
+		} else if (opcode >= 0xb8 && opcode <= 0xbf) {
+			begin();
+			std::print(file, "\t\tr.{} = 0x{:04x};\n", r16_names[opcode & 0b111], imm16);
+		} else if (opcode >= 0x70 && opcode <= 0x7f) {
+			begin();
+			std::print(file, "\t\tt.JumpRelative({}, {});\n", conditions[opcode & 0x0f], rel8);
+		} else if (opcode >= 0x88 && opcode <= 0x8c && register_form) {
+			begin();
+			switch (opcode) {
+				case 0x88: std::print(file, "\t\tr.{} = r.{};\n", r8_names[rm], r8_names[reg]); break;
+				case 0x89: std::print(file, "\t\tr.{} = r.{};\n", r16_names[rm], r16_names[reg]); break;
+				case 0x8a: std::print(file, "\t\tr.{} = r.{};\n", r8_names[reg], r8_names[rm]); break;
+				case 0x8b: std::print(file, "\t\tr.{} = r.{};\n", r16_names[reg], r16_names[rm]); break;
+				case 0x8c: std::print(file, "\t\tr.{} = r.{};\n", r16_names[rm], sreg_names[reg & 0b11]); break;
+			}
+		} else if (opcode == 0xfa || opcode == 0xfc) {
+			begin();
+			std::print(file, "\t\tt.ClearFlag(Flags::{});\n", opcode == 0xfa ? "IF" : "DF");
+		} else if (opcode == 0xeb || opcode == 0xe9) {
+			begin();
+			std::print(file, "\t\tt.JumpRelative(true, {});\n", opcode == 0xeb ? rel8 : rel16);
+		} else if (opcode == 0xe2) {
+			begin();
+			std::print(file, "\t\tr.cx--;\n\t\tt.JumpRelative(r.cx != 0, {});\n", rel8);
+		} else {
+			return false;
+		}
+
+		std::print(file, "\t\tt.Retire();\n");
+		return true;
+	}
+
+	void Translator::WriteBlock(std::FILE* file, uint32_t address, const std::vector<Instruction>& block) const {
+		std::print(file, "\tvoid Block_{:05x}(TranslationContext& t) {{\n", address);
+		std::print(file, "\t\tRegisters& r = t.GetRegisters();\n");
+
+		for (size_t i = 0; i < block.size(); i++) {
+			const Instruction& instruction = block[i];
+			if (i > 0) {
+				std::print(file, "\n\t\tif (!t.Continue()) return;\n");
+			}
+
+			std::print(file, "\n\t\t// {:05x} ", instruction.address);
+			for (uint8_t j = 0; j < instruction.length; j++) {
+				std::print(file, " {:02x}", instruction.bytes[j]);
+			}
+
+			std::print(file, "\n");
+
+			if (!WriteNative(file, instruction)) {
+				// the last instruction of a block has nothing after it to guard
+				if (i + 1 == block.size()) {
+					std::print(file, "\t\tt.Interpret({});\n", instruction.length);
+				} else {
+					std::print(file, "\t\tif (!t.Interpret({})) return;\n", instruction.length);
+				}
+			}
+		}
+
+		std::print(file, "\t}}\n\n");
+	}
+
+	bool Translator::Write(std::string_view path, std::string_view rom_name) const {
+		std::FILE* file = std::fopen(std::string(path).c_str(), "w");
+		if (!file) {
+			std::println(stderr, "translate: failed to create '{}'", path);
+			return false;
+		}
+
+		// the same hash Bus::GetRomHash makes of a single rom area mapped at the base
+		uint64_t area_hash = xe86::Fnv1a64(m_Rom.data(), m_Rom.size());
+		uint64_t rom_hash = xe86::Fnv1a64(reinterpret_cast<const uint8_t*>(&m_Base), sizeof(m_Base));
+		rom_hash = xe86::Fnv1a64(reinterpret_cast<const uint8_t*>(&area_hash), sizeof(area_hash), rom_hash);
+
+		std::print(file, "// translated from {} by xe86-translate, don't edit\n\n", rom_name);
+		std::print(file, "#include \"translation.hpp\"\n\nusing namespace xe86;\n\nnamespace {{\n");
+
+		for (const auto& [address, block] : m_Blocks) {
+			WriteBlock(file, address, block);
+		}
+
+		std::print(file, "\tconstexpr TranslatedBlock blocks[] = {{\n");
+		for (const auto& [address, block] : m_Blocks) {
+			std::print(file, "\t\t{{ 0x{:04x}, Block_{:05x} }},\n", address - m_Base, address);
+		}
+
+		std::print(file, "\t}};\n\n");
+		std::print(file, "\tconst RomTranslation translation{{ 0x{:016x}ull, 0x{:05x}, 0x{:x}, blocks }};\n", rom_hash, m_Base, m_Rom.size());
+		std::print(file, "\tconst RomTranslationRegistrar registrar(translation);\n}}\n\n");
+		std::print(file, "void xe86::LinkTranslatedRom() {{\n}}\n");
+
+		bool written = !std::ferror(file);
+		std::fclose(file);
+		return written;
+	}
+
+	// seg:off or a plain physical address, both hex
+	bool ParseAddress(std::string_view text, uint32_t& address) {
+		auto parse = [](std::string_view hex, uint32_t& value) {
+			if (hex.empty() || hex.size() > 5) {
+				return false;
+			}
+
+			value = 0;
+			for (char c : hex) {
+				int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+				if (digit < 0) {
+					return false;
+				}
+
+				value = (value << 4) | digit;
+			}
+
+			return true;
+		};
+
+		size_t colon = text.find(':');
+		if (colon == std::string_view::npos) {
+			return parse(text, address);
+		}
+
+		uint32_t segment, offset;
+		if (!parse(text.substr(0, colon), segment) || !parse(text.substr(colon + 1), offset) || segment > 0xffff || offset > 0xffff) {
+			return false;
+		}
+
+		address = ((segment << 4) + offset) & 0xfffff;
+		return true;
+	}
+}
+
+int main(int argc, char** argv) {
+	std::string_view rom_path;
+	std::string_view out_path;
+	std::vector<uint32_t> entries;
+	uint32_t base = 0;
+	bool has_base = false;
+
+	for (int i = 1; i < argc; i++) {
+		std::string_view arg = argv[i];
+		uint32_t address;
+
+		if (arg == "--base" && i + 1 < argc && ParseAddress(argv[i + 1], address)) {
+			base = address;
+			has_base = true;
+			i++;
+		} else if (arg == "--entry" && i + 1 < argc && ParseAddress(argv[i + 1], address)) {
+			entries.push_back(address);
+			i++;
+		} else if (rom_path.empty() && !arg.starts_with("--")) {
+			rom_path = arg;
+		} else if (out_path.empty() && !arg.starts_with("--")) {
+			out_path = arg;
+		} else {
+			rom_path = {};
+			break;
+		}
+	}
+
+	if (rom_path.empty() || out_path.empty()) {
+		std::println(stderr, "usage: xe86-translate <rom> <out.cpp> [--base <hex>] [--entry <seg:off | hex address>]...");
+		return 1;
+	}
+
+	std::ifstream file{ std::string(rom_path), std::ios::binary };
+	if (!file) {
+		std::println(stderr, "translate: failed to open '{}'", rom_path);
+		return 1;
+	}
+
+	std::vector<uint8_t> rom{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+	if (rom.empty() || rom.size() > 0x100000) {
+		std::println(stderr, "translate: '{}' isn't a rom image", rom_path);
+		return 1;
+	}
+
+	// a bios rom ends at the top of memory, where the reset vector is
+	if (!has_base) {
+		base = 0x100000 - static_cast<uint32_t>(rom.size());
+	}
+
+	Translator translator(std::move(rom), base);
+	translator.AddEntry(0xffff0);
+	for (uint32_t entry : entries) {
+		translator.AddEntry(entry);
+	}
+
+	translator.Run();
+	if (!translator.Write(out_path, rom_path)) {
+		return 1;
+	}
+
+	std::println("translate: {} blocks from '{}'", translator.GetBlockCount(), rom_path);
+	return 0;
+}
\ No newline at end of file